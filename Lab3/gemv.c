@@ -0,0 +1,233 @@
+// Host-side helpers for the templated GEMV kernels in gemv.cl.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gemv.h"
+
+size_t gemv_dtype_size(gemv_dtype dtype)
+{
+    switch (dtype) {
+    case GEMV_INT8:  return sizeof(int8_t);
+    case GEMV_INT16: return sizeof(int16_t);
+    case GEMV_INT32: return sizeof(int32_t);
+    case GEMV_FP16:  return sizeof(uint16_t);
+    case GEMV_FP32:  return sizeof(float);
+    }
+    return 0;
+}
+
+size_t gemv_output_size(gemv_dtype dtype)
+{
+    return (dtype == GEMV_FP16 || dtype == GEMV_FP32) ? sizeof(float) : sizeof(int32_t);
+}
+
+size_t gemv_acc_size(gemv_dtype dtype)
+{
+    return (dtype == GEMV_INT16 || dtype == GEMV_INT32) ? sizeof(int64_t) : sizeof(int32_t);
+}
+
+static const char *dtype_names[] = { "int8", "int16", "int32", "fp16", "fp32" };
+static const char *dtype_defines[] = { "GEMV_INT8", "GEMV_INT16", "GEMV_INT32", "GEMV_FP16", "GEMV_FP32" };
+
+const char *gemv_dtype_name(gemv_dtype dtype)
+{
+    return dtype_names[dtype];
+}
+
+int gemv_dtype_from_name(const char *name, gemv_dtype *dtype)
+{
+    for (int i = 0; i < 5; i++) {
+        if (strcmp(name, dtype_names[i]) == 0) {
+            *dtype = (gemv_dtype)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void gemv_build_options(gemv_dtype dtype, gemv_rounding rounding, char *buf, size_t len)
+{
+    snprintf(buf, len, "-D%s -DGEMV_ROUNDING=%d", dtype_defines[dtype], (int)rounding);
+}
+
+char *gemv_load_source(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        printf("Error opening file %s.\n", filename);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *src = malloc(size + 1);
+    if (src == NULL || fread(src, 1, size, file) != (size_t)size) {
+        free(src);
+        fclose(file);
+        return NULL;
+    }
+    src[size] = '\0';
+
+    fclose(file);
+    return src;
+}
+
+gemv_quant gemv_quant_identity(void)
+{
+    gemv_quant q = { 1, 0, GEMV_ROUND_TRUNC, 1.0f };
+    return q;
+}
+
+gemv_quant gemv_quant_from_scale(double real_scale, gemv_rounding rounding)
+{
+    gemv_quant q = { 0, 0, rounding, (float)real_scale };
+    if (real_scale <= 0)
+        return q;
+
+    // real_scale = m * 2^e with m in [0.5, 1): multiplier = m * 2^31, shift = 31 - e
+    int e;
+    double m = frexp(real_scale, &e);
+    int64_t mult = (int64_t)llround(m * 2147483648.0);
+    if (mult == 2147483648LL) {
+        mult /= 2;
+        e++;
+    }
+
+    int shift = 31 - e;
+    while (shift > 62) {
+        mult >>= 1;
+        shift--;
+    }
+    if (shift < 0) {
+        // scales >= 2^31 cannot be represented, saturate
+        mult = INT32_MAX;
+        shift = 0;
+    }
+
+    q.multiplier = (int32_t)mult;
+    q.shift = shift;
+    return q;
+}
+
+static float dtype_qmax(gemv_dtype dtype)
+{
+    switch (dtype) {
+    case GEMV_INT8:  return 127.0f;
+    case GEMV_INT16: return 32767.0f;
+    default:         return 0.0f;
+    }
+}
+
+float gemv_input_scale(gemv_dtype dtype, const float *src, size_t n)
+{
+    float qmax = dtype_qmax(dtype);
+
+    // int32 and the floating point types store values unscaled
+    if (qmax == 0.0f)
+        return 1.0f;
+
+    float amax = 0.0f;
+    for (size_t i = 0; i < n; i++)
+        amax = fmaxf(amax, fabsf(src[i]));
+    return amax > 0.0f ? amax / qmax : 1.0f;
+}
+
+static long quantize_value(float v, float scale, long lo, long hi)
+{
+    long q = lroundf(v / scale);
+    return q < lo ? lo : (q > hi ? hi : q);
+}
+
+void gemv_quantize_input(gemv_dtype dtype, const float *src, size_t n, float scale, void *dst)
+{
+    for (size_t i = 0; i < n; i++) {
+        switch (dtype) {
+        case GEMV_INT8:
+            ((int8_t *)dst)[i] = (int8_t)quantize_value(src[i], scale, -128, 127);
+            break;
+        case GEMV_INT16:
+            ((int16_t *)dst)[i] = (int16_t)quantize_value(src[i], scale, -32768, 32767);
+            break;
+        case GEMV_INT32:
+            ((int32_t *)dst)[i] = (int32_t)quantize_value(src[i], scale, INT32_MIN, INT32_MAX);
+            break;
+        case GEMV_FP16:
+            ((uint16_t *)dst)[i] = gemv_float_to_half(src[i]);
+            break;
+        case GEMV_FP32:
+            ((float *)dst)[i] = src[i];
+            break;
+        }
+    }
+}
+
+uint16_t gemv_float_to_half(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int32_t exp = (int32_t)((bits >> 23) & 0xffu) - 127 + 15;
+    uint32_t mant = bits & 0x7fffffu;
+
+    // NaN and infinity
+    if (((bits >> 23) & 0xffu) == 0xffu)
+        return (uint16_t)(sign | 0x7c00u | (mant ? 0x200u : 0));
+
+    // overflow to infinity
+    if (exp >= 31)
+        return (uint16_t)(sign | 0x7c00u);
+
+    // subnormal or zero
+    if (exp <= 0) {
+        if (exp < -10)
+            return (uint16_t)sign;
+        mant |= 0x800000u;
+        uint32_t shift = (uint32_t)(14 - exp);
+        uint32_t half = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t mid = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1u)))
+            half++;
+        return (uint16_t)(sign | half);
+    }
+
+    // normal, round to nearest even (a carry into the exponent is correct)
+    uint32_t half = ((uint32_t)exp << 10) | (mant >> 13);
+    uint32_t rem = mant & 0x1fffu;
+    if (rem > 0x1000u || (rem == 0x1000u && (half & 1u)))
+        half++;
+    return (uint16_t)(sign | half);
+}
+
+float gemv_half_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1fu;
+    uint32_t mant = h & 0x3ffu;
+    uint32_t bits;
+
+    if (exp == 0x1fu) {
+        bits = sign | 0x7f800000u | (mant << 13);
+    } else if (exp != 0) {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    } else if (mant == 0) {
+        bits = sign;
+    } else {
+        // subnormal half: normalise
+        exp = 127 - 15 + 1;
+        while (!(mant & 0x400u)) {
+            mant <<= 1;
+            exp--;
+        }
+        bits = sign | (exp << 23) | ((mant & 0x3ffu) << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
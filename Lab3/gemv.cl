@@ -0,0 +1,258 @@
+// Templated GEMV kernels: y = quantize(A * x)
+//
+// The element type is selected at build time with exactly one of
+//   -DGEMV_INT8   char  storage, packed 4-way dot products, int accumulator
+//   -DGEMV_INT16  short storage, long accumulator
+//   -DGEMV_INT32  int   storage, long accumulator
+//   -DGEMV_FP16   half  storage (vload_half), float accumulator
+//   -DGEMV_FP32   float storage, float accumulator
+// and the integer rounding mode with -DGEMV_ROUNDING=<gemv_rounding> (see gemv.h).
+//
+// Integer outputs are int:   y = sat32(round((acc * multiplier) / 2^shift))
+// Float outputs are float:   y = acc * scale
+
+#if defined(GEMV_INT8)
+    typedef char   a_t;
+    typedef int    acc_t;
+    typedef int    out_t;
+    #define GEMV_IS_FLOAT 0
+#elif defined(GEMV_INT16)
+    typedef short  a_t;
+    typedef long   acc_t;
+    typedef int    out_t;
+    #define GEMV_IS_FLOAT 0
+#elif defined(GEMV_INT32)
+    typedef int    a_t;
+    typedef long   acc_t;
+    typedef int    out_t;
+    #define GEMV_IS_FLOAT 0
+#elif defined(GEMV_FP16)
+    #ifdef cl_khr_fp16
+    #pragma OPENCL EXTENSION cl_khr_fp16 : enable
+    #endif
+    typedef half   a_t;
+    typedef float  acc_t;
+    typedef float  out_t;
+    #define GEMV_IS_FLOAT 1
+#elif defined(GEMV_FP32)
+    typedef float  a_t;
+    typedef float  acc_t;
+    typedef float  out_t;
+    #define GEMV_IS_FLOAT 1
+#else
+    #error "one of GEMV_INT8, GEMV_INT16, GEMV_INT32, GEMV_FP16, GEMV_FP32 must be defined"
+#endif
+
+#ifndef GEMV_ROUNDING
+#define GEMV_ROUNDING 0
+#endif
+
+#define GEMV_ROUND_TRUNC   0
+#define GEMV_ROUND_NEAREST 1
+#define GEMV_ROUND_FLOOR   2
+
+// Element i of p converted to the accumulator type.
+#if defined(GEMV_FP16)
+#define GEMV_LOAD(i, p) vload_half((i), (p))
+#else
+#define GEMV_LOAD(i, p) ((acc_t)(p)[(i)])
+#endif
+
+// Product of element i of a and x in the accumulator type.
+#define GEMV_MUL(i, a, x) (GEMV_LOAD((i), (a)) * GEMV_LOAD((i), (x)))
+
+// Dot product of the 4-element vector at index v (in units of 4 elements) of a and x.
+inline acc_t gemv_dot4(size_t v, __global const a_t *a, __global const a_t *x)
+{
+#if defined(GEMV_INT8)
+    char4 va = vload4(v, a);
+    char4 vx = vload4(v, x);
+    #if defined(__opencl_c_integer_dot_product_input_4x8bit)
+    return dot(va, vx);
+    #else
+    int4 p = convert_int4(va) * convert_int4(vx);
+    return p.x + p.y + p.z + p.w;
+    #endif
+#elif defined(GEMV_INT16)
+    int4 p = convert_int4(vload4(v, a)) * convert_int4(vload4(v, x));
+    return (long)p.x + (long)p.y + (long)p.z + (long)p.w;
+#elif defined(GEMV_INT32)
+    long4 p = convert_long4(vload4(v, a)) * convert_long4(vload4(v, x));
+    return p.x + p.y + p.z + p.w;
+#elif defined(GEMV_FP16)
+    return dot(vload_half4(v, a), vload_half4(v, x));
+#else
+    return dot(vload4(v, a), vload4(v, x));
+#endif
+}
+
+// Apply scale and rounding to a finished accumulator.
+inline out_t gemv_quantize(acc_t acc, int multiplier, int shift, float scale)
+{
+#if GEMV_IS_FLOAT
+    return acc * scale;
+#else
+    // |acc * multiplier| as a 128-bit hi:lo, as gemv_quantize_acc on the host
+    int negative = (acc < 0) != (multiplier < 0);
+    ulong a = acc < 0 ? 0 - (ulong)(long)acc : (ulong)(long)acc;
+    ulong m = multiplier < 0 ? 0 - (ulong)(long)multiplier : (ulong)multiplier;
+    ulong low = (a & 0xffffffffUL) * m;
+    ulong mid = (a >> 32) * m;
+    ulong lo = low + (mid << 32);
+    ulong hi = (mid >> 32) + (lo < low);
+    #if GEMV_ROUNDING == GEMV_ROUND_NEAREST
+    ulong bias = shift > 0 ? 1UL << (shift - 1) : 0;
+    #elif GEMV_ROUNDING == GEMV_ROUND_FLOOR
+    ulong bias = negative ? (1UL << shift) - 1 : 0;
+    #else
+    ulong bias = 0;
+    #endif
+    lo += bias;
+    hi += lo < bias;
+    ulong mag = shift > 0 ? (lo >> shift) | (hi << (64 - shift)) : lo;
+    if ((shift > 0 ? hi >> shift : hi) != 0 || mag > (negative ? 1UL << 31 : (ulong)INT_MAX))
+        return negative ? INT_MIN : INT_MAX;
+    return negative ? (int)-(long)mag : (int)mag;
+#endif
+}
+
+// Dot product of one full row, as seen by a single work-item striding by `step`.
+inline acc_t gemv_row_partial(__global const a_t *arow, __global const a_t *x,
+                              const unsigned int width, size_t first, size_t step)
+{
+    acc_t sum = 0;
+    size_t nvec = width / 4;
+    for (size_t v = first; v < nvec; v += step)
+        sum += gemv_dot4(v, arow, x);
+    for (size_t i = nvec * 4 + first; i < width; i += step)
+        sum += GEMV_MUL(i, arow, x);
+    return sum;
+}
+
+// One work-item per row. Best for tall-skinny matrices where a row is too
+// short to keep a work-group busy.
+__kernel void gemv_item(__global const a_t *a,
+                        __global const a_t *x,
+                        __global out_t *y,
+                        const unsigned int height,
+                        const unsigned int width,
+                        const int multiplier,
+                        const int shift,
+                        const float scale)
+{
+    size_t row = get_global_id(0);
+
+    //Make sure we do not go out of bounds
+    if (row >= height)
+        return;
+
+    acc_t sum = gemv_row_partial(a + row * width, x, width, 0, 1);
+    y[row] = gemv_quantize(sum, multiplier, shift, scale);
+}
+
+// One work-group per row. Work-items stride over the row with vector loads
+// (coalesced across the group) and combine their partial sums in local memory.
+// The local size must be a power of two.
+__kernel void gemv_wg(__global const a_t *a,
+                      __global const a_t *x,
+                      __global out_t *y,
+                      const unsigned int height,
+                      const unsigned int width,
+                      const int multiplier,
+                      const int shift,
+                      const float scale,
+                      __local acc_t *partial)
+{
+    size_t row = get_group_id(0);
+    size_t lid = get_local_id(0);
+    size_t lsz = get_local_size(0);
+
+    partial[lid] = row < height ? gemv_row_partial(a + row * width, x, width, lid, lsz) : 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (size_t s = lsz / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            partial[lid] += partial[lid + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0 && row < height)
+        y[row] = gemv_quantize(partial[0], multiplier, shift, scale);
+}
+
+// ---------------------------------------------------------------------------
+// Sparse kernels (see gemv_sparse.h for the storage formats)
+// ---------------------------------------------------------------------------
+
+// CSR-vector: one work-group per row, the work-items stride over the row's
+// nonzeros and reduce in local memory. Suited to long rows.
+// The local size must be a power of two.
+__kernel void gemv_csr_vector(__global const uint *row_ptr,
+                              __global const uint *col_idx,
+                              __global const a_t *values,
+                              __global const a_t *x,
+                              __global out_t *y,
+                              const unsigned int height,
+                              const int multiplier,
+                              const int shift,
+                              const float scale,
+                              __local acc_t *partial)
+{
+    size_t row = get_group_id(0);
+    size_t lid = get_local_id(0);
+    size_t lsz = get_local_size(0);
+
+    acc_t sum = 0;
+    if (row < height) {
+        uint end = row_ptr[row + 1];
+        for (uint k = row_ptr[row] + lid; k < end; k += lsz)
+            sum += GEMV_LOAD(k, values) * GEMV_LOAD(col_idx[k], x);
+    }
+    partial[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (size_t s = lsz / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            partial[lid] += partial[lid + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0 && row < height)
+        y[row] = gemv_quantize(partial[0], multiplier, shift, scale);
+}
+
+// SELL-C-sigma: one work-item per (sorted) row. Entry j of the rows of a
+// slice is stored contiguously, so neighbouring work-items load neighbouring
+// words. Plain ELL is the single-slice case. The global size is
+// nslices * chunk; padding rows have row_perm == height.
+__kernel void gemv_sell(__global const uint *slice_ptr,
+                        __global const uint *slice_width,
+                        __global const uint *row_perm,
+                        __global const uint *col_idx,
+                        __global const a_t *values,
+                        __global const a_t *x,
+                        __global out_t *y,
+                        const unsigned int height,
+                        const unsigned int chunk,
+                        const int multiplier,
+                        const int shift,
+                        const float scale)
+{
+    size_t gid = get_global_id(0);
+    size_t slice = gid / chunk;
+    size_t lane = gid % chunk;
+
+    uint row = row_perm[gid];
+    if (row >= height)
+        return;
+
+    acc_t sum = 0;
+    size_t base = slice_ptr[slice] + lane;
+    uint width = slice_width[slice];
+    for (uint j = 0; j < width; j++) {
+        size_t k = base + (size_t)j * chunk;
+        sum += GEMV_LOAD(k, values) * GEMV_LOAD(col_idx[k], x);
+    }
+
+    y[row] = gemv_quantize(sum, multiplier, shift, scale);
+}
@@ -0,0 +1,93 @@
+// Typed / quantized GEMV: y = quantize(A * x)
+//
+// A is row-major (rows x cols), x has cols elements and y has rows elements.
+// Integer types produce int32_t outputs, floating point types produce float.
+// The OpenCL kernels live in gemv.cl and are specialised per type through the
+// build options returned by gemv_build_options(); gemv_ref.c holds the matching
+// CPU implementations used to check them.
+
+#ifndef GEMV_H
+#define GEMV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    GEMV_INT8  = 0,     // int8_t storage, packed 4-way dot products, int32 accumulator
+    GEMV_INT16 = 1,     // int16_t storage, int64 accumulator
+    GEMV_INT32 = 2,     // int32_t storage, int64 accumulator
+    GEMV_FP16  = 3,     // IEEE half storage (uint16_t on the host), float accumulator
+    GEMV_FP32  = 4      // float storage, float accumulator
+} gemv_dtype;
+
+// Rounding of (acc * multiplier) / 2^shift for integer types. The values are
+// passed to the kernel as -DGEMV_ROUNDING and must stay in sync with gemv.cl.
+typedef enum {
+    GEMV_ROUND_TRUNC   = 0, // toward zero, like C integer division
+    GEMV_ROUND_NEAREST = 1, // to nearest, halves away from zero
+    GEMV_ROUND_FLOOR   = 2  // toward minus infinity (arithmetic shift)
+} gemv_rounding;
+
+// Output scaling. Integer types use multiplier/shift/rounding and saturate to
+// int32, floating point types use scale.
+typedef struct {
+    int32_t multiplier;
+    int shift;
+    gemv_rounding rounding;
+    float scale;
+} gemv_quant;
+
+// Size in bytes of one stored element / one output element.
+size_t gemv_dtype_size(gemv_dtype dtype);
+size_t gemv_output_size(gemv_dtype dtype);
+size_t gemv_acc_size(gemv_dtype dtype);     // accumulator size, for the gemv_wg local buffer
+const char *gemv_dtype_name(gemv_dtype dtype);
+int gemv_dtype_from_name(const char *name, gemv_dtype *dtype);
+
+// Build options selecting the kernel specialisation, e.g. "-DGEMV_INT8 -DGEMV_ROUNDING=1".
+void gemv_build_options(gemv_dtype dtype, gemv_rounding rounding, char *buf, size_t len);
+
+// Read a kernel source file into a NUL-terminated malloc'ed string (NULL on failure).
+char *gemv_load_source(const char *filename);
+
+// Identity scaling (y = A * x).
+gemv_quant gemv_quant_identity(void);
+
+// Fixed-point multiplier/shift approximating a real output scale
+// (e.g. scale_a * scale_x for quantized inputs).
+gemv_quant gemv_quant_from_scale(double real_scale, gemv_rounding rounding);
+
+// Convert float data to the storage type. Integer types are quantized as
+// round(src / scale) with saturation, floating point types ignore scale.
+void gemv_quantize_input(gemv_dtype dtype, const float *src, size_t n, float scale, void *dst);
+
+// Symmetric per-tensor scale for quantizing src to an integer type (max|src| / qmax).
+float gemv_input_scale(gemv_dtype dtype, const float *src, size_t n);
+
+// IEEE 754 binary16 conversions (round to nearest even).
+uint16_t gemv_float_to_half(float f);
+float gemv_half_to_float(uint16_t h);
+
+// ----------------------------------------------------------------------------
+// CPU reference implementations (gemv_ref.c)
+// ----------------------------------------------------------------------------
+
+int32_t gemv_dot_i8(const int8_t *a, const int8_t *x, size_t n);
+int64_t gemv_dot_i16(const int16_t *a, const int16_t *x, size_t n);
+int64_t gemv_dot_i32(const int32_t *a, const int32_t *x, size_t n);
+float gemv_dot_f16(const uint16_t *a, const uint16_t *x, size_t n);
+float gemv_dot_f32(const float *a, const float *x, size_t n);
+
+// Scale, round and saturate an integer accumulator exactly as gemv.cl does.
+int32_t gemv_quantize_acc(int64_t acc, const gemv_quant *q);
+
+// Reference y = quantize(A * x) for rows [row_begin, row_end).
+void gemv_ref_rows(gemv_dtype dtype, const gemv_quant *q, size_t cols,
+                   const void *a, const void *x, void *y,
+                   size_t row_begin, size_t row_end);
+
+// Reference y = quantize(A * x) over the whole matrix.
+void gemv_ref(gemv_dtype dtype, const gemv_quant *q, size_t rows, size_t cols,
+              const void *a, const void *x, void *y);
+
+#endif
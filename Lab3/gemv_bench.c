@@ -0,0 +1,622 @@
+// GEMV roofline benchmark.
+//
+// Sweeps tall-skinny, square and short-wide shapes over every element type and
+// kernel variant (GPU plans with forced kernels and the native CPU backend),
+// and reports GFLOP/s and GB/s next to a roofline measured on the same
+// machine: device copy bandwidth, host<->device transfer bandwidth, peak
+// float / int multiply-add throughput and the device capabilities (the clinfo
+// fields of console.txt that matter here). Results are written as JSON.
+//
+// Times are per gemv_execute() call with A resident, so they include the x
+// upload and the y readback, as seen by a caller.
+//
+// Build: gcc -O2 -march=native gemv_bench.c gemv.c gemv_ref.c gemv_sparse.c gemv_cpu.c gemv_plan.c -o gemv_bench -lOpenCL -lm -lpthread
+// Usage: ./gemv_bench [-q] [-c] [-o results.json]
+//   -q  quick run with smaller shapes
+//   -c  CPU backend only
+//   -o  write the JSON to a file instead of stdout
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <CL/opencl.h>
+#include "gemv.h"
+#include "gemv_cpu.h"
+#include "gemv_plan.h"
+#include "gemv_simd.h"
+
+#define BENCH_SOURCE_FILE "gemv_bench.cl"
+
+// Bytes moved by the bandwidth microbenchmarks
+#define BENCH_BYTES (64u << 20)
+
+// Work-items and iterations of the peak kernels (must match BENCH_ITERS)
+#define BENCH_PEAK_ITEMS (1u << 20)
+#define BENCH_PEAK_ITERS 256
+
+// Minimum measuring time per case, in seconds
+#define BENCH_MIN_TIME 0.1
+
+typedef struct {
+    const char *name;
+    size_t rows;
+    size_t cols;
+} bench_shape;
+
+// Every shape has the same number of elements, so only the aspect changes
+static const bench_shape shapes[] = {
+    { "tall-skinny", 65536, 64 },
+    { "square", 2048, 2048 },
+    { "short-wide", 64, 65536 },
+};
+
+typedef struct {
+    const char *kernel;
+    size_t local;
+} bench_variant;
+
+static const bench_variant variants[] = {
+    { "gemv_item", 64 },
+    { "gemv_item", 256 },
+    { "gemv_wg", 32 },
+    { "gemv_wg", 64 },
+    { "gemv_wg", 128 },
+    { "gemv_wg", 256 },
+};
+
+typedef struct {
+    bool present;
+    double copy_gbs;
+    double h2d_gbs;
+    double d2h_gbs;
+    double peak_float_gflops;
+    double peak_int_gops;
+} roofline;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Escape-free JSON string: the device strings are plain ASCII names
+static void json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', out);
+        if ((unsigned char)*s >= 0x20)
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+// ----------------------------------------------------------------------------
+// Device probe and microbenchmarks
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+} bench_cl;
+
+static bool has_extension(const char *extensions, const char *name)
+{
+    size_t n = strlen(name);
+    for (const char *p = strstr(extensions, name); p != NULL; p = strstr(p + 1, name)) {
+        if ((p == extensions || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+static void print_device(FILE *out, cl_device_id device)
+{
+    char name[256] = "", vendor[256] = "", version[256] = "", driver[256] = "", c_version[256] = "";
+    cl_uint units = 0, clock = 0, vec_float = 0;
+    cl_ulong global_mem = 0, local_mem = 0, max_alloc = 0, cache = 0;
+    size_t max_wg = 0, ext_len = 0;
+    cl_bool unified = CL_FALSE;
+
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_VENDOR, sizeof(vendor), vendor, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(version), version, NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver), driver, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_OPENCL_C_VERSION, sizeof(c_version), c_version, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(units), &units, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(clock), &clock, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(vec_float), &vec_float, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_mem), &global_mem, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(local_mem), &local_mem, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, sizeof(cache), &cache, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_wg), &max_wg, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, NULL);
+
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &ext_len);
+    char *ext_buf = calloc(1, ext_len + 1);
+    if (ext_buf != NULL)
+        clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, ext_len, ext_buf, NULL);
+    const char *extensions = ext_buf != NULL ? ext_buf : "";
+
+    fprintf(out, "  \"device\": {\n    \"name\": ");
+    json_string(out, name);
+    fprintf(out, ",\n    \"vendor\": ");
+    json_string(out, vendor);
+    fprintf(out, ",\n    \"version\": ");
+    json_string(out, version);
+    fprintf(out, ",\n    \"opencl_c_version\": ");
+    json_string(out, c_version);
+    fprintf(out, ",\n    \"driver\": ");
+    json_string(out, driver);
+    fprintf(out, ",\n    \"compute_units\": %u,\n    \"max_clock_mhz\": %u,\n", units, clock);
+    fprintf(out, "    \"global_mem_bytes\": %llu,\n    \"local_mem_bytes\": %llu,\n",
+            (unsigned long long)global_mem, (unsigned long long)local_mem);
+    fprintf(out, "    \"max_alloc_bytes\": %llu,\n    \"global_cache_bytes\": %llu,\n",
+            (unsigned long long)max_alloc, (unsigned long long)cache);
+    fprintf(out, "    \"max_work_group_size\": %zu,\n    \"preferred_vector_width_float\": %u,\n", max_wg, vec_float);
+    fprintf(out, "    \"host_unified_memory\": %s,\n", unified ? "true" : "false");
+    fprintf(out, "    \"fp16\": %s,\n    \"fp64\": %s,\n",
+            has_extension(extensions, "cl_khr_fp16") ? "true" : "false",
+            has_extension(extensions, "cl_khr_fp64") ? "true" : "false");
+    fprintf(out, "    \"integer_dot_product\": %s,\n    \"subgroups\": %s,\n",
+            has_extension(extensions, "cl_khr_integer_dot_product") ? "true" : "false",
+            has_extension(extensions, "cl_khr_subgroups") || has_extension(extensions, "cl_intel_subgroups") ? "true" : "false");
+    fprintf(out, "    \"image2d_from_buffer\": %s\n  },\n",
+            has_extension(extensions, "cl_khr_image2d_from_buffer") ? "true" : "false");
+
+    free(ext_buf);
+}
+
+static double event_seconds(cl_event event)
+{
+    cl_ulong start = 0, end = 0;
+    clWaitForEvents(1, &event);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    clReleaseEvent(event);
+    return (end - start) * 1e-9;
+}
+
+// Best of three launches of a 1D kernel
+static double time_launch(bench_cl *cl, cl_kernel kernel, size_t global)
+{
+    double best = INFINITY;
+    for (int run = 0; run <= 3; run++) {
+        cl_event event;
+        if (clEnqueueNDRangeKernel(cl->queue, kernel, 1, NULL, &global, NULL, 0, NULL, &event) != CL_SUCCESS)
+            return INFINITY;
+        double t = event_seconds(event);
+        if (run > 0 && t < best)
+            best = t;
+    }
+    return best;
+}
+
+static cl_program build_bench(bench_cl *cl, const char *source, const char *options)
+{
+    cl_int err;
+    cl_program program = clCreateProgramWithSource(cl->context, 1, &source, NULL, &err);
+    if (err == CL_SUCCESS)
+        err = clBuildProgram(program, 1, &cl->device, options, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "Failed to build %s (%s)\n", BENCH_SOURCE_FILE, options);
+        if (program != NULL)
+            clReleaseProgram(program);
+        return NULL;
+    }
+    return program;
+}
+
+static double peak_ops(bench_cl *cl, const char *source, const char *type)
+{
+    char options[64];
+    snprintf(options, sizeof(options), "-DBENCH_T=%s -DBENCH_ITERS=%d", type, BENCH_PEAK_ITERS);
+
+    cl_program program = build_bench(cl, source, options);
+    if (program == NULL)
+        return 0.0;
+
+    cl_int err;
+    int seed = 1;
+    cl_kernel kernel = clCreateKernel(program, "bench_peak", &err);
+    cl_mem out = clCreateBuffer(cl->context, CL_MEM_WRITE_ONLY, BENCH_PEAK_ITEMS * 16, NULL, &err);
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), &out);
+    clSetKernelArg(kernel, 1, sizeof(int), &seed);
+
+    double t = time_launch(cl, kernel, BENCH_PEAK_ITEMS);
+
+    clReleaseMemObject(out);
+    clReleaseKernel(kernel);
+    clReleaseProgram(program);
+
+    // 16 multiply-adds of 4 lanes per iteration, 2 operations each
+    return (double)BENCH_PEAK_ITEMS * BENCH_PEAK_ITERS * 16 * 4 * 2 / t * 1e-9;
+}
+
+static void measure_gpu(bench_cl *cl, roofline *roof)
+{
+    cl_int err_a, err_b, err;
+    cl_event event;
+    char *source = gemv_load_source(BENCH_SOURCE_FILE);
+    void *host = calloc(1, BENCH_BYTES);
+    cl_mem a = clCreateBuffer(cl->context, CL_MEM_READ_WRITE, BENCH_BYTES, NULL, &err_a);
+    cl_mem b = clCreateBuffer(cl->context, CL_MEM_READ_WRITE, BENCH_BYTES, NULL, &err_b);
+    if (source == NULL || host == NULL || err_a != CL_SUCCESS || err_b != CL_SUCCESS)
+        goto done;
+    roof->present = true;
+
+    // Host <-> device transfers (best of three)
+    roof->h2d_gbs = roof->d2h_gbs = 0.0;
+    for (int run = 0; run < 3; run++) {
+        clEnqueueWriteBuffer(cl->queue, a, CL_TRUE, 0, BENCH_BYTES, host, 0, NULL, &event);
+        roof->h2d_gbs = fmax(roof->h2d_gbs, BENCH_BYTES / event_seconds(event) * 1e-9);
+        clEnqueueReadBuffer(cl->queue, a, CL_TRUE, 0, BENCH_BYTES, host, 0, NULL, &event);
+        roof->d2h_gbs = fmax(roof->d2h_gbs, BENCH_BYTES / event_seconds(event) * 1e-9);
+    }
+
+    // Device copy: every byte is read once and written once
+    cl_program program = build_bench(cl, source, "");
+    if (program != NULL) {
+        cl_kernel kernel = clCreateKernel(program, "bench_copy", &err);
+        clSetKernelArg(kernel, 0, sizeof(cl_mem), &a);
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), &b);
+        roof->copy_gbs = 2.0 * BENCH_BYTES / time_launch(cl, kernel, BENCH_BYTES / 16) * 1e-9;
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+    }
+
+    roof->peak_float_gflops = peak_ops(cl, source, "float4");
+    roof->peak_int_gops = peak_ops(cl, source, "uint4");
+
+done:
+    if (a != NULL)
+        clReleaseMemObject(a);
+    if (b != NULL)
+        clReleaseMemObject(b);
+    free(host);
+    free(source);
+}
+
+// ----------------------------------------------------------------------------
+// CPU microbenchmarks, run on the backend's thread pool
+// ----------------------------------------------------------------------------
+
+#define CPU_COPY_CHUNK (1u << 20)
+#define CPU_PEAK_ITERS (1u << 22)
+
+typedef struct {
+    char *src;
+    char *dst;
+    double sink[256];
+} cpu_bench;
+
+static void copy_task(size_t task, void *arg)
+{
+    cpu_bench *b = arg;
+    memcpy(b->dst + task * CPU_COPY_CHUNK, b->src + task * CPU_COPY_CHUNK, CPU_COPY_CHUNK);
+}
+
+// Eight independent FMA chains; counts 8 chains * lanes * 2 operations per iteration
+static void float_task(size_t task, void *arg)
+{
+    cpu_bench *b = arg;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 m = _mm256_set1_ps(0.999f), c = _mm256_set1_ps(1e-3f);
+    __m256 v0 = _mm256_set1_ps(1.0f + task), v1 = v0, v2 = v0, v3 = v0;
+    __m256 v4 = v0, v5 = v0, v6 = v0, v7 = v0;
+    for (unsigned i = 0; i < CPU_PEAK_ITERS; i++) {
+        v0 = _mm256_fmadd_ps(v0, m, c); v1 = _mm256_fmadd_ps(v1, m, c);
+        v2 = _mm256_fmadd_ps(v2, m, c); v3 = _mm256_fmadd_ps(v3, m, c);
+        v4 = _mm256_fmadd_ps(v4, m, c); v5 = _mm256_fmadd_ps(v5, m, c);
+        v6 = _mm256_fmadd_ps(v6, m, c); v7 = _mm256_fmadd_ps(v7, m, c);
+    }
+    __m256 s = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(v0, v1), _mm256_add_ps(v2, v3)),
+                             _mm256_add_ps(_mm256_add_ps(v4, v5), _mm256_add_ps(v6, v7)));
+    b->sink[task % 256] = hsum_ps(s);
+#else
+    float v[8];
+    for (int k = 0; k < 8; k++)
+        v[k] = 1.0f + task + k;
+    for (unsigned i = 0; i < CPU_PEAK_ITERS; i++) {
+        for (int k = 0; k < 8; k++)
+            v[k] = v[k] * 0.999f + 1e-3f;
+    }
+    b->sink[task % 256] = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+#endif
+}
+
+// Eight independent int16 multiply / int32 add chains (the int8 dot product path)
+static void int_task(size_t task, void *arg)
+{
+    cpu_bench *b = arg;
+#if defined(__AVX2__)
+    __m256i m = _mm256_set1_epi16(3);
+    __m256i v0 = _mm256_set1_epi32((int)task), v1 = v0, v2 = v0, v3 = v0;
+    __m256i v4 = v0, v5 = v0, v6 = v0, v7 = v0;
+    for (unsigned i = 0; i < CPU_PEAK_ITERS; i++) {
+        v0 = _mm256_add_epi32(v0, _mm256_madd_epi16(v0, m)); v1 = _mm256_add_epi32(v1, _mm256_madd_epi16(v1, m));
+        v2 = _mm256_add_epi32(v2, _mm256_madd_epi16(v2, m)); v3 = _mm256_add_epi32(v3, _mm256_madd_epi16(v3, m));
+        v4 = _mm256_add_epi32(v4, _mm256_madd_epi16(v4, m)); v5 = _mm256_add_epi32(v5, _mm256_madd_epi16(v5, m));
+        v6 = _mm256_add_epi32(v6, _mm256_madd_epi16(v6, m)); v7 = _mm256_add_epi32(v7, _mm256_madd_epi16(v7, m));
+    }
+    __m256i s = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(v0, v1), _mm256_add_epi32(v2, v3)),
+                                 _mm256_add_epi32(_mm256_add_epi32(v4, v5), _mm256_add_epi32(v6, v7)));
+    b->sink[task % 256] = hsum_epi32(s);
+#else
+    uint32_t v[8];
+    for (int k = 0; k < 8; k++)
+        v[k] = (uint32_t)(task + k);
+    for (unsigned i = 0; i < CPU_PEAK_ITERS; i++) {
+        for (int k = 0; k < 8; k++)
+            v[k] = v[k] * 3u + 1u;
+    }
+    b->sink[task % 256] = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+#endif
+}
+
+// Operations per task: 8 chains * lanes * (multiply + add)
+#if defined(__AVX2__) && defined(__FMA__)
+#define CPU_FLOAT_OPS (8.0 * 8 * 2)
+#else
+#define CPU_FLOAT_OPS (8.0 * 2)
+#endif
+#if defined(__AVX2__)
+#define CPU_INT_OPS (8.0 * 16 * 2)
+#else
+#define CPU_INT_OPS (8.0 * 2)
+#endif
+
+static void measure_cpu(gemv_cpu_pool *pool, roofline *roof)
+{
+    cpu_bench b;
+    size_t nthreads = gemv_cpu_pool_size(pool);
+
+    b.src = malloc(BENCH_BYTES);
+    b.dst = malloc(BENCH_BYTES);
+    if (b.src == NULL || b.dst == NULL) {
+        free(b.src);
+        free(b.dst);
+        return;
+    }
+    memset(b.src, 1, BENCH_BYTES);
+    memset(b.dst, 0, BENCH_BYTES);
+    roof->present = true;
+
+    // Read + write per byte, best of three
+    roof->copy_gbs = 0.0;
+    for (int run = 0; run < 3; run++) {
+        double t = now();
+        gemv_cpu_pool_run(pool, BENCH_BYTES / CPU_COPY_CHUNK, copy_task, &b);
+        roof->copy_gbs = fmax(roof->copy_gbs, 2.0 * BENCH_BYTES / (now() - t) * 1e-9);
+    }
+    roof->h2d_gbs = roof->d2h_gbs = 0.0;
+
+    double t = now();
+    gemv_cpu_pool_run(pool, nthreads, float_task, &b);
+    roof->peak_float_gflops = nthreads * CPU_PEAK_ITERS * CPU_FLOAT_OPS / (now() - t) * 1e-9;
+
+    t = now();
+    gemv_cpu_pool_run(pool, nthreads, int_task, &b);
+    roof->peak_int_gops = nthreads * CPU_PEAK_ITERS * CPU_INT_OPS / (now() - t) * 1e-9;
+
+    free(b.src);
+    free(b.dst);
+}
+
+static void print_roofline(FILE *out, const char *name, const roofline *roof, bool last)
+{
+    if (!roof->present) {
+        fprintf(out, "    \"%s\": null%s\n", name, last ? "" : ",");
+        return;
+    }
+    fprintf(out, "    \"%s\": { \"copy_gbs\": %.2f, \"h2d_gbs\": %.2f, \"d2h_gbs\": %.2f, "
+                 "\"peak_float_gflops\": %.1f, \"peak_int_gops\": %.1f }%s\n",
+            name, roof->copy_gbs, roof->h2d_gbs, roof->d2h_gbs,
+            roof->peak_float_gflops, roof->peak_int_gops, last ? "" : ",");
+}
+
+// ----------------------------------------------------------------------------
+// GEMV sweep
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    const bench_shape *shape;
+    gemv_dtype dtype;
+    const void *a;
+    const void *x;
+    void *y;
+    const void *ref;
+} bench_case;
+
+static int count_mismatches(const bench_case *c)
+{
+    int mismatches = 0;
+    for (size_t i = 0; i < c->shape->rows; i++) {
+        if (c->dtype == GEMV_FP16 || c->dtype == GEMV_FP32) {
+            float v = ((const float *)c->y)[i], ref = ((const float *)c->ref)[i];
+            if (fabsf(v - ref) > 1e-3f * fmaxf(1.0f, fabsf(ref)))
+                mismatches++;
+        } else if (((const int32_t *)c->y)[i] != ((const int32_t *)c->ref)[i]) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+// Time one plan and append its JSON record.
+static void run_case(FILE *out, bool *first, gemv_plan *plan, const bench_case *c,
+                     const char *backend, const roofline *roof)
+{
+    size_t rows = c->shape->rows, cols = c->shape->cols;
+
+    // Warm up, then repeat for at least BENCH_MIN_TIME
+    memset(c->y, 0, rows * gemv_output_size(c->dtype));
+    if (gemv_execute(plan, NULL, c->x, c->y) != 0)
+        return;
+    int mismatches = count_mismatches(c);
+
+    int calls = 0;
+    double start = now(), elapsed;
+    do {
+        gemv_execute(plan, NULL, c->x, c->y);
+        calls++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_MIN_TIME || calls < 3);
+
+    double seconds = elapsed / calls;
+    double flops = 2.0 * rows * cols;
+    double bytes = (double)(rows * cols + cols) * gemv_dtype_size(c->dtype) + rows * gemv_output_size(c->dtype);
+
+    // Attainable = min(peak, intensity * bandwidth); float types compute in float
+    bool is_float = c->dtype == GEMV_FP16 || c->dtype == GEMV_FP32;
+    double peak = is_float ? roof->peak_float_gflops : roof->peak_int_gops;
+    double bound = fmin(peak, flops / bytes * roof->copy_gbs);
+
+    fprintf(out, "%s    { \"shape\": \"%s\", \"rows\": %zu, \"cols\": %zu, \"dtype\": \"%s\", "
+                 "\"backend\": \"%s\", \"kernel\": \"%s\", \"us\": %.2f, \"gflops\": %.3f, \"gbs\": %.3f, "
+                 "\"intensity\": %.3f, \"bound_gflops\": %.3f, \"efficiency\": %.3f, \"mismatches\": %d }",
+            *first ? "" : ",\n", c->shape->name, rows, cols, gemv_dtype_name(c->dtype),
+            backend, gemv_plan_describe(plan), seconds * 1e6, flops / seconds * 1e-9, bytes / seconds * 1e-9,
+            flops / bytes, bound, bound > 0.0 ? flops / seconds * 1e-9 / bound : 0.0, mismatches);
+    *first = false;
+
+    fprintf(stderr, "%-12s %-6s %-4s %-22s %10.2f us %8.3f GFLOP/s %8.3f GB/s\n",
+            c->shape->name, gemv_dtype_name(c->dtype), backend, gemv_plan_describe(plan),
+            seconds * 1e6, flops / seconds * 1e-9, bytes / seconds * 1e-9);
+}
+
+static void sweep(FILE *out, bool quick, bool gpu, const roofline *gpu_roof, const roofline *cpu_roof)
+{
+    bool first = true;
+
+    fprintf(out, "  \"results\": [\n");
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        bench_shape shape = shapes[s];
+        if (quick) {
+            shape.rows = shape.rows > 64 ? shape.rows / 16 : shape.rows;
+            shape.cols = shape.cols > 64 ? shape.cols / 16 : shape.cols;
+        }
+
+        // Random inputs in [-1, 1], quantized per type
+        float *f_a = malloc(shape.rows * shape.cols * sizeof(float));
+        float *f_x = malloc(shape.cols * sizeof(float));
+        for (size_t i = 0; i < shape.rows * shape.cols; i++)
+            f_a[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+        for (size_t i = 0; i < shape.cols; i++)
+            f_x[i] = 2.0f * rand() / RAND_MAX - 1.0f;
+
+        for (int d = GEMV_INT8; d <= GEMV_FP32; d++) {
+            gemv_dtype dtype = (gemv_dtype)d;
+            void *a = malloc(shape.rows * shape.cols * gemv_dtype_size(dtype));
+            void *x = malloc(shape.cols * gemv_dtype_size(dtype));
+            void *y = malloc(shape.rows * gemv_output_size(dtype));
+            void *ref = malloc(shape.rows * gemv_output_size(dtype));
+            gemv_quantize_input(dtype, f_a, shape.rows * shape.cols, gemv_input_scale(dtype, f_a, shape.rows * shape.cols), a);
+            gemv_quantize_input(dtype, f_x, shape.cols, gemv_input_scale(dtype, f_x, shape.cols), x);
+
+            gemv_quant quant = gemv_quant_identity();
+            gemv_ref(dtype, &quant, shape.rows, shape.cols, a, x, ref);
+            bench_case c = { &shape, dtype, a, x, y, ref };
+
+            // GPU: every variant, forced
+            gemv_plan *plan = gpu ? gemv_plan_create(shape.rows, shape.cols, dtype, GEMV_DEVICE_GPU) : NULL;
+            if (plan != NULL) {
+                gemv_plan_set_matrix(plan, a);
+                for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+                    if (gemv_plan_set_kernel(plan, variants[v].kernel, variants[v].local) == 0)
+                        run_case(out, &first, plan, &c, "gpu", gpu_roof);
+                }
+                gemv_plan_destroy(plan);
+            }
+
+            plan = gemv_plan_create(shape.rows, shape.cols, dtype, GEMV_DEVICE_CPU);
+            if (plan != NULL) {
+                gemv_plan_set_matrix(plan, a);
+                run_case(out, &first, plan, &c, "cpu", cpu_roof);
+                gemv_plan_destroy(plan);
+            }
+
+            free(a);
+            free(x);
+            free(y);
+            free(ref);
+        }
+        free(f_a);
+        free(f_x);
+    }
+    fprintf(out, "\n  ]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool quick = false, cpuOnly = false;
+    const char *outFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0)
+            quick = true;
+        else if (strcmp(argv[i], "-c") == 0)
+            cpuOnly = true;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            outFile = argv[++i];
+    }
+
+    FILE *out = outFile != NULL ? fopen(outFile, "w") : stdout;
+    if (out == NULL) {
+        printf("Error opening %s\n", outFile);
+        return EXIT_FAILURE;
+    }
+
+    roofline gpu_roof = { 0 }, cpu_roof = { 0 };
+    gemv_cpu_pool *pool = gemv_cpu_pool_create(0);
+    measure_cpu(pool, &cpu_roof);
+    int threads = gemv_cpu_pool_size(pool);
+    gemv_cpu_pool_destroy(pool);
+
+    // The probe uses its own context with profiling; the plans share theirs
+    fprintf(out, "{\n");
+    bench_cl cl = { NULL };
+    cl_platform_id platform;
+    cl_int err = CL_DEVICE_NOT_FOUND;
+    if (!cpuOnly) {
+        err = clGetPlatformIDs(1, &platform, NULL);
+        if (err == CL_SUCCESS)
+            err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &cl.device, NULL);
+        if (err == CL_SUCCESS)
+            cl.context = clCreateContext(0, 1, &cl.device, NULL, NULL, &err);
+        if (err == CL_SUCCESS)
+            cl.queue = clCreateCommandQueue(cl.context, cl.device, CL_QUEUE_PROFILING_ENABLE, &err);
+    }
+    if (err == CL_SUCCESS) {
+        print_device(out, cl.device);
+        measure_gpu(&cl, &gpu_roof);
+        clReleaseCommandQueue(cl.queue);
+        clReleaseContext(cl.context);
+    } else {
+        fprintf(out, "  \"device\": null,\n");
+        if (cl.context != NULL)
+            clReleaseContext(cl.context);
+    }
+
+    fprintf(out, "  \"cpu\": { \"isa\": \"%s\", \"threads\": %d },\n", gemv_cpu_isa(), threads);
+    fprintf(out, "  \"roofline\": {\n");
+    print_roofline(out, "gpu", &gpu_roof, false);
+    print_roofline(out, "cpu", &cpu_roof, true);
+    fprintf(out, "  },\n");
+
+    sweep(out, quick, gpu_roof.present, &gpu_roof, &cpu_roof);
+    fprintf(out, "}\n");
+
+    gemv_shutdown();
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,37 @@
+// Roofline microbenchmarks for gemv_bench.c.
+//
+// bench_copy streams global memory; bench_peak runs independent multiply-add
+// chains on BENCH_T (float4 or uint4, set with -DBENCH_T=...) and counts
+// 2 * 4 * 16 operations per iteration.
+
+#ifndef BENCH_T
+#define BENCH_T float4
+#endif
+
+#ifndef BENCH_ITERS
+#define BENCH_ITERS 256
+#endif
+
+__kernel void bench_copy(__global const float4 *in, __global float4 *out)
+{
+    size_t i = get_global_id(0);
+    out[i] = in[i];
+}
+
+// Two interleaved dependency chains, 16 multiply-adds per iteration
+#define MAD_2(x, y) x = y * x + y; y = x * y + x
+#define MAD_16(x, y) MAD_2(x, y); MAD_2(x, y); MAD_2(x, y); MAD_2(x, y); \
+                     MAD_2(x, y); MAD_2(x, y); MAD_2(x, y); MAD_2(x, y)
+
+__kernel void bench_peak(__global BENCH_T *out, int seed)
+{
+    BENCH_T x = (BENCH_T)(seed);
+    BENCH_T y = (BENCH_T)((int)get_local_id(0));
+
+    for (int i = 0; i < BENCH_ITERS; i++) {
+        MAD_16(x, y);
+    }
+
+    // keep the result live
+    out[get_global_id(0)] = y;
+}
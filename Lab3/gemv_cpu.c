@@ -0,0 +1,381 @@
+// Native CPU GEMV backend: persistent pthread pool, row chunks handed out
+// dynamically, column blocks sized for L2 and 4-row register blocking for
+// the fp32 and int8 kernels (AVX-512 when available, else AVX2, else scalar).
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "gemv_cpu.h"
+#include "gemv_simd.h"
+
+// ----------------------------------------------------------------------------
+// Thread pool
+// ----------------------------------------------------------------------------
+
+struct gemv_cpu_pool {
+    int nthreads;                   // worker threads, the caller also runs tasks
+    pthread_t *threads;
+    pthread_mutex_t job;            // one job at a time when callers share the pool
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;       // bumped for every job
+    int active;                     // workers still running the current job
+    int stop;
+
+    void (*fn)(size_t task, void *arg);
+    void *arg;
+    size_t ntasks;
+    atomic_size_t next;
+};
+
+static void run_tasks(gemv_cpu_pool *pool)
+{
+    size_t task;
+    while ((task = atomic_fetch_add(&pool->next, 1)) < pool->ntasks)
+        pool->fn(task, pool->arg);
+}
+
+static void *worker_main(void *p)
+{
+    gemv_cpu_pool *pool = p;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->stop)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_tasks(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+gemv_cpu_pool *gemv_cpu_pool_create(int nthreads)
+{
+    if (nthreads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = n > 0 ? (int)n : 1;
+    }
+
+    gemv_cpu_pool *pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+
+    pthread_mutex_init(&pool->job, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // The calling thread is one of the nthreads
+    pool->threads = calloc(nthreads, sizeof(pthread_t));
+    for (int i = 0; pool->threads != NULL && i < nthreads - 1; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0)
+            break;
+        pool->nthreads++;
+    }
+
+    return pool;
+}
+
+void gemv_cpu_pool_destroy(gemv_cpu_pool *pool)
+{
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->job);
+    free(pool->threads);
+    free(pool);
+}
+
+int gemv_cpu_pool_size(const gemv_cpu_pool *pool)
+{
+    return pool ? pool->nthreads + 1 : 1;
+}
+
+void gemv_cpu_pool_run(gemv_cpu_pool *pool, size_t ntasks,
+                       void (*fn)(size_t task, void *arg), void *arg)
+{
+    if (pool == NULL || pool->nthreads == 0 || ntasks <= 1) {
+        for (size_t t = 0; t < ntasks; t++)
+            fn(t, arg);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->job);
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->ntasks = ntasks;
+    atomic_store(&pool->next, 0);
+    pool->active = pool->nthreads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->job);
+}
+
+// ----------------------------------------------------------------------------
+// 4-row register-blocked kernels: x is loaded once for four rows of A
+// ----------------------------------------------------------------------------
+
+const char *gemv_cpu_isa(void)
+{
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    return "avx512";
+#elif defined(__AVX2__) && defined(__FMA__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+static void dot4_f32(const float *a, size_t lda, const float *x, size_t n, float out[4])
+{
+    const float *a0 = a, *a1 = a + lda, *a2 = a + 2 * lda, *a3 = a + 3 * lda;
+    size_t i = 0;
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+#if defined(__AVX512F__)
+    __m512 v0 = _mm512_setzero_ps(), v1 = _mm512_setzero_ps();
+    __m512 v2 = _mm512_setzero_ps(), v3 = _mm512_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        __m512 xv = _mm512_loadu_ps(x + i);
+        v0 = _mm512_fmadd_ps(_mm512_loadu_ps(a0 + i), xv, v0);
+        v1 = _mm512_fmadd_ps(_mm512_loadu_ps(a1 + i), xv, v1);
+        v2 = _mm512_fmadd_ps(_mm512_loadu_ps(a2 + i), xv, v2);
+        v3 = _mm512_fmadd_ps(_mm512_loadu_ps(a3 + i), xv, v3);
+    }
+    s0 = _mm512_reduce_add_ps(v0);
+    s1 = _mm512_reduce_add_ps(v1);
+    s2 = _mm512_reduce_add_ps(v2);
+    s3 = _mm512_reduce_add_ps(v3);
+#elif defined(__AVX2__) && defined(__FMA__)
+    __m256 v0 = _mm256_setzero_ps(), v1 = _mm256_setzero_ps();
+    __m256 v2 = _mm256_setzero_ps(), v3 = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 xv = _mm256_loadu_ps(x + i);
+        v0 = _mm256_fmadd_ps(_mm256_loadu_ps(a0 + i), xv, v0);
+        v1 = _mm256_fmadd_ps(_mm256_loadu_ps(a1 + i), xv, v1);
+        v2 = _mm256_fmadd_ps(_mm256_loadu_ps(a2 + i), xv, v2);
+        v3 = _mm256_fmadd_ps(_mm256_loadu_ps(a3 + i), xv, v3);
+    }
+    s0 = hsum_ps(v0);
+    s1 = hsum_ps(v1);
+    s2 = hsum_ps(v2);
+    s3 = hsum_ps(v3);
+#endif
+    for (; i < n; i++) {
+        s0 += a0[i] * x[i];
+        s1 += a1[i] * x[i];
+        s2 += a2[i] * x[i];
+        s3 += a3[i] * x[i];
+    }
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+}
+
+// int8 products summed with int32 wrap-around, like the device accumulator.
+static void dot4_i8(const int8_t *a, size_t lda, const int8_t *x, size_t n, uint32_t out[4])
+{
+    const int8_t *a0 = a, *a1 = a + lda, *a2 = a + 2 * lda, *a3 = a + 3 * lda;
+    size_t i = 0;
+    uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    __m512i v0 = _mm512_setzero_si512(), v1 = _mm512_setzero_si512();
+    __m512i v2 = _mm512_setzero_si512(), v3 = _mm512_setzero_si512();
+    for (; i + 32 <= n; i += 32) {
+        __m512i xv = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(x + i)));
+        v0 = _mm512_add_epi32(v0, _mm512_madd_epi16(_mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(a0 + i))), xv));
+        v1 = _mm512_add_epi32(v1, _mm512_madd_epi16(_mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(a1 + i))), xv));
+        v2 = _mm512_add_epi32(v2, _mm512_madd_epi16(_mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(a2 + i))), xv));
+        v3 = _mm512_add_epi32(v3, _mm512_madd_epi16(_mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(a3 + i))), xv));
+    }
+    s0 = (uint32_t)_mm512_reduce_add_epi32(v0);
+    s1 = (uint32_t)_mm512_reduce_add_epi32(v1);
+    s2 = (uint32_t)_mm512_reduce_add_epi32(v2);
+    s3 = (uint32_t)_mm512_reduce_add_epi32(v3);
+#elif defined(__AVX2__)
+    __m256i v0 = _mm256_setzero_si256(), v1 = _mm256_setzero_si256();
+    __m256i v2 = _mm256_setzero_si256(), v3 = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        __m256i xv = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(x + i)));
+        v0 = _mm256_add_epi32(v0, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a0 + i))), xv));
+        v1 = _mm256_add_epi32(v1, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a1 + i))), xv));
+        v2 = _mm256_add_epi32(v2, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a2 + i))), xv));
+        v3 = _mm256_add_epi32(v3, _mm256_madd_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a3 + i))), xv));
+    }
+    s0 = (uint32_t)hsum_epi32(v0);
+    s1 = (uint32_t)hsum_epi32(v1);
+    s2 = (uint32_t)hsum_epi32(v2);
+    s3 = (uint32_t)hsum_epi32(v3);
+#endif
+    for (; i < n; i++) {
+        s0 += (uint32_t)(a0[i] * x[i]);
+        s1 += (uint32_t)(a1[i] * x[i]);
+        s2 += (uint32_t)(a2[i] * x[i]);
+        s3 += (uint32_t)(a3[i] * x[i]);
+    }
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+}
+
+// ----------------------------------------------------------------------------
+// Dense GEMV
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    gemv_dtype dtype;
+    const gemv_quant *q;
+    size_t rows;
+    size_t cols;
+    const void *a;
+    const void *x;
+    void *y;
+} dense_job;
+
+// Accumulate columns [c0, c0 + n) of rows [r0, r1) into iacc / facc.
+static void accumulate_block(const dense_job *job, size_t r0, size_t r1, size_t c0, size_t n,
+                             int64_t *iacc, float *facc)
+{
+    size_t cols = job->cols;
+    size_t r = r0;
+
+    switch (job->dtype) {
+    case GEMV_INT8: {
+        const int8_t *a = (const int8_t *)job->a + c0, *x = (const int8_t *)job->x + c0;
+        uint32_t s[4];
+        for (; r + 4 <= r1; r += 4) {
+            dot4_i8(a + r * cols, cols, x, n, s);
+            for (int k = 0; k < 4; k++)
+                iacc[r - r0 + k] = (uint32_t)iacc[r - r0 + k] + s[k];
+        }
+        for (; r < r1; r++)
+            iacc[r - r0] = (uint32_t)iacc[r - r0] + (uint32_t)gemv_dot_i8(a + r * cols, x, n);
+        break;
+    }
+    case GEMV_INT16:
+        for (; r < r1; r++)
+            iacc[r - r0] += gemv_dot_i16((const int16_t *)job->a + r * cols + c0, (const int16_t *)job->x + c0, n);
+        break;
+    case GEMV_INT32:
+        for (; r < r1; r++)
+            iacc[r - r0] += gemv_dot_i32((const int32_t *)job->a + r * cols + c0, (const int32_t *)job->x + c0, n);
+        break;
+    case GEMV_FP16:
+        for (; r < r1; r++)
+            facc[r - r0] += gemv_dot_f16((const uint16_t *)job->a + r * cols + c0, (const uint16_t *)job->x + c0, n);
+        break;
+    case GEMV_FP32: {
+        const float *a = (const float *)job->a + c0, *x = (const float *)job->x + c0;
+        float s[4];
+        for (; r + 4 <= r1; r += 4) {
+            dot4_f32(a + r * cols, cols, x, n, s);
+            for (int k = 0; k < 4; k++)
+                facc[r - r0 + k] += s[k];
+        }
+        for (; r < r1; r++)
+            facc[r - r0] += gemv_dot_f32(a + r * cols, x, n);
+        break;
+    }
+    }
+}
+
+static void dense_task(size_t task, void *arg)
+{
+    const dense_job *job = arg;
+    size_t r0 = task * GEMV_CPU_ROW_CHUNK;
+    size_t r1 = r0 + GEMV_CPU_ROW_CHUNK < job->rows ? r0 + GEMV_CPU_ROW_CHUNK : job->rows;
+    int64_t iacc[GEMV_CPU_ROW_CHUNK] = { 0 };
+    float facc[GEMV_CPU_ROW_CHUNK] = { 0 };
+
+    // Sweep all rows of the chunk over one column block before moving on,
+    // so the x block is reused from cache
+    for (size_t c0 = 0; c0 < job->cols; c0 += GEMV_CPU_COL_BLOCK) {
+        size_t n = job->cols - c0 < GEMV_CPU_COL_BLOCK ? job->cols - c0 : GEMV_CPU_COL_BLOCK;
+        accumulate_block(job, r0, r1, c0, n, iacc, facc);
+    }
+
+    for (size_t r = r0; r < r1; r++) {
+        switch (job->dtype) {
+        case GEMV_INT8:
+            ((int32_t *)job->y)[r] = gemv_quantize_acc((int32_t)(uint32_t)iacc[r - r0], job->q);
+            break;
+        case GEMV_INT16:
+        case GEMV_INT32:
+            ((int32_t *)job->y)[r] = gemv_quantize_acc(iacc[r - r0], job->q);
+            break;
+        case GEMV_FP16:
+        case GEMV_FP32:
+            ((float *)job->y)[r] = facc[r - r0] * job->q->scale;
+            break;
+        }
+    }
+}
+
+void gemv_cpu_execute(gemv_cpu_pool *pool, gemv_dtype dtype, const gemv_quant *q,
+                      size_t rows, size_t cols, const void *a, const void *x, void *y)
+{
+    dense_job job = { dtype, q, rows, cols, a, x, y };
+    size_t ntasks = (rows + GEMV_CPU_ROW_CHUNK - 1) / GEMV_CPU_ROW_CHUNK;
+    gemv_cpu_pool_run(pool, ntasks, dense_task, &job);
+}
+
+// ----------------------------------------------------------------------------
+// Sparse GEMV
+// ----------------------------------------------------------------------------
+
+typedef struct {
+    const gemv_csr *csr;
+    const gemv_quant *q;
+    const void *x;
+    void *y;
+} csr_job;
+
+static void csr_task(size_t task, void *arg)
+{
+    const csr_job *job = arg;
+    uint32_t r0 = (uint32_t)(task * GEMV_CPU_ROW_CHUNK);
+    uint32_t r1 = r0 + GEMV_CPU_ROW_CHUNK < job->csr->rows ? r0 + GEMV_CPU_ROW_CHUNK : job->csr->rows;
+    gemv_csr_ref_rows(job->csr, job->q, job->x, job->y, r0, r1);
+}
+
+void gemv_cpu_csr_execute(gemv_cpu_pool *pool, const gemv_csr *csr, const gemv_quant *q,
+                          const void *x, void *y)
+{
+    csr_job job = { csr, q, x, y };
+    size_t ntasks = (csr->rows + GEMV_CPU_ROW_CHUNK - 1) / GEMV_CPU_ROW_CHUNK;
+    gemv_cpu_pool_run(pool, ntasks, csr_task, &job);
+}
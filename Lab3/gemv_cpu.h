@@ -0,0 +1,43 @@
+// Native CPU backend for GEMV: AVX2 / AVX-512 vectorized, cache-blocked and
+// multithreaded, with the numeric semantics of gemv.cl (integer results are
+// bit-identical to the device, float results differ by summation order only).
+// Used when no suitable OpenCL device exists or when it is forced.
+
+#ifndef GEMV_CPU_H
+#define GEMV_CPU_H
+
+#include <stddef.h>
+#include "gemv.h"
+#include "gemv_sparse.h"
+
+// Columns per cache block: the x block (and one A row block) stays in L2
+// while every row of the thread's range is swept over it.
+#define GEMV_CPU_COL_BLOCK 8192
+
+// Rows handed out to a worker at a time.
+#define GEMV_CPU_ROW_CHUNK 64
+
+typedef struct gemv_cpu_pool gemv_cpu_pool;
+
+// Persistent worker threads; nthreads <= 0 uses one per online CPU.
+gemv_cpu_pool *gemv_cpu_pool_create(int nthreads);
+void gemv_cpu_pool_destroy(gemv_cpu_pool *pool);
+int gemv_cpu_pool_size(const gemv_cpu_pool *pool);
+
+// Run fn(task, arg) for task in [0, ntasks) on the pool and the calling thread.
+// Concurrent callers are serialized.
+void gemv_cpu_pool_run(gemv_cpu_pool *pool, size_t ntasks,
+                       void (*fn)(size_t task, void *arg), void *arg);
+
+// Name of the instruction set the dense kernels were compiled for.
+const char *gemv_cpu_isa(void);
+
+// y = quantize(A * x) for a dense row-major matrix.
+void gemv_cpu_execute(gemv_cpu_pool *pool, gemv_dtype dtype, const gemv_quant *q,
+                      size_t rows, size_t cols, const void *a, const void *x, void *y);
+
+// y = quantize(A * x) for a CSR matrix.
+void gemv_cpu_csr_execute(gemv_cpu_pool *pool, const gemv_csr *csr, const gemv_quant *q,
+                          const void *x, void *y);
+
+#endif
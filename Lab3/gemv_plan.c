@@ -0,0 +1,658 @@
+// GEMV plans: shared OpenCL runtime, per-plan kernels, tuned local sizes and
+// device buffers, with the CPU backend as fallback.
+
+#define CL_TARGET_OPENCL_VERSION 120
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <CL/opencl.h>
+#include "gemv_plan.h"
+#include "gemv_cpu.h"
+
+#define GEMV_SOURCE_FILE "gemv.cl"
+
+// SELL-C-sigma slice height and sorting window
+#define SELL_CHUNK 32
+#define SELL_SIGMA 256
+
+// Timed launches per local-size candidate
+#define TUNE_RUNS 3
+
+typedef enum {
+    KERNEL_ITEM,
+    KERNEL_WG,
+    KERNEL_CSR_VECTOR,
+    KERNEL_SELL
+} kernel_kind;
+
+static const char *kernel_names[] = { "gemv_item", "gemv_wg", "gemv_csr_vector", "gemv_sell" };
+
+// ----------------------------------------------------------------------------
+// Process-wide runtime
+// ----------------------------------------------------------------------------
+
+static struct {
+    pthread_mutex_t lock;
+    int state;                      // 0: not initialised, 1: GPU ready, -1: no GPU
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    char *source;
+    cl_program programs[5][3];      // per gemv_dtype and gemv_rounding
+    gemv_cpu_pool *pool;
+
+    // Background warm-up, see gemv_warmup()
+    pthread_t warmup;
+    bool warming;
+    gemv_dtype warm_dtype;
+    gemv_rounding warm_rounding;
+    gemv_device warm_device;
+} runtime = { PTHREAD_MUTEX_INITIALIZER };
+
+// Set up the first OpenCL GPU once. Returns false if there is none.
+static bool runtime_gpu(void)
+{
+    cl_int err;
+
+    pthread_mutex_lock(&runtime.lock);
+    if (runtime.state == 0) {
+        runtime.state = -1;
+
+        // Bind to platform and get ID for the device
+        err = clGetPlatformIDs(1, &runtime.platform, NULL);
+        if (err == CL_SUCCESS)
+            err = clGetDeviceIDs(runtime.platform, CL_DEVICE_TYPE_GPU, 1, &runtime.device, NULL);
+
+        // Create a context and a command queue (profiling is used for tuning)
+        if (err == CL_SUCCESS)
+            runtime.context = clCreateContext(0, 1, &runtime.device, NULL, NULL, &err);
+        if (err == CL_SUCCESS)
+            runtime.queue = clCreateCommandQueue(runtime.context, runtime.device,
+                                                 CL_QUEUE_PROFILING_ENABLE, &err);
+
+        // Read the kernel source
+        if (err == CL_SUCCESS) {
+            runtime.source = gemv_load_source(GEMV_SOURCE_FILE);
+            if (runtime.source == NULL)
+                err = CL_INVALID_VALUE;
+        }
+
+        if (err == CL_SUCCESS) {
+            runtime.state = 1;
+        } else {
+            printf("No OpenCL GPU available (error %d)\n", err);
+            if (runtime.queue != NULL)
+                clReleaseCommandQueue(runtime.queue);
+            if (runtime.context != NULL)
+                clReleaseContext(runtime.context);
+            runtime.queue = NULL;
+            runtime.context = NULL;
+        }
+    }
+    bool ok = runtime.state == 1;
+    pthread_mutex_unlock(&runtime.lock);
+    return ok;
+}
+
+static void print_build_log(cl_program program)
+{
+    size_t build_log_len;
+    if (clGetProgramBuildInfo(program, runtime.device, CL_PROGRAM_BUILD_LOG, 0, NULL, &build_log_len) != CL_SUCCESS) {
+        printf("clGetProgramBuildInfo failed at line %d\n", __LINE__);
+        return;
+    }
+
+    char *buff_erro = malloc(build_log_len);
+    if (!buff_erro) {
+        printf("malloc failed at line %d\n", __LINE__);
+        return;
+    }
+
+    if (clGetProgramBuildInfo(program, runtime.device, CL_PROGRAM_BUILD_LOG, build_log_len, buff_erro, NULL) == CL_SUCCESS)
+        fprintf(stderr, "Build log: \n%s\n", buff_erro);
+    free(buff_erro);
+}
+
+// The program specialised for dtype and rounding, built on first use.
+static cl_program runtime_program(gemv_dtype dtype, gemv_rounding rounding)
+{
+    cl_int err;
+    cl_program program;
+
+    pthread_mutex_lock(&runtime.lock);
+    program = runtime.programs[dtype][rounding];
+    if (program == NULL) {
+        char options[128];
+        gemv_build_options(dtype, rounding, options, sizeof(options));
+
+        program = clCreateProgramWithSource(runtime.context, 1, (const char **)&runtime.source, NULL, &err);
+        if (err == CL_SUCCESS)
+            err = clBuildProgram(program, 1, &runtime.device, options, NULL, NULL);
+
+        if (err != CL_SUCCESS) {
+            print_build_log(program);
+            fprintf(stderr, "clBuildProgram failed (%s)\n", options);
+            if (program != NULL)
+                clReleaseProgram(program);
+            program = NULL;
+        }
+        runtime.programs[dtype][rounding] = program;
+    }
+    pthread_mutex_unlock(&runtime.lock);
+    return program;
+}
+
+static gemv_cpu_pool *runtime_pool(void)
+{
+    pthread_mutex_lock(&runtime.lock);
+    if (runtime.pool == NULL)
+        runtime.pool = gemv_cpu_pool_create(0);
+    gemv_cpu_pool *pool = runtime.pool;
+    pthread_mutex_unlock(&runtime.lock);
+    return pool;
+}
+
+// ----------------------------------------------------------------------------
+// Background warm-up
+// ----------------------------------------------------------------------------
+
+// The runtime functions take runtime.lock, so a plan created meanwhile
+// simply waits for the step in progress.
+static void *warmup_main(void *arg)
+{
+    (void)arg;
+    if (runtime.warm_device != GEMV_DEVICE_CPU && runtime_gpu()) {
+        runtime_program(runtime.warm_dtype, gemv_quant_identity().rounding);
+        runtime_program(runtime.warm_dtype, runtime.warm_rounding);
+    } else if (runtime.warm_device != GEMV_DEVICE_GPU) {
+        runtime_pool();
+    }
+    return NULL;
+}
+
+int gemv_warmup(gemv_dtype dtype, gemv_rounding rounding, gemv_device device)
+{
+    gemv_warmup_wait();
+
+    runtime.warm_dtype = dtype;
+    runtime.warm_rounding = rounding;
+    runtime.warm_device = device;
+    if (pthread_create(&runtime.warmup, NULL, warmup_main, NULL) != 0)
+        return -1;
+    runtime.warming = true;
+    return 0;
+}
+
+void gemv_warmup_wait(void)
+{
+    if (runtime.warming) {
+        pthread_join(runtime.warmup, NULL);
+        runtime.warming = false;
+    }
+}
+
+void gemv_shutdown(void)
+{
+    gemv_warmup_wait();
+
+    pthread_mutex_lock(&runtime.lock);
+    for (int d = 0; d < 5; d++) {
+        for (int r = 0; r < 3; r++) {
+            if (runtime.programs[d][r] != NULL)
+                clReleaseProgram(runtime.programs[d][r]);
+            runtime.programs[d][r] = NULL;
+        }
+    }
+    if (runtime.queue != NULL)
+        clReleaseCommandQueue(runtime.queue);
+    if (runtime.context != NULL)
+        clReleaseContext(runtime.context);
+    free(runtime.source);
+    gemv_cpu_pool_destroy(runtime.pool);
+
+    runtime.queue = NULL;
+    runtime.context = NULL;
+    runtime.source = NULL;
+    runtime.pool = NULL;
+    runtime.state = 0;
+    pthread_mutex_unlock(&runtime.lock);
+}
+
+// ----------------------------------------------------------------------------
+// Plans
+// ----------------------------------------------------------------------------
+
+struct gemv_plan {
+    gemv_device device;
+    gemv_dtype dtype;
+    size_t rows;
+    size_t cols;
+    gemv_quant quant;
+    bool has_matrix;                // A is resident (always true for sparse plans)
+
+    // CPU backend
+    const gemv_csr *csr;
+    const void *resident;
+
+    // GPU backend
+    kernel_kind kind;
+    cl_kernel kernel;
+    size_t local;
+    size_t global;
+    cl_mem d_a;                     // dense A, or the CSR/SELL arrays in d_sparse
+    cl_mem d_sparse[5];
+    int nsparse;
+    cl_mem d_x;
+    cl_mem d_y;
+    unsigned int chunk;             // SELL slice height
+
+    char description[64];
+};
+
+static cl_mem create_buffer(cl_mem_flags flags, size_t bytes, const void *host, cl_int *err)
+{
+    if (bytes == 0 || host == NULL)
+        return clCreateBuffer(runtime.context, flags, bytes ? bytes : 4, NULL, err);
+    return clCreateBuffer(runtime.context, flags | CL_MEM_COPY_HOST_PTR, bytes, (void *)host, err);
+}
+
+static void set_scalar_args(gemv_plan *plan)
+{
+    cl_uint first = plan->kind == KERNEL_SELL ? 9 : (plan->kind == KERNEL_CSR_VECTOR ? 6 : 5);
+    clSetKernelArg(plan->kernel, first, sizeof(int), &plan->quant.multiplier);
+    clSetKernelArg(plan->kernel, first + 1, sizeof(int), &plan->quant.shift);
+    clSetKernelArg(plan->kernel, first + 2, sizeof(float), &plan->quant.scale);
+}
+
+// Create the kernel of plan->kind for plan->local and bind the buffers.
+static cl_int create_kernel(gemv_plan *plan)
+{
+    cl_int err, status = CL_SUCCESS;
+    cl_program program = runtime_program(plan->dtype, plan->quant.rounding);
+    if (program == NULL)
+        return CL_BUILD_PROGRAM_FAILURE;
+
+    if (plan->kernel != NULL)
+        clReleaseKernel(plan->kernel);
+    plan->kernel = clCreateKernel(program, kernel_names[plan->kind], &err);
+    if (err != CL_SUCCESS)
+        return err;
+
+    unsigned int rows = (unsigned int)plan->rows;
+    unsigned int cols = (unsigned int)plan->cols;
+    size_t acc = plan->local * gemv_acc_size(plan->dtype);
+
+    switch (plan->kind) {
+    case KERNEL_ITEM:
+    case KERNEL_WG:
+        status |= clSetKernelArg(plan->kernel, 0, sizeof(cl_mem), &plan->d_a);
+        status |= clSetKernelArg(plan->kernel, 1, sizeof(cl_mem), &plan->d_x);
+        status |= clSetKernelArg(plan->kernel, 2, sizeof(cl_mem), &plan->d_y);
+        status |= clSetKernelArg(plan->kernel, 3, sizeof(unsigned int), &rows);
+        status |= clSetKernelArg(plan->kernel, 4, sizeof(unsigned int), &cols);
+        if (plan->kind == KERNEL_WG)
+            status |= clSetKernelArg(plan->kernel, 8, acc, NULL);
+        break;
+    case KERNEL_CSR_VECTOR:
+        for (cl_uint i = 0; i < 3; i++)
+            status |= clSetKernelArg(plan->kernel, i, sizeof(cl_mem), &plan->d_sparse[i]);
+        status |= clSetKernelArg(plan->kernel, 3, sizeof(cl_mem), &plan->d_x);
+        status |= clSetKernelArg(plan->kernel, 4, sizeof(cl_mem), &plan->d_y);
+        status |= clSetKernelArg(plan->kernel, 5, sizeof(unsigned int), &rows);
+        status |= clSetKernelArg(plan->kernel, 9, acc, NULL);
+        break;
+    case KERNEL_SELL:
+        for (cl_uint i = 0; i < 5; i++)
+            status |= clSetKernelArg(plan->kernel, i, sizeof(cl_mem), &plan->d_sparse[i]);
+        status |= clSetKernelArg(plan->kernel, 5, sizeof(cl_mem), &plan->d_x);
+        status |= clSetKernelArg(plan->kernel, 6, sizeof(cl_mem), &plan->d_y);
+        status |= clSetKernelArg(plan->kernel, 7, sizeof(unsigned int), &rows);
+        status |= clSetKernelArg(plan->kernel, 8, sizeof(unsigned int), &plan->chunk);
+        break;
+    }
+    set_scalar_args(plan);
+
+    // Number of total work items - localSize must be devisor
+    switch (plan->kind) {
+    case KERNEL_ITEM:
+    case KERNEL_SELL:
+        plan->global = (plan->rows + plan->local - 1) / plan->local * plan->local;
+        break;
+    case KERNEL_WG:
+    case KERNEL_CSR_VECTOR:
+        plan->global = plan->rows * plan->local;
+        break;
+    }
+
+    snprintf(plan->description, sizeof(plan->description), "%s local=%zu",
+             kernel_names[plan->kind], plan->local);
+    return status;
+}
+
+// Best of TUNE_RUNS launches of the current kernel, in ns (or ~0 on failure).
+static cl_ulong time_kernel(gemv_plan *plan)
+{
+    cl_ulong best = (cl_ulong)-1;
+    if (plan->global == 0)
+        return 0;
+
+    for (int run = 0; run <= TUNE_RUNS; run++) {
+        cl_event event;
+        cl_ulong start, end;
+        if (clEnqueueNDRangeKernel(runtime.queue, plan->kernel, 1, NULL, &plan->global, &plan->local,
+                                   0, NULL, &event) != CL_SUCCESS)
+            return (cl_ulong)-1;
+        clWaitForEvents(1, &event);
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+        clReleaseEvent(event);
+
+        // the first launch is a warm-up
+        if (run > 0 && end - start < best)
+            best = end - start;
+    }
+    return best;
+}
+
+// Try each kernel / local size candidate and keep the fastest.
+static cl_int tune(gemv_plan *plan, const kernel_kind *kinds, const size_t *locals, int ncandidates)
+{
+    cl_ulong best = (cl_ulong)-1;
+    kernel_kind best_kind = kinds[0];
+    size_t best_local = locals[0];
+
+    for (int i = 0; i < ncandidates; i++) {
+        size_t max_local;
+        plan->kind = kinds[i];
+        plan->local = locals[i];
+        if (create_kernel(plan) != CL_SUCCESS)
+            continue;
+        if (clGetKernelWorkGroupInfo(plan->kernel, runtime.device, CL_KERNEL_WORK_GROUP_SIZE,
+                                     sizeof(max_local), &max_local, NULL) != CL_SUCCESS || plan->local > max_local)
+            continue;
+
+        cl_ulong t = time_kernel(plan);
+        if (t < best) {
+            best = t;
+            best_kind = plan->kind;
+            best_local = plan->local;
+        }
+    }
+
+    plan->kind = best_kind;
+    plan->local = best_local;
+    return create_kernel(plan);
+}
+
+static gemv_plan *plan_alloc(size_t M, size_t N, gemv_dtype dtype, gemv_device device)
+{
+    gemv_plan *plan = calloc(1, sizeof(*plan));
+    if (plan == NULL)
+        return NULL;
+
+    plan->rows = M;
+    plan->cols = N;
+    plan->dtype = dtype;
+    plan->quant = gemv_quant_identity();
+
+    // Resolve the backend
+    if (device == GEMV_DEVICE_CPU || (device == GEMV_DEVICE_AUTO && !runtime_gpu())) {
+        plan->device = GEMV_DEVICE_CPU;
+    } else if (runtime_gpu()) {
+        plan->device = GEMV_DEVICE_GPU;
+    } else {
+        free(plan);
+        return NULL;
+    }
+
+    if (plan->device == GEMV_DEVICE_CPU) {
+        gemv_cpu_pool *pool = runtime_pool();
+        snprintf(plan->description, sizeof(plan->description), "%s threads=%d",
+                 gemv_cpu_isa(), gemv_cpu_pool_size(pool));
+    }
+    return plan;
+}
+
+gemv_plan *gemv_plan_create(size_t M, size_t N, gemv_dtype dtype, gemv_device device)
+{
+    cl_int err, status = CL_SUCCESS;
+    gemv_plan *plan = plan_alloc(M, N, dtype, device);
+    if (plan == NULL || plan->device == GEMV_DEVICE_CPU)
+        return plan;
+
+    size_t esize = gemv_dtype_size(dtype);
+    plan->d_a = create_buffer(CL_MEM_READ_ONLY, M * N * esize, NULL, &err);
+    status |= err;
+    plan->d_x = create_buffer(CL_MEM_READ_ONLY, N * esize, NULL, &err);
+    status |= err;
+    plan->d_y = create_buffer(CL_MEM_WRITE_ONLY, M * gemv_output_size(dtype), NULL, &err);
+    status |= err;
+
+    // Tune on zeroed inputs: one work-item per row, or one work-group per row
+    // with a power-of-two local size
+    if (status == CL_SUCCESS) {
+        cl_uint zero = 0;
+        if (M * N > 0)
+            clEnqueueFillBuffer(runtime.queue, plan->d_a, &zero, 1, 0, M * N * esize, 0, NULL, NULL);
+        if (N > 0)
+            clEnqueueFillBuffer(runtime.queue, plan->d_x, &zero, 1, 0, N * esize, 0, NULL, NULL);
+
+        kernel_kind kinds[] = { KERNEL_ITEM, KERNEL_WG, KERNEL_WG, KERNEL_WG, KERNEL_WG };
+        size_t locals[] = { 64, 32, 64, 128, 256 };
+        status = tune(plan, kinds, locals, 5);
+    }
+
+    if (status != CL_SUCCESS) {
+        printf("gemv_plan_create failed (%d)\n", status);
+        gemv_plan_destroy(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+gemv_plan *gemv_plan_create_csr(const gemv_csr *csr, gemv_device device)
+{
+    cl_int err, status = CL_SUCCESS;
+    gemv_plan *plan = plan_alloc(csr->rows, csr->cols, csr->dtype, device);
+    if (plan == NULL)
+        return NULL;
+
+    plan->has_matrix = true;
+    if (plan->device == GEMV_DEVICE_CPU) {
+        plan->csr = csr;
+        return plan;
+    }
+
+    size_t esize = gemv_dtype_size(csr->dtype);
+    plan->d_x = create_buffer(CL_MEM_READ_ONLY, csr->cols * esize, NULL, &err);
+    status |= err;
+    plan->d_y = create_buffer(CL_MEM_WRITE_ONLY, csr->rows * gemv_output_size(csr->dtype), NULL, &err);
+    status |= err;
+
+    if (gemv_sparse_choose(csr, SELL_CHUNK, SELL_SIGMA) == GEMV_SPARSE_CSR_VECTOR) {
+        plan->d_sparse[plan->nsparse++] = create_buffer(CL_MEM_READ_ONLY, (csr->rows + 1) * sizeof(uint32_t), csr->row_ptr, &err);
+        status |= err;
+        plan->d_sparse[plan->nsparse++] = create_buffer(CL_MEM_READ_ONLY, csr->nnz * sizeof(uint32_t), csr->col_idx, &err);
+        status |= err;
+        plan->d_sparse[plan->nsparse++] = create_buffer(CL_MEM_READ_ONLY, csr->nnz * esize, csr->values, &err);
+        status |= err;
+
+        if (status == CL_SUCCESS) {
+            kernel_kind kinds[] = { KERNEL_CSR_VECTOR, KERNEL_CSR_VECTOR, KERNEL_CSR_VECTOR, KERNEL_CSR_VECTOR };
+            size_t locals[] = { 32, 64, 128, 256 };
+            status = tune(plan, kinds, locals, 4);
+        }
+    } else {
+        gemv_sell sell;
+        if (gemv_sell_from_csr(&sell, csr, SELL_CHUNK, SELL_SIGMA) != 0) {
+            gemv_plan_destroy(plan);
+            return NULL;
+        }
+
+        size_t stored = gemv_sell_stored(&sell);
+        plan->d_sparse[plan->nsparse++] = create_buffer(CL_MEM_READ_ONLY, (sell.nslices + 1) * sizeof(uint32_t), sell.slice_ptr, &err);
+        status |= err;
+        plan->d_sparse[plan->nsparse++] = create_buffer(CL_MEM_READ_ONLY, sell.nslices * sizeof(uint32_t), sell.slice_width, &err);
+        status |= err;
+        plan->d_sparse[plan->nsparse++] = create_buffer(CL_MEM_READ_ONLY, sell.nslices * sell.chunk * sizeof(uint32_t), sell.row_perm, &err);
+        status |= err;
+        plan->d_sparse[plan->nsparse++] = create_buffer(CL_MEM_READ_ONLY, stored * sizeof(uint32_t), sell.col_idx, &err);
+        status |= err;
+        plan->d_sparse[plan->nsparse++] = create_buffer(CL_MEM_READ_ONLY, stored * esize, sell.values, &err);
+        status |= err;
+
+        // One work-group per slice; the global size covers the padded rows
+        plan->kind = KERNEL_SELL;
+        plan->chunk = sell.chunk;
+        plan->local = sell.chunk;
+        if (status == CL_SUCCESS)
+            status = create_kernel(plan);
+        gemv_sell_free(&sell);
+    }
+
+    if (status != CL_SUCCESS) {
+        printf("gemv_plan_create_csr failed (%d)\n", status);
+        gemv_plan_destroy(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+void gemv_plan_destroy(gemv_plan *plan)
+{
+    if (plan == NULL)
+        return;
+
+    if (plan->kernel != NULL)
+        clReleaseKernel(plan->kernel);
+    for (int i = 0; i < plan->nsparse; i++) {
+        if (plan->d_sparse[i] != NULL)
+            clReleaseMemObject(plan->d_sparse[i]);
+    }
+    if (plan->d_a != NULL)
+        clReleaseMemObject(plan->d_a);
+    if (plan->d_x != NULL)
+        clReleaseMemObject(plan->d_x);
+    if (plan->d_y != NULL)
+        clReleaseMemObject(plan->d_y);
+    free(plan);
+}
+
+int gemv_plan_set_quant(gemv_plan *plan, const gemv_quant *q)
+{
+    gemv_rounding previous = plan->quant.rounding;
+    plan->quant = *q;
+
+    if (plan->device != GEMV_DEVICE_GPU)
+        return 0;
+
+    // The rounding mode is compiled in: switch to the matching program
+    if (q->rounding != previous)
+        return create_kernel(plan);
+
+    set_scalar_args(plan);
+    return 0;
+}
+
+int gemv_plan_set_kernel(gemv_plan *plan, const char *kernel, size_t local)
+{
+    size_t max_local;
+    kernel_kind kind;
+
+    if (plan->device != GEMV_DEVICE_GPU || local == 0)
+        return CL_INVALID_VALUE;
+
+    if (strcmp(kernel, "gemv_item") == 0 && plan->nsparse == 0)
+        kind = KERNEL_ITEM;
+    else if (strcmp(kernel, "gemv_wg") == 0 && plan->nsparse == 0)
+        kind = KERNEL_WG;
+    else if (strcmp(kernel, "gemv_csr_vector") == 0 && plan->kind == KERNEL_CSR_VECTOR)
+        kind = KERNEL_CSR_VECTOR;
+    else
+        return CL_INVALID_VALUE;
+
+    // The reductions need a power-of-two work-group
+    if (kind != KERNEL_ITEM && (local & (local - 1)) != 0)
+        return CL_INVALID_WORK_GROUP_SIZE;
+
+    plan->kind = kind;
+    plan->local = local;
+    cl_int err = create_kernel(plan);
+    if (err == CL_SUCCESS)
+        err = clGetKernelWorkGroupInfo(plan->kernel, runtime.device, CL_KERNEL_WORK_GROUP_SIZE,
+                                       sizeof(max_local), &max_local, NULL);
+    if (err == CL_SUCCESS && local > max_local)
+        err = CL_INVALID_WORK_GROUP_SIZE;
+    return err;
+}
+
+int gemv_plan_set_matrix(gemv_plan *plan, const void *A)
+{
+    if (plan->csr != NULL || plan->nsparse > 0)
+        return -1;
+
+    plan->has_matrix = true;
+    if (plan->device == GEMV_DEVICE_CPU) {
+        plan->resident = A;
+        return 0;
+    }
+
+    size_t bytes = plan->rows * plan->cols * gemv_dtype_size(plan->dtype);
+    return bytes ? clEnqueueWriteBuffer(runtime.queue, plan->d_a, CL_TRUE, 0, bytes, A, 0, NULL, NULL) : 0;
+}
+
+int gemv_execute(gemv_plan *plan, const void *A, const void *x, void *y)
+{
+    cl_int err = CL_SUCCESS;
+
+    if (A == NULL && !plan->has_matrix)
+        return CL_INVALID_VALUE;
+    // A sparse plan only runs its resident CSR matrix
+    if (plan->csr != NULL && A != NULL)
+        return CL_INVALID_VALUE;
+
+    if (plan->device == GEMV_DEVICE_CPU) {
+        gemv_cpu_pool *pool = runtime_pool();
+        if (plan->csr != NULL)
+            gemv_cpu_csr_execute(pool, plan->csr, &plan->quant, x, y);
+        else
+            gemv_cpu_execute(pool, plan->dtype, &plan->quant, plan->rows, plan->cols,
+                             A != NULL ? A : plan->resident, x, y);
+        return 0;
+    }
+
+    if (plan->rows == 0)
+        return 0;
+
+    size_t esize = gemv_dtype_size(plan->dtype);
+    size_t bytes_a = plan->rows * plan->cols * esize;
+    size_t bytes_x = plan->cols * esize;
+    size_t bytes_y = plan->rows * gemv_output_size(plan->dtype);
+
+    // Non-blocking writes are safe: the blocking read below waits for them
+    if (A != NULL && bytes_a > 0)
+        err = clEnqueueWriteBuffer(runtime.queue, plan->d_a, CL_FALSE, 0, bytes_a, A, 0, NULL, NULL);
+    if (err == CL_SUCCESS && bytes_x > 0)
+        err = clEnqueueWriteBuffer(runtime.queue, plan->d_x, CL_FALSE, 0, bytes_x, x, 0, NULL, NULL);
+    if (err == CL_SUCCESS)
+        err = clEnqueueNDRangeKernel(runtime.queue, plan->kernel, 1, NULL, &plan->global, &plan->local, 0, NULL, NULL);
+    if (err == CL_SUCCESS)
+        err = clEnqueueReadBuffer(runtime.queue, plan->d_y, CL_TRUE, 0, bytes_y, y, 0, NULL, NULL);
+    // On failure the writes may still be reading A and x, which the caller owns
+    if (err != CL_SUCCESS)
+        clFinish(runtime.queue);
+    return err;
+}
+
+gemv_device gemv_plan_device(const gemv_plan *plan)
+{
+    return plan->device;
+}
+
+const char *gemv_plan_describe(const gemv_plan *plan)
+{
+    return plan->description;
+}
@@ -0,0 +1,77 @@
+// Reusable GEMV plans, in the style of an FFTW plan:
+//
+//     gemv_plan *plan = gemv_plan_create(M, N, GEMV_INT8, GEMV_DEVICE_AUTO);
+//     gemv_plan_set_quant(plan, &quant);
+//     for (...)
+//         gemv_execute(plan, A, x, y);
+//     gemv_plan_destroy(plan);
+//
+// The OpenCL platform, device, context, queue and the built programs are
+// created once per process and shared by all plans (until gemv_shutdown()).
+// A plan owns its kernel, the local size tuned for its shape and its device
+// buffers, so gemv_execute() only transfers data and launches.
+// Plans are not thread-safe: use one plan per thread.
+
+#ifndef GEMV_PLAN_H
+#define GEMV_PLAN_H
+
+#include <stddef.h>
+#include "gemv.h"
+#include "gemv_sparse.h"
+
+typedef enum {
+    GEMV_DEVICE_AUTO,   // the first OpenCL GPU, else the CPU backend
+    GEMV_DEVICE_GPU,    // fail if there is no OpenCL GPU
+    GEMV_DEVICE_CPU     // native CPU backend (gemv_cpu.h)
+} gemv_device;
+
+typedef struct gemv_plan gemv_plan;
+
+// Dense M x N plan. Returns NULL on failure (e.g. GEMV_DEVICE_GPU without a GPU).
+gemv_plan *gemv_plan_create(size_t M, size_t N, gemv_dtype dtype, gemv_device device);
+
+// Sparse plan. The matrix is uploaded once (GPU) or referenced (CPU, so csr
+// must outlive the plan); execute with A == NULL.
+gemv_plan *gemv_plan_create_csr(const gemv_csr *csr, gemv_device device);
+
+void gemv_plan_destroy(gemv_plan *plan);
+
+// Output scaling, identity by default. Changing the rounding mode switches
+// to another cached program.
+int gemv_plan_set_quant(gemv_plan *plan, const gemv_quant *q);
+
+// Force a kernel variant instead of the tuned choice (GPU plans only):
+// "gemv_item" or "gemv_wg" for dense plans, "gemv_csr_vector" for CSR-vector
+// sparse plans. Returns 0, or a negative code if the variant does not apply.
+int gemv_plan_set_kernel(gemv_plan *plan, const char *kernel, size_t local);
+
+// Keep A resident, so that gemv_execute() can be called with A == NULL.
+int gemv_plan_set_matrix(gemv_plan *plan, const void *A);
+
+// y = quantize(A * x). A may be NULL if the plan holds a resident matrix,
+// and must be for a sparse plan (CL_INVALID_VALUE otherwise).
+// Returns 0 or a negative (OpenCL) error code.
+int gemv_execute(gemv_plan *plan, const void *A, const void *x, void *y);
+
+// Backend the plan resolved to (GEMV_DEVICE_GPU or GEMV_DEVICE_CPU).
+gemv_device gemv_plan_device(const gemv_plan *plan);
+
+// Human-readable kernel choice, e.g. "gemv_wg local=128".
+const char *gemv_plan_describe(const gemv_plan *plan);
+
+// Start setting up the backend on a background thread: the OpenCL device
+// and the programs a dtype plan needs (tuned with identity scaling, then run
+// with the given rounding), or the CPU thread pool. The caller goes on
+// loading its inputs meanwhile; creating a plan waits for the warm-up only
+// when it needs the device. Returns 0, or -1 if the thread could not start
+// (plans then set up on first use as usual). Call from one thread.
+int gemv_warmup(gemv_dtype dtype, gemv_rounding rounding, gemv_device device);
+
+// Wait for a warm-up started by gemv_warmup(), if any.
+void gemv_warmup_wait(void);
+
+// Release the shared OpenCL objects and the CPU thread pool. All plans must
+// have been destroyed.
+void gemv_shutdown(void);
+
+#endif
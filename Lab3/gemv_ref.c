@@ -0,0 +1,171 @@
+// CPU reference implementations of the gemv.cl kernels.
+//
+// Integer types are exact, so the device results must match bit for bit.
+// Floating point types only differ by summation order.
+// The SIMD paths are selected at compile time (build with -march=native or
+// -mavx2 -mfma -mf16c); the scalar loops define the semantics.
+
+#include <stdlib.h>
+#include "gemv.h"
+#include "gemv_simd.h"
+
+int32_t gemv_dot_i8(const int8_t *a, const int8_t *x, size_t n)
+{
+    size_t i = 0;
+    int32_t sum = 0;
+#if defined(__AVX2__)
+    // sign-extend 16 bytes to int16, then madd pairs into int32 lanes
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i vx = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(x + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vx));
+    }
+    sum = hsum_epi32(acc);
+#endif
+    // wrap-around like the int accumulator on the device
+    for (; i < n; i++)
+        sum = (int32_t)((uint32_t)sum + (uint32_t)(a[i] * x[i]));
+    return sum;
+}
+
+int64_t gemv_dot_i16(const int16_t *a, const int16_t *x, size_t n)
+{
+    size_t i = 0;
+    int64_t sum = 0;
+#if defined(__AVX2__)
+    // int16 * int16 always fits in int32; widen each product to int64
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+        __m256i va = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i vx = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(x + i)));
+        __m256i p = _mm256_mullo_epi32(va, vx);
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p)));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1)));
+    }
+    sum = hsum_epi64(acc);
+#endif
+    for (; i < n; i++)
+        sum += (int64_t)a[i] * x[i];
+    return sum;
+}
+
+int64_t gemv_dot_i32(const int32_t *a, const int32_t *x, size_t n)
+{
+    size_t i = 0;
+    int64_t sum = 0;
+#if defined(__AVX2__)
+    // _mm256_mul_epi32 multiplies the even lanes to int64; shift odd lanes down for the rest
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vx = _mm256_loadu_si256((const __m256i *)(x + i));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(va, vx));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(_mm256_srli_epi64(va, 32), _mm256_srli_epi64(vx, 32)));
+    }
+    sum = hsum_epi64(acc);
+#endif
+    for (; i < n; i++)
+        sum += (int64_t)a[i] * x[i];
+    return sum;
+}
+
+float gemv_dot_f16(const uint16_t *a, const uint16_t *x, size_t n)
+{
+    size_t i = 0;
+    float sum = 0.0f;
+#if defined(__AVX2__) && defined(__F16C__) && defined(__FMA__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 va = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256 vx = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(x + i)));
+        acc = _mm256_fmadd_ps(va, vx, acc);
+    }
+    sum = hsum_ps(acc);
+#endif
+    for (; i < n; i++)
+        sum += gemv_half_to_float(a[i]) * gemv_half_to_float(x[i]);
+    return sum;
+}
+
+float gemv_dot_f32(const float *a, const float *x, size_t n)
+{
+    size_t i = 0;
+    float sum = 0.0f;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(x + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(x + i + 8), acc1);
+    }
+    sum = hsum_ps(_mm256_add_ps(acc0, acc1));
+#endif
+    for (; i < n; i++)
+        sum += a[i] * x[i];
+    return sum;
+}
+
+// acc * multiplier needs up to 95 bits, so the product is formed as a
+// 128-bit magnitude (hi:lo) from 32-bit halves of |acc|, rounded and shifted
+// there, and only then saturated. gemv.cl does the same in ulong.
+int32_t gemv_quantize_acc(int64_t acc, const gemv_quant *q)
+{
+    int negative = (acc < 0) != (q->multiplier < 0);
+    uint64_t a = acc < 0 ? 0 - (uint64_t)acc : (uint64_t)acc;
+    uint64_t m = q->multiplier < 0 ? 0 - (uint64_t)(int64_t)q->multiplier : (uint64_t)q->multiplier;
+    uint64_t low = (a & 0xffffffffu) * m;
+    uint64_t mid = (a >> 32) * m;
+    uint64_t lo = low + (mid << 32);
+    uint64_t hi = (mid >> 32) + (lo < low);
+    uint64_t bias = 0;
+
+    switch (q->rounding) {
+    case GEMV_ROUND_NEAREST:
+        bias = q->shift > 0 ? (uint64_t)1 << (q->shift - 1) : 0;
+        break;
+    case GEMV_ROUND_FLOOR:
+        bias = negative ? ((uint64_t)1 << q->shift) - 1 : 0;
+        break;
+    default:
+        break;
+    }
+    lo += bias;
+    hi += lo < bias;
+
+    uint64_t mag = q->shift > 0 ? (lo >> q->shift) | (hi << (64 - q->shift)) : lo;
+    if ((q->shift > 0 ? hi >> q->shift : hi) != 0 || mag > (negative ? (uint64_t)1 << 31 : INT32_MAX))
+        return negative ? INT32_MIN : INT32_MAX;
+    return negative ? (int32_t)-(int64_t)mag : (int32_t)mag;
+}
+
+void gemv_ref_rows(gemv_dtype dtype, const gemv_quant *q, size_t cols,
+                   const void *a, const void *x, void *y,
+                   size_t row_begin, size_t row_end)
+{
+    for (size_t r = row_begin; r < row_end; r++) {
+        switch (dtype) {
+        case GEMV_INT8:
+            ((int32_t *)y)[r] = gemv_quantize_acc(gemv_dot_i8((const int8_t *)a + r * cols, x, cols), q);
+            break;
+        case GEMV_INT16:
+            ((int32_t *)y)[r] = gemv_quantize_acc(gemv_dot_i16((const int16_t *)a + r * cols, x, cols), q);
+            break;
+        case GEMV_INT32:
+            ((int32_t *)y)[r] = gemv_quantize_acc(gemv_dot_i32((const int32_t *)a + r * cols, x, cols), q);
+            break;
+        case GEMV_FP16:
+            ((float *)y)[r] = gemv_dot_f16((const uint16_t *)a + r * cols, x, cols) * q->scale;
+            break;
+        case GEMV_FP32:
+            ((float *)y)[r] = gemv_dot_f32((const float *)a + r * cols, x, cols) * q->scale;
+            break;
+        }
+    }
+}
+
+void gemv_ref(gemv_dtype dtype, const gemv_quant *q, size_t rows, size_t cols,
+              const void *a, const void *x, void *y)
+{
+    gemv_ref_rows(dtype, q, cols, a, x, y, 0, rows);
+}
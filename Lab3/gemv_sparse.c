@@ -0,0 +1,365 @@
+// Sparse matrix storage and CPU reference for the CSR / SELL-C-sigma GEMV kernels.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gemv_sparse.h"
+
+int gemv_csr_from_dense(gemv_csr *csr, gemv_dtype dtype, const float *dense,
+                        uint32_t rows, uint32_t cols, float threshold, float scale)
+{
+    memset(csr, 0, sizeof(*csr));
+    csr->dtype = dtype;
+    csr->rows = rows;
+    csr->cols = cols;
+
+    // First pass: count the kept entries of every row
+    csr->row_ptr = malloc(((size_t)rows + 1) * sizeof(uint32_t));
+    if (csr->row_ptr == NULL)
+        return -1;
+
+    uint32_t nnz = 0;
+    for (uint32_t r = 0; r < rows; r++) {
+        csr->row_ptr[r] = nnz;
+        for (uint32_t c = 0; c < cols; c++) {
+            if (fabsf(dense[(size_t)r * cols + c]) > threshold)
+                nnz++;
+        }
+    }
+    csr->row_ptr[rows] = nnz;
+    csr->nnz = nnz;
+
+    // Second pass: gather columns and values, then quantize the values
+    float *kept = malloc((nnz ? nnz : 1) * sizeof(float));
+    csr->col_idx = malloc((nnz ? nnz : 1) * sizeof(uint32_t));
+    csr->values = malloc((nnz ? nnz : 1) * gemv_dtype_size(dtype));
+    if (kept == NULL || csr->col_idx == NULL || csr->values == NULL) {
+        free(kept);
+        gemv_csr_free(csr);
+        return -1;
+    }
+
+    uint32_t k = 0;
+    for (uint32_t r = 0; r < rows; r++) {
+        for (uint32_t c = 0; c < cols; c++) {
+            float v = dense[(size_t)r * cols + c];
+            if (fabsf(v) > threshold) {
+                csr->col_idx[k] = c;
+                kept[k] = v;
+                k++;
+            }
+        }
+    }
+    gemv_quantize_input(dtype, kept, nnz, scale, csr->values);
+    free(kept);
+
+    return 0;
+}
+
+int gemv_csr_read_binary(gemv_csr *csr, const char *filename)
+{
+    FILE *file;
+    char magic[4];
+    uint32_t header[4];
+
+    memset(csr, 0, sizeof(*csr));
+
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        printf("Error opening file %s.\n", filename);
+        return -1;
+    }
+
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, "CSR1", 4) != 0
+        || fread(header, sizeof(uint32_t), 4, file) != 4 || header[3] > GEMV_FP32) {
+        printf("%s is not a CSR file.\n", filename);
+        fclose(file);
+        return -1;
+    }
+
+    csr->rows = header[0];
+    csr->cols = header[1];
+    csr->nnz = header[2];
+    csr->dtype = (gemv_dtype)header[3];
+
+    size_t nnz = csr->nnz ? csr->nnz : 1;
+    csr->row_ptr = malloc(((size_t)csr->rows + 1) * sizeof(uint32_t));
+    csr->col_idx = malloc(nnz * sizeof(uint32_t));
+    csr->values = malloc(nnz * gemv_dtype_size(csr->dtype));
+
+    if (csr->row_ptr == NULL || csr->col_idx == NULL || csr->values == NULL
+        || fread(csr->row_ptr, sizeof(uint32_t), csr->rows + 1, file) != csr->rows + 1
+        || fread(csr->col_idx, sizeof(uint32_t), csr->nnz, file) != csr->nnz
+        || fread(csr->values, gemv_dtype_size(csr->dtype), csr->nnz, file) != csr->nnz
+        || csr->row_ptr[csr->rows] != csr->nnz) {
+        printf("Error reading %s.\n", filename);
+        gemv_csr_free(csr);
+        fclose(file);
+        return -1;
+    }
+
+    // Reject offsets and indices that would make the kernels read out of bounds
+    int valid = 1;
+    for (uint32_t r = 0; r < csr->rows; r++)
+        valid &= csr->row_ptr[r] <= csr->row_ptr[r + 1];
+    for (uint32_t i = 0; i < csr->nnz; i++)
+        valid &= csr->col_idx[i] < csr->cols;
+    if (!valid) {
+        printf("%s: row offsets or column indices out of range.\n", filename);
+        gemv_csr_free(csr);
+        fclose(file);
+        return -1;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int gemv_csr_write_binary(const gemv_csr *csr, const char *filename)
+{
+    FILE *file;
+    uint32_t header[4] = { csr->rows, csr->cols, csr->nnz, (uint32_t)csr->dtype };
+
+    file = fopen(filename, "wb");
+    if (file == NULL) {
+        printf("Error opening file %s.\n", filename);
+        return -1;
+    }
+
+    int ok = fwrite("CSR1", 1, 4, file) == 4
+          && fwrite(header, sizeof(uint32_t), 4, file) == 4
+          && fwrite(csr->row_ptr, sizeof(uint32_t), csr->rows + 1, file) == csr->rows + 1
+          && fwrite(csr->col_idx, sizeof(uint32_t), csr->nnz, file) == csr->nnz
+          && fwrite(csr->values, gemv_dtype_size(csr->dtype), csr->nnz, file) == csr->nnz;
+
+    fclose(file);
+    return ok ? 0 : -1;
+}
+
+void gemv_csr_free(gemv_csr *csr)
+{
+    free(csr->row_ptr);
+    free(csr->col_idx);
+    free(csr->values);
+    csr->row_ptr = NULL;
+    csr->col_idx = NULL;
+    csr->values = NULL;
+}
+
+// Sort key: longest rows first, original order among equal lengths.
+static int compare_keys(const void *a, const void *b)
+{
+    uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+    return (ka > kb) - (ka < kb);
+}
+
+static uint32_t row_length(const gemv_csr *csr, uint32_t r)
+{
+    return csr->row_ptr[r + 1] - csr->row_ptr[r];
+}
+
+// Fill perm with the sigma-window sorted row order (nslices * chunk entries).
+static int sell_permutation(const gemv_csr *csr, uint32_t chunk, uint32_t sigma,
+                            uint32_t nslices, uint32_t *perm)
+{
+    uint32_t padded = nslices * chunk;
+    uint64_t *keys = malloc((size_t)sigma * sizeof(uint64_t));
+    if (keys == NULL)
+        return -1;
+
+    for (uint32_t w = 0; w < padded; w += sigma) {
+        uint32_t n = 0;
+        for (uint32_t r = w; r < w + sigma && r < csr->rows; r++)
+            keys[n++] = ((uint64_t)(UINT32_MAX - row_length(csr, r)) << 32) | r;
+        qsort(keys, n, sizeof(uint64_t), compare_keys);
+
+        for (uint32_t i = 0; i < sigma && w + i < padded; i++)
+            perm[w + i] = i < n ? (uint32_t)keys[i] : csr->rows;
+    }
+
+    free(keys);
+    return 0;
+}
+
+int gemv_sell_from_csr(gemv_sell *sell, const gemv_csr *csr, uint32_t chunk, uint32_t sigma)
+{
+    memset(sell, 0, sizeof(*sell));
+    if (chunk == 0)
+        chunk = 1;
+    if (sigma < chunk)
+        sigma = chunk;
+    sigma = (sigma + chunk - 1) / chunk * chunk;
+
+    sell->dtype = csr->dtype;
+    sell->rows = csr->rows;
+    sell->cols = csr->cols;
+    sell->chunk = chunk;
+    sell->sigma = sigma;
+    sell->nslices = (csr->rows + chunk - 1) / chunk;
+
+    size_t padded = (size_t)sell->nslices * chunk;
+    sell->row_perm = malloc((padded ? padded : 1) * sizeof(uint32_t));
+    sell->slice_ptr = malloc(((size_t)sell->nslices + 1) * sizeof(uint32_t));
+    sell->slice_width = malloc((sell->nslices ? sell->nslices : 1) * sizeof(uint32_t));
+    if (sell->row_perm == NULL || sell->slice_ptr == NULL || sell->slice_width == NULL
+        || sell_permutation(csr, chunk, sigma, sell->nslices, sell->row_perm) != 0) {
+        gemv_sell_free(sell);
+        return -1;
+    }
+
+    // Slice widths and offsets
+    uint32_t stored = 0;
+    for (uint32_t s = 0; s < sell->nslices; s++) {
+        uint32_t width = 0;
+        for (uint32_t lane = 0; lane < chunk; lane++) {
+            uint32_t r = sell->row_perm[s * chunk + lane];
+            if (r < csr->rows && row_length(csr, r) > width)
+                width = row_length(csr, r);
+        }
+        sell->slice_ptr[s] = stored;
+        sell->slice_width[s] = width;
+        stored += width * chunk;
+    }
+    sell->slice_ptr[sell->nslices] = stored;
+
+    // Scatter the entries column-major inside each slice; padding stays zero
+    size_t esize = gemv_dtype_size(csr->dtype);
+    sell->col_idx = calloc(stored ? stored : 1, sizeof(uint32_t));
+    sell->values = calloc(stored ? stored : 1, esize);
+    if (sell->col_idx == NULL || sell->values == NULL) {
+        gemv_sell_free(sell);
+        return -1;
+    }
+
+    for (uint32_t s = 0; s < sell->nslices; s++) {
+        for (uint32_t lane = 0; lane < chunk; lane++) {
+            uint32_t r = sell->row_perm[s * chunk + lane];
+            if (r >= csr->rows)
+                continue;
+            for (uint32_t j = 0; j < row_length(csr, r); j++) {
+                size_t src = csr->row_ptr[r] + j;
+                size_t dst = sell->slice_ptr[s] + (size_t)j * chunk + lane;
+                sell->col_idx[dst] = csr->col_idx[src];
+                memcpy((char *)sell->values + dst * esize, (const char *)csr->values + src * esize, esize);
+            }
+        }
+    }
+
+    return 0;
+}
+
+void gemv_sell_free(gemv_sell *sell)
+{
+    free(sell->slice_ptr);
+    free(sell->slice_width);
+    free(sell->row_perm);
+    free(sell->col_idx);
+    free(sell->values);
+    memset(sell, 0, sizeof(*sell));
+}
+
+size_t gemv_sell_stored(const gemv_sell *sell)
+{
+    return sell->slice_ptr ? sell->slice_ptr[sell->nslices] : 0;
+}
+
+void gemv_csr_row_stats(const gemv_csr *csr, gemv_row_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (csr->rows == 0)
+        return;
+
+    double sum = 0, sumsq = 0;
+    for (uint32_t r = 0; r < csr->rows; r++) {
+        uint32_t len = row_length(csr, r);
+        sum += len;
+        sumsq += (double)len * len;
+        if (len > stats->max)
+            stats->max = len;
+        if (len == 0)
+            stats->empty++;
+    }
+
+    stats->mean = sum / csr->rows;
+    stats->stddev = sqrt(fmax(0.0, sumsq / csr->rows - stats->mean * stats->mean));
+    stats->density = csr->cols ? sum / ((double)csr->rows * csr->cols) : 0.0;
+}
+
+gemv_sparse_kernel gemv_sparse_choose(const gemv_csr *csr, uint32_t chunk, uint32_t sigma)
+{
+    gemv_row_stats stats;
+    gemv_csr_row_stats(csr, &stats);
+
+    // Long rows keep a whole work-group busy and read A fully coalesced
+    if (stats.mean >= 32)
+        return GEMV_SPARSE_CSR_VECTOR;
+
+    // Regular rows: SELL wastes nothing on padding
+    if (stats.stddev <= 0.25 * stats.mean)
+        return GEMV_SPARSE_SELL;
+
+    // Irregular short rows: SELL only pays off if sorting keeps the padding low
+    gemv_sell sell;
+    if (gemv_sell_from_csr(&sell, csr, chunk, sigma) != 0)
+        return GEMV_SPARSE_CSR_VECTOR;
+    double efficiency = gemv_sell_stored(&sell) ? (double)csr->nnz / gemv_sell_stored(&sell) : 1.0;
+    gemv_sell_free(&sell);
+
+    return efficiency >= 0.5 ? GEMV_SPARSE_SELL : GEMV_SPARSE_CSR_VECTOR;
+}
+
+void gemv_csr_ref_rows(const gemv_csr *csr, const gemv_quant *q, const void *x, void *y,
+                       uint32_t row_begin, uint32_t row_end)
+{
+    for (uint32_t r = row_begin; r < row_end; r++) {
+        uint32_t begin = csr->row_ptr[r], end = csr->row_ptr[r + 1];
+        switch (csr->dtype) {
+        case GEMV_INT8: {
+            const int8_t *v = csr->values, *xv = x;
+            uint32_t acc = 0;   // wraps like the device int accumulator
+            for (uint32_t k = begin; k < end; k++)
+                acc += (uint32_t)(v[k] * xv[csr->col_idx[k]]);
+            ((int32_t *)y)[r] = gemv_quantize_acc((int32_t)acc, q);
+            break;
+        }
+        case GEMV_INT16: {
+            const int16_t *v = csr->values, *xv = x;
+            int64_t acc = 0;
+            for (uint32_t k = begin; k < end; k++)
+                acc += (int64_t)v[k] * xv[csr->col_idx[k]];
+            ((int32_t *)y)[r] = gemv_quantize_acc(acc, q);
+            break;
+        }
+        case GEMV_INT32: {
+            const int32_t *v = csr->values, *xv = x;
+            int64_t acc = 0;
+            for (uint32_t k = begin; k < end; k++)
+                acc += (int64_t)v[k] * xv[csr->col_idx[k]];
+            ((int32_t *)y)[r] = gemv_quantize_acc(acc, q);
+            break;
+        }
+        case GEMV_FP16: {
+            const uint16_t *v = csr->values, *xv = x;
+            float acc = 0.0f;
+            for (uint32_t k = begin; k < end; k++)
+                acc += gemv_half_to_float(v[k]) * gemv_half_to_float(xv[csr->col_idx[k]]);
+            ((float *)y)[r] = acc * q->scale;
+            break;
+        }
+        case GEMV_FP32: {
+            const float *v = csr->values, *xv = x;
+            float acc = 0.0f;
+            for (uint32_t k = begin; k < end; k++)
+                acc += v[k] * xv[csr->col_idx[k]];
+            ((float *)y)[r] = acc * q->scale;
+            break;
+        }
+        }
+    }
+}
+
+void gemv_csr_ref(const gemv_csr *csr, const gemv_quant *q, const void *x, void *y)
+{
+    gemv_csr_ref_rows(csr, q, x, y, 0, csr->rows);
+}
@@ -0,0 +1,80 @@
+// Sparse GEMV: CSR and SELL-C-sigma storage for y = quantize(A * x)
+//
+// The kernels (gemv_csr_vector, gemv_sell) are in gemv.cl and share its
+// element types and quantization; values are stored in the gemv_dtype of
+// the matrix. Plain ELL is SELL with a single slice (chunk = rows, sigma = 1).
+
+#ifndef GEMV_SPARSE_H
+#define GEMV_SPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gemv.h"
+
+typedef struct {
+    gemv_dtype dtype;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t nnz;
+    uint32_t *row_ptr;      // rows + 1 offsets into col_idx / values
+    uint32_t *col_idx;      // nnz column indices
+    void *values;           // nnz elements of dtype
+} gemv_csr;
+
+typedef struct {
+    gemv_dtype dtype;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t chunk;         // C: rows per slice
+    uint32_t sigma;         // rows are sorted by length inside windows of sigma rows
+    uint32_t nslices;
+    uint32_t *slice_ptr;    // nslices + 1 offsets into col_idx / values
+    uint32_t *slice_width;  // padded row length of each slice
+    uint32_t *row_perm;     // slice position -> original row (nslices * chunk, padded with rows)
+    uint32_t *col_idx;      // column-major within a slice, padding points at column 0
+    void *values;           // padding is zero
+} gemv_sell;
+
+typedef struct {
+    double mean;            // mean nonzeros per row
+    double stddev;
+    uint32_t max;
+    uint32_t empty;         // rows without nonzeros
+    double density;         // nnz / (rows * cols)
+} gemv_row_stats;
+
+typedef enum {
+    GEMV_SPARSE_CSR_VECTOR, // one work-group per row, local reduction
+    GEMV_SPARSE_SELL        // one work-item per row, slice-coalesced loads
+} gemv_sparse_kernel;
+
+// Build a CSR matrix from dense row-major float data, dropping entries with
+// |v| <= threshold, and quantize the kept values with gemv_quantize_input().
+int gemv_csr_from_dense(gemv_csr *csr, gemv_dtype dtype, const float *dense,
+                        uint32_t rows, uint32_t cols, float threshold, float scale);
+
+// Binary CSR file: "CSR1", rows, cols, nnz, dtype (uint32 little endian each),
+// then row_ptr, col_idx and the values in the stored type.
+int gemv_csr_read_binary(gemv_csr *csr, const char *filename);
+int gemv_csr_write_binary(const gemv_csr *csr, const char *filename);
+void gemv_csr_free(gemv_csr *csr);
+
+// Convert CSR to SELL-C-sigma. sigma is rounded up to a multiple of chunk.
+int gemv_sell_from_csr(gemv_sell *sell, const gemv_csr *csr, uint32_t chunk, uint32_t sigma);
+void gemv_sell_free(gemv_sell *sell);
+
+// Number of stored (padded) entries in a SELL matrix.
+size_t gemv_sell_stored(const gemv_sell *sell);
+
+void gemv_csr_row_stats(const gemv_csr *csr, gemv_row_stats *stats);
+
+// Pick the kernel from the row-length statistics. The SELL padding of the
+// given chunk/sigma is taken into account when rows are irregular.
+gemv_sparse_kernel gemv_sparse_choose(const gemv_csr *csr, uint32_t chunk, uint32_t sigma);
+
+// CPU reference for rows [row_begin, row_end), same semantics as gemv_ref().
+void gemv_csr_ref_rows(const gemv_csr *csr, const gemv_quant *q, const void *x, void *y,
+                       uint32_t row_begin, uint32_t row_end);
+void gemv_csr_ref(const gemv_csr *csr, const gemv_quant *q, const void *x, void *y);
+
+#endif
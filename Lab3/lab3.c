@@ -1,42 +1,25 @@
 // Program courtesy : Oak Ridge National Labs (with modifications)
 
-#define CL_TARGET_OPENCL_VERSION 120
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
-#include <CL/opencl.h>
 #include <sys/time.h>
 #include <string.h>
 #include <stdbool.h>
-
-#define BUFFER_SIZE 1024
-
-// OpenCL kernel. Each work item takes care of one element of c
-// The kernel code is supplied as a string. This could be read from a text file (with extension .cl) using file I/O instead.
-const char *kernelSource =                                       "\n" \
-"#pragma OPENCL EXTENSION cl_khr_fp64 : enable                    \n" \
-"__kernel void matrixMul(  __global int *a,                       \n" \
-"                          __global int *b,                       \n" \
-"                          __global int *c,                       \n" \
-"                          const unsigned int width)              \n" \
-"{                                                                \n" \
-"    //Get our global thread ID                                   \n" \
-"    int id = get_global_id(0);                                   \n" \
-"                                                                 \n" \
-"    //Make sure we do not go out of bounds                       \n" \
-"                                                                 \n" \
-"        for (int i = 0; i < width ; i++) {                       \n" \
-"            c[id] += a[id * width + i] * b[i]/256;               \n" \
-"        }                                                        \n" \
-"}                                                                \n" \
-                                                                 "\n" ;
-
-
-// note : cl_khr_fp64 is needed for double precision floating point, but not for single precision
-// I have used single precision here since intel integrated GPUs don't support double precision
-// you can see the supported extensions via clinfo
-
-
+#include "gemv.h"
+#include "gemv_sparse.h"
+#include "gemv_plan.h"
+
+// The GEMV kernels are read from gemv.cl and specialised per element type
+// through build options (-DGEMV_INT8, -DGEMV_FP16, ...), see gemv.h. The
+// OpenCL setup and kernel choice live in a reusable plan, see gemv_plan.h.
+//
+// Build: gcc -O2 -march=native lab3.c gemv.c gemv_ref.c gemv_sparse.c gemv_cpu.c gemv_plan.c -o lab3 -lOpenCL -lm -lpthread
+// Usage: ./lab3 [-t int8|int16|int32|fp16|fp32] [-s threshold | -a A.csr] [-c] [-n repeats]
+//   -s  sparse mode: A.csv is converted to CSR, dropping entries with |a| <= threshold
+//   -a  sparse mode with A read from a binary CSR file (its stored type overrides -t)
+//   -c  use the native CPU backend (also used automatically when there is no OpenCL GPU)
+//   -n  execute the plan this many times and report the time per multiply
 
 #define BUFFER_SIZE 1024
 
@@ -85,34 +68,77 @@ int main( int argc, char* argv[] )
     unsigned int row = 64;
     unsigned int col = 8;
 
-    // Host input vectors
+    // Element type of A and B on the device
+    gemv_dtype dtype = GEMV_INT32;
+
+    // Sparse mode: A is dense CSV thresholded to CSR, or a binary CSR file
+    bool sparse = false;
+    bool forceCpu = false;
+    int repeats = 1;
+    float threshold = 0.0f;
+    const char *csrFile = NULL;
+    gemv_csr csr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            if (gemv_dtype_from_name(argv[++i], &dtype) != 0) {
+                printf("Unknown type %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            sparse = true;
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            sparse = true;
+            csrFile = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0) {
+            forceCpu = true;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+            if (repeats < 1)
+                repeats = 1;
+        }
+    }
+
+    // Set up the backend and build the kernels in the background while the
+    // inputs are read; the plan only waits for them when it is created.
+    // A CSR file may still change the type, and then its program is built
+    // with the plan.
+    gemv_device device = forceCpu ? GEMV_DEVICE_CPU : GEMV_DEVICE_AUTO;
+    gemv_warmup(dtype, dtype == GEMV_INT32 ? gemv_quant_identity().rounding : GEMV_ROUND_NEAREST, device);
+
+    if (csrFile != NULL) {
+        if (gemv_csr_read_binary(&csr, csrFile) != 0)
+            return EXIT_FAILURE;
+        if (csr.rows != row || csr.cols != col) {
+            printf("%s is %ux%u, expected %ux%u\n", csrFile, csr.rows, csr.cols, row, col);
+            return EXIT_FAILURE;
+        }
+        dtype = csr.dtype;
+    }
+
+    // Host input vectors (as read from the CSV files)
     int *h_a;
     int *h_b;
-    // Host output vector
-    int *h_c;
-
-    // Device input buffers
-    cl_mem d_a;
-    cl_mem d_b;
-    // Device output buffer
-    cl_mem d_c;
-
-    cl_platform_id cpPlatform;        // OpenCL platform
-    cl_device_id device_id;           // device ID
-    cl_context context;               // context
-    cl_command_queue queue;           // command queue
-    cl_program program;               // program
-    cl_kernel kernel;                 // kernel
+    // Host input vectors converted to the device element type
+    void *h_qa;
+    void *h_qb;
+    // Host output vector and CPU reference
+    void *h_c;
+    void *h_ref;
 
     // Size, in bytes, of each vector
-    size_t bytes_a = row*col*sizeof(int);
-    size_t bytes_b = col*sizeof(int);
-    size_t bytes_c = row*sizeof(int);
+    size_t bytes_a = row*col*gemv_dtype_size(dtype);
+    size_t bytes_b = col*gemv_dtype_size(dtype);
+    size_t bytes_c = row*gemv_output_size(dtype);
 
     // Allocate memory for each vector on host
-    h_a = (int*)malloc(bytes_a);
-    h_b = (int*)malloc(bytes_b);
-    h_c = (int*)malloc(bytes_c);
+    h_a = (int*)malloc(row*col*sizeof(int));
+    h_b = (int*)malloc(col*sizeof(int));
+    h_qa = malloc(bytes_a);
+    h_qb = malloc(bytes_b);
+    h_c = malloc(bytes_c);
+    h_ref = malloc(bytes_c);
 
     // Initialize vectors on host
     read_csv("A.csv", h_a, 64, 8);
@@ -132,65 +158,58 @@ int main( int argc, char* argv[] )
     }
     printf("\n");
 
-    size_t globalSize, localSize;
-    cl_int err;
-
-    // Number of work items in each local work group
-    localSize = 64;
-
-    // Number of total work items - localSize must be devisor
-    globalSize = ceil(row/(int)localSize)*localSize;
-
-    // Bind to platform
-    err = clGetPlatformIDs(1, &cpPlatform, NULL);
-
-    // Get ID for the device
-    err = clGetDeviceIDs(cpPlatform, CL_DEVICE_TYPE_GPU, 1, &device_id, NULL);
-
-    // Create a context
-    context = clCreateContext(0, 1, &device_id, NULL, NULL, &err);
-
-    // Create a command queue
-    queue = clCreateCommandQueue(context, device_id, 0, &err);
-
-    // Create the compute program from the source buffer
-    program = clCreateProgramWithSource(context, 1,
-                            (const char **) & kernelSource, NULL, &err);
-
-    // Build the program executable
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
-
-    // to print error info if your program doesn't compile - courtesy stackoverflow.
-    if (err != CL_SUCCESS) {
-    char *buff_erro;
-    cl_int errcode;
-    size_t build_log_len;
-    errcode = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &build_log_len);
-    if (errcode) {
-                printf("clGetProgramBuildInfo failed at line %d\n", __LINE__);
-                exit(-1);
-            }
-
-        buff_erro = malloc(build_log_len);
-        if (!buff_erro) {
-            printf("malloc failed at line %d\n", __LINE__);
-            exit(-2);
-        }
-
-        errcode = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, build_log_len, buff_erro, NULL);
-        if (errcode) {
-            printf("clGetProgramBuildInfo failed at line %d\n", __LINE__);
-            exit(-3);
-        }
-
-        fprintf(stderr,"Build log: \n%s\n", buff_erro); //Be careful with  the fprint
-        free(buff_erro);
-        fprintf(stderr,"clBuildProgram failed\n");
-        exit(EXIT_FAILURE);
+    // Quantize the inputs to the device element type. The result is
+    // c = A*B/256; for int8/int16 the input scales are folded into the
+    // fixed-point output multiplier.
+    float *f_a = (float*)malloc(row*col*sizeof(float));
+    float *f_b = (float*)malloc(col*sizeof(float));
+    for (unsigned int i = 0; i < row*col; i++)
+        f_a[i] = (float)h_a[i];
+    for (unsigned int i = 0; i < col; i++)
+        f_b[i] = (float)h_b[i];
+
+    float scale_a = gemv_input_scale(dtype, f_a, row*col);
+    float scale_b = gemv_input_scale(dtype, f_b, col);
+    gemv_quantize_input(dtype, f_a, row*col, scale_a, h_qa);
+    gemv_quantize_input(dtype, f_b, col, scale_b, h_qb);
+
+    // A binary CSR file already holds quantized values (scale 1)
+    if (csrFile != NULL) {
+        scale_a = 1.0f;
+    } else if (sparse && gemv_csr_from_dense(&csr, dtype, f_a, row, col, threshold, scale_a) != 0) {
+        printf("Failed to build the CSR matrix\n");
+        return EXIT_FAILURE;
+    }
+    if (sparse) {
+        gemv_row_stats stats;
+        gemv_csr_row_stats(&csr, &stats);
+        printf("sparse: density %.3f, row length mean %.2f stddev %.2f max %u\n",
+               stats.density, stats.mean, stats.stddev, stats.max);
+    }
+    free(f_a);
+    free(f_b);
+
+    gemv_quant quant;
+    if (dtype == GEMV_INT32) {
+        quant = gemv_quant_identity();
+        quant.shift = 8;
+    } else {
+        quant = gemv_quant_from_scale((double)scale_a * scale_b / 256.0, GEMV_ROUND_NEAREST);
     }
 
-    // Create the compute kernel in the program we wish to run
-    kernel = clCreateKernel(program, "matrixMul", &err);
+    // Plan once: device setup, program build, kernel choice and buffers.
+    // The OpenCL GPU is used if there is one, the native CPU backend otherwise.
+    gemv_plan *plan = sparse ? gemv_plan_create_csr(&csr, device)
+                             : gemv_plan_create(row, col, dtype, device);
+    if (plan == NULL) {
+        printf("Failed to create the GEMV plan\n");
+        return EXIT_FAILURE;
+    }
+    gemv_plan_set_quant(plan, &quant);
+    if (!sparse)
+        gemv_plan_set_matrix(plan, h_qa);
+    printf("%s backend: %s\n", gemv_plan_device(plan) == GEMV_DEVICE_GPU ? "GPU" : "CPU",
+           gemv_plan_describe(plan));
 
     // note down the time before the accelerator overhead starts
     struct timeval time_curr;
@@ -198,31 +217,13 @@ int main( int argc, char* argv[] )
     gettimeofday(&time_curr, NULL);
     time1 = time_curr.tv_sec * (int)1e6 + time_curr.tv_usec;
 
-    // Create the input and output arrays in device memory for our calculation
-    d_a = clCreateBuffer(context, CL_MEM_READ_ONLY,  bytes_a, NULL, NULL);
-    d_b = clCreateBuffer(context, CL_MEM_READ_ONLY,  bytes_b, NULL, NULL);
-    d_c = clCreateBuffer(context, CL_MEM_WRITE_ONLY, bytes_c, NULL, NULL);
-
-    // Write our data set into the input array in device memory
-    err  = clEnqueueWriteBuffer(queue, d_a, CL_TRUE, 0, bytes_a, h_a, 0, NULL, NULL);
-    err |= clEnqueueWriteBuffer(queue, d_b, CL_TRUE, 0, bytes_b, h_b, 0, NULL, NULL);
-
-    // Set the arguments to our compute kernel
-    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &d_a);
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_b);
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_c);
-    err |= clSetKernelArg(kernel, 3, sizeof(unsigned int), &col);
-
-    // Execute the kernel over the entire range of the data set
-    err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &globalSize, &localSize,
-                                                              0, NULL, NULL);
-
-    // Wait for the command queue to get serviced before reading back results
-    clFinish(queue);
-
-    // Read the results from the device
-    clEnqueueReadBuffer(queue, d_c, CL_TRUE, 0,
-                                bytes_c, h_c, 0, NULL, NULL );
+    for (int r = 0; r < repeats; r++) {
+        int err = gemv_execute(plan, NULL, h_qb, h_c);
+        if (err != 0) {
+            printf("gemv_execute failed (%d)\n", err);
+            return EXIT_FAILURE;
+        }
+    }
 
     // note down the time after the accelerator is done
     unsigned int time2;
@@ -230,25 +231,43 @@ int main( int argc, char* argv[] )
     time2 = time_curr.tv_sec * (int)1e6 + time_curr.tv_usec;
 
     printf("%d\n", time2-time1);
-
-    //Sum up vector c and print result divided by n, this should equal 1 within error
-    float sum = 0;
-    for(int i=0; i<row; i++)
-        printf("c[%d]=%d\n", i, h_c[i]);
-
-    // release OpenCL resources
-    clReleaseMemObject(d_a);
-    clReleaseMemObject(d_b);
-    clReleaseMemObject(d_c);
-    clReleaseProgram(program);
-    clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
+    if (repeats > 1)
+        printf("%.2f us per multiply over %d runs\n", (double)(time2-time1) / repeats, repeats);
+
+    // Check against the CPU reference: exact for integer types,
+    // up to summation order for floating point types
+    if (sparse)
+        gemv_csr_ref(&csr, &quant, h_qb, h_ref);
+    else
+        gemv_ref(dtype, &quant, row, col, h_qa, h_qb, h_ref);
+
+    int mismatches = 0;
+    for(int i=0; i<row; i++) {
+        if (dtype == GEMV_FP16 || dtype == GEMV_FP32) {
+            float c = ((float*)h_c)[i], ref = ((float*)h_ref)[i];
+            printf("c[%d]=%f\n", i, c);
+            if (fabsf(c - ref) > 1e-3f * fmaxf(1.0f, fabsf(ref)))
+                mismatches++;
+        } else {
+            int c = ((int*)h_c)[i], ref = ((int*)h_ref)[i];
+            printf("c[%d]=%d\n", i, c);
+            if (c != ref)
+                mismatches++;
+        }
+    }
+    printf("%s: %d mismatches against the CPU reference\n", gemv_dtype_name(dtype), mismatches);
 
     //release host memory
     free(h_a);
     free(h_b);
+    free(h_qa);
+    free(h_qb);
     free(h_c);
+    free(h_ref);
+    gemv_plan_destroy(plan);
+    gemv_shutdown();
+    if (sparse)
+        gemv_csr_free(&csr);
 
     return 0;
 }
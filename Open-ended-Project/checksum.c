@@ -0,0 +1,375 @@
+#include <string.h>
+#include "checksum.h"
+
+// -DCHECKSUM_NO_THREADS for targets without pthreads; bare-metal ones have none
+#if !defined(CHECKSUM_NO_THREADS) && (defined(__unix__) || defined(__APPLE__))
+#include <pthread.h>
+#define CHECKSUM_PTHREADS 1
+#endif
+
+// -DCHECKSUM_NO_HW keeps the table implementation on every machine
+#ifndef CHECKSUM_NO_HW
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define CRC32C_SSE42 1
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC32C_SSE42 1
+#define CRC32C_SSE42_DISPATCH 1
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARMV8 1
+#endif
+#endif
+
+#define CRC32C_POLY 0x82F63B78u     // reflected Castagnoli polynomial
+
+static uint32_t load32(const unsigned char *p){
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// =================================================================
+// ------------------------ CRC32C, tables -------------------------
+// =================================================================
+
+static uint32_t crcTable[8][256];
+
+static void crcTableInit(void){
+    for(uint32_t i = 0; i < 256; i++){
+        uint32_t crc = i;
+        for(int b = 0; b < 8; b++){
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crcTable[0][i] = crc;
+    }
+    for(uint32_t i = 0; i < 256; i++){
+        for(int k = 1; k < 8; k++){
+            crcTable[k][i] = (crcTable[k - 1][i] >> 8) ^ crcTable[0][crcTable[k - 1][i] & 0xff];
+        }
+    }
+}
+
+/**
+ * Slicing-by-8: eight table lookups per 8 input bytes.
+ * */
+
+static uint32_t crcSlicing8(uint32_t crc, const unsigned char *p, size_t size){
+    while(size >= 8){
+        uint32_t lo = crc ^ load32(p);
+        uint32_t hi = load32(p + 4);
+        crc = crcTable[7][lo & 0xff] ^ crcTable[6][(lo >> 8) & 0xff]
+            ^ crcTable[5][(lo >> 16) & 0xff] ^ crcTable[4][lo >> 24]
+            ^ crcTable[3][hi & 0xff] ^ crcTable[2][(hi >> 8) & 0xff]
+            ^ crcTable[1][(hi >> 16) & 0xff] ^ crcTable[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while(size-- > 0){
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *p++) & 0xff];
+    }
+    return crc;
+}
+
+// =================================================================
+// ---------------------- CRC32C, instructions ---------------------
+// =================================================================
+
+#ifdef CRC32C_SSE42
+#ifdef CRC32C_SSE42_DISPATCH
+__attribute__((target("sse4.2")))
+#endif
+static uint32_t crcSse42(uint32_t crc, const unsigned char *p, size_t size){
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    while(size >= 8){
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc64 = _mm_crc32_u64(crc64, v);
+        p += 8;
+        size -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while(size >= 4){
+        crc = _mm_crc32_u32(crc, load32(p));
+        p += 4;
+        size -= 4;
+    }
+    while(size-- > 0){
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+#ifdef CRC32C_ARMV8
+static uint32_t crcArmv8(uint32_t crc, const unsigned char *p, size_t size){
+    while(size >= 8){
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        crc = __crc32cd(crc, v);
+        p += 8;
+        size -= 8;
+    }
+    while(size-- > 0){
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+// =================================================================
+// ------------------------ Implementation -------------------------
+// =================================================================
+
+typedef uint32_t (*CrcFunction)(uint32_t crc, const unsigned char *p, size_t size);
+
+static CrcFunction crcImpl;
+static const char *crcImplName;
+
+static void crcSelect(void){
+#ifdef CRC32C_SSE42
+#ifdef CRC32C_SSE42_DISPATCH
+    if(__builtin_cpu_supports("sse4.2"))
+#endif
+    {
+        crcImpl = crcSse42;
+        crcImplName = "sse4.2";
+        return;
+    }
+#endif
+#ifdef CRC32C_ARMV8
+    crcImpl = crcArmv8;
+    crcImplName = "armv8-crc";
+    return;
+#endif
+    crcTableInit();
+    crcImpl = crcSlicing8;
+    crcImplName = "slicing-by-8";
+}
+
+#ifdef CHECKSUM_PTHREADS
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+#define CRC_INIT() pthread_once(&crcOnce, crcSelect)
+#else
+#define CRC_INIT() do { if(crcImpl == NULL) crcSelect(); } while(0)
+#endif
+
+uint32_t checksumCrc32c(uint32_t crc, const void *data, size_t size){
+    CRC_INIT();
+    return ~crcImpl(~crc, (const unsigned char*) data, size);
+}
+
+const char *checksumCrc32cImpl(void){
+    CRC_INIT();
+    return crcImplName;
+}
+
+// =================================================================
+// ----------------------------- XXH32 -----------------------------
+// =================================================================
+
+#define XXH_PRIME1 2654435761u
+#define XXH_PRIME2 2246822519u
+#define XXH_PRIME3 3266489917u
+#define XXH_PRIME4 668265263u
+#define XXH_PRIME5 374761393u
+
+static uint32_t rotl32(uint32_t x, int r){
+    return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxhRound(uint32_t acc, uint32_t input){
+    return rotl32(acc + input * XXH_PRIME2, 13) * XXH_PRIME1;
+}
+
+uint32_t checksumXxh32(uint32_t seed, const void *data, size_t size){
+    const unsigned char *p = (const unsigned char*) data;
+    const unsigned char *end = p + size;
+    uint32_t h;
+
+    if(size >= 16){
+        // Four independent lanes, so the loop keeps the multipliers busy
+        uint32_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint32_t v2 = seed + XXH_PRIME2;
+        uint32_t v3 = seed;
+        uint32_t v4 = seed - XXH_PRIME1;
+        const unsigned char *limit = end - 16;
+        do {
+            v1 = xxhRound(v1, load32(p));
+            v2 = xxhRound(v2, load32(p + 4));
+            v3 = xxhRound(v3, load32(p + 8));
+            v4 = xxhRound(v4, load32(p + 12));
+            p += 16;
+        } while(p <= limit);
+        h = rotl32(v1, 1) + rotl32(v2, 7) + rotl32(v3, 12) + rotl32(v4, 18);
+    } else {
+        h = seed + XXH_PRIME5;
+    }
+    h += (uint32_t) size;
+
+    while(p + 4 <= end){
+        h = rotl32(h + load32(p) * XXH_PRIME3, 17) * XXH_PRIME4;
+        p += 4;
+    }
+    while(p < end){
+        h = rotl32(h + (*p++) * XXH_PRIME5, 11) * XXH_PRIME1;
+    }
+
+    h ^= h >> 15;
+    h *= XXH_PRIME2;
+    h ^= h >> 13;
+    h *= XXH_PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t checksumDigest(ChecksumAlgorithm algo, const void *data, size_t size){
+    return algo == CHECKSUM_CRC32C ? checksumCrc32c(0, data, size) : checksumXxh32(0, data, size);
+}
+
+// =================================================================
+// ---------------------------- Strips -----------------------------
+// =================================================================
+
+size_t checksumStripCount(size_t size, size_t stripBytes){
+    return stripBytes == 0 ? 0 : (size + stripBytes - 1) / stripBytes;
+}
+
+typedef struct {
+    ChecksumAlgorithm algo;
+    const unsigned char *data;
+    size_t size;
+    size_t stripBytes;
+    size_t first;               // strips [first, last) of this worker
+    size_t last;
+    uint32_t *digests;
+} StripJob;
+
+static void *digestStrips(void *arg){
+    StripJob *job = (StripJob*) arg;
+
+    for(size_t s = job->first; s < job->last; s++){
+        size_t offset = s * job->stripBytes;
+        size_t n = job->size - offset < job->stripBytes ? job->size - offset : job->stripBytes;
+        job->digests[s] = checksumDigest(job->algo, &job->data[offset], n);
+    }
+    return NULL;
+}
+
+void checksumStrips(ChecksumAlgorithm algo,
+                    const unsigned char *data,
+                    size_t size,
+                    size_t stripBytes,
+                    uint32_t *digests,
+                    int threads){
+    size_t strips = checksumStripCount(size, stripBytes);
+    StripJob job = { algo, data, size, stripBytes, 0, strips, digests };
+
+    if(algo == CHECKSUM_CRC32C){
+        CRC_INIT();
+    }
+
+#ifdef CHECKSUM_PTHREADS
+    /**
+     * Give each thread a contiguous range of strips; the calling thread
+     * takes the first range.
+     * */
+
+    if(threads > CHECKSUM_MAX_THREADS){
+        threads = CHECKSUM_MAX_THREADS;
+    }
+    if((size_t) threads > strips){
+        threads = (int) strips;
+    }
+    if(threads > 1){
+        pthread_t tid[CHECKSUM_MAX_THREADS];
+        StripJob jobs[CHECKSUM_MAX_THREADS];
+        int started[CHECKSUM_MAX_THREADS];
+
+        for(int t = 0; t < threads; t++){
+            jobs[t] = job;
+            jobs[t].first = strips * t / threads;
+            jobs[t].last = strips * (t + 1) / threads;
+            started[t] = t > 0 && pthread_create(&tid[t], NULL, digestStrips, &jobs[t]) == 0;
+        }
+        for(int t = 0; t < threads; t++){
+            if(!started[t]){
+                digestStrips(&jobs[t]);
+            }
+        }
+        for(int t = 1; t < threads; t++){
+            if(started[t]){
+                pthread_join(tid[t], NULL);
+            }
+        }
+        return;
+    }
+#else
+    (void) threads;
+#endif
+    digestStrips(&job);
+}
+
+long checksumCompareStrips(ChecksumAlgorithm algo,
+                           const unsigned char *data,
+                           size_t size,
+                           size_t stripBytes,
+                           const uint32_t *expected){
+    ChecksumVerifier verifier;
+
+    checksumVerifierInit(&verifier, algo, expected, size, stripBytes);
+    checksumVerifierAdvance(&verifier, data, size);
+    return verifier.badStrip;
+}
+
+// =================================================================
+// -------------------------- Verifier -----------------------------
+// =================================================================
+
+void checksumVerifierInit(ChecksumVerifier *verifier,
+                          ChecksumAlgorithm algo,
+                          const uint32_t *expected,
+                          size_t size,
+                          size_t stripBytes){
+    verifier->algo = algo;
+    verifier->expected = expected;
+    verifier->size = size;
+    verifier->stripBytes = stripBytes;
+    verifier->verified = 0;
+    // No strips to check against: fail at once rather than divide by zero
+    verifier->badStrip = stripBytes == 0 && size > 0 ? 0 : -1;
+}
+
+int checksumVerifierAdvance(ChecksumVerifier *verifier,
+                            const unsigned char *data,
+                            size_t available){
+    if(available > verifier->size){
+        available = verifier->size;
+    }
+
+    while(verifier->badStrip < 0 && verifier->verified < available){
+        size_t n = verifier->size - verifier->verified;
+        if(n > verifier->stripBytes){
+            n = verifier->stripBytes;
+        }
+        if(verifier->verified + n > available){
+            break;              // strip not complete yet
+        }
+
+        size_t strip = verifier->verified / verifier->stripBytes;
+        if(checksumDigest(verifier->algo, &data[verifier->verified], n) != verifier->expected[strip]){
+            verifier->badStrip = (long) strip;
+        }
+        verifier->verified += n;
+    }
+    return verifier->badStrip < 0 ? 0 : -1;
+}
+
+int checksumVerifierDone(const ChecksumVerifier *verifier){
+    return verifier->badStrip < 0 && verifier->verified == verifier->size;
+}
@@ -0,0 +1,133 @@
+/**
+ * Integrity checksums for the image data path.
+ *
+ * Two digests are offered: CRC32C (Castagnoli), computed with the SSE4.2 or
+ * ARMv8 CRC instructions when available and with slicing-by-8 tables
+ * otherwise, and XXH32, a fast non-cryptographic hash. Both detect
+ * reordered data, unlike an additive sum.
+ *
+ * A frame is split into strips of a fixed number of bytes (usually a few
+ * rows) with one digest each, computed on as many threads as asked for
+ * (one where pthreads are missing, or with -DCHECKSUM_NO_THREADS). A
+ * verifier checks the strips one by one as the data is produced or
+ * streamed, instead of in a final whole-frame pass.
+ * */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHECKSUM_MAX_THREADS 64         // cap on the threads of checksumStrips
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    CHECKSUM_CRC32C,
+    CHECKSUM_XXH32
+} ChecksumAlgorithm;
+
+/**
+ * Continue a CRC32C over size more bytes. Start with crc = 0; the result of
+ * one call can be passed to the next to checksum data in pieces.
+ * */
+
+uint32_t checksumCrc32c(uint32_t crc, const void *data, size_t size);
+
+/**
+ * XXH32 of size bytes.
+ * */
+
+uint32_t checksumXxh32(uint32_t seed, const void *data, size_t size);
+
+/**
+ * Digest of size bytes with the given algorithm.
+ * */
+
+uint32_t checksumDigest(ChecksumAlgorithm algo, const void *data, size_t size);
+
+/**
+ * Name of the CRC32C implementation selected on this machine.
+ * */
+
+const char *checksumCrc32cImpl(void);
+
+// =================================================================
+// ---------------------------- Strips -----------------------------
+// =================================================================
+
+/**
+ * Number of strips of stripBytes in size bytes (the last may be shorter).
+ * */
+
+size_t checksumStripCount(size_t size, size_t stripBytes);
+
+/**
+ * Digest every strip of data into digests[checksumStripCount(size, stripBytes)],
+ * on up to threads threads (the caller's included).
+ * */
+
+void checksumStrips(ChecksumAlgorithm algo,
+                    const unsigned char *data,
+                    size_t size,
+                    size_t stripBytes,
+                    uint32_t *digests,
+                    int threads);
+
+/**
+ * Index of the first strip whose digest differs from expected, or -1.
+ * */
+
+long checksumCompareStrips(ChecksumAlgorithm algo,
+                           const unsigned char *data,
+                           size_t size,
+                           size_t stripBytes,
+                           const uint32_t *expected);
+
+// =================================================================
+// -------------------------- Verifier -----------------------------
+// =================================================================
+
+typedef struct {
+    ChecksumAlgorithm algo;
+    const uint32_t *expected;   // one digest per strip
+    size_t size;
+    size_t stripBytes;
+    size_t verified;            // bytes of complete strips already checked
+    long badStrip;              // first mismatching strip, or -1
+} ChecksumVerifier;
+
+/**
+ * Start checking size bytes against expected, strip by strip. A zero
+ * stripBytes with a non-empty frame leaves the verifier failed at strip 0.
+ * */
+
+void checksumVerifierInit(ChecksumVerifier *verifier,
+                          ChecksumAlgorithm algo,
+                          const uint32_t *expected,
+                          size_t size,
+                          size_t stripBytes);
+
+/**
+ * Check the strips completed by the first available bytes of data.
+ * Returns 0 while every checked strip matches, -1 once one does not.
+ * */
+
+int checksumVerifierAdvance(ChecksumVerifier *verifier,
+                            const unsigned char *data,
+                            size_t available);
+
+/**
+ * Non-zero when the whole frame has been checked and matched.
+ * */
+
+int checksumVerifierDone(const ChecksumVerifier *verifier);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,251 @@
+#include <string.h>
+#include "dirty_tiles.h"
+#include "seq_filter.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// =================================================================
+// ------------------------- Tile diff -----------------------------
+// =================================================================
+
+/**
+ * Check whether n bytes of two rows differ, 16 at a time.
+ * */
+
+static bool segmentDiffers(const unsigned char *a, const unsigned char *b, size_t n){
+    size_t i = 0;
+#if defined(__SSE2__)
+    for(; i + 16 <= n; i += 16){
+        __m128i va = _mm_loadu_si128((const __m128i*) &a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i*) &b[i]);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff){
+            return true;
+        }
+    }
+#elif defined(__ARM_NEON)
+    for(; i + 16 <= n; i += 16){
+        uint64x2_t d = vreinterpretq_u64_u8(veorq_u8(vld1q_u8(&a[i]), vld1q_u8(&b[i])));
+        if(vgetq_lane_u64(d, 0) | vgetq_lane_u64(d, 1)){
+            return true;
+        }
+    }
+#endif
+    for(; i < n; i++){
+        if(a[i] != b[i]){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Flag the tiles that differ between two frames.
+ * */
+
+void seqDiffTiles(unsigned int imgWidth,
+                  unsigned int imgHeight,
+                  const unsigned char *prevR,
+                  const unsigned char *prevG,
+                  const unsigned char *prevB,
+                  const unsigned char *inputR,
+                  const unsigned char *inputG,
+                  const unsigned char *inputB,
+                  unsigned char *tileMask){
+    unsigned int tilesX = tileCount(imgWidth);
+
+    memset(tileMask, 0, tilesX * tileCount(imgHeight));
+
+    for(size_t j = 0; j < imgHeight; j++){
+        unsigned char *flags = &tileMask[(j / DIRTY_TILE_SIZE) * tilesX];
+        size_t row = j * imgWidth;
+
+        for(unsigned int tx = 0; tx < tilesX; tx++){
+            // A tile is compared until its first difference
+            if(flags[tx]){
+                continue;
+            }
+            size_t x = tx * DIRTY_TILE_SIZE;
+            size_t n = imgWidth - x < DIRTY_TILE_SIZE ? imgWidth - x : DIRTY_TILE_SIZE;
+            flags[tx] = segmentDiffers(&prevR[row + x], &inputR[row + x], n)
+                     || segmentDiffers(&prevG[row + x], &inputG[row + x], n)
+                     || segmentDiffers(&prevB[row + x], &inputB[row + x], n);
+        }
+    }
+}
+
+/**
+ * Grow the flagged tiles by radius tiles in every direction.
+ * */
+
+void seqDilateTiles(unsigned int tilesX,
+                    unsigned int tilesY,
+                    unsigned int radius,
+                    const unsigned char *tileMask,
+                    unsigned char *dilated){
+    memset(dilated, 0, tilesX * tilesY);
+
+    for(unsigned int ty = 0; ty < tilesY; ty++){
+        for(unsigned int tx = 0; tx < tilesX; tx++){
+            if(!tileMask[tx + ty * tilesX]){
+                continue;
+            }
+            unsigned int i0 = tx > radius ? tx - radius : 0;
+            unsigned int j0 = ty > radius ? ty - radius : 0;
+            unsigned int i1 = tx + radius < tilesX ? tx + radius : tilesX - 1;
+            unsigned int j1 = ty + radius < tilesY ? ty + radius : tilesY - 1;
+            for(unsigned int j = j0; j <= j1; j++){
+                memset(&dilated[i0 + j * tilesX], 1, i1 - i0 + 1);
+            }
+        }
+    }
+}
+
+/**
+ * Merge the flagged tiles into rectangles: horizontal runs of tiles, joined
+ * with the run right above when it spans the same columns.
+ * */
+
+std::vector<TileRegion> tileRegions(unsigned int imgWidth,
+                                    unsigned int imgHeight,
+                                    const unsigned char *tileMask){
+    unsigned int tilesX = tileCount(imgWidth);
+    unsigned int tilesY = tileCount(imgHeight);
+    std::vector<TileRegion> regions;
+    std::vector<size_t> above;          // regions ending at the top of this tile row
+
+    for(unsigned int ty = 0; ty < tilesY; ty++){
+        std::vector<size_t> current;
+        unsigned int y0 = ty * DIRTY_TILE_SIZE;
+        unsigned int y1 = y0 + DIRTY_TILE_SIZE < imgHeight ? y0 + DIRTY_TILE_SIZE : imgHeight;
+
+        for(unsigned int tx = 0; tx < tilesX; ){
+            if(!tileMask[tx + ty * tilesX]){
+                tx++;
+                continue;
+            }
+            unsigned int run = tx;
+            while(tx < tilesX && tileMask[tx + ty * tilesX]){
+                tx++;
+            }
+            unsigned int x0 = run * DIRTY_TILE_SIZE;
+            unsigned int x1 = tx * DIRTY_TILE_SIZE < imgWidth ? tx * DIRTY_TILE_SIZE : imgWidth;
+
+            size_t r = 0;
+            while(r < above.size() && (regions[above[r]].x0 != x0 || regions[above[r]].x1 != x1)){
+                r++;
+            }
+            if(r < above.size()){
+                regions[above[r]].y1 = y1;
+                current.push_back(above[r]);
+            } else {
+                regions.push_back({x0, y0, x1, y1});
+                current.push_back(regions.size() - 1);
+            }
+        }
+        above.swap(current);
+    }
+    return regions;
+}
+
+// =================================================================
+// ------------------------ Incremental filter ---------------------
+// =================================================================
+
+/**
+ * Filter a frame, recomputing the changed tiles only. The first frame, or
+ * a frame of another size, is filtered whole.
+ * */
+
+double seqFilterIncremental(SeqIncrementalState &state,
+                            unsigned int imgWidth,
+                            unsigned int imgHeight,
+                            unsigned int lpMaskSize,
+                            unsigned int hpMaskSize,
+                            unsigned char *inputRchannel,
+                            unsigned char *inputGchannel,
+                            unsigned char *inputBchannel,
+                            float *lpMask,
+                            float *hpMask,
+                            unsigned char *outputImg){
+    size_t imgSize = (size_t) imgWidth * imgHeight;
+    unsigned int tilesX = tileCount(imgWidth);
+    unsigned int tilesY = tileCount(imgHeight);
+    double fraction = 1.0;
+
+    if(!state.primed || state.imgWidth != imgWidth || state.imgHeight != imgHeight){
+
+        /**
+         * Filter the whole frame and keep its intermediates.
+         * */
+
+        state.imgWidth = imgWidth;
+        state.imgHeight = imgHeight;
+        state.gray.resize(imgSize);
+        state.lp.resize(imgSize);
+        state.output.resize(imgSize);
+        state.tileMask.resize(tilesX * tilesY);
+        state.dilated.resize(tilesX * tilesY);
+
+        seqRgb2Gray(imgWidth, imgHeight, inputRchannel, inputGchannel, inputBchannel, state.gray.data());
+        seqConvolve(imgWidth, imgHeight, lpMaskSize, state.gray.data(), lpMask, state.lp.data());
+        seqConvolve(imgWidth, imgHeight, hpMaskSize, state.lp.data(), hpMask, state.output.data());
+
+        state.prevR.assign(inputRchannel, inputRchannel + imgSize);
+        state.prevG.assign(inputGchannel, inputGchannel + imgSize);
+        state.prevB.assign(inputBchannel, inputBchannel + imgSize);
+        state.primed = true;
+    } else {
+
+        /**
+         * Find the changed tiles and the tiles within the halo of a change.
+         * */
+
+        seqDiffTiles(imgWidth, imgHeight, state.prevR.data(), state.prevG.data(), state.prevB.data(),
+                     inputRchannel, inputGchannel, inputBchannel, state.tileMask.data());
+        std::vector<TileRegion> changed = tileRegions(imgWidth, imgHeight, state.tileMask.data());
+
+        seqDilateTiles(tilesX, tilesY, haloTiles(lpMaskSize, hpMaskSize), state.tileMask.data(), state.dilated.data());
+        std::vector<TileRegion> regions = tileRegions(imgWidth, imgHeight, state.dilated.data());
+
+        /**
+         * Recompute each stage on the regions; a stage must be complete
+         * before the next one reads its halo.
+         * */
+
+        size_t recomputed = 0;
+        for(const TileRegion &r : regions){
+            seqRgb2GrayRegion(imgWidth, imgHeight, r.x0, r.y0, r.x1, r.y1,
+                              inputRchannel, inputGchannel, inputBchannel, state.gray.data());
+            recomputed += (size_t)(r.x1 - r.x0) * (r.y1 - r.y0);
+        }
+        for(const TileRegion &r : regions){
+            seqConvolveRegion(imgWidth, imgHeight, lpMaskSize, r.x0, r.y0, r.x1, r.y1,
+                              state.gray.data(), lpMask, state.lp.data());
+        }
+        for(const TileRegion &r : regions){
+            seqConvolveRegion(imgWidth, imgHeight, hpMaskSize, r.x0, r.y0, r.x1, r.y1,
+                              state.lp.data(), hpMask, state.output.data());
+        }
+        fraction = (double) recomputed / imgSize;
+
+        /**
+         * Keep the changed pixels as the previous frame.
+         * */
+
+        for(const TileRegion &r : changed){
+            for(size_t j = r.y0; j < r.y1; j++){
+                size_t idx = r.x0 + j * imgWidth;
+                memcpy(&state.prevR[idx], &inputRchannel[idx], r.x1 - r.x0);
+                memcpy(&state.prevG[idx], &inputGchannel[idx], r.x1 - r.x0);
+                memcpy(&state.prevB[idx], &inputBchannel[idx], r.x1 - r.x0);
+            }
+        }
+    }
+
+    memcpy(outputImg, state.output.data(), imgSize);
+    return fraction;
+}
@@ -0,0 +1,87 @@
+/**
+ * Dirty-rectangle incremental filtering for frame sequences where most of
+ * the image does not change.
+ *
+ * The new RGB frame is compared with the previous one in 16x16 tiles; the
+ * changed tiles are grown by the combined low-pass and high-pass halo, and
+ * gray, low-pass and high-pass are recomputed on those tiles only, over
+ * intermediates kept from the previous frame. The result is identical to
+ * seqFilter on the whole frame, as long as the masks stay the same.
+ * */
+
+#ifndef DIRTY_TILES_H
+#define DIRTY_TILES_H
+
+#include <vector>
+
+#define DIRTY_TILE_SIZE 16          // must match TILE_SIZE in image_filtering.cl
+
+struct TileRegion {
+    unsigned int x0, y0;            // first pixel
+    unsigned int x1, y1;            // one past the last pixel
+};
+
+/**
+ * Tiles covering a dimension of the image.
+ * */
+
+inline unsigned int tileCount(unsigned int pixels){
+    return (pixels + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+}
+
+/**
+ * Tiles by which the changes must be grown so that every output pixel
+ * reading a changed pixel through both masks is recomputed.
+ * */
+
+inline unsigned int haloTiles(unsigned int lpMaskSize, unsigned int hpMaskSize){
+    return (lpMaskSize/2 + hpMaskSize/2 + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+}
+
+void seqDiffTiles(unsigned int imgWidth,
+                  unsigned int imgHeight,
+                  const unsigned char *prevR,
+                  const unsigned char *prevG,
+                  const unsigned char *prevB,
+                  const unsigned char *inputR,
+                  const unsigned char *inputG,
+                  const unsigned char *inputB,
+                  unsigned char *tileMask);                     // Flag the tiles that differ between two frames.
+
+void seqDilateTiles(unsigned int tilesX,
+                    unsigned int tilesY,
+                    unsigned int radius,
+                    const unsigned char *tileMask,
+                    unsigned char *dilated);                    // Grow the flagged tiles by radius tiles.
+
+std::vector<TileRegion> tileRegions(unsigned int imgWidth,
+                                    unsigned int imgHeight,
+                                    const unsigned char *tileMask); // Merge the flagged tiles into rectangles.
+
+// =================================================================
+// ------------------------ Incremental filter ---------------------
+// =================================================================
+
+struct SeqIncrementalState {
+    unsigned int imgWidth = 0;
+    unsigned int imgHeight = 0;
+    bool primed = false;                    // previous frame and intermediates are valid
+    std::vector<unsigned char> prevR, prevG, prevB;
+    std::vector<unsigned char> gray, lp, output;
+    std::vector<unsigned char> tileMask, dilated;
+};
+
+double seqFilterIncremental(SeqIncrementalState &state,
+                            unsigned int imgWidth,
+                            unsigned int imgHeight,
+                            unsigned int lpMaskSize,
+                            unsigned int hpMaskSize,
+                            unsigned char *inputRchannel,
+                            unsigned char *inputGchannel,
+                            unsigned char *inputBchannel,
+                            float *lpMask,
+                            float *hpMask,
+                            unsigned char *outputImg);  // Filter a frame, recomputing the changed tiles only.
+                                                        // Returns the fraction of the pixels recomputed.
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * Host emulator for the FIFO link to the imageFiltering coprocessor: runs
+ * the transfer protocol of fifo_transfer.c against the mock XLlFifo with the
+ * HLS C-model (image.h) on the far side, checks every frame against
+ * seqFilter and reports the link throughput. Every strip is checked both
+ * ways with the CRC32C digests the C-model sends back, as on the board.
+ *
+ * Build: g++ -O2 -DFIFO_MOCK -Ihls_sim fifo_emulator.cpp fifo_transfer.c checksum.c xllfifo_mock.c image.cpp seq_filter.cpp scratch_arena.cpp -pthread -o fifo_emulator
+ * Usage: ./fifo_emulator [-n frames] [-t txDepth] [-r rxDepth] [-j checksumThreads]
+ *
+ * The C-model filters a frame once all of it has arrived, so the emulated
+ * overlap is lower than on the board; the word counts, packing efficiency
+ * and the back-pressure behaviour are exact.
+ * */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "image.h"
+#include "seq_filter.h"
+#include "fifo_transfer.h"
+
+// =================================================================
+// ------------------------- Device model --------------------------
+// =================================================================
+
+struct Coprocessor {
+    hls::stream<AXIS_wLAST> S_AXIS;
+    hls::stream<AXIS_wLAST> M_AXIS;
+    u32 frameWords;             // input words per frame
+    u32 received;
+    u32 rxDepth;
+};
+
+/**
+ * Accept a TX packet unless the output side is backed up, and run the
+ * C-model once a whole frame has arrived.
+ * */
+
+static int coprocessorReceive(XLlFifo *fifo, const u32 *words, u32 nwords, void *arg){
+    Coprocessor *dev = (Coprocessor*) arg;
+
+    if(XLlFifo_MockPending(fifo) > dev->rxDepth){
+        return 0;
+    }
+
+    for(u32 i = 0; i < nwords; i++){
+        AXIS_wLAST beat;
+        beat.data = (int)words[i];
+        beat.user = 0;
+        beat.last = (i == nwords - 1);
+        dev->S_AXIS.write(beat);
+    }
+    dev->received += nwords;
+
+    if(dev->received == dev->frameWords){
+        dev->received = 0;
+        imageFiltering(dev->S_AXIS, dev->M_AXIS);
+
+        // One RX packet per TLAST-terminated row
+        std::vector<u32> packet;
+        while(!dev->M_AXIS.empty()){
+            AXIS_wLAST beat = dev->M_AXIS.read();
+            packet.push_back((u32)(long long)beat.data);
+            if(beat.last){
+                XLlFifo_MockSend(fifo, packet.data(), packet.size());
+                packet.clear();
+            }
+        }
+    }
+    return 1;
+}
+
+// =================================================================
+// ------------------------- Main Function -------------------------
+// =================================================================
+
+int main(int argc, char *argv[]){
+    int frames = 100;
+    u32 txDepth = XLLF_MOCK_TX_DEPTH;
+    u32 rxDepth = XLLF_MOCK_RX_DEPTH;
+    int checksumThreads = (int) std::thread::hardware_concurrency();
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+            frames = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc){
+            txDepth = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+            rxDepth = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+            checksumThreads = atoi(argv[++i]);
+        }
+    }
+
+    /**
+     * Masks of the filter chain.
+     * */
+
+    float lpMask[5 * 5];
+    float hpMask[5 * 5];
+    for(int i = 0; i < 5 * 5; i++){
+        lpMask[i] = 0.04f;
+        hpMask[i] = -1.0f;
+    }
+    hpMask[12] = 24.0f;
+
+    /**
+     * Bring up the mock FIFO with the C-model attached.
+     * */
+
+    // The RX FIFO is store-and-forward: an output row must fit in it
+    if(rxDepth < WIDTH / 4){
+        printf("RX depth must be at least %d words\n", WIDTH / 4);
+        return 1;
+    }
+
+    XLlFifo fifo;
+    Coprocessor dev;
+    dev.frameWords = 2 * 5 * 5 + HEIGHT * 3 * WIDTH / 4;
+    dev.received = 0;
+    dev.rxDepth = rxDepth;
+
+    XLlFifo_CfgInitialize(&fifo, XLlFifo_LookupConfig(0), 0);
+    XLlFifo_MockAttach(&fifo, txDepth, rxDepth, coprocessorReceive, &dev);
+
+    std::vector<unsigned char> rgbImg(WIDTH * HEIGHT * 3);
+    std::vector<unsigned char> planar(WIDTH * HEIGHT * 3);
+    std::vector<unsigned char> outputImg(WIDTH * HEIGHT);
+    std::vector<unsigned char> expected(WIDTH * HEIGHT);
+
+    FifoTransferStats total;
+    memset(&total, 0, sizeof(total));
+    double seconds = 0.0;
+    int failures = 0;
+    int corrupt = 0;
+    const size_t stripBytes = FIFO_STRIP_ROWS * 3 * WIDTH;
+    std::vector<uint32_t> digests(checksumStripCount(rgbImg.size(), stripBytes));
+    double checksumSeconds = 0.0;
+    unsigned int seed = 1;
+
+    for(int f = 0; f < frames; f++){
+        for(size_t i = 0; i < rgbImg.size(); i++){
+            seed = seed * 1103515245 + 12345;
+            rgbImg[i] = (seed >> 16) & 0xff;
+        }
+
+        // The strip digests alone, as fifoTransferFrame computes them
+        auto start = std::chrono::steady_clock::now();
+        checksumStrips(CHECKSUM_CRC32C, rgbImg.data(), rgbImg.size(), stripBytes, digests.data(), checksumThreads);
+        checksumSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        FifoTransferStats stats;
+        start = std::chrono::steady_clock::now();
+        int status = fifoTransferFrame(&fifo, rgbImg.data(), WIDTH, HEIGHT, lpMask, hpMask, outputImg.data(), checksumThreads, &stats);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        total.txWords += stats.txWords;
+        total.txPackets += stats.txPackets;
+        total.rxWords += stats.rxWords;
+        total.rxPackets += stats.rxPackets;
+        total.txStalls += stats.txStalls;
+        total.payloadBytes += stats.payloadBytes;
+
+        /**
+         * Check against the sequential filter on the planar image.
+         * */
+
+        for(int i = 0; i < WIDTH * HEIGHT; i++){
+            for(int c = 0; c < 3; c++){
+                planar[c * WIDTH * HEIGHT + i] = rgbImg[3 * i + c];
+            }
+        }
+        seqFilter(WIDTH, HEIGHT, 5, 5, &planar[0], &planar[WIDTH * HEIGHT], &planar[2 * WIDTH * HEIGHT],
+                  lpMask, hpMask, expected.data());
+
+        if(stats.badInputStrip >= 0 || stats.badOutputStrip >= 0
+           || stats.stripsVerified != (HEIGHT + FIFO_STRIP_ROWS - 1) / FIFO_STRIP_ROWS){
+            corrupt++;
+        }
+        if(status != XST_SUCCESS || outputImg != expected){
+            failures++;
+        }
+    }
+
+    /**
+     * Print results.
+     * */
+
+    double linkBytes = 4.0 * (total.txWords + total.rxWords);
+    printf("Frames: %d (%dx%d), failures: %d, digest mismatches: %d\n", frames, WIDTH, HEIGHT, failures, corrupt);
+    printf("TX: %u words in %u packets, %u stalls (depth %u)\n", total.txWords, total.txPackets, total.txStalls, txDepth);
+    printf("RX: %u words in %u packets (depth %u)\n", total.rxWords, total.rxPackets, rxDepth);
+    printf("Link efficiency: %.1f%% of the word capacity carries payload\n", 100.0 * total.payloadBytes / linkBytes);
+    printf("Throughput: %.1f frames/s, %.2f MB/s payload (host emulation)\n",
+           frames / seconds, total.payloadBytes / seconds * 1e-6);
+
+    printf("Strip digests: %.2f MB/s (CRC32C, %s, %d threads)\n",
+           frames * rgbImg.size() / checksumSeconds * 1e-6, checksumCrc32cImpl(), checksumThreads);
+
+    XLlFifo_MockRelease(&fifo);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <string.h>
+#include "fifo_transfer.h"
+
+// =================================================================
+// --------------------------- Receiver ----------------------------
+// =================================================================
+
+typedef struct {
+    XLlFifo *fifo;
+    unsigned char *outputImg;
+    u32 outputBytes;
+    u32 received;               // output bytes stored so far
+    u32 packetLeft;             // words of the current RX packet still to read
+    u32 stripBytes;             // output bytes per strip
+    u32 stripLeft;              // output bytes of the current strip still to come
+    u32 digestLeft;             // digest words of the current strip still to come
+    u32 strip;                  // strips whose digests have arrived
+    const uint32_t *txDigests;  // of the words sent, per strip
+    uint32_t *outputDigests;    // sent back by the coprocessor, per strip
+    ChecksumVerifier outputCheck;
+    FifoTransferStats *stats;
+} FifoReceiver;
+
+/**
+ * Store one RX word: 4 output pixels, or one of the two digests that follow
+ * every strip. The input digest must match that of the words sent; the
+ * output digest becomes the expected value of the strip just received.
+ * */
+
+static void receiveWord(FifoReceiver *rx, u32 word){
+    if(rx->digestLeft == 0){
+        for(int p = 0; p < 4; p++){
+            rx->outputImg[rx->received++] = (word >> (8 * p)) & 0xff;
+        }
+        rx->stripLeft -= 4;
+        if(rx->stripLeft == 0){
+            rx->digestLeft = 2;
+        }
+        return;
+    }
+
+    if(rx->digestLeft == 2){
+        if(word != rx->txDigests[rx->strip] && rx->stats->badInputStrip < 0){
+            rx->stats->badInputStrip = rx->strip;
+        }
+    } else {
+        rx->outputDigests[rx->strip] = word;
+        if(checksumVerifierAdvance(&rx->outputCheck, rx->outputImg, rx->received) != 0 && rx->stats->badOutputStrip < 0){
+            rx->stats->badOutputStrip = rx->outputCheck.badStrip;
+        }
+        rx->strip++;
+        rx->stats->stripsVerified++;
+        rx->stripLeft = rx->outputBytes - rx->received < rx->stripBytes ? rx->outputBytes - rx->received : rx->stripBytes;
+    }
+    rx->digestLeft--;
+}
+
+/**
+ * Read everything the RX FIFO holds, one packet length at a time.
+ * */
+
+static void drainRx(FifoReceiver *rx){
+    u32 occupancy;
+
+    while((occupancy = XLlFifo_iRxOccupancy(rx->fifo)) > 0){
+        if(rx->packetLeft == 0){
+            rx->packetLeft = (XLlFifo_iRxGetLen(rx->fifo) + 3) / 4;
+            if(rx->packetLeft == 0){
+                break;
+            }
+            rx->stats->rxPackets++;
+        }
+
+        u32 burst = occupancy < rx->packetLeft ? occupancy : rx->packetLeft;
+        for(u32 i = 0; i < burst; i++){
+            u32 word = XLlFifo_RxGetWord(rx->fifo);
+            if(rx->received < rx->outputBytes || rx->digestLeft > 0){
+                receiveWord(rx, word);
+            }
+        }
+        rx->packetLeft -= burst;
+        rx->stats->rxWords += burst;
+    }
+}
+
+// =================================================================
+// -------------------------- Transmitter --------------------------
+// =================================================================
+
+/**
+ * Write one packet in vacancy-sized bursts and commit it. The packet must
+ * fit in the TX FIFO, as the hardware only starts sending on commit.
+ * */
+
+static int sendPacket(FifoReceiver *rx, const u32 *words, u32 nwords){
+    u32 sent = 0;
+    u32 idle = 0;
+
+    while(sent < nwords){
+        u32 vacancy = XLlFifo_iTxVacancy(rx->fifo);
+        if(vacancy == 0){
+            // Back-pressure: receive while the coprocessor works through the TX FIFO
+            u32 before = rx->received;
+            drainRx(rx);
+            rx->stats->txStalls++;
+            if(rx->received == before && ++idle >= FIFO_TIMEOUT){
+                return XST_FAILURE;
+            }
+            continue;
+        }
+        idle = 0;
+
+        u32 burst = nwords - sent < vacancy ? nwords - sent : vacancy;
+        for(u32 i = 0; i < burst; i++){
+            XLlFifo_TxPutWord(rx->fifo, words[sent + i]);
+        }
+        sent += burst;
+    }
+
+    XLlFifo_iTxSetLen(rx->fifo, nwords * 4);
+    rx->stats->txWords += nwords;
+    rx->stats->txPackets++;
+    return XST_SUCCESS;
+}
+
+/**
+ * Send words as packets of at most maxPacket words.
+ * */
+
+static int sendWords(FifoReceiver *rx, const u32 *words, u32 nwords, u32 maxPacket){
+    for(u32 i = 0; i < nwords; i += maxPacket){
+        u32 n = nwords - i < maxPacket ? nwords - i : maxPacket;
+        if(sendPacket(rx, &words[i], n) != XST_SUCCESS){
+            return XST_FAILURE;
+        }
+    }
+    return XST_SUCCESS;
+}
+
+// =================================================================
+// ----------------------------- Frame -----------------------------
+// =================================================================
+
+int fifoTransferFrame(XLlFifo *InstancePtr,
+                      const unsigned char *rgbImg,
+                      unsigned int imgWidth,
+                      unsigned int imgHeight,
+                      const float *lpMask,
+                      const float *hpMask,
+                      unsigned char *outputImg,
+                      int checksumThreads,
+                      FifoTransferStats *stats){
+    FifoTransferStats localStats;
+    FifoReceiver rx;
+    u32 maskWords = FIFO_MASK_SIZE * FIFO_MASK_SIZE;
+    u32 rowWords = 3 * imgWidth / 4;
+
+    if(stats == NULL){
+        stats = &localStats;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->badInputStrip = -1;
+    stats->badOutputStrip = -1;
+
+    if(imgWidth == 0 || imgWidth % 4 != 0 || imgHeight == 0){
+        return XST_FAILURE;
+    }
+
+    // Rows longer than the (empty) TX FIFO are split; the coprocessor only
+    // counts words, so the extra TLASTs are harmless
+    u32 maxPacket = XLlFifo_iTxVacancy(InstancePtr);
+    if(maxPacket == 0){
+        return XST_FAILURE;
+    }
+
+    /**
+     * Pack the whole frame first, rows as R, G and B segments, 4 pixels per
+     * word, pixel x in byte x % 4, and digest the packed strips: these are
+     * the bytes that cross the link, as the coprocessor hashes them.
+     * */
+
+    u32 strips = (imgHeight + FIFO_STRIP_ROWS - 1) / FIFO_STRIP_ROWS;
+    u32 *frameWords = (u32*) malloc((size_t) imgHeight * rowWords * sizeof(u32));
+    uint32_t *txDigests = (uint32_t*) malloc(strips * sizeof(uint32_t));
+    uint32_t *outputDigests = (uint32_t*) malloc(strips * sizeof(uint32_t));
+    if(frameWords == NULL || txDigests == NULL || outputDigests == NULL){
+        free(frameWords);
+        free(txDigests);
+        free(outputDigests);
+        return XST_FAILURE;
+    }
+
+    for(u32 y = 0; y < imgHeight; y++){
+        const unsigned char *row = &rgbImg[3 * y * imgWidth];
+        u32 *words = &frameWords[y * rowWords];
+        u32 n = 0;
+        for(u32 c = 0; c < 3; c++){
+            for(u32 x = 0; x < imgWidth; x += 4){
+                words[n++] = (u32)row[3 * x + c]
+                           | (u32)row[3 * (x + 1) + c] << 8
+                           | (u32)row[3 * (x + 2) + c] << 16
+                           | (u32)row[3 * (x + 3) + c] << 24;
+            }
+        }
+    }
+    // The words are little-endian in memory, as on the Zynq
+    checksumStrips(CHECKSUM_CRC32C, (const unsigned char*) frameWords, (size_t) imgHeight * rowWords * 4,
+                   (size_t) FIFO_STRIP_ROWS * rowWords * 4, txDigests, checksumThreads);
+
+    rx.fifo = InstancePtr;
+    rx.outputImg = outputImg;
+    rx.outputBytes = imgWidth * imgHeight;
+    rx.received = 0;
+    rx.packetLeft = 0;
+    rx.stripBytes = FIFO_STRIP_ROWS * imgWidth;
+    rx.stripLeft = rx.stripBytes < rx.outputBytes ? rx.stripBytes : rx.outputBytes;
+    rx.digestLeft = 0;
+    rx.strip = 0;
+    rx.txDigests = txDigests;
+    rx.outputDigests = outputDigests;
+    checksumVerifierInit(&rx.outputCheck, CHECKSUM_CRC32C, outputDigests, rx.outputBytes, rx.stripBytes);
+    rx.stats = stats;
+
+    // Masks: one float tap per word
+    int status = XST_SUCCESS;
+    u32 maskBuf[FIFO_MASK_SIZE * FIFO_MASK_SIZE];
+    memcpy(maskBuf, lpMask, maskWords * sizeof(u32));
+    status |= sendWords(&rx, maskBuf, maskWords, maxPacket);
+    memcpy(maskBuf, hpMask, maskWords * sizeof(u32));
+    status |= sendWords(&rx, maskBuf, maskWords, maxPacket);
+    stats->payloadBytes += 2 * maskWords * 4;
+
+    for(u32 y = 0; y < imgHeight && status == XST_SUCCESS; y++){
+        status |= sendWords(&rx, &frameWords[y * rowWords], rowWords, maxPacket);
+        if(status == XST_SUCCESS){
+            stats->payloadBytes += 3 * imgWidth;
+        }
+
+        // Overlap: pick up the results that are already back
+        drainRx(&rx);
+    }
+
+    // Wait for the remaining output rows and digests
+    u32 idle = 0;
+    while(status == XST_SUCCESS && rx.strip < strips){
+        u32 before = rx.received + rx.strip;
+        drainRx(&rx);
+        if(rx.received + rx.strip == before && ++idle >= FIFO_TIMEOUT){
+            status = XST_FAILURE;
+        } else if(rx.received + rx.strip != before){
+            idle = 0;
+        }
+    }
+    stats->payloadBytes += rx.received;
+
+    free(frameWords);
+    free(txDigests);
+    free(outputDigests);
+
+    if(stats->badInputStrip >= 0 || stats->badOutputStrip >= 0){
+        status = XST_FAILURE;
+    }
+    return status == XST_SUCCESS ? XST_SUCCESS : XST_FAILURE;
+}
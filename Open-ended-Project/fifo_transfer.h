@@ -0,0 +1,77 @@
+/**
+ * Frame transfer to the imageFiltering coprocessor through the AXI4-Stream
+ * FIFO, in the stream order of image.h: the two masks, then every row as
+ * R, G and B segments packed 4 pixels per 32-bit word.
+ *
+ * Words are written in bursts sized by the TX vacancy; whenever the TX FIFO
+ * is full, the RX FIFO is drained, so the results of earlier rows are
+ * received while later rows are still being sent and the coprocessor never
+ * stalls on a full RX FIFO.
+ *
+ * Both directions of the link are checked strip by strip. After every
+ * FIFO_STRIP_ROWS output rows the coprocessor sends the CRC32C of the input
+ * words it read for those rows and of the output words it wrote; the first
+ * is compared with the digest of the words actually sent, the second with
+ * the rows received, as soon as the strip is in.
+ * */
+
+#ifndef FIFO_TRANSFER_H
+#define FIFO_TRANSFER_H
+
+#ifdef FIFO_MOCK
+#include "xllfifo_mock.h"
+#else
+#include "xllfifo.h"
+#endif
+#include "checksum.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FIFO_MASK_SIZE 5
+
+// Polls without progress before a transfer is abandoned
+#define FIFO_TIMEOUT (1 << 20)
+
+// Rows per digest strip; must match STRIP_ROWS in image.h
+#define FIFO_STRIP_ROWS 8
+
+typedef struct {
+    u32 txWords;            // words written to the TX FIFO
+    u32 txPackets;
+    u32 rxWords;            // words read from the RX FIFO
+    u32 rxPackets;
+    u32 txStalls;           // polls that found the TX FIFO full
+    u32 payloadBytes;       // pixel and mask bytes carried by the words
+    u32 stripsVerified;     // strips whose digests came back and were checked
+    long badInputStrip;     // first strip the coprocessor read wrong, or -1
+    long badOutputStrip;    // first strip received wrong, or -1
+} FifoTransferStats;
+
+/**
+ * Send one frame and receive the filtered result.
+ *
+ * rgbImg is interleaved (as loaded by stbi_load with 3 channels) and
+ * imgWidth must be a multiple of 4. outputImg receives imgWidth * imgHeight
+ * gray pixels. The packed strips are digested on checksumThreads threads
+ * before they are sent. stats may be NULL.
+ * Returns XST_SUCCESS, or XST_FAILURE on a bad size, a digest mismatch in
+ * either direction (see stats) or a timeout.
+ * */
+
+int fifoTransferFrame(XLlFifo *InstancePtr,
+                      const unsigned char *rgbImg,
+                      unsigned int imgWidth,
+                      unsigned int imgHeight,
+                      const float *lpMask,
+                      const float *hpMask,
+                      unsigned char *outputImg,
+                      int checksumThreads,
+                      FifoTransferStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
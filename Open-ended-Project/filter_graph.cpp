@@ -0,0 +1,607 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include "filter_graph.h"
+#include "seq_filter.h"
+#include "scratch_arena.h"
+
+// =================================================================
+// ---------------------------- Graph ------------------------------
+// =================================================================
+
+/**
+ * Index of a stage, or -1.
+ * */
+
+int FilterGraph::find(const std::string &name) const{
+    for(size_t i = 0; i < stages.size(); i++){
+        if(stages[i].name == name){
+            return i;
+        }
+    }
+    return -1;
+}
+
+int FilterGraph::gray(const std::string &name){
+    GraphStage stage;
+    stage.name = name;
+    stage.kind = STAGE_GRAY;
+    stages.push_back(stage);
+    return stages.size() - 1;
+}
+
+int FilterGraph::convolve(const std::string &name, int input, unsigned int maskSize, const float *mask){
+    GraphStage stage;
+    stage.name = name;
+    stage.kind = STAGE_CONVOLVE;
+    stage.inputs[0] = input;
+    stage.maskSize = maskSize;
+    stage.mask.assign(mask, mask + maskSize * maskSize);
+    stages.push_back(stage);
+    return stages.size() - 1;
+}
+
+int FilterGraph::point(const std::string &name, PointOp op, int input, float a, float b){
+    GraphStage stage;
+    stage.name = name;
+    stage.kind = STAGE_POINT;
+    stage.op = op;
+    stage.inputs[0] = input;
+    stage.a = a;
+    stage.b = b;
+    stages.push_back(stage);
+    return stages.size() - 1;
+}
+
+int FilterGraph::combine(const std::string &name, CombineOp op, int input0, int input1, float a, float b){
+    GraphStage stage;
+    stage.name = name;
+    stage.kind = STAGE_COMBINE;
+    stage.op = op;
+    stage.inputs[0] = input0;
+    stage.inputs[1] = input1;
+    stage.a = a;
+    stage.b = b;
+    stages.push_back(stage);
+    return stages.size() - 1;
+}
+
+int FilterGraph::contrast(const std::string &name, int input, float clip){
+    GraphStage stage;
+    stage.name = name;
+    stage.kind = STAGE_CONTRAST;
+    stage.inputs[0] = input;
+    stage.a = clip;
+    stages.push_back(stage);
+    return stages.size() - 1;
+}
+
+int FilterGraph::median(const std::string &name, int input, unsigned int size){
+    GraphStage stage;
+    stage.name = name;
+    stage.kind = STAGE_MEDIAN;
+    stage.inputs[0] = input;
+    stage.maskSize = size;
+    stages.push_back(stage);
+    return stages.size() - 1;
+}
+
+int FilterGraph::morph(const std::string &name, MorphOp op, int input, unsigned int width, unsigned int height){
+    GraphStage stage;
+    stage.name = name;
+    stage.kind = STAGE_MORPH;
+    stage.op = op;
+    stage.inputs[0] = input;
+    stage.maskSize = width;
+    stage.maskHeight = height;
+    stages.push_back(stage);
+    return stages.size() - 1;
+}
+
+/**
+ * gray -> low-pass -> high-pass, as seqFilter.
+ * */
+
+FilterGraph defaultFilterGraph(unsigned int lpMaskSize,
+                               unsigned int hpMaskSize,
+                               float *lpMask,
+                               float *hpMask){
+    FilterGraph graph;
+    int gray = graph.gray("gray");
+    int lp = graph.convolve("lp", gray, lpMaskSize, lpMask);
+    graph.convolve("hp", lp, hpMaskSize, hpMask);
+    return graph;
+}
+
+// =================================================================
+// ------------------------- Config file ---------------------------
+// =================================================================
+
+/**
+ * Parse a float token.
+ * */
+
+static bool parseFloat(const std::string &token, float &value){
+    char *end;
+    value = strtof(token.c_str(), &end);
+    return !token.empty() && *end == '\0';
+}
+
+/**
+ * Parse a config file (see filter_graph.h) into graph; false with a message
+ * naming the line on error.
+ * */
+
+bool loadFilterGraph(const char *path,
+                     FilterGraph &graph,
+                     std::string &error){
+    std::ifstream file(path);
+    if(!file){
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    /**
+     * Split the file into lines of tokens, without comments and blank lines.
+     * */
+
+    std::vector<std::vector<std::string>> lines;
+    std::vector<int> lineNumbers;
+    std::string text;
+    for(int number = 1; std::getline(file, text); number++){
+        std::istringstream stream(text.substr(0, text.find('#')));
+        std::vector<std::string> tokens;
+        std::string token;
+        while(stream >> token){
+            tokens.push_back(token);
+        }
+        if(!tokens.empty()){
+            lines.push_back(tokens);
+            lineNumbers.push_back(number);
+        }
+    }
+
+    static const char *pointOps[] = {"clamp", "scale", "invert", "threshold"};
+    static const char *combineOps[] = {"add", "sub", "absdiff", "min", "max", "weighted"};
+    static const char *morphOps[] = {"erode", "dilate", "open", "close"};
+    std::string outputName;
+
+    for(size_t n = 0; n < lines.size(); n++){
+        std::vector<std::string> tokens = lines[n];
+        std::string where = std::string(path) + ":" + std::to_string(lineNumbers[n]) + ": ";
+        size_t next = 2;
+
+        if(tokens[0] == "output"){
+            if(tokens.size() != 2){
+                error = where + "expected 'output <name>'";
+                return false;
+            }
+            outputName = tokens[1];
+            continue;
+        }
+        if(tokens.size() < 2){
+            error = where + "expected '<name> <kind> ...'";
+            return false;
+        }
+        if(graph.find(tokens[0]) >= 0){
+            error = where + "stage '" + tokens[0] + "' is already defined";
+            return false;
+        }
+
+        GraphStage stage;
+        stage.name = tokens[0];
+        int inputCount = 0;
+
+        if(tokens[1] == "gray"){
+            stage.kind = STAGE_GRAY;
+        } else if(tokens[1] == "convolve"){
+            stage.kind = STAGE_CONVOLVE;
+            inputCount = 1;
+        } else if(tokens[1] == "point" || tokens[1] == "combine" || tokens[1] == "morph"){
+            bool point = tokens[1] == "point", combine = tokens[1] == "combine";
+            const char **names = point ? pointOps : (combine ? combineOps : morphOps);
+            int count = combine ? 6 : 4;
+            stage.kind = point ? STAGE_POINT : (combine ? STAGE_COMBINE : STAGE_MORPH);
+            inputCount = combine ? 2 : 1;
+            stage.op = -1;
+            for(int i = 0; i < count && tokens.size() > 2; i++){
+                if(tokens[2] == names[i]){
+                    stage.op = i;
+                }
+            }
+            if(stage.op < 0){
+                error = where + "unknown " + tokens[1] + " operation";
+                return false;
+            }
+            next = 3;
+        } else if(tokens[1] == "contrast"){
+            stage.kind = STAGE_CONTRAST;
+            inputCount = 1;
+        } else if(tokens[1] == "median"){
+            stage.kind = STAGE_MEDIAN;
+            inputCount = 1;
+        } else {
+            error = where + "unknown stage kind '" + tokens[1] + "'";
+            return false;
+        }
+
+        /**
+         * Inputs, by name.
+         * */
+
+        for(int i = 0; i < inputCount; i++, next++){
+            if(next >= tokens.size() || (stage.inputs[i] = graph.find(tokens[next])) < 0){
+                error = where + "missing or undefined input";
+                return false;
+            }
+        }
+
+        /**
+         * Parameters: the mask, which may continue on the following lines,
+         * the window size of a median, the element of a morphology, or up
+         * to two numbers with defaults per operation.
+         * */
+
+        if(stage.kind == STAGE_CONVOLVE){
+            if(next >= tokens.size()){
+                error = where + "missing mask size";
+                return false;
+            }
+            stage.maskSize = atoi(tokens[next++].c_str());
+            while(stage.mask.size() < stage.maskSize * stage.maskSize){
+                if(next == tokens.size() && n + 1 < lines.size()){
+                    tokens = lines[++n];
+                    next = 0;
+                }
+                float value;
+                if(next == tokens.size() || !parseFloat(tokens[next++], value)){
+                    error = where + "expected " + std::to_string(stage.maskSize * stage.maskSize) + " mask values";
+                    return false;
+                }
+                stage.mask.push_back(value);
+            }
+        } else if(stage.kind == STAGE_MEDIAN){
+            if(next >= tokens.size()){
+                error = where + "missing window size";
+                return false;
+            }
+            stage.maskSize = atoi(tokens[next++].c_str());
+        } else if(stage.kind == STAGE_MORPH){
+            if(next >= tokens.size()){
+                error = where + "missing element width";
+                return false;
+            }
+            stage.maskSize = atoi(tokens[next++].c_str());
+            stage.maskHeight = next < tokens.size() ? atoi(tokens[next++].c_str()) : stage.maskSize;
+        } else if(stage.kind != STAGE_GRAY){
+            float defaults[2][6][2] = {
+                {{0, 255}, {1, 0}, {0, 0}, {128, 0}},
+                {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}, {.5, .5}},
+            };
+            float contrastDefaults[2] = {0, 0};
+            float *params = stage.kind == STAGE_CONTRAST ? contrastDefaults : defaults[stage.kind == STAGE_COMBINE][stage.op];
+            int paramCount = stage.kind == STAGE_CONTRAST ? 1 : 2;
+            for(int i = 0; i < paramCount && next < tokens.size(); i++, next++){
+                if(!parseFloat(tokens[next], params[i])){
+                    error = where + "bad parameter '" + tokens[next] + "'";
+                    return false;
+                }
+            }
+            stage.a = params[0];
+            stage.b = params[1];
+        }
+
+        if(next != tokens.size()){
+            error = where + "unexpected '" + tokens[next] + "'";
+            return false;
+        }
+        graph.stages.push_back(stage);
+    }
+
+    if(!outputName.empty() && (graph.output = graph.find(outputName)) < 0){
+        error = std::string(path) + ": undefined output '" + outputName + "'";
+        return false;
+    }
+    return true;
+}
+
+// =================================================================
+// --------------------------- Plan --------------------------------
+// =================================================================
+
+/**
+ * Build the execution plan of a graph: check the stages, drop those that do
+ * not reach the output, assign buffer slots and derive the dependencies.
+ * */
+
+bool compileFilterGraph(const FilterGraph &graph,
+                        FilterPlan &plan,
+                        std::string &error){
+    int stageCount = graph.stages.size();
+    int output = graph.output >= 0 ? graph.output : stageCount - 1;
+
+    if(stageCount == 0 || output >= stageCount){
+        error = "the graph has no output stage";
+        return false;
+    }
+
+    /**
+     * Check the stages; inputs must come earlier, so the graph is acyclic
+     * and its index order is a valid execution order.
+     * */
+
+    for(int s = 0; s < stageCount; s++){
+        const GraphStage &stage = graph.stages[s];
+        int inputCount = stage.kind == STAGE_GRAY ? 0 : (stage.kind == STAGE_COMBINE ? 2 : 1);
+        for(int i = 0; i < 2; i++){
+            bool used = i < inputCount;
+            if(used != (stage.inputs[i] >= 0) || stage.inputs[i] >= s){
+                error = "stage '" + stage.name + "' has bad inputs";
+                return false;
+            }
+        }
+        if(stage.kind == STAGE_CONVOLVE
+        && (stage.maskSize % 2 == 0 || stage.maskSize > GRAPH_MAX_MASK_SIZE || stage.mask.size() != stage.maskSize * stage.maskSize)){
+            error = "stage '" + stage.name + "' needs an odd mask of at most " + std::to_string(GRAPH_MAX_MASK_SIZE) + " taps a side";
+            return false;
+        }
+        if(stage.kind == STAGE_MEDIAN && (stage.maskSize % 2 == 0 || stage.maskSize < 3 || stage.maskSize > MEDIAN_MAX_SIZE)){
+            error = "stage '" + stage.name + "' needs an odd window of 3 to " + std::to_string(MEDIAN_MAX_SIZE) + " pixels a side";
+            return false;
+        }
+        if(stage.kind == STAGE_MORPH && (stage.maskSize % 2 == 0 || stage.maskHeight % 2 == 0
+                                         || stage.maskSize > MORPH_MAX_SIZE || stage.maskHeight > MORPH_MAX_SIZE)){
+            error = "stage '" + stage.name + "' needs an element of odd width and height, 1 to "
+                  + std::to_string(MORPH_MAX_SIZE) + " pixels";
+            return false;
+        }
+        if(stage.kind == STAGE_CONTRAST && !(stage.a >= 0 && stage.a < 0.5f)){
+            error = "stage '" + stage.name + "' needs a clip fraction in [0, 0.5)";
+            return false;
+        }
+    }
+
+    /**
+     * Keep the stages the output depends on.
+     * */
+
+    std::vector<bool> live(stageCount, false);
+    live[output] = true;
+    for(int s = output; s >= 0; s--){
+        for(int i = 0; i < 2 && live[s]; i++){
+            if(graph.stages[s].inputs[i] >= 0){
+                live[graph.stages[s].inputs[i]] = true;
+            }
+        }
+    }
+
+    std::vector<int> stepOf(stageCount, -1);
+    plan = FilterPlan();
+    for(int s = 0; s < stageCount; s++){
+        if(live[s]){
+            stepOf[s] = plan.stages.size();
+            plan.stages.push_back(graph.stages[s]);
+        }
+    }
+    for(GraphStage &stage : plan.stages){
+        for(int i = 0; i < 2; i++){
+            stage.inputs[i] = stage.inputs[i] >= 0 ? stepOf[stage.inputs[i]] : -1;
+        }
+    }
+
+    /**
+     * Last step reading each stage; the output is never released.
+     * */
+
+    int steps = plan.stages.size();
+    std::vector<int> lastUse(steps, -1);
+    for(int t = 0; t < steps; t++){
+        for(int i = 0; i < 2; i++){
+            if(plan.stages[t].inputs[i] >= 0){
+                lastUse[plan.stages[t].inputs[i]] = t;
+            }
+        }
+    }
+    lastUse[steps - 1] = steps;
+
+    /**
+     * Steps each step transitively depends on through its inputs.
+     * */
+
+    std::vector<std::vector<bool>> ancestor(steps, std::vector<bool>(steps, false));
+    for(int t = 0; t < steps; t++){
+        for(int i = 0; i < 2; i++){
+            int input = plan.stages[t].inputs[i];
+            if(input >= 0){
+                ancestor[t][input] = true;
+                for(int u = 0; u < input; u++){
+                    ancestor[t][u] = ancestor[t][u] || ancestor[input][u];
+                }
+            }
+        }
+    }
+
+    /**
+     * Give each step the lowest free slot whose previous writer and readers
+     * are already among its ancestors, so that reusing it adds no ordering
+     * between independent branches; a chain alternates between two slots.
+     * Overwriting a slot waits for its previous writer and readers, besides
+     * the producers of the inputs.
+     * */
+
+    std::vector<int> slotOf(steps), slotWriter, freeSlots;
+    std::vector<std::vector<int>> slotReaders;
+
+    for(int t = 0; t < steps; t++){
+        PlanStep step;
+        step.stage = t;
+
+        for(int i = 0; i < 2; i++){
+            int input = plan.stages[t].inputs[i];
+            if(input >= 0){
+                step.inputs[i] = slotOf[input];
+                step.after.push_back(input);
+            }
+        }
+
+        std::sort(freeSlots.begin(), freeSlots.end());
+        auto reusable = std::find_if(freeSlots.begin(), freeSlots.end(), [&](int slot){
+            bool ordered = slotWriter[slot] < 0 || ancestor[t][slotWriter[slot]];
+            for(int reader : slotReaders[slot]){
+                ordered = ordered && ancestor[t][reader];
+            }
+            return ordered;
+        });
+        if(reusable == freeSlots.end()){
+            reusable = freeSlots.insert(freeSlots.end(), plan.slots++);
+            slotWriter.push_back(-1);
+            slotReaders.push_back(std::vector<int>());
+        }
+        step.output = slotOf[t] = *reusable;
+        freeSlots.erase(reusable);
+
+        if(slotWriter[step.output] >= 0){
+            step.after.push_back(slotWriter[step.output]);
+        }
+        step.after.insert(step.after.end(), slotReaders[step.output].begin(), slotReaders[step.output].end());
+        slotWriter[step.output] = t;
+        slotReaders[step.output].clear();
+
+        for(int i = 0; i < 2; i++){
+            int input = plan.stages[t].inputs[i];
+            if(input >= 0){
+                slotReaders[slotOf[input]].push_back(t);
+                if(lastUse[input] == t && std::find(freeSlots.begin(), freeSlots.end(), slotOf[input]) == freeSlots.end()){
+                    freeSlots.push_back(slotOf[input]);
+                }
+            }
+        }
+
+        std::sort(step.after.begin(), step.after.end());
+        step.after.erase(std::unique(step.after.begin(), step.after.end()), step.after.end());
+        plan.steps.push_back(step);
+    }
+
+    plan.result = slotOf[steps - 1];
+    return true;
+}
+
+// =================================================================
+// ------------------------- CPU backend ---------------------------
+// =================================================================
+
+/**
+ * Sequentially apply a per-pixel operation.
+ * */
+
+void seqPointOp(PointOp op,
+                float a,
+                float b,
+                size_t imgSize,
+                const unsigned char *inputImg,
+                unsigned char *outputImg){
+    int lo = a < 0 ? 0 : (a > 255 ? 255 : (int) a);
+    int hi = b < 0 ? 0 : (b > 255 ? 255 : (int) b);
+
+    for(size_t i = 0; i < imgSize; i++){
+        int p = inputImg[i];
+        int value;
+        switch(op){
+            case POINT_CLAMP:     value = p < lo ? lo : (p > hi ? hi : p); break;
+            case POINT_SCALE:     value = (int)(p * a + b); break;
+            case POINT_INVERT:    value = 255 - p; break;
+            default:              value = p >= a ? 255 : 0; break;
+        }
+        outputImg[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+}
+
+/**
+ * Sequentially combine two images pixel by pixel.
+ * */
+
+void seqCombine(CombineOp op,
+                float a,
+                float b,
+                size_t imgSize,
+                const unsigned char *inputImg0,
+                const unsigned char *inputImg1,
+                unsigned char *outputImg){
+    for(size_t i = 0; i < imgSize; i++){
+        int p = inputImg0[i];
+        int q = inputImg1[i];
+        int value;
+        switch(op){
+            case COMBINE_ADD:     value = p + q; break;
+            case COMBINE_SUB:     value = p - q; break;
+            case COMBINE_ABSDIFF: value = abs(p - q); break;
+            case COMBINE_MIN:     value = p < q ? p : q; break;
+            case COMBINE_MAX:     value = p > q ? p : q; break;
+            default:              value = (int)(p * a + q * b); break;
+        }
+        outputImg[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+}
+
+/**
+ * Sequentially run a plan on an image, step by step over its slots. The
+ * statistics of the output of every stage whose index in plan.stages is a
+ * key of stats are filled in.
+ * */
+
+void seqRunPlan(const FilterPlan &plan,
+                unsigned int imgWidth,
+                unsigned int imgHeight,
+                unsigned char *inputRchannel,
+                unsigned char *inputGchannel,
+                unsigned char *inputBchannel,
+                unsigned char *outputImg,
+                std::map<int, ImageStats> *stats){
+    size_t imgSize = (size_t) imgWidth * imgHeight;
+    ScratchArena &arena = threadArena();
+    ArenaScope frame(arena);
+
+    unsigned char **slots = (unsigned char**) arena.allocate(plan.slots * sizeof(unsigned char*));
+    for(int slot = 0; slot < plan.slots; slot++){
+        slots[slot] = (unsigned char*) arena.allocate(imgSize);
+    }
+
+    for(const PlanStep &step : plan.steps){
+        const GraphStage &stage = plan.stages[step.stage];
+        unsigned char *out = slots[step.output];
+        unsigned char *in0 = step.inputs[0] >= 0 ? slots[step.inputs[0]] : nullptr;
+        unsigned char *in1 = step.inputs[1] >= 0 ? slots[step.inputs[1]] : nullptr;
+
+        switch(stage.kind){
+            case STAGE_GRAY:
+                seqRgb2Gray(imgWidth, imgHeight, inputRchannel, inputGchannel, inputBchannel, out);
+                break;
+            case STAGE_CONVOLVE:
+                seqConvolve(imgWidth, imgHeight, stage.maskSize, in0, const_cast<float*>(stage.mask.data()), out);
+                break;
+            case STAGE_POINT:
+                seqPointOp((PointOp) stage.op, stage.a, stage.b, imgSize, in0, out);
+                break;
+            case STAGE_COMBINE:
+                seqCombine((CombineOp) stage.op, stage.a, stage.b, imgSize, in0, in1, out);
+                break;
+            case STAGE_CONTRAST:
+                seqAutoContrast(stage.a, imgSize, in0, out);
+                break;
+            case STAGE_MEDIAN:
+                seqMedian(imgWidth, imgHeight, stage.maskSize, in0, out);
+                break;
+            case STAGE_MORPH:
+                seqMorphology((MorphOp) stage.op, imgWidth, imgHeight, stage.maskSize, stage.maskHeight, in0, out);
+                break;
+        }
+
+        if(stats && stats->count(step.stage)){
+            seqImageStats(out, imgSize, 0, (*stats)[step.stage]);
+        }
+    }
+
+    memcpy(outputImg, slots[plan.result], imgSize);
+}
@@ -0,0 +1,150 @@
+/**
+ * Declarative filter graph: a DAG of stages over gray images, described in
+ * code or in a small config file, compiled into an execution plan.
+ *
+ * Every stage writes one gray image of the input size. The plan orders the
+ * stages that reach the output, gives each one a buffer slot that is reused
+ * as soon as its last reader has run (a chain needs two ping-pong slots),
+ * and lists for each step the steps it must wait for: the producers of its
+ * inputs, and the last writer and readers of the slot it overwrites. The
+ * CPU runs the steps in order; the device runs them on an out-of-order
+ * queue with those dependencies as events, so independent branches overlap.
+ *
+ * Config file, one stage per line, '#' starts a comment:
+ *   <name> gray
+ *   <name> convolve <input> <size> <size*size mask values, row by row>
+ *   <name> point <clamp|scale|invert|threshold> <input> [a [b]]
+ *   <name> combine <add|sub|absdiff|min|max|weighted> <input> <input> [a b]
+ *   <name> contrast <input> [clip]
+ *   <name> median <input> <size>
+ *   <name> morph <erode|dilate|open|close> <input> <width> [height]
+ *   output <name>
+ * Inputs must be defined above; without an output line the last stage is
+ * the output. A contrast stage stretches its input to 0..255, saturating
+ * the clip fraction of the pixels at each end (default 0: min to max). A
+ * median stage takes odd windows of 3 to MEDIAN_MAX_SIZE pixels a side, and
+ * a morph stage an odd rectangle of 1 to MORPH_MAX_SIZE pixels a side,
+ * square by default.
+ * */
+
+#ifndef FILTER_GRAPH_H
+#define FILTER_GRAPH_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "image_stats.h"
+#include "median_filter.h"
+#include "morphology.h"
+
+#define GRAPH_MAX_MASK_SIZE 9           // must match MAX_MASK_SIZE in image_filtering.cl
+
+enum StageKind {
+    STAGE_GRAY,                         // RGB input to gray, as seqRgb2Gray
+    STAGE_CONVOLVE,                     // mask convolution, as seqConvolve
+    STAGE_POINT,                        // per-pixel operation on one input
+    STAGE_COMBINE,                      // per-pixel operation on two inputs
+    STAGE_CONTRAST,                     // auto-contrast stretch, as seqAutoContrast
+    STAGE_MEDIAN,                       // median of size x size windows, as seqMedian
+    STAGE_MORPH                         // erosion, dilation, opening or closing, as seqMorphology
+};
+
+enum PointOp {
+    POINT_CLAMP,                        // clamp(p, a, b)
+    POINT_SCALE,                        // clamp((int)(p * a + b), 0, 255)
+    POINT_INVERT,                       // 255 - p
+    POINT_THRESHOLD                     // p >= a ? 255 : 0
+};                                      // Values must match image_filtering.cl.
+
+enum CombineOp {
+    COMBINE_ADD,                        // min(p + q, 255)
+    COMBINE_SUB,                        // max(p - q, 0)
+    COMBINE_ABSDIFF,                    // |p - q|
+    COMBINE_MIN,
+    COMBINE_MAX,
+    COMBINE_WEIGHTED                    // clamp((int)(p * a + q * b), 0, 255)
+};                                      // Values must match image_filtering.cl.
+
+struct GraphStage {
+    std::string name;
+    StageKind kind;
+    int op = 0;                         // PointOp, CombineOp or MorphOp
+    int inputs[2] = {-1, -1};           // indices of the input stages
+    unsigned int maskSize = 0;          // also the window size of a median, and the element width
+    unsigned int maskHeight = 0;        // element height of a morphology
+    std::vector<float> mask;            // row by row, as the masks of seqFilter
+    float a = 0, b = 0;                 // operation parameters; contrast: a is the clip fraction
+};
+
+class FilterGraph {
+public:
+    std::vector<GraphStage> stages;
+    int output = -1;                    // stage read back; -1 for the last one
+
+    int find(const std::string &name) const;                        // Index of a stage, or -1.
+
+    int gray(const std::string &name);                              // Add a stage; each returns its index.
+    int convolve(const std::string &name, int input, unsigned int maskSize, const float *mask);
+    int point(const std::string &name, PointOp op, int input, float a = 0, float b = 0);
+    int combine(const std::string &name, CombineOp op, int input0, int input1, float a = 0, float b = 0);
+    int contrast(const std::string &name, int input, float clip = 0);
+    int median(const std::string &name, int input, unsigned int size);
+    int morph(const std::string &name, MorphOp op, int input, unsigned int width, unsigned int height);
+};
+
+bool loadFilterGraph(const char *path,
+                     FilterGraph &graph,
+                     std::string &error);               // Parse a config file; false with a message on error.
+
+FilterGraph defaultFilterGraph(unsigned int lpMaskSize,
+                               unsigned int hpMaskSize,
+                               float *lpMask,
+                               float *hpMask);          // gray -> low-pass -> high-pass, as seqFilter.
+
+// =================================================================
+// --------------------------- Plan --------------------------------
+// =================================================================
+
+struct PlanStep {
+    int stage;                          // index in FilterPlan::stages
+    int output;                         // slot written
+    int inputs[2] = {-1, -1};           // slots read
+    std::vector<int> after;             // steps that must complete first
+};
+
+struct FilterPlan {
+    std::vector<GraphStage> stages;
+    std::vector<PlanStep> steps;        // in a valid sequential order
+    int slots = 0;                      // gray buffers needed
+    int result = -1;                    // slot holding the output
+};
+
+bool compileFilterGraph(const FilterGraph &graph,
+                        FilterPlan &plan,
+                        std::string &error);            // Build the execution plan of a graph.
+
+void seqPointOp(PointOp op,
+                float a,
+                float b,
+                size_t imgSize,
+                const unsigned char *inputImg,
+                unsigned char *outputImg);              // Sequentially apply a per-pixel operation.
+
+void seqCombine(CombineOp op,
+                float a,
+                float b,
+                size_t imgSize,
+                const unsigned char *inputImg0,
+                const unsigned char *inputImg1,
+                unsigned char *outputImg);              // Sequentially combine two images pixel by pixel.
+
+void seqRunPlan(const FilterPlan &plan,
+                unsigned int imgWidth,
+                unsigned int imgHeight,
+                unsigned char *inputRchannel,
+                unsigned char *inputGchannel,
+                unsigned char *inputBchannel,
+                unsigned char *outputImg,
+                std::map<int, ImageStats> *stats = nullptr);    // Sequentially run a plan on an image.
+
+#endif
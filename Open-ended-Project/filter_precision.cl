@@ -0,0 +1,144 @@
+// Vector kernels of the precision policy, specialised per stage with -D:
+//   IN_T    storage type of the stage input: uchar, half or float
+//   OUT_T   storage type of the stage output: uchar, half or float
+//   ACC_T   arithmetic type: float or half
+//   VEC     pixels per work-item
+//   IN_HALF, OUT_HALF  set when IN_T, OUT_T is half
+// Every stage rounds as seqFilter: the sums are truncated after each term
+// and clamped to 0..255, so intermediates are whole numbers that uchar,
+// half and float all store exactly. With float arithmetic the output is
+// that of seqFilter; with half the products and sums round to 11 bits.
+// Half storage goes through vload_half/vstore_half, which need no
+// cl_khr_fp16; only half arithmetic (USE_HALF) does.
+
+#ifdef USE_HALF
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#endif
+
+// Keep a*b+c as two rounded operations, as in seqConvolve
+#pragma OPENCL FP_CONTRACT OFF
+
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+
+#define VTYPE(t) CAT(t, VEC)                            // e.g. float4
+#define VLOAD CAT(vload, VEC)
+#define VSTORE CAT(vstore, VEC)
+#define CONVERT(t, x) CAT(convert_, VTYPE(t))(x)
+
+// VEC stage inputs at p as ACC_T, and input i as ACC_T
+#ifdef IN_HALF
+#define LOAD_IN(p) CONVERT(ACC_T, CAT(vload_half, VEC)(0, p))
+#define LOAD_IN1(p, i) ((ACC_T) vload_half(i, p))
+#else
+#define LOAD_IN(p) CONVERT(ACC_T, VLOAD(0, p))
+#define LOAD_IN1(p, i) ((ACC_T) (p)[i])
+#endif
+
+// Store VEC values (any vector type) at p, and value v at output i
+#ifdef OUT_HALF
+#define STORE_OUT(v, p) CAT(vstore_half, VEC)(CONVERT(float, v), 0, p)
+#define STORE_OUT1(v, p, i) vstore_half((float) (v), i, p)
+#else
+#define STORE_OUT(v, p) VSTORE(CONVERT(OUT_T, v), 0, p)
+#define STORE_OUT1(v, p, i) ((p)[i] = (OUT_T) (v))
+#endif
+
+// =================================================================
+// ----------------------- Helper Functions ------------------------
+// =================================================================
+
+/**
+ * One output pixel, for the work-items at the image border or past its
+ * width.
+ * */
+
+ACC_T filterScalar(int x,
+                   int y,
+                   int imgWidth,
+                   int imgHeight,
+                   int maskSize,
+                   global const IN_T *input,
+                   global const float *mask){
+    int radius = maskSize / 2;
+
+    if(x < radius || y < radius || x >= imgWidth - radius || y >= imgHeight - radius){
+        return 0;
+    }
+
+    ACC_T outSum = 0;
+    for(int k = 0; k < maskSize; k++){
+        for(int l = 0; l < maskSize; l++){
+            ACC_T pixel = LOAD_IN1(input, (y - radius + l) * imgWidth + x - radius + k);
+            outSum = trunc(outSum + pixel * (ACC_T) mask[(maskSize-1-k) + (maskSize-1-l)*maskSize]);
+        }
+    }
+    return clamp(outSum, (ACC_T) 0, (ACC_T) 255);
+}
+
+// =================================================================
+// ------------------------- Vector kernels ------------------------
+// =================================================================
+
+/**
+ * Convert VEC consecutive pixels of an RGB image to grayscale. The global
+ * size is ceil(imgWidth * imgHeight / VEC).
+ * */
+
+__kernel void rgb2grayVector(uint imgSize,
+                             global const uchar *inputR,
+                             global const uchar *inputG,
+                             global const uchar *inputB,
+                             global OUT_T *output){
+    int idx = get_global_id(0) * VEC;
+
+    if(idx + VEC <= imgSize){
+        VTYPE(int) sum = CONVERT(int, VLOAD(0, inputR + idx)) + CONVERT(int, VLOAD(0, inputG + idx)) + CONVERT(int, VLOAD(0, inputB + idx));
+        STORE_OUT(sum / 3, output + idx);
+        return;
+    }
+
+    for(int i = idx; i < imgSize; i++){
+        STORE_OUT1((inputR[i] + inputG[i] + inputB[i]) / 3, output, i);
+    }
+}
+
+/**
+ * Convolve VEC consecutive pixels of a row with a mask. The global size is
+ * (ceil(imgWidth / VEC), imgHeight).
+ * */
+
+__kernel void filterVector(uint maskSize,
+                           uint imgWidth,
+                           uint imgHeight,
+                           global const IN_T *input,
+                           global const float *mask,
+                           global OUT_T *output){
+    int x0 = get_global_id(0) * VEC;
+    int y = get_global_id(1);
+    int radius = maskSize / 2;
+
+    if(y >= imgHeight){
+        return;
+    }
+
+    /**
+     * Whole vectors clear of the border: each term is one vector load.
+     * */
+
+    if(y >= radius && y < (int) imgHeight - radius && x0 >= radius && x0 + VEC <= (int) imgWidth - radius){
+        VTYPE(ACC_T) outSum = 0;
+        for(int k = 0; k < maskSize; k++){
+            for(int l = 0; l < maskSize; l++){
+                VTYPE(ACC_T) pixel = LOAD_IN(input + (y - radius + l) * imgWidth + x0 - radius + k);
+                outSum = trunc(outSum + pixel * (ACC_T) mask[(maskSize-1-k) + (maskSize-1-l)*maskSize]);
+            }
+        }
+        STORE_OUT(clamp(outSum, (ACC_T) 0, (ACC_T) 255), output + y * imgWidth + x0);
+        return;
+    }
+
+    for(int x = x0; x < x0 + VEC && x < imgWidth; x++){
+        STORE_OUT1(filterScalar(x, y, imgWidth, imgHeight, maskSize, input, mask), output, y * imgWidth + x);
+    }
+}
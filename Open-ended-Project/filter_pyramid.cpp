@@ -0,0 +1,261 @@
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include "filter_pyramid.h"
+#include "filter_graph.h"
+#include "dirty_tiles.h"
+
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
+/**
+ * Rounded mean of the 2^level x 2^level blocks of one channel, cut by the
+ * right and bottom edges.
+ * */
+
+void seqDownsample(unsigned int imgWidth,
+                   unsigned int imgHeight,
+                   unsigned int level,
+                   const unsigned char *inputImg,
+                   unsigned char *outputImg){
+    unsigned int block = 1u << level;
+    unsigned int width = levelPixels(imgWidth, level);
+    unsigned int height = levelPixels(imgHeight, level);
+
+    for(unsigned int y = 0; y < height; y++){
+        for(unsigned int x = 0; x < width; x++){
+            unsigned int x1 = (x + 1) * block < imgWidth ? (x + 1) * block : imgWidth;
+            unsigned int y1 = (y + 1) * block < imgHeight ? (y + 1) * block : imgHeight;
+            unsigned int count = (x1 - x * block) * (y1 - y * block);
+            unsigned int sum = 0;
+            for(unsigned int j = y * block; j < y1; j++){
+                for(unsigned int i = x * block; i < x1; i++){
+                    sum += inputImg[i + (size_t) j * imgWidth];
+                }
+            }
+            outputImg[x + (size_t) y * width] = (sum + count / 2) / count;
+        }
+    }
+}
+
+// =================================================================
+// --------------------------- Pyramid -----------------------------
+// =================================================================
+
+/**
+ * Upload the image and build its pyramid in one launch, waiting for it.
+ * */
+
+FilterPyramid::FilterPyramid(const cl::Context &context,
+                             const cl::Device &device,
+                             const cl::Program &program,
+                             unsigned int imgWidth,
+                             unsigned int imgHeight,
+                             const unsigned char *inputRchannel,
+                             const unsigned char *inputGchannel,
+                             const unsigned char *inputBchannel,
+                             unsigned int lpMaskSize,
+                             unsigned int hpMaskSize,
+                             const float *lpMask,
+                             const float *hpMask,
+                             unsigned int levels)
+    : context(context), program(program), imgWidth(imgWidth), imgHeight(imgHeight),
+      lpMaskSize(lpMaskSize), hpMaskSize(hpMaskSize){
+    for(unsigned int size : {lpMaskSize, hpMaskSize}){
+        if(size % 2 == 0 || size > GRAPH_MAX_MASK_SIZE){
+            throw std::invalid_argument("pyramid masks must be odd and at most "
+                                        + std::to_string(GRAPH_MAX_MASK_SIZE) + " taps a side");
+        }
+    }
+
+    levels = levels < PYRAMID_MAX_LEVELS ? levels : PYRAMID_MAX_LEVELS;
+    levelCount = levels + 1;
+    queue = cl::CommandQueue(context, device);
+    lpMaskBuf = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, lpMaskSize * lpMaskSize * sizeof(float), (void*) lpMask);
+    hpMaskBuf = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, hpMaskSize * hpMaskSize * sizeof(float), (void*) hpMask);
+
+    size_t imgSize = (size_t) imgWidth * imgHeight;
+    size_t pyramidSize = 0;
+    offsets.push_back(0);
+    for(unsigned int level = 1; level <= levels; level++){
+        offsets.push_back(pyramidSize);
+        pyramidSize += 3 * (size_t) levelPixels(imgWidth, level) * levelPixels(imgHeight, level);
+    }
+
+    inputBuf = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY, 3 * imgSize);
+    pyramidBuf = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, pyramidSize > 0 ? pyramidSize : 1);
+
+    cl::Kernel kernel(program, "buildPyramid");
+    kernel.setArg(0, sizeof(unsigned int), &imgWidth);
+    kernel.setArg(1, sizeof(unsigned int), &imgHeight);
+    kernel.setArg(2, sizeof(unsigned int), &levels);
+    kernel.setArg(3, inputBuf);
+    kernel.setArg(4, pyramidBuf);
+
+    unsigned int groupsX = (levelPixels(imgWidth, 1) + PYRAMID_GROUP - 1) / PYRAMID_GROUP;
+    unsigned int groupsY = (levelPixels(imgHeight, 1) + PYRAMID_GROUP - 1) / PYRAMID_GROUP;
+    cl_int err = queue.enqueueWriteBuffer(inputBuf, CL_FALSE, 0, imgSize, inputRchannel);
+    err |= queue.enqueueWriteBuffer(inputBuf, CL_FALSE, imgSize, imgSize, inputGchannel);
+    err |= queue.enqueueWriteBuffer(inputBuf, CL_FALSE, 2 * imgSize, imgSize, inputBchannel);
+    if(levels > 0){
+        err |= queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(groupsX * PYRAMID_GROUP, groupsY * PYRAMID_GROUP),
+                                          cl::NDRange(PYRAMID_GROUP, PYRAMID_GROUP));
+    }
+    err |= queue.finish();
+    if(err != CL_SUCCESS){
+        throw std::runtime_error("pyramid build failed");
+    }
+}
+
+unsigned int FilterPyramid::levels() const{
+    return levelCount;
+}
+
+unsigned int FilterPyramid::width(unsigned int level) const{
+    return levelPixels(imgWidth, level);
+}
+
+unsigned int FilterPyramid::height(unsigned int level) const{
+    return levelPixels(imgHeight, level);
+}
+
+unsigned int FilterPyramid::tilesX(unsigned int level) const{
+    return (width(level) + PYRAMID_TILE_SIZE - 1) / PYRAMID_TILE_SIZE;
+}
+
+unsigned int FilterPyramid::tilesY(unsigned int level) const{
+    return (height(level) + PYRAMID_TILE_SIZE - 1) / PYRAMID_TILE_SIZE;
+}
+
+PyramidStats FilterPyramid::stats() const{
+    return counters;
+}
+
+/**
+ * The whole level, filtered; computed on the first request and cached once
+ * the launch has succeeded, so a failed one is retried on the next request.
+ * */
+
+const std::vector<unsigned char> &FilterPyramid::preview(unsigned int level){
+    if(level >= levelCount){
+        throw std::out_of_range("no such pyramid level");
+    }
+
+    auto cached = previews.find(level);
+    if(cached != previews.end()){
+        counters.cacheHits++;
+        return cached->second;
+    }
+
+    std::vector<unsigned char> output((size_t) width(level) * height(level));
+    filterRegion(level, 0, 0, width(level), height(level), output.data());
+    counters.previews++;
+    return previews.emplace(level, std::move(output)).first->second;
+}
+
+/**
+ * One tile of a level, filtered: cut from the preview of the level if there
+ * is one, else computed on its own on the first request.
+ * */
+
+const std::vector<unsigned char> &FilterPyramid::tile(unsigned int level,
+                                                      unsigned int tileX,
+                                                      unsigned int tileY){
+    if(level >= levelCount || tileX >= tilesX(level) || tileY >= tilesY(level)){
+        throw std::out_of_range("no such pyramid tile");
+    }
+
+    auto key = std::make_tuple(level, tileX, tileY);
+    auto cached = tiles.find(key);
+    if(cached != tiles.end()){
+        counters.cacheHits++;
+        return cached->second;
+    }
+
+    unsigned int x0 = tileX * PYRAMID_TILE_SIZE;
+    unsigned int y0 = tileY * PYRAMID_TILE_SIZE;
+    unsigned int x1 = x0 + PYRAMID_TILE_SIZE < width(level) ? x0 + PYRAMID_TILE_SIZE : width(level);
+    unsigned int y1 = y0 + PYRAMID_TILE_SIZE < height(level) ? y0 + PYRAMID_TILE_SIZE : height(level);
+    std::vector<unsigned char> output((size_t) (x1 - x0) * (y1 - y0));
+
+    auto whole = previews.find(level);
+    if(whole != previews.end()){
+        for(unsigned int y = y0; y < y1; y++){
+            memcpy(&output[(size_t) (y - y0) * (x1 - x0)], &whole->second[x0 + (size_t) y * width(level)], x1 - x0);
+        }
+        counters.cacheHits++;
+        return tiles.emplace(key, std::move(output)).first->second;
+    }
+
+    filterRegion(level, x0, y0, x1, y1, output.data());
+    counters.tiles++;
+    return tiles.emplace(key, std::move(output)).first->second;
+}
+
+/**
+ * Filter [x0, x1) x [y0, y1) of a level into output, row by row: copy the
+ * region grown by the halo of both masks, clipped to the level, out of the
+ * pyramid, run the batch kernels on that crop as on a whole image and read
+ * the region back. Where the crop is cut by the level's edges, the masks do
+ * not fit there either, so the region is as in seqFilter on the level.
+ * */
+
+void FilterPyramid::filterRegion(unsigned int level,
+                                 unsigned int x0,
+                                 unsigned int y0,
+                                 unsigned int x1,
+                                 unsigned int y1,
+                                 unsigned char *output){
+    unsigned int levelWidth = width(level), levelHeight = height(level);
+    unsigned int halo = lpMaskSize / 2 + hpMaskSize / 2;
+    unsigned int cropX = x0 > halo ? x0 - halo : 0;
+    unsigned int cropY = y0 > halo ? y0 - halo : 0;
+    unsigned int cropWidth = (x1 + halo < levelWidth ? x1 + halo : levelWidth) - cropX;
+    unsigned int cropHeight = (y1 + halo < levelHeight ? y1 + halo : levelHeight) - cropY;
+    size_t cropSize = (size_t) cropWidth * cropHeight;
+
+    cl::Buffer rgbBuf(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, 3 * cropSize);
+    cl::Buffer grayBuf(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, cropSize);
+    cl::Buffer lpBuf(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, cropSize);
+    cl::Buffer outputBuf(context, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, cropSize);
+
+    cl::Kernel grayKernel(program, "rgb2grayBatch");
+    grayKernel.setArg(0, rgbBuf);
+    grayKernel.setArg(1, grayBuf);
+
+    cl::Kernel lpKernel(program, "convolveBatch");
+    lpKernel.setArg(0, sizeof(unsigned int), &lpMaskSize);
+    lpKernel.setArg(1, sizeof(unsigned int), &cropWidth);
+    lpKernel.setArg(2, sizeof(unsigned int), &cropHeight);
+    lpKernel.setArg(3, grayBuf);
+    lpKernel.setArg(4, lpMaskBuf);
+    lpKernel.setArg(5, lpBuf);
+
+    cl::Kernel hpKernel(program, "convolveBatch");
+    hpKernel.setArg(0, sizeof(unsigned int), &hpMaskSize);
+    hpKernel.setArg(1, sizeof(unsigned int), &cropWidth);
+    hpKernel.setArg(2, sizeof(unsigned int), &cropHeight);
+    hpKernel.setArg(3, lpBuf);
+    hpKernel.setArg(4, hpMaskBuf);
+    hpKernel.setArg(5, outputBuf);
+
+    /**
+     * The R, G and B planes of the level are the slices of a 3D region.
+     * */
+
+    size_t levelSize = (size_t) levelWidth * levelHeight;
+    cl::NDRange tiles(tileCount(cropWidth) * 16, tileCount(cropHeight) * 16, 1);
+    cl_int err = queue.enqueueCopyBufferRect(level == 0 ? inputBuf : pyramidBuf, rgbBuf,
+                                             {offsets[level] + cropX, cropY, 0}, {0, 0, 0}, {cropWidth, cropHeight, 3},
+                                             levelWidth, levelSize, cropWidth, cropSize);
+    err |= queue.enqueueNDRangeKernel(grayKernel, cl::NullRange, cl::NDRange(cropWidth, cropHeight, 1));
+    err |= queue.enqueueNDRangeKernel(lpKernel, cl::NullRange, tiles, cl::NDRange(16, 16, 1));
+    err |= queue.enqueueNDRangeKernel(hpKernel, cl::NullRange, tiles, cl::NDRange(16, 16, 1));
+    err |= queue.enqueueReadBufferRect(outputBuf, CL_TRUE, {x0 - cropX, y0 - cropY, 0}, {0, 0, 0}, {x1 - x0, y1 - y0, 1},
+                                       cropWidth, 0, x1 - x0, 0, output);
+    if(err != CL_SUCCESS){
+        queue.finish();
+        throw std::runtime_error("pyramid filter launch failed");
+    }
+}
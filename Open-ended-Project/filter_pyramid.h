@@ -0,0 +1,107 @@
+/**
+ * Multi-resolution filtering of large images: a coarse preview at once,
+ * full-resolution tiles only where they are looked at.
+ *
+ * The input goes to the device once, and one launch of buildPyramid builds
+ * up to PYRAMID_MAX_LEVELS downsampled levels from it: pixel (x, y) of
+ * level l is the rounded mean of the 2^l x 2^l block of input pixels at
+ * (x * 2^l, y * 2^l), cut by the right and bottom edges. Level 0 is the
+ * input itself. The gray -> low-pass -> high-pass chain then runs at any
+ * level, either on the whole level (a preview) or on one PYRAMID_TILE_SIZE
+ * tile of it, computed from a crop grown by the halo of both masks so that
+ * the tile matches seqFilter on the whole level. Previews and tiles are
+ * cached per level and tile, and a tile of a level whose preview exists is
+ * cut from it. Not thread-safe.
+ * */
+
+#ifndef FILTER_PYRAMID_H
+#define FILTER_PYRAMID_H
+
+#ifndef CL_HPP_TARGET_OPENCL_VERSION
+#define CL_HPP_TARGET_OPENCL_VERSION 200
+#define CL_HPP_ENABLE_PROGRAM_CONSTRUCTION_FROM_ARRAY_COMPATIBILITY 1
+#endif
+#include <CL/opencl.hpp>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#define PYRAMID_MAX_LEVELS 5            // levels built below the input; must match image_filtering.cl
+#define PYRAMID_GROUP 16                // work-group edge of buildPyramid, 2^(PYRAMID_MAX_LEVELS - 1)
+#define PYRAMID_TILE_SIZE 256           // side of the tiles served
+
+struct PyramidStats {
+    size_t previews = 0;                // whole levels filtered
+    size_t tiles = 0;                   // tiles filtered
+    size_t cacheHits = 0;               // requests served from the cache
+};
+
+/**
+ * Pixels of a dimension of the image at a level.
+ * */
+
+inline unsigned int levelPixels(unsigned int pixels, unsigned int level){
+    return (pixels + (1u << level) - 1) >> level;
+}
+
+void seqDownsample(unsigned int imgWidth,
+                   unsigned int imgHeight,
+                   unsigned int level,
+                   const unsigned char *inputImg,
+                   unsigned char *outputImg);               // One channel at a pyramid level, as buildPyramid.
+
+class FilterPyramid {
+public:
+    FilterPyramid(const cl::Context &context,
+                  const cl::Device &device,
+                  const cl::Program &program,
+                  unsigned int imgWidth,
+                  unsigned int imgHeight,
+                  const unsigned char *inputRchannel,
+                  const unsigned char *inputGchannel,
+                  const unsigned char *inputBchannel,
+                  unsigned int lpMaskSize,
+                  unsigned int hpMaskSize,
+                  const float *lpMask,
+                  const float *hpMask,
+                  unsigned int levels = PYRAMID_MAX_LEVELS);      // Upload the image and build the pyramid. Throws std::invalid_argument on an even or too large mask.
+
+    unsigned int levels() const;                                    // Levels, the input included.
+    unsigned int width(unsigned int level) const;
+    unsigned int height(unsigned int level) const;
+    unsigned int tilesX(unsigned int level) const;
+    unsigned int tilesY(unsigned int level) const;
+
+    const std::vector<unsigned char> &preview(unsigned int level);  // The whole level, filtered.
+
+    const std::vector<unsigned char> &tile(unsigned int level,
+                                           unsigned int tileX,
+                                           unsigned int tileY);     // One tile of a level, filtered, row by row.
+
+    PyramidStats stats() const;
+
+private:
+    void filterRegion(unsigned int level,
+                      unsigned int x0,
+                      unsigned int y0,
+                      unsigned int x1,
+                      unsigned int y1,
+                      unsigned char *output);       // Filter [x0, x1) x [y0, y1) of a level.
+
+    cl::Context context;
+    cl::Program program;
+    cl::CommandQueue queue;
+    cl::Buffer inputBuf;                // level 0: R, G and B planes
+    cl::Buffer pyramidBuf;              // levels 1 and up, planes one after another
+    cl::Buffer lpMaskBuf, hpMaskBuf;
+    std::vector<size_t> offsets;        // of the R plane of each level in its buffer
+    unsigned int imgWidth, imgHeight;
+    unsigned int lpMaskSize, hpMaskSize;
+    unsigned int levelCount;
+
+    std::map<unsigned int, std::vector<unsigned char>> previews;
+    std::map<std::tuple<unsigned int, unsigned int, unsigned int>, std::vector<unsigned char>> tiles;
+    PyramidStats counters;
+};
+
+#endif
@@ -0,0 +1,281 @@
+#include <stdexcept>
+#include <string.h>
+#include "filter_service.h"
+#include "dirty_tiles.h"
+#include "filter_graph.h"
+#include "scratch_arena.h"
+
+// =================================================================
+// --------------------------- Clients -----------------------------
+// =================================================================
+
+FilterService::FilterService(const cl::Context &context,
+                             const cl::Device &device,
+                             const cl::Program &program,
+                             unsigned int lpMaskSize,
+                             unsigned int hpMaskSize,
+                             const float *lpMask,
+                             const float *hpMask,
+                             const ServiceOptions &options)
+    : context(context), device(device), program(program),
+      lpMaskSize(lpMaskSize), hpMaskSize(hpMaskSize), options(options){
+    // convolveBatch caches a tile plus the mask halo in local memory
+    for(unsigned int size : {lpMaskSize, hpMaskSize}){
+        if(size % 2 == 0 || size > GRAPH_MAX_MASK_SIZE){
+            throw std::invalid_argument("filter service masks must be odd and at most "
+                                        + std::to_string(GRAPH_MAX_MASK_SIZE) + " taps a side");
+        }
+    }
+
+    queue = cl::CommandQueue(context, device);
+    lpMaskBuf = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, lpMaskSize * lpMaskSize * sizeof(float), (void*) lpMask);
+    hpMaskBuf = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, hpMaskSize * hpMaskSize * sizeof(float), (void*) hpMask);
+    grayKernel = cl::Kernel(program, "rgb2grayBatch");
+    lpKernel = cl::Kernel(program, "convolveBatch");
+    hpKernel = cl::Kernel(program, "convolveBatch");
+    dispatcher = std::thread(&FilterService::dispatch, this);
+}
+
+/**
+ * Finish the pending images and stop the dispatcher.
+ * */
+
+FilterService::~FilterService(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    dispatcher.join();
+}
+
+/**
+ * Queue an image and return the future of its filtered image. The channels
+ * are copied, so the caller may reuse them at once. Thread-safe.
+ * */
+
+std::future<std::vector<unsigned char>> FilterService::submit(unsigned int imgWidth,
+                                                              unsigned int imgHeight,
+                                                              const unsigned char *inputRchannel,
+                                                              const unsigned char *inputGchannel,
+                                                              const unsigned char *inputBchannel){
+    const unsigned char *channels[3] = {inputRchannel, inputGchannel, inputBchannel};
+    std::shared_ptr<Image> image = std::make_shared<Image>();
+    std::future<std::vector<unsigned char>> result = image->promise.get_future();
+    image->output.resize((size_t) imgWidth * imgHeight);
+
+    if(imgWidth == 0 || imgHeight == 0){
+        image->promise.set_value(image->output);
+        return result;
+    }
+
+    /**
+     * Cut tall images in strips; each strip carries the rows within the
+     * halo of both masks above and below it, so that its kept rows are
+     * filtered as in the whole image.
+     * */
+
+    unsigned int halo = lpMaskSize / 2 + hpMaskSize / 2;
+    unsigned int stripRows = imgHeight > options.splitRows && options.splitRows > 0 ? options.splitRows : imgHeight;
+    std::vector<Job> jobs;
+    auto now = std::chrono::steady_clock::now();
+
+    for(unsigned int y = 0; y < imgHeight; y += stripRows){
+        unsigned int rows = stripRows < imgHeight - y ? stripRows : imgHeight - y;
+        unsigned int top = y > halo ? y - halo : 0;
+        unsigned int bottom = y + rows + halo < imgHeight ? y + rows + halo : imgHeight;
+        size_t stripSize = (size_t) imgWidth * (bottom - top);
+
+        Job job;
+        job.imgWidth = imgWidth;
+        job.imgHeight = bottom - top;
+        job.rgb.resize(3 * stripSize);
+        for(int c = 0; c < 3; c++){
+            memcpy(&job.rgb[c * stripSize], &channels[c][(size_t) top * imgWidth], stripSize);
+        }
+        job.image = image;
+        job.firstRow = y - top;
+        job.rows = rows;
+        job.outputRow = y;
+        job.queued = now;
+        jobs.push_back(std::move(job));
+    }
+    image->pending = jobs.size();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(Job &job : jobs){
+            pending.push_back(std::move(job));
+        }
+    }
+    wake.notify_one();
+    return result;
+}
+
+ServiceStats FilterService::stats(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+// =================================================================
+// -------------------------- Dispatcher ---------------------------
+// =================================================================
+
+/**
+ * Dispatcher thread: take the jobs of the same size as the oldest pending
+ * one, and launch them once they fill a batch, the oldest reaches the
+ * deadline, or the service stops.
+ * */
+
+void FilterService::dispatch(){
+    std::unique_lock<std::mutex> lock(mutex);
+    auto deadline = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double, std::milli>(options.deadlineMs));
+
+    while(true){
+        if(pending.empty()){
+            if(stopping){
+                return;
+            }
+            wake.wait(lock);
+            continue;
+        }
+
+        /**
+         * Size the batch of the oldest job.
+         * */
+
+        const Job &oldest = pending.front();
+        unsigned int count = 0;
+        size_t pixels = 0;
+        bool full = false;
+        for(const Job &job : pending){
+            if(job.imgWidth != oldest.imgWidth || job.imgHeight != oldest.imgHeight){
+                continue;
+            }
+            size_t jobPixels = (size_t) job.imgWidth * job.imgHeight;
+            if(count == options.maxBatch || (count > 0 && pixels + jobPixels > options.maxBatchPixels)){
+                full = true;
+                break;
+            }
+            count++;
+            pixels += jobPixels;
+        }
+        full = full || count == options.maxBatch;
+
+        if(!full && !stopping && std::chrono::steady_clock::now() < oldest.queued + deadline){
+            wake.wait_until(lock, oldest.queued + deadline);
+            continue;
+        }
+
+        /**
+         * Take the batch out of the queue and filter it unlocked.
+         * */
+
+        std::vector<Job> batch;
+        unsigned int width = oldest.imgWidth, height = oldest.imgHeight;
+        for(auto job = pending.begin(); job != pending.end() && batch.size() < count; ){
+            if(job->imgWidth == width && job->imgHeight == height){
+                batch.push_back(std::move(*job));
+                job = pending.erase(job);
+            } else {
+                job++;
+            }
+        }
+
+        lock.unlock();
+        launch(batch);
+        lock.lock();
+    }
+}
+
+/**
+ * Filter a batch of jobs of the same size in one launch per stage, and
+ * deliver the images whose last job this was.
+ * */
+
+void FilterService::launch(std::vector<Job> &batch){
+    unsigned int imgWidth = batch[0].imgWidth, imgHeight = batch[0].imgHeight;
+    unsigned int images = batch.size();
+    size_t imgSize = (size_t) imgWidth * imgHeight;
+    size_t pixels = imgSize * images;
+
+    /**
+     * Grow the batch buffers to the largest batch seen.
+     * */
+
+    if(pixels > bufferPixels){
+        inputBuf = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY, 3 * pixels);
+        grayBuf = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, pixels);
+        lpBuf = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, pixels);
+        outputBuf = cl::Buffer(context, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, pixels);
+        bufferPixels = pixels;
+    }
+
+    ScratchArena &arena = threadArena();
+    ArenaScope staging(arena);
+    unsigned char *input = (unsigned char*) arena.allocate(3 * pixels);
+    unsigned char *output = (unsigned char*) arena.allocate(pixels);
+    for(unsigned int n = 0; n < images; n++){
+        memcpy(&input[3 * n * imgSize], batch[n].rgb.data(), 3 * imgSize);
+    }
+
+    grayKernel.setArg(0, inputBuf);
+    grayKernel.setArg(1, grayBuf);
+
+    lpKernel.setArg(0, sizeof(unsigned int), &lpMaskSize);
+    lpKernel.setArg(1, sizeof(unsigned int), &imgWidth);
+    lpKernel.setArg(2, sizeof(unsigned int), &imgHeight);
+    lpKernel.setArg(3, grayBuf);
+    lpKernel.setArg(4, lpMaskBuf);
+    lpKernel.setArg(5, lpBuf);
+
+    hpKernel.setArg(0, sizeof(unsigned int), &hpMaskSize);
+    hpKernel.setArg(1, sizeof(unsigned int), &imgWidth);
+    hpKernel.setArg(2, sizeof(unsigned int), &imgHeight);
+    hpKernel.setArg(3, lpBuf);
+    hpKernel.setArg(4, hpMaskBuf);
+    hpKernel.setArg(5, outputBuf);
+
+    cl::NDRange tiles(tileCount(imgWidth) * 16, tileCount(imgHeight) * 16, images);
+    cl_int err = queue.enqueueWriteBuffer(inputBuf, CL_FALSE, 0, 3 * pixels, input);
+    err |= queue.enqueueNDRangeKernel(grayKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight, images));
+    err |= queue.enqueueNDRangeKernel(lpKernel, cl::NullRange, tiles, cl::NDRange(16, 16, 1));
+    err |= queue.enqueueNDRangeKernel(hpKernel, cl::NullRange, tiles, cl::NDRange(16, 16, 1));
+    err |= queue.enqueueReadBuffer(outputBuf, CL_TRUE, 0, pixels, output);
+    if(err != CL_SUCCESS){
+        // The upload may still be reading the staging memory released below
+        queue.finish();
+    }
+
+    /**
+     * Copy the kept rows of every job into its image; the last job of an
+     * image fulfils its future.
+     * */
+
+    size_t completed = 0;
+    for(unsigned int n = 0; n < images; n++){
+        Job &job = batch[n];
+        if(err != CL_SUCCESS){
+            if(job.image->pending > 0){
+                job.image->pending = 0;
+                job.image->promise.set_exception(std::make_exception_ptr(std::runtime_error("filter launch failed")));
+            }
+            continue;
+        }
+        if(job.image->pending == 0){
+            continue;                   // an earlier strip failed
+        }
+        memcpy(&job.image->output[(size_t) job.outputRow * imgWidth], &output[n * imgSize + (size_t) job.firstRow * imgWidth],
+               (size_t) job.rows * imgWidth);
+        if(--job.image->pending == 0){
+            job.image->promise.set_value(std::move(job.image->output));
+            completed++;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.images += completed;
+    counters.jobs += images;
+    counters.batches++;
+}
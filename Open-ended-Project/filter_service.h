@@ -0,0 +1,103 @@
+/**
+ * In-process filter service: a thread-safe front end to one OpenCL device.
+ *
+ * Client threads submit RGB images and get a future of the filtered image.
+ * A dispatcher thread owns the command queue. It groups pending images of
+ * the same size and filters each group in one batched launch (a 3D NDRange
+ * over images packed one after another), as soon as the group is full or
+ * its oldest image has waited for the deadline. Images taller than
+ * splitRows are cut into strips of splitRows rows plus the filter halo;
+ * the strips are batched like small images and the output is reassembled.
+ * The result is that of seqFilter.
+ * */
+
+#ifndef FILTER_SERVICE_H
+#define FILTER_SERVICE_H
+
+#ifndef CL_HPP_TARGET_OPENCL_VERSION
+#define CL_HPP_TARGET_OPENCL_VERSION 200
+#define CL_HPP_ENABLE_PROGRAM_CONSTRUCTION_FROM_ARRAY_COMPATIBILITY 1
+#endif
+#include <CL/opencl.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ServiceOptions {
+    unsigned int maxBatch = 64;         // images per launch
+    size_t maxBatchPixels = 1 << 24;    // pixels per launch, bounding the device buffers
+    double deadlineMs = 2.0;            // longest wait for a batch to fill
+    unsigned int splitRows = 1024;      // taller images are filtered in strips of this many rows
+};
+
+struct ServiceStats {
+    size_t images = 0;                  // images completed
+    size_t jobs = 0;                    // images and strips filtered
+    size_t batches = 0;                 // launches
+};
+
+class FilterService {
+public:
+    FilterService(const cl::Context &context,
+                  const cl::Device &device,
+                  const cl::Program &program,
+                  unsigned int lpMaskSize,
+                  unsigned int hpMaskSize,
+                  const float *lpMask,
+                  const float *hpMask,
+                  const ServiceOptions &options = ServiceOptions());  // Throws std::invalid_argument on an even or too large mask.
+    ~FilterService();                   // Finish the pending images and stop.
+
+    std::future<std::vector<unsigned char>> submit(unsigned int imgWidth,
+                                                   unsigned int imgHeight,
+                                                   const unsigned char *inputRchannel,
+                                                   const unsigned char *inputGchannel,
+                                                   const unsigned char *inputBchannel);  // Queue an image; thread-safe.
+
+    ServiceStats stats();
+
+private:
+    struct Image {                      // a submitted image, possibly split in strips
+        std::promise<std::vector<unsigned char>> promise;
+        std::vector<unsigned char> output;
+        unsigned int pending;           // strips not yet filtered
+    };
+
+    struct Job {                        // an image or a strip of it, filtered as a whole image
+        unsigned int imgWidth, imgHeight;
+        std::vector<unsigned char> rgb; // R, G and B planes
+        std::shared_ptr<Image> image;
+        unsigned int firstRow;          // first row of the job kept in the output,
+        unsigned int rows;              // how many,
+        unsigned int outputRow;         // and where they go in the image
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    void dispatch();                                                // Dispatcher thread.
+    void launch(std::vector<Job> &batch);                           // Filter a batch of same-size jobs.
+
+    cl::Context context;
+    cl::Device device;
+    cl::Program program;
+    cl::CommandQueue queue;
+    cl::Kernel grayKernel, lpKernel, hpKernel;
+    cl::Buffer lpMaskBuf, hpMaskBuf;
+    cl::Buffer inputBuf, grayBuf, lpBuf, outputBuf;
+    size_t bufferPixels = 0;            // capacity of the batch buffers
+    unsigned int lpMaskSize, hpMaskSize;
+    ServiceOptions options;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> pending;            // in submission order
+    ServiceStats counters;
+    bool stopping = false;
+    std::thread dispatcher;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * Software stand-in for the Vitis HLS arbitrary precision integers, for C
+ * simulation on a host without the Xilinx headers (g++ -Ihls_sim ...).
+ *
+ * Only widths up to 64 bits are supported. Values wrap to W bits on
+ * assignment; range(hi, lo) (or (hi, lo)) reads and writes bit fields.
+ * */
+
+#ifndef AP_INT_SIM_H
+#define AP_INT_SIM_H
+
+#include <stdint.h>
+
+template <int W, bool SIGNED>
+class ap_int_base {
+public:
+    ap_int_base() : value_(0) {}
+    ap_int_base(long long v) { set(v); }
+
+    operator long long() const {
+        if(SIGNED && W > 0 && W < 64 && (value_ >> (W > 0 ? W - 1 : 0)) & 1){
+            return (long long)(value_ | ~mask());
+        }
+        return (long long)value_;
+    }
+
+    ap_int_base &operator=(long long v){
+        set(v);
+        return *this;
+    }
+
+    /**
+     * Bits hi..lo, readable and assignable.
+     * */
+
+    class range_ref {
+    public:
+        range_ref(ap_int_base &base, int hi, int lo) : base_(base), hi_(hi), lo_(lo) {}
+        operator uint64_t() const { return base_.getRange(hi_, lo_); }
+        range_ref &operator=(uint64_t v){
+            base_.setRange(hi_, lo_, v);
+            return *this;
+        }
+
+    private:
+        ap_int_base &base_;
+        int hi_;
+        int lo_;
+    };
+
+    range_ref range(int hi, int lo){ return range_ref(*this, hi, lo); }
+    uint64_t range(int hi, int lo) const { return getRange(hi, lo); }
+    range_ref operator()(int hi, int lo){ return range_ref(*this, hi, lo); }
+    uint64_t operator()(int hi, int lo) const { return getRange(hi, lo); }
+
+    bool operator[](int bit) const { return (value_ >> bit) & 1; }
+
+    static int width() { return W; }
+
+private:
+    static uint64_t mask(){ return W >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << W) - 1); }
+
+    static uint64_t fieldMask(int hi, int lo){
+        int n = hi - lo + 1;
+        return n >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+    }
+
+    void set(long long v){ value_ = (uint64_t)v & mask(); }
+
+    uint64_t getRange(int hi, int lo) const {
+        return (value_ >> lo) & fieldMask(hi, lo);
+    }
+
+    void setRange(int hi, int lo, uint64_t v){
+        uint64_t m = fieldMask(hi, lo) << lo;
+        value_ = ((value_ & ~m) | ((v << lo) & m)) & mask();
+    }
+
+    uint64_t value_;
+};
+
+template <int W>
+class ap_int : public ap_int_base<W, true> {
+public:
+    ap_int() {}
+    ap_int(long long v) : ap_int_base<W, true>(v) {}
+};
+
+template <int W>
+class ap_uint : public ap_int_base<W, false> {
+public:
+    ap_uint() {}
+    ap_uint(long long v) : ap_int_base<W, false>(v) {}
+};
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * Software stand-in for the Vitis HLS hls::stream, for C simulation on a
+ * host without the Xilinx headers (g++ -Ihls_sim ...).
+ *
+ * Streams are unbounded FIFOs: in C simulation the dataflow processes run
+ * one after the other, so every stream must hold a whole frame.
+ * */
+
+#ifndef HLS_STREAM_SIM_H
+#define HLS_STREAM_SIM_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+
+namespace hls {
+
+template <typename T, int DEPTH = 0>
+class stream {
+public:
+    stream() {}
+    explicit stream(const char *name) : name_(name) {}
+
+    /**
+     * Blocking read. Reading an empty stream would dead-lock the hardware,
+     * so the simulation stops with an error.
+     * */
+
+    T read(){
+        if(fifo_.empty()){
+            std::fprintf(stderr, "hls::stream '%s' read while empty\n", name_.c_str());
+            std::abort();
+        }
+        T value = fifo_.front();
+        fifo_.pop_front();
+        return value;
+    }
+
+    void read(T &value){ value = read(); }
+
+    bool read_nb(T &value){
+        if(fifo_.empty()){
+            return false;
+        }
+        value = read();
+        return true;
+    }
+
+    void write(const T &value){ fifo_.push_back(value); }
+
+    bool write_nb(const T &value){
+        write(value);
+        return true;
+    }
+
+    void operator>>(T &value){ value = read(); }
+    void operator<<(const T &value){ write(value); }
+
+    bool empty() const { return fifo_.empty(); }
+    bool full() const { return false; }
+    size_t size() const { return fifo_.size(); }
+
+private:
+    stream(const stream &);
+    stream &operator=(const stream &);
+
+    std::deque<T> fifo_;
+    std::string name_;
+};
+
+}
+
+#endif
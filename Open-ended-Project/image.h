@@ -0,0 +1,311 @@
+/**
+ * Streaming image filter for Vitis HLS: grayscale conversion followed by a
+ * 5x5 low-pass and a 5x5 high-pass convolution, with the semantics of
+ * seqFilter (seq_filter.h).
+ *
+ * AXI4-Stream protocol, 32-bit beats:
+ *   in:  25 low-pass then 25 high-pass mask taps, one float per beat, TLAST
+ *        on the last tap of each mask; then, for every row, the R, G and B
+ *        planes of that row, 4 pixels per beat (pixel x in bits 8*(x%4)+7..
+ *        8*(x%4)). TUSER marks the first pixel beat of a frame, TLAST the
+ *        last beat of every row.
+ *   out: the filtered rows, 4 pixels per beat, with TUSER on the first beat
+ *        of the frame and TLAST on the last beat of every row. After every
+ *        STRIP_ROWS rows, and after the last row, comes a digest packet of
+ *        two beats: the CRC32C of the pixel beats of those rows as read from
+ *        the input, then the CRC32C of the beats just written, TLAST on the
+ *        second. The CRC32C is that of checksumCrc32c (checksum.h) over the
+ *        beats as little-endian words, so the host can check the link both
+ *        ways.
+ *
+ * The frame size is a template parameter; WIDTH must be a multiple of 4.
+ * */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "hls_stream.h"  // HLS streams
+#include "ap_int.h"      // define arbitrary precision integer types
+#include "ap_axi_sdata.h"  // defines a structure for AXI stream data
+
+#define WIDTH 64
+#define HEIGHT 48
+#define NUM_CHANNELS 3
+
+#define MASK_SIZE 5
+#define HALO (MASK_SIZE / 2)
+
+#define PIXELS_PER_BEAT 4
+
+#define STRIP_ROWS 8            // rows per digest; must match FIFO_STRIP_ROWS in fifo_transfer.h
+
+// Creating a custom structure which includes the data word, TUSER (start of frame) and TLAST signal.
+typedef ap_axis<32, 1, 0, 0> AXIS_wLAST;
+
+/**
+ * Read one mask, one float tap per beat.
+ * */
+
+static void readMask(hls::stream<AXIS_wLAST> &inStream, float mask[MASK_SIZE * MASK_SIZE]){
+    union {
+        int i;
+        float f;
+    } tap;
+
+    for (int i = 0; i < MASK_SIZE * MASK_SIZE; ++i) {
+#pragma HLS PIPELINE II=1
+        tap.i = (int)inStream.read().data;
+        mask[i] = tap.f;
+    }
+}
+
+/**
+ * Continue a CRC32C (state kept inverted, starting at 0xffffffff) over one
+ * beat: the 32 bit steps of its 4 bytes, unrolled into an XOR network.
+ * */
+
+static unsigned int crc32cBeat(unsigned int state, unsigned int word){
+    state ^= word;
+    for (int i = 0; i < 32; i++) {
+#pragma HLS UNROLL
+        state = (state >> 1) ^ (0x82F63B78u & (0u - (state & 1u)));
+    }
+    return state;
+}
+
+/**
+ * Whether row y closes a digest strip.
+ * */
+
+template <int H>
+static bool stripEnd(int y){
+    return (y + 1) % STRIP_ROWS == 0 || y == H - 1;
+}
+
+/**
+ * Unpack the R, G and B row segments and emit one gray pixel per cycle in
+ * row-major order. The row planes are double-buffered: while gray pixel x of
+ * row y is written from one half, the 3W/4 beats of row y + 1 are read into
+ * the other, so after the first row the stage never stalls on its input.
+ * The CRC32C of the beats of every strip goes to digestStream.
+ * */
+
+template <int W, int H>
+void readGray(hls::stream<AXIS_wLAST> &inStream,
+              hls::stream<unsigned char> &grayStream,
+              hls::stream<unsigned int> &digestStream){
+    const int BEATS = W / PIXELS_PER_BEAT;      // beats per plane of a row
+
+    unsigned char rgbRow[2][NUM_CHANNELS][W];
+#pragma HLS ARRAY_PARTITION variable=rgbRow complete dim=1
+#pragma HLS ARRAY_PARTITION variable=rgbRow complete dim=2
+#pragma HLS ARRAY_PARTITION variable=rgbRow cyclic factor=4 dim=3
+#pragma HLS DEPENDENCE variable=rgbRow inter false
+    unsigned int crc = 0xffffffffu;
+
+    // Row 0 has nothing to overlap with
+    for (int i = 0; i < NUM_CHANNELS * BEATS; i++) {
+#pragma HLS PIPELINE II=1
+        AXIS_wLAST beat = inStream.read();
+        int c = i / BEATS;
+        int x = (i - c * BEATS) * PIXELS_PER_BEAT;
+        for (int p = 0; p < PIXELS_PER_BEAT; p++) {
+            rgbRow[0][c][x + p] = beat.data.range(8 * p + 7, 8 * p);
+        }
+        crc = crc32cBeat(crc, (unsigned int)beat.data.range(31, 0));
+    }
+    if (stripEnd<H>(0)) {
+        digestStream.write(~crc);
+        crc = 0xffffffffu;
+    }
+
+    for (int y = 0; y < H; y++) {
+        int cur = y & 1;
+        for (int x = 0; x < W; x++) {
+#pragma HLS PIPELINE II=1
+            if (y + 1 < H && x < NUM_CHANNELS * BEATS) {
+                AXIS_wLAST beat = inStream.read();
+                int c = x / BEATS;
+                int nextX = (x - c * BEATS) * PIXELS_PER_BEAT;
+                for (int p = 0; p < PIXELS_PER_BEAT; p++) {
+                    rgbRow[1 - cur][c][nextX + p] = beat.data.range(8 * p + 7, 8 * p);
+                }
+                crc = crc32cBeat(crc, (unsigned int)beat.data.range(31, 0));
+                if (x == NUM_CHANNELS * BEATS - 1 && stripEnd<H>(y + 1)) {
+                    digestStream.write(~crc);
+                    crc = 0xffffffffu;
+                }
+            }
+            grayStream.write((unsigned char)(((int)rgbRow[cur][0][x] + (int)rgbRow[cur][1][x] + (int)rgbRow[cur][2][x]) / 3));
+        }
+    }
+}
+
+/**
+ * Apply the mask to the window centred on the current pixel, with the same
+ * arithmetic as seqConvolve: the flipped mask is walked column by column and
+ * the running sum is truncated to int after every term.
+ * */
+
+static unsigned char convolvePixel(unsigned char window[MASK_SIZE][MASK_SIZE],
+                                   float mask[MASK_SIZE * MASK_SIZE]){
+    int outSum = 0;
+    for (int k = 0; k < MASK_SIZE; k++) {
+        for (int l = 0; l < MASK_SIZE; l++) {
+            int maskIdx = (MASK_SIZE - 1 - k) + (MASK_SIZE - 1 - l) * MASK_SIZE;
+            outSum += window[l][k] * mask[maskIdx];
+        }
+    }
+
+    if (outSum < 0) {
+        return 0;
+    } else if (outSum > 255) {
+        return 255;
+    }
+    return outSum;
+}
+
+/**
+ * Streaming 5x5 convolution. The last MASK_SIZE-1 rows live in line buffers
+ * and the neighbourhood in a shift-register window, so one pixel is consumed
+ * and one produced per cycle with O(W) memory. The output trails the input
+ * by HALO rows and HALO columns; pixels where the mask does not fit are 0,
+ * as in seqConvolve.
+ * */
+
+template <int W, int H>
+void convolve(hls::stream<unsigned char> &inStream,
+              float mask[MASK_SIZE * MASK_SIZE],
+              hls::stream<unsigned char> &outStream){
+    unsigned char lineBuf[MASK_SIZE - 1][W];
+#pragma HLS ARRAY_PARTITION variable=lineBuf complete dim=1
+    unsigned char window[MASK_SIZE][MASK_SIZE];
+#pragma HLS ARRAY_PARTITION variable=window complete dim=0
+
+    for (int y = 0; y < H + HALO; y++) {
+        for (int x = 0; x < W + HALO; x++) {
+#pragma HLS PIPELINE II=1
+            // window[r][c] holds pixel (x - MASK_SIZE + 1 + c, y - MASK_SIZE + 1 + r)
+            for (int r = 0; r < MASK_SIZE; r++) {
+                for (int c = 0; c < MASK_SIZE - 1; c++) {
+                    window[r][c] = window[r][c + 1];
+                }
+            }
+
+            if (x < W) {
+                unsigned char pixel = y < H ? inStream.read() : 0;
+                for (int r = 0; r < MASK_SIZE - 1; r++) {
+                    window[r][MASK_SIZE - 1] = lineBuf[r][x];
+                }
+                window[MASK_SIZE - 1][MASK_SIZE - 1] = pixel;
+
+                for (int r = 0; r < MASK_SIZE - 2; r++) {
+                    lineBuf[r][x] = lineBuf[r + 1][x];
+                }
+                lineBuf[MASK_SIZE - 2][x] = pixel;
+            }
+
+            // Output pixel (x - HALO, y - HALO) is centred in the window
+            int outX = x - HALO;
+            int outY = y - HALO;
+            if (outX < 0 || outY < 0) {
+                continue;
+            }
+
+            if (outX < HALO || outY < HALO || outX >= W - HALO || outY >= H - HALO) {
+                outStream.write(0);
+            } else {
+                outStream.write(convolvePixel(window, mask));
+            }
+        }
+    }
+}
+
+/**
+ * Pack 4 output pixels per beat and frame the rows; after the last row of
+ * every strip, send the input digest of the strip and that of its output.
+ * */
+
+template <int W, int H>
+void writeOutput(hls::stream<unsigned char> &inStream,
+                 hls::stream<unsigned int> &digestStream,
+                 hls::stream<AXIS_wLAST> &outStream){
+    unsigned int crc = 0xffffffffu;
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x += PIXELS_PER_BEAT) {
+#pragma HLS PIPELINE II=4
+            AXIS_wLAST beat;
+            for (int p = 0; p < PIXELS_PER_BEAT; p++) {
+                beat.data.range(8 * p + 7, 8 * p) = inStream.read();
+            }
+            beat.keep = -1;
+            beat.strb = -1;
+            beat.user = (x == 0 && y == 0);
+            beat.last = (x == W - PIXELS_PER_BEAT);
+            outStream.write(beat);
+            crc = crc32cBeat(crc, (unsigned int)beat.data.range(31, 0));
+        }
+
+        if (stripEnd<H>(y)) {
+            AXIS_wLAST beat;
+            beat.keep = -1;
+            beat.strb = -1;
+            beat.user = 0;
+            beat.data = (int)digestStream.read();
+            beat.last = 0;
+            outStream.write(beat);
+            beat.data = (int)~crc;
+            beat.last = 1;
+            outStream.write(beat);
+            crc = 0xffffffffu;
+        }
+    }
+}
+
+/**
+ * Grayscale, low-pass and high-pass stages running concurrently, chained
+ * through streams.
+ * */
+
+template <int W, int H>
+void filterFrame(hls::stream<AXIS_wLAST> &inStream,
+                 float lpMask[MASK_SIZE * MASK_SIZE],
+                 float hpMask[MASK_SIZE * MASK_SIZE],
+                 hls::stream<AXIS_wLAST> &outStream){
+#pragma HLS DATAFLOW
+    hls::stream<unsigned char> grayStream("grayStream");
+    hls::stream<unsigned char> lpStream("lpStream");
+    hls::stream<unsigned char> hpStream("hpStream");
+    hls::stream<unsigned int> digestStream("digestStream");
+    // Bypasses both convolutions, which hold back fewer than 2 * STRIP_ROWS rows
+#pragma HLS STREAM variable=digestStream depth=4
+
+    readGray<W, H>(inStream, grayStream, digestStream);
+    convolve<W, H>(grayStream, lpMask, lpStream);
+    convolve<W, H>(lpStream, hpMask, hpStream);
+    writeOutput<W, H>(hpStream, digestStream, outStream);
+}
+
+/**
+ * Filter one W x H frame: masks first, then the pixel rows.
+ * */
+
+template <int W, int H>
+void imageFilteringStream(hls::stream<AXIS_wLAST> &S_AXIS, hls::stream<AXIS_wLAST> &M_AXIS){
+    static_assert(W % PIXELS_PER_BEAT == 0, "the row width must be a multiple of 4 pixels");
+
+    // Keep the masks in registers so that every tap is read in the same cycle
+    float lpMask[MASK_SIZE * MASK_SIZE];
+    float hpMask[MASK_SIZE * MASK_SIZE];
+#pragma HLS ARRAY_PARTITION variable=lpMask complete
+#pragma HLS ARRAY_PARTITION variable=hpMask complete
+
+    readMask(S_AXIS, lpMask);
+    readMask(S_AXIS, hpMask);
+    filterFrame<W, H>(S_AXIS, lpMask, hpMask, M_AXIS);
+}
+
+void imageFiltering(hls::stream<AXIS_wLAST> &S_AXIS, hls::stream<AXIS_wLAST> &M_AXIS);
+
+#endif
@@ -0,0 +1,786 @@
+// Keep a*b+c as two rounded operations, as in seqConvolve
+#pragma OPENCL FP_CONTRACT OFF
+
+#define TILE_SIZE 16                            // work-group and dirty tile edge
+#define MAX_MASK_SIZE 9
+#define CACHE_SIZE (TILE_SIZE + MAX_MASK_SIZE - 1)
+
+#define EDGES_ZERO 0                            // pixels where the mask does not fit are 0
+#define EDGES_CLAMP 1                           // they are filtered over the sampler's border
+
+// =================================================================
+// ----------------------- Helper Functions ------------------------
+// =================================================================
+
+/**
+ * Copy the TILE_SIZE x TILE_SIZE block at (x0, y0) plus its halo into
+ * local memory, with zeros outside the image.
+ * */
+
+void loadCache(local uchar cache[CACHE_SIZE][CACHE_SIZE],
+               global const uchar *input,
+               int imgWidth,
+               int imgHeight,
+               int x0,
+               int y0,
+               int radius){
+    int side = TILE_SIZE + 2 * radius;
+    int lid = get_local_id(0) + get_local_id(1) * TILE_SIZE;
+
+    for(int i = lid; i < side * side; i += TILE_SIZE * TILE_SIZE){
+        int cx = i % side;
+        int cy = i / side;
+        int x = x0 - radius + cx;
+        int y = y0 - radius + cy;
+        cache[cy][cx] = (x >= 0 && y >= 0 && x < imgWidth && y < imgHeight) ? input[x + y * imgWidth] : 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+/**
+ * Convolve the cached neighbourhood of local pixel (lx, ly), with the
+ * same loop order and per-term truncation as seqConvolve.
+ * */
+
+uchar convolveCached(local uchar cache[CACHE_SIZE][CACHE_SIZE],
+                     int lx,
+                     int ly,
+                     int maskSize,
+                     global const float *mask){
+    int outSum = 0;
+    for(int k = 0; k < maskSize; k++){
+        for(int l = 0; l < maskSize; l++){
+            outSum += cache[ly + l][lx + k] * mask[(maskSize-1-k) + (maskSize-1-l)*maskSize];
+        }
+    }
+    return (uchar) clamp(outSum, 0, 255);
+}
+
+/**
+ * Filter pixel (x, y) of the block cached at (x0, y0); pixels where the
+ * mask does not fit are 0.
+ * */
+
+void filterCachedPixel(local uchar cache[CACHE_SIZE][CACHE_SIZE],
+                       int imgWidth,
+                       int imgHeight,
+                       int x,
+                       int y,
+                       int x0,
+                       int y0,
+                       int maskSize,
+                       global const float *mask,
+                       global uchar *output){
+    int radius = maskSize / 2;
+
+    if(x >= imgWidth || y >= imgHeight){
+        return;
+    }
+    if(x < radius || y < radius || x >= imgWidth - radius || y >= imgHeight - radius){
+        output[x + y * imgWidth] = 0;
+        return;
+    }
+    output[x + y * imgWidth] = convolveCached(cache, x - x0, y - y0, maskSize, mask);
+}
+
+// =================================================================
+// ------------------------- Whole image ---------------------------
+// =================================================================
+
+/**
+ * Convert an RGB image to grayscale.
+ * */
+
+__kernel void rgb2gray(global const uchar *inputR,
+                       global const uchar *inputG,
+                       global const uchar *inputB,
+                       global uchar *output){
+    int idx = get_global_id(0) + get_global_id(1) * get_global_size(0);
+    output[idx] = (inputR[idx] + inputG[idx] + inputB[idx]) / 3;
+}
+
+/**
+ * Convolve an image with a mask, caching each 16x16 block and its halo in
+ * local memory. The global size is the image size.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+void filterImageWithCache(uint maskSize,
+                          global const uchar *input,
+                          global const float *mask,
+                          global uchar *output){
+    local uchar cache[CACHE_SIZE][CACHE_SIZE];
+    int imgWidth = get_global_size(0);
+    int imgHeight = get_global_size(1);
+    int x0 = get_group_id(0) * TILE_SIZE;
+    int y0 = get_group_id(1) * TILE_SIZE;
+
+    loadCache(cache, input, imgWidth, imgHeight, x0, y0, maskSize / 2);
+    filterCachedPixel(cache, imgWidth, imgHeight, get_global_id(0), get_global_id(1),
+                      x0, y0, maskSize, mask, output);
+}
+
+// =================================================================
+// --------------------------- Image2D -----------------------------
+// =================================================================
+
+/**
+ * Convolve an image read through a sampler, so that the texture cache does
+ * the caching and the sampler's addressing mode the edge handling. input
+ * is CL_R / CL_UNORM_INT8; the output is a plain buffer.
+ * */
+
+__kernel void filterImage2D(uint maskSize,
+                            uint edges,
+                            read_only image2d_t input,
+                            sampler_t sampler,
+                            global const float *mask,
+                            global uchar *output){
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    int imgWidth = get_image_width(input);
+    int imgHeight = get_image_height(input);
+    int radius = maskSize / 2;
+
+    if(x >= imgWidth || y >= imgHeight){
+        return;
+    }
+    if(edges == EDGES_ZERO && (x < radius || y < radius || x >= imgWidth - radius || y >= imgHeight - radius)){
+        output[x + y * imgWidth] = 0;
+        return;
+    }
+
+    int outSum = 0;
+    for(int k = 0; k < maskSize; k++){
+        for(int l = 0; l < maskSize; l++){
+            // UNORM_INT8 reads back as pixel / 255
+            float pixel = rint(read_imagef(input, sampler, (int2)(x - radius + k, y - radius + l)).x * 255.0f);
+            outSum += pixel * mask[(maskSize-1-k) + (maskSize-1-l)*maskSize];
+        }
+    }
+    output[x + y * imgWidth] = (uchar) clamp(outSum, 0, 255);
+}
+
+// =================================================================
+// ------------------------- Dirty tiles ---------------------------
+// =================================================================
+
+/**
+ * Flag the 16x16 tiles where the new frame differs from the previous one.
+ * The global size is the image size rounded up to whole tiles.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+void diffTiles(uint imgWidth,
+               uint imgHeight,
+               global const uchar *prevR,
+               global const uchar *prevG,
+               global const uchar *prevB,
+               global const uchar *inputR,
+               global const uchar *inputG,
+               global const uchar *inputB,
+               global uchar *tileMask){
+    local int changed;
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if(get_local_id(0) == 0 && get_local_id(1) == 0){
+        changed = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if(x < imgWidth && y < imgHeight){
+        int idx = x + y * imgWidth;
+        if(prevR[idx] != inputR[idx] || prevG[idx] != inputG[idx] || prevB[idx] != inputB[idx]){
+            atomic_or(&changed, 1);
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if(get_local_id(0) == 0 && get_local_id(1) == 0){
+        tileMask[get_group_id(0) + get_group_id(1) * get_num_groups(0)] = changed;
+    }
+}
+
+/**
+ * Grow the changed tiles by radius tiles in every direction, so that the
+ * filter halo around a change is recomputed too.
+ * */
+
+__kernel void dilateTiles(uint radius,
+                          global const uchar *tileMask,
+                          global uchar *dilated){
+    int tx = get_global_id(0);
+    int ty = get_global_id(1);
+    int tilesX = get_global_size(0);
+    int tilesY = get_global_size(1);
+    uchar any = 0;
+
+    for(int j = max(ty - (int) radius, 0); j <= min(ty + (int) radius, tilesY - 1); j++){
+        for(int i = max(tx - (int) radius, 0); i <= min(tx + (int) radius, tilesX - 1); i++){
+            any |= tileMask[i + j * tilesX];
+        }
+    }
+    dilated[tx + ty * tilesX] = any;
+}
+
+/**
+ * Compact the indices of the flagged tiles into tileList; tileCount must
+ * be zero on entry.
+ * */
+
+__kernel void listTiles(global const uchar *tileMask,
+                        global int *tileCount,
+                        global int *tileList){
+    int tile = get_global_id(0);
+    if(tileMask[tile]){
+        tileList[atomic_inc(tileCount)] = tile;
+    }
+}
+
+/**
+ * rgb2gray over the listed tiles only: one work-group per tile.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+void rgb2grayTiles(uint imgWidth,
+                   uint imgHeight,
+                   uint tilesX,
+                   global const int *tileList,
+                   global const uchar *inputR,
+                   global const uchar *inputG,
+                   global const uchar *inputB,
+                   global uchar *output){
+    int tile = tileList[get_group_id(0)];
+    int x = (tile % tilesX) * TILE_SIZE + get_local_id(0);
+    int y = (tile / tilesX) * TILE_SIZE + get_local_id(1);
+
+    if(x < imgWidth && y < imgHeight){
+        int idx = x + y * imgWidth;
+        output[idx] = (inputR[idx] + inputG[idx] + inputB[idx]) / 3;
+    }
+}
+
+/**
+ * filterImageWithCache over the listed tiles only: one work-group per tile.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+void filterTiles(uint maskSize,
+                 uint imgWidth,
+                 uint imgHeight,
+                 uint tilesX,
+                 global const int *tileList,
+                 global const uchar *input,
+                 global const float *mask,
+                 global uchar *output){
+    local uchar cache[CACHE_SIZE][CACHE_SIZE];
+    int tile = tileList[get_group_id(0)];
+    int x0 = (tile % tilesX) * TILE_SIZE;
+    int y0 = (tile / tilesX) * TILE_SIZE;
+
+    loadCache(cache, input, imgWidth, imgHeight, x0, y0, maskSize / 2);
+    filterCachedPixel(cache, imgWidth, imgHeight, x0 + get_local_id(0), y0 + get_local_id(1),
+                      x0, y0, maskSize, mask, output);
+}
+
+// =================================================================
+// ------------------------- Filter graph --------------------------
+// =================================================================
+
+#define POINT_CLAMP 0                           // values of PointOp and CombineOp in filter_graph.h
+#define POINT_SCALE 1
+#define POINT_INVERT 2
+#define POINT_THRESHOLD 3
+
+#define COMBINE_ADD 0
+#define COMBINE_SUB 1
+#define COMBINE_ABSDIFF 2
+#define COMBINE_MIN 3
+#define COMBINE_MAX 4
+#define COMBINE_WEIGHTED 5
+
+/**
+ * filterImageWithCache for any image size: the global size is the image
+ * size rounded up to whole tiles.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+void convolveImage(uint maskSize,
+                   uint imgWidth,
+                   uint imgHeight,
+                   global const uchar *input,
+                   global const float *mask,
+                   global uchar *output){
+    local uchar cache[CACHE_SIZE][CACHE_SIZE];
+    int x0 = get_group_id(0) * TILE_SIZE;
+    int y0 = get_group_id(1) * TILE_SIZE;
+
+    loadCache(cache, input, imgWidth, imgHeight, x0, y0, maskSize / 2);
+    filterCachedPixel(cache, imgWidth, imgHeight, get_global_id(0), get_global_id(1),
+                      x0, y0, maskSize, mask, output);
+}
+
+/**
+ * Apply a per-pixel operation, as seqPointOp.
+ * */
+
+__kernel void pointImage(uint op,
+                         float a,
+                         float b,
+                         global const uchar *input,
+                         global uchar *output){
+    int idx = get_global_id(0);
+    int p = input[idx];
+    int value;
+
+    switch(op){
+        case POINT_CLAMP:     value = clamp(p, (int) clamp(a, 0.0f, 255.0f), (int) clamp(b, 0.0f, 255.0f)); break;
+        case POINT_SCALE:     value = (int)(p * a + b); break;
+        case POINT_INVERT:    value = 255 - p; break;
+        default:              value = p >= a ? 255 : 0; break;
+    }
+    output[idx] = clamp(value, 0, 255);
+}
+
+/**
+ * Combine two images pixel by pixel, as seqCombine.
+ * */
+
+__kernel void combineImages(uint op,
+                            float a,
+                            float b,
+                            global const uchar *input0,
+                            global const uchar *input1,
+                            global uchar *output){
+    int idx = get_global_id(0);
+    int p = input0[idx];
+    int q = input1[idx];
+    int value;
+
+    switch(op){
+        case COMBINE_ADD:     value = p + q; break;
+        case COMBINE_SUB:     value = p - q; break;
+        case COMBINE_ABSDIFF: value = abs(p - q); break;
+        case COMBINE_MIN:     value = min(p, q); break;
+        case COMBINE_MAX:     value = max(p, q); break;
+        default:              value = (int)(p * a + q * b); break;
+    }
+    output[idx] = clamp(value, 0, 255);
+}
+
+// =================================================================
+// -------------------------- Statistics ---------------------------
+// =================================================================
+
+#define HISTOGRAM_GROUP 256                     // work-group size of histogramImage
+
+#define RANGE_MIN 0                             // words of the range buffer, see image_stats.h
+#define RANGE_MAX 1
+#define RANGE_LOW 2
+#define RANGE_HIGH 3
+#define RANGE_SUM_LOW 4
+#define RANGE_SUM_HIGH 5
+
+/**
+ * Add the 256-bin histogram of an image to histogram, which starts zeroed:
+ * each work-group counts its pixels in local memory with local atomics,
+ * then adds its bins to the global histogram. The work-items stride over
+ * the image, so a few work-groups cover any size.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(HISTOGRAM_GROUP, 1, 1)))
+void histogramImage(uint imgSize,
+                    global const uchar *input,
+                    global uint *histogram){
+    local uint bins[256];
+    uint lid = get_local_id(0);
+
+    bins[lid] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(uint idx = get_global_id(0); idx < imgSize; idx += get_global_size(0)){
+        atomic_inc(&bins[input[idx]]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if(bins[lid] > 0){
+        atomic_add(&histogram[lid], bins[lid]);
+    }
+}
+
+/**
+ * Derive min, max, the sum of the pixels and the contrast range after
+ * clipping clipCount pixels at each end from a histogram, as
+ * statsFromHistogram. One work-item.
+ * */
+
+__kernel void imageRange(uint clipCount,
+                         global const uint *histogram,
+                         global uint *range){
+    uint minimum = 255, maximum = 0;
+    ulong sum = 0;
+    for(uint v = 0; v < 256; v++){
+        if(histogram[v] > 0){
+            minimum = min(minimum, v);
+            maximum = v;
+        }
+        sum += (ulong) histogram[v] * v;
+    }
+
+    uint low = 0, below = 0;
+    while(low < 255 && below + histogram[low] <= clipCount){
+        below += histogram[low++];
+    }
+    uint high = 255, above = 0;
+    while(high > 0 && above + histogram[high] <= clipCount){
+        above += histogram[high--];
+    }
+
+    range[RANGE_MIN] = minimum;
+    range[RANGE_MAX] = maximum;
+    range[RANGE_LOW] = low;
+    range[RANGE_HIGH] = high;
+    range[RANGE_SUM_LOW] = (uint) sum;
+    range[RANGE_SUM_HIGH] = (uint)(sum >> 32);
+}
+
+/**
+ * Map the range [low, high] found by imageRange to [0, 255], as
+ * seqContrastStretch.
+ * */
+
+__kernel void contrastImage(global const uint *range,
+                            global const uchar *input,
+                            global uchar *output){
+    int idx = get_global_id(0);
+    int low = range[RANGE_LOW];
+    int high = range[RANGE_HIGH];
+    int p = input[idx];
+
+    output[idx] = high <= low ? p : clamp((p - low) * 255 / (high - low), 0, 255);
+}
+
+// =================================================================
+// ---------------------------- Median -----------------------------
+// =================================================================
+
+#define MAX_MEDIAN_NETWORK_SIZE 7               // MEDIAN_DEVICE_NETWORK_SIZE in median_filter.h
+#define MEDIAN_SEGMENT 32                       // row pixels per work-item of medianHistogram
+
+/**
+ * Median of the n = 2k + 1 values of v by forgetful selection, as
+ * selectMedian in median_filter.cpp: drop the min and max of the first
+ * k + 2 values, bring in the next one, until three remain. Called with a
+ * constant n, so that the loops unroll and v stays in registers.
+ * */
+
+uchar selectMedian(uchar *v, const int n){
+    int lo = 0, hi = n / 2 + 1;
+
+    for(int next = hi + 1; next < n; next++){
+        for(int i = lo + 1; i <= hi; i++){
+            uchar a = v[lo], b = v[i];
+            v[lo] = min(a, b);
+            v[i] = max(a, b);
+        }
+        for(int i = lo + 1; i < hi; i++){
+            uchar a = v[i], b = v[hi];
+            v[i] = min(a, b);
+            v[hi] = max(a, b);
+        }
+        lo++;
+        v[hi] = v[next];
+    }
+
+    uchar a = v[lo], b = v[lo + 1], c = v[lo + 2];
+    return max(min(a, b), min(max(a, b), c));
+}
+
+uchar medianCached(local uchar cache[CACHE_SIZE][CACHE_SIZE],
+                   int lx,
+                   int ly,
+                   const int size){
+    uchar window[MAX_MEDIAN_NETWORK_SIZE * MAX_MEDIAN_NETWORK_SIZE];
+    for(int l = 0; l < size; l++){
+        for(int k = 0; k < size; k++){
+            window[k + l * size] = cache[ly + l][lx + k];
+        }
+    }
+    return selectMedian(window, size * size);
+}
+
+/**
+ * Median of the 3x3, 5x5 or 7x7 window of each pixel, as seqMedianNetwork,
+ * over blocks cached in local memory like convolveImage; pixels where the
+ * window does not fit are 0.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+void medianImage(uint size,
+                 uint imgWidth,
+                 uint imgHeight,
+                 global const uchar *input,
+                 global uchar *output){
+    local uchar cache[CACHE_SIZE][CACHE_SIZE];
+    int radius = size / 2;
+    int x0 = get_group_id(0) * TILE_SIZE;
+    int y0 = get_group_id(1) * TILE_SIZE;
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    loadCache(cache, input, imgWidth, imgHeight, x0, y0, radius);
+    if(x >= imgWidth || y >= imgHeight){
+        return;
+    }
+    if(x < radius || y < radius || x >= (int) imgWidth - radius || y >= (int) imgHeight - radius){
+        output[x + y * imgWidth] = 0;
+        return;
+    }
+
+    uchar median;
+    switch(size){
+        case 3:  median = medianCached(cache, x - x0, y - y0, 3); break;
+        case 5:  median = medianCached(cache, x - x0, y - y0, 5); break;
+        default: median = medianCached(cache, x - x0, y - y0, 7); break;
+    }
+    output[x + y * imgWidth] = median;
+}
+
+/**
+ * Median of windows of any odd size, as seqMedianHistogram: each work-item
+ * slides a private histogram along MEDIAN_SEGMENT pixels of a row, one
+ * column in and one out per pixel, and moves the median from its previous
+ * value. The global size is (imgWidth / MEDIAN_SEGMENT, imgHeight) rounded
+ * up.
+ * */
+
+__kernel void medianHistogram(uint size,
+                              uint imgWidth,
+                              uint imgHeight,
+                              global const uchar *input,
+                              global uchar *output){
+    int radius = size / 2;
+    int half = size * size / 2;
+    int y = get_global_id(1);
+    int x0 = get_global_id(0) * MEDIAN_SEGMENT;
+    int x1 = min(x0 + MEDIAN_SEGMENT, (int) imgWidth);
+
+    if(y >= imgHeight){
+        return;
+    }
+    global uchar *row = &output[y * imgWidth];
+    if(y < radius || y >= (int) imgHeight - radius){
+        for(int x = x0; x < x1; x++){
+            row[x] = 0;
+        }
+        return;
+    }
+
+    ushort histogram[256];
+    int median = 0, below = 0;                  // pixels of the window under median
+    bool first = true;
+
+    for(int x = x0; x < x1; x++){
+        if(x < radius || x >= (int) imgWidth - radius){
+            row[x] = 0;
+            continue;
+        }
+
+        global const uchar *top = &input[(y - radius) * imgWidth];
+        if(first){
+            for(int v = 0; v < 256; v++){
+                histogram[v] = 0;
+            }
+            for(int l = 0; l < size; l++){
+                for(int k = x - radius; k <= x + radius; k++){
+                    histogram[top[k + l * imgWidth]]++;
+                }
+            }
+            first = false;
+        } else {
+            for(int l = 0; l < size; l++){
+                int out = top[x - radius - 1 + l * imgWidth];
+                int in = top[x + radius + l * imgWidth];
+                histogram[out]--;
+                histogram[in]++;
+                below += (in < median) - (out < median);
+            }
+        }
+
+        while(below > half){
+            below -= histogram[--median];
+        }
+        while(below + histogram[median] <= half){
+            below += histogram[median++];
+        }
+        row[x] = median;
+    }
+}
+
+// =================================================================
+// -------------------------- Morphology ---------------------------
+// =================================================================
+
+/**
+ * One van Herk/Gil-Werman pass of an erosion or dilation, as seqMorphRows
+ * (step 1, lineStep imgWidth) or seqMorphColumns (step imgWidth, lineStep
+ * 1): pixel i of line n is at n * lineStep + i * step. Work-item (n, j)
+ * writes the windows that start in block j of the padded line: first the
+ * backward extremes of block j, then, with the forward extremes of block
+ * j + 1, their final values. The global size is (lines, blocks).
+ * */
+
+__kernel void morphLines(uint dilate,
+                         uint size,
+                         uint length,
+                         uint step,
+                         uint lineStep,
+                         global const uchar *input,
+                         global uchar *output){
+    int radius = size / 2;
+    int start = get_global_id(1) * size;        // padded index of the block
+    uchar neutral = dilate ? 0 : 255;
+    global const uchar *in = &input[get_global_id(0) * lineStep];
+    global uchar *out = &output[get_global_id(0) * lineStep];
+
+    if(start >= length){
+        return;
+    }
+
+    uchar extreme = neutral;
+    for(int p = start + size - 1; p >= start; p--){
+        int i = p - radius;
+        uchar pixel = i >= 0 && i < length ? in[i * step] : neutral;
+        extreme = dilate ? max(extreme, pixel) : min(extreme, pixel);
+        if(p < length){
+            out[p * step] = extreme;            // the window of pixel p starts at padded p
+        }
+    }
+
+    extreme = neutral;
+    for(int p = start + size; p < start + 2 * size - 1; p++){
+        int i = p - radius;
+        int x = p - size + 1;
+        uchar pixel = i >= 0 && i < length ? in[i * step] : neutral;
+        extreme = dilate ? max(extreme, pixel) : min(extreme, pixel);
+        if(x < length){
+            out[x * step] = dilate ? max(out[x * step], extreme) : min(out[x * step], extreme);
+        }
+    }
+}
+
+// =================================================================
+// --------------------------- Batches -----------------------------
+// =================================================================
+
+/**
+ * rgb2gray over a batch of images of the same size: image n is the R, G and
+ * B planes at input + 3 * n * imgWidth * imgHeight. The global size is
+ * (imgWidth, imgHeight, images).
+ * */
+
+__kernel void rgb2grayBatch(global const uchar *input,
+                            global uchar *output){
+    int imgSize = get_global_size(0) * get_global_size(1);
+    int idx = get_global_id(0) + get_global_id(1) * get_global_size(0);
+    global const uchar *rgb = input + 3 * get_global_id(2) * imgSize;
+
+    output[get_global_id(2) * imgSize + idx] = (rgb[idx] + rgb[imgSize + idx] + rgb[2 * imgSize + idx]) / 3;
+}
+
+/**
+ * filterImageWithCache over a batch of images of the same size, packed one
+ * after another. The global size is the image size rounded up to whole
+ * tiles, by the number of images.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(TILE_SIZE, TILE_SIZE, 1)))
+void convolveBatch(uint maskSize,
+                   uint imgWidth,
+                   uint imgHeight,
+                   global const uchar *input,
+                   global const float *mask,
+                   global uchar *output){
+    local uchar cache[CACHE_SIZE][CACHE_SIZE];
+    int offset = get_global_id(2) * imgWidth * imgHeight;
+    int x0 = get_group_id(0) * TILE_SIZE;
+    int y0 = get_group_id(1) * TILE_SIZE;
+
+    loadCache(cache, input + offset, imgWidth, imgHeight, x0, y0, maskSize / 2);
+    filterCachedPixel(cache, imgWidth, imgHeight, get_global_id(0), get_global_id(1),
+                      x0, y0, maskSize, mask, output + offset);
+}
+
+// =================================================================
+// --------------------------- Pyramid -----------------------------
+// =================================================================
+
+#define PYRAMID_GROUP 16                        // PYRAMID_GROUP in filter_pyramid.h: 2^(levels - 1) at most
+
+/**
+ * Build levels 1 to levels (at most 5) of the pyramid of an RGB image in one
+ * pass, as seqDownsample: pixel (x, y) of level l is the rounded mean of the
+ * input pixels in the 2^l x 2^l block at (x * 2^l, y * 2^l), cut by the
+ * right and bottom edges. Each work-item sums a 2x2 block of the input for
+ * level 1, and the work-group adds its sums up four by four in local memory
+ * for the next levels, so the input is read once. Level l is
+ * ceil(imgWidth / 2^l) x ceil(imgHeight / 2^l), and its R, G and B planes
+ * follow those of level l - 1 in pyramid. The global size is level 1
+ * rounded up to whole work-groups.
+ * */
+
+__kernel __attribute__((reqd_work_group_size(PYRAMID_GROUP, PYRAMID_GROUP, 1)))
+void buildPyramid(uint imgWidth,
+                  uint imgHeight,
+                  uint levels,
+                  global const uchar *input,
+                  global uchar *pyramid){
+    local uint sums[3][PYRAMID_GROUP][PYRAMID_GROUP];
+    int lx = get_local_id(0);
+    int ly = get_local_id(1);
+    uint imgSize = imgWidth * imgHeight;
+    ulong offset = 0;                           // of the current level in pyramid
+    uint total[3];
+
+    for(uint level = 1; level <= levels; level++){
+        uint side = PYRAMID_GROUP >> (level - 1);   // pixels of the level per work-group side
+        uint block = 1 << level;
+        uint width = (imgWidth + block - 1) >> level;
+        uint height = (imgHeight + block - 1) >> level;
+        uint x = get_group_id(0) * side + lx;
+        uint y = get_group_id(1) * side + ly;
+        bool active = lx < side && ly < side;
+
+        if(active){
+            for(int c = 0; c < 3; c++){
+                if(level == 1){
+                    total[c] = 0;
+                    for(uint j = 2 * y; j < min(2 * y + 2, imgHeight); j++){
+                        for(uint i = 2 * x; i < min(2 * x + 2, imgWidth); i++){
+                            total[c] += input[c * imgSize + i + j * imgWidth];
+                        }
+                    }
+                } else {
+                    total[c] = sums[c][2 * ly][2 * lx] + sums[c][2 * ly][2 * lx + 1]
+                             + sums[c][2 * ly + 1][2 * lx] + sums[c][2 * ly + 1][2 * lx + 1];
+                }
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if(active){
+            for(int c = 0; c < 3; c++){
+                sums[c][ly][lx] = total[c];
+            }
+            if(x < width && y < height){
+                uint count = min(block, imgWidth - x * block) * min(block, imgHeight - y * block);
+                for(int c = 0; c < 3; c++){
+                    pyramid[offset + c * width * height + x + y * width] = (total[c] + count / 2) / count;
+                }
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        offset += 3 * (ulong) width * height;
+    }
+}
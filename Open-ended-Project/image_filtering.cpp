@@ -2,10 +2,22 @@
 #define CL_HPP_ENABLE_PROGRAM_CONSTRUCTION_FROM_ARRAY_COMPATIBILITY 1
 #include <CL/opencl.hpp>
 // #include <CL/opencl.h>
+#include <chrono>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <map>
+#include <thread>
 #include <string.h>
 #include <time.h>
+#include "seq_filter.h"
+#include "dirty_tiles.h"
+#include "filter_graph.h"
+#include "filter_service.h"
+#include "scratch_arena.h"
+#include "validation.h"
+#include "output_encoder.h"
+#include "filter_pyramid.h"
 
 #define cimg_use_jpeg
 #include "CImg.h"
@@ -15,31 +27,6 @@ using namespace cimg_library;
 // ---------------------- Secondary Functions ----------------------
 // =================================================================
 
-void seqRgb2Gray(unsigned int imgWidth,
-                 unsigned int imgHeight,
-                 unsigned char *rChannel,
-                 unsigned char *gChannel,
-                 unsigned char *bChannel,
-                 unsigned char *grayImg);                          // Sequentially convert an RGB image to grayscale.
-
-void seqConvolve(unsigned int imgWidth,                     
-                 unsigned int imgHeight,
-                 unsigned int maskSize,
-                 unsigned char *inputImg,
-                 float *mask,
-                 unsigned char *outputImg);                        // Sequentially convolve an image with a filter.
-
-void seqFilter(unsigned int imgWidth,                       
-               unsigned int imgHeight,
-               unsigned int lpMaskSize,
-               unsigned int hpMaskSize,
-               unsigned char *inputRchannel,
-               unsigned char *inputGchannel,
-               unsigned char *inputBchannel,
-               float *lpMask,
-               float *hpMask,
-               unsigned char *outputImg);                           // Sequentially filter an image.
-
 bool checkEquality(unsigned char* img1, 
                     unsigned char* img2, 
                     const int W, 
@@ -55,6 +42,8 @@ cl::Device getDefaultDevice();                                    // Return a de
 
 void initializeDevice();                                          // Inicialize device and compile kernel code.
 
+std::shared_future<void> startDevice();                           // Initialize the device on a background thread.
+
 void parFilter(unsigned int imgWidth,                       
                unsigned int imgHeight,
                unsigned int lpMaskSize,
@@ -66,6 +55,166 @@ void parFilter(unsigned int imgWidth,
                float *hpMask,
                unsigned char *outputImg);                        // Parallelly filter an image.
 
+enum FilterBackend {
+    BACKEND_BUFFER,                 // linear buffers, filterImageWithCache
+    BACKEND_IMAGE                   // Image2D through a sampler, filterImage2D
+};
+
+enum FilterEdges {
+    EDGES_ZERO,                     // border pixels are 0, as in seqFilter
+    EDGES_CLAMP                     // border pixels are filtered over clamp-to-edge reads (image backend)
+};                                  // Values must match image_filtering.cl.
+
+bool imageBackendSupported();                                     // Check if the device can read images.
+
+void parFilterWith(FilterBackend backend,
+                   FilterEdges edges,
+                   unsigned int imgWidth,
+                   unsigned int imgHeight,
+                   unsigned int lpMaskSize,
+                   unsigned int hpMaskSize,
+                   unsigned char *inputRchannel,
+                   unsigned char *inputGchannel,
+                   unsigned char *inputBchannel,
+                   float *lpMask,
+                   float *hpMask,
+                   unsigned char *outputImg);                    // Parallelly filter an image with the given backend.
+
+FilterBackend selectBackend(unsigned int imgWidth,
+                            unsigned int imgHeight,
+                            unsigned int lpMaskSize,
+                            unsigned int hpMaskSize,
+                            unsigned char *inputRchannel,
+                            unsigned char *inputGchannel,
+                            unsigned char *inputBchannel,
+                            float *lpMask,
+                            float *hpMask);                  // Pick the faster backend on this device.
+
+struct ParIncrementalState {
+    unsigned int imgWidth = 0;
+    unsigned int imgHeight = 0;
+    bool primed = false;                // device buffers hold the previous frame
+    cl::CommandQueue queue;
+    cl::Buffer prev[3], input[3];       // previous and new RGB frames, swapped every frame
+    cl::Buffer gray, lp, output, lpMask, hpMask;
+    cl::Buffer tileMask, dilated, tileCount, tileList;
+    std::vector<unsigned char> hostOutput;
+    std::vector<int> hostTiles;
+};
+
+double parFilterIncremental(ParIncrementalState &state,
+                            unsigned int imgWidth,
+                            unsigned int imgHeight,
+                            unsigned int lpMaskSize,
+                            unsigned int hpMaskSize,
+                            unsigned char *inputRchannel,
+                            unsigned char *inputGchannel,
+                            unsigned char *inputBchannel,
+                            float *lpMask,
+                            float *hpMask,
+                            unsigned char *outputImg);  // Parallelly filter a frame, recomputing the changed tiles only.
+
+void filterSequence(unsigned int imgWidth,
+                    unsigned int imgHeight,
+                    unsigned int lpMaskSize,
+                    unsigned int hpMaskSize,
+                    unsigned char *inputImg,
+                    float *lpMask,
+                    float *hpMask,
+                    int frames);                        // Filter a mostly static sequence incrementally.
+
+enum StagePrecision {
+    PRECISION_UCHAR4,               // uchar storage, float arithmetic, 4 pixels per work-item
+    PRECISION_UCHAR16,              // uchar storage, float arithmetic, 16 pixels per work-item
+    PRECISION_HALF,                 // half storage and arithmetic (cl_khr_fp16), 8 pixels per work-item
+    PRECISION_HALF_STORAGE,         // half storage, float arithmetic, 8 pixels per work-item
+    PRECISION_FLOAT                 // float storage and arithmetic, 4 pixels per work-item
+};                                  // Each stage rounds as seqFilter; only half arithmetic deviates.
+
+struct PrecisionPolicy {
+    const char *name;
+    StagePrecision gray, lp, hp;    // the high-pass output is always stored as uchar
+    int maxDiff;                    // stated tolerance: largest difference from seqFilter,
+    double maxMismatch;             // and largest fraction of pixels differing at all
+};
+
+bool halfSupported();                                             // Check if the device has cl_khr_fp16.
+
+void parFilterPrecision(const PrecisionPolicy &policy,
+                        unsigned int imgWidth,
+                        unsigned int imgHeight,
+                        unsigned int lpMaskSize,
+                        unsigned int hpMaskSize,
+                        unsigned char *inputRchannel,
+                        unsigned char *inputGchannel,
+                        unsigned char *inputBchannel,
+                        float *lpMask,
+                        float *hpMask,
+                        unsigned char *outputImg);           // Parallelly filter an image with vector kernels.
+
+const PrecisionPolicy *selectPrecision(unsigned int imgWidth,
+                                       unsigned int imgHeight,
+                                       unsigned int lpMaskSize,
+                                       unsigned int hpMaskSize,
+                                       unsigned char *inputRchannel,
+                                       unsigned char *inputGchannel,
+                                       unsigned char *inputBchannel,
+                                       float *lpMask,
+                                       float *hpMask,
+                                       unsigned char *seqOutput,
+                                       int maxDiff);     // Pick the fastest policy within maxDiff of seqFilter.
+
+#define HISTOGRAM_GROUP 256             // must match image_filtering.cl
+#define HISTOGRAM_PIXELS 64             // pixels per work-item before the work-groups are capped
+#define HISTOGRAM_MAX_GROUPS 64
+#define MEDIAN_SEGMENT 32               // must match image_filtering.cl
+
+void enqueueImageStats(const cl::CommandQueue &queue,
+                       const cl::Buffer &image,
+                       unsigned int imgSize,
+                       unsigned int clipCount,
+                       cl::Buffer &histogram,
+                       cl::Buffer &range,
+                       const std::vector<cl::Event> *waitFor,
+                       cl::Event *done);                // Histogram and range of a device image, on the device.
+
+void parRunPlan(const FilterPlan &plan,
+                unsigned int imgWidth,
+                unsigned int imgHeight,
+                unsigned char *inputRchannel,
+                unsigned char *inputGchannel,
+                unsigned char *inputBchannel,
+                unsigned char *outputImg,
+                std::map<int, ImageStats> *stats = nullptr);    // Parallelly run a filter graph plan on an image.
+
+void filterGraphs(unsigned int imgWidth,
+                  unsigned int imgHeight,
+                  unsigned char *inputImg,
+                  unsigned int lpMaskSize,
+                  unsigned int hpMaskSize,
+                  float *lpMask,
+                  float *hpMask,
+                  unsigned char *seqOutput);            // Run the filter as a graph, and filter_graph.cfg.
+
+void serveThumbnails(unsigned int imgWidth,
+                     unsigned int imgHeight,
+                     unsigned char *inputImg,
+                     unsigned int lpMaskSize,
+                     unsigned int hpMaskSize,
+                     float *lpMask,
+                     float *hpMask,
+                     int clients,
+                     int perClient);                    // Filter many crops through the filter service.
+
+void browsePyramid(unsigned int imgWidth,
+                   unsigned int imgHeight,
+                   unsigned char *inputImg,
+                   unsigned int lpMaskSize,
+                   unsigned int hpMaskSize,
+                   float *lpMask,
+                   float *hpMask,
+                   unsigned char *seqOutput);           // Preview the image, then filter full-resolution tiles.
+
 // =================================================================
 // ------------------------ Global Variables ------------------------
 // =================================================================
@@ -73,6 +222,19 @@ void parFilter(unsigned int imgWidth,
 cl::Program program;                // The program that will run on the device.    
 cl::Context context;                // The context which holds the device.    
 cl::Device device;                  // The device where the kernel will run.
+FilterBackend filterBackend = BACKEND_BUFFER;   // The backend used by parFilter.
+const PrecisionPolicy *filterPrecision = nullptr; // The vector kernels used by parFilter, if any.
+std::map<std::string, cl::Program> precisionPrograms;   // filter_precision.cl, built per stage options.
+
+// Only the high-pass runs in half: a low-pass error is amplified by the high-pass gain.
+// The intermediates are whole numbers up to 255, so half storage alone is exact.
+const PrecisionPolicy precisionPolicies[] = {
+    {"uchar4",  PRECISION_UCHAR4,       PRECISION_UCHAR4,       PRECISION_UCHAR4,  0, 0.0},
+    {"uchar16", PRECISION_UCHAR16,      PRECISION_UCHAR16,      PRECISION_UCHAR16, 0, 0.0},
+    {"float",   PRECISION_FLOAT,        PRECISION_FLOAT,        PRECISION_FLOAT,   0, 0.0},
+    {"half",    PRECISION_HALF_STORAGE, PRECISION_HALF_STORAGE, PRECISION_UCHAR16, 0, 0.0},
+    {"fp16",    PRECISION_UCHAR16,      PRECISION_UCHAR16,      PRECISION_HALF,    1, 0.01},
+};
 
 // =================================================================
 // ------------------------- Main Function -------------------------
@@ -84,7 +246,15 @@ int main(){
      * Create auxiliary variables.
      * */
 
-    clock_t start, end;
+    std::chrono::steady_clock::time_point start, end;
+
+    /**
+     * Start initializing the OpenCL device, so that the platform query and
+     * the kernel build overlap with loading the image and the sequential
+     * filter.
+     * */
+
+    std::shared_future<void> deviceReady = startDevice();
 
     /**
      * Load input image.
@@ -126,56 +296,138 @@ int main(){
     float* hpMaskData = &hpMask[0][0];
 
     /**
-     * Allocate memory for the output images.
+     * Allocate memory for the output images, from one arena block.
      * */
 
-    unsigned char *seqFilteredImg = (unsigned char*) malloc(imgWidth * imgHeight * sizeof(unsigned char));
-    unsigned char *parFilteredImg = (unsigned char*) malloc(imgWidth * imgHeight * sizeof(unsigned char));
+    size_t imgSize = (size_t) imgWidth * imgHeight;
+    ScratchArena outputImages;
+    outputImages.reserve(2 * (imgSize + ARENA_ALIGNMENT));
+    unsigned char *seqFilteredImg = (unsigned char*) outputImages.allocate(imgSize * sizeof(unsigned char));
+    unsigned char *parFilteredImg = (unsigned char*) outputImages.allocate(imgSize * sizeof(unsigned char));
     
     /**
      * Sequentially convolve filter over image.
      * */
 
-    start = clock();
+    start = std::chrono::steady_clock::now();
     seqFilter(imgWidth, imgHeight, lpMaskSize, hpMaskSize, inputRchannel, inputGchannel, inputBchannel, 
     lpMaskData, hpMaskData, seqFilteredImg);
-    end = clock();
-    double seqTime = ((double) 10e3 * (end - start)) / CLOCKS_PER_SEC;
+    end = std::chrono::steady_clock::now();
+    double seqTime = std::chrono::duration<double, std::milli>(end - start).count();
 
     /**
-     * Initialize OpenCL device.
+     * Wait for the OpenCL device, if it is not ready yet.
      */
 
-    initializeDevice();
+    auto waitStart = std::chrono::steady_clock::now();
+    deviceReady.get();
+    double deviceWait = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+
+    /**
+     * Benchmark the buffer and image backends on this device.
+     * */
+
+    filterBackend = selectBackend(imgWidth, imgHeight, lpMaskSize, hpMaskSize, inputRchannel, inputGchannel, inputBchannel,
+    lpMaskData, hpMaskData);
+
+    /**
+     * Benchmark the precision policies; parFilter only takes one that
+     * matches seqFilter exactly.
+     * */
+
+    filterPrecision = selectPrecision(imgWidth, imgHeight, lpMaskSize, hpMaskSize, inputRchannel, inputGchannel, inputBchannel,
+    lpMaskData, hpMaskData, seqFilteredImg, 0);
 
     /**
      * Parallelly convolve filter over image.
      * */
     
-    start = clock();
+    start = std::chrono::steady_clock::now();
     parFilter(imgWidth, imgHeight, lpMaskSize, hpMaskSize, inputRchannel, inputGchannel, inputBchannel, 
     lpMaskData, hpMaskData, parFilteredImg);
-    end = clock();
-    double parTime = ((double) 10e3 * (end - start)) / CLOCKS_PER_SEC;
+    end = std::chrono::steady_clock::now();
+    double parTime = std::chrono::duration<double, std::milli>(end - start).count();
     
     /**
      * Check if outputs are equal.
      * */
 
-    bool equal = checkEquality(seqFilteredImg, parFilteredImg, imgWidth, imgHeight);
+    auto checkStart = std::chrono::steady_clock::now();
+    CompareResult check = compareImages(seqFilteredImg, parFilteredImg, imgWidth, imgHeight);
+    double checkTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - checkStart).count();
+    bool equal = check.passed();
 
     /**
      * Print results.
      */
 
     std::cout << "Status: " << (equal ? "SUCCESS!" : "FAILED!") << std::endl;
+    if(!equal){
+        size_t worst = 0;
+        for(size_t tile = 0; tile < check.heatMap.size(); tile++){
+            worst = check.heatMap[tile] > check.heatMap[worst] ? tile : worst;
+        }
+        std::cout << "\t" << check.mismatches << " pixels differ, max diff " << check.maxDiff << ", PSNR " << check.psnr
+                  << " dB;\n\tmost in tile (" << worst % check.tilesX << ", " << worst / check.tilesX << "): "
+                  << check.heatMap[worst] << " pixels." << std::endl;
+    }
+    std::cout << "Validation: " << checkTime << " ms (" << compareImpl() << ")." << std::endl;
+    std::cout << "Device initialization: waited " << deviceWait << " ms." << std::endl;
+
+    /**
+     * Write the filtered image in the background, while the other modes run.
+     * */
+
+    EncoderPool encoders;
+    encoders.submit("output_img.jpg", imgWidth, imgHeight, parFilteredImg);
     std::cout << "Mean execution time: \n\tSequential: " << seqTime << " ms;\n\tParallel: " << parTime << " ms." << std::endl;
     std::cout << "Performance gain: " << (100 * (seqTime - parTime) / parTime) << "\%\n";
 
     /**
-     * Display filtered image.
+     * Filter once more: the first frame sized the scratch arena, so this
+     * one makes no heap calls.
      * */
-    
+
+    size_t heapCalls = threadArena().heapCalls();
+    seqFilter(imgWidth, imgHeight, lpMaskSize, hpMaskSize, inputRchannel, inputGchannel, inputBchannel,
+    lpMaskData, hpMaskData, seqFilteredImg);
+    std::cout << "Scratch arena: " << threadArena().capacity() / 1024 << " KiB, "
+              << threadArena().heapCalls() - heapCalls << " heap calls per frame after the first." << std::endl;
+
+    /**
+     * Filter a mostly static sequence incrementally.
+     * */
+
+    filterSequence(imgWidth, imgHeight, lpMaskSize, hpMaskSize, inputImg, lpMaskData, hpMaskData, 20);
+
+    /**
+     * Run the filter as a graph, and the graph of filter_graph.cfg, on the
+     * CPU and on the device.
+     * */
+
+    filterGraphs(imgWidth, imgHeight, inputImg, lpMaskSize, hpMaskSize, lpMaskData, hpMaskData, seqFilteredImg);
+
+    /**
+     * Filter thumbnails from several client threads through the service.
+     * */
+
+    serveThumbnails(imgWidth, imgHeight, inputImg, lpMaskSize, hpMaskSize, lpMaskData, hpMaskData, 4, 64);
+
+    /**
+     * Preview the image from its pyramid, then zoom into full-resolution
+     * tiles.
+     * */
+
+    browsePyramid(imgWidth, imgHeight, inputImg, lpMaskSize, hpMaskSize, lpMaskData, hpMaskData, seqFilteredImg);
+
+    /**
+     * Wait for the output image, then display it if there is a display.
+     * */
+
+    encoders.finish();
+    EncoderStats written = encoders.stats();
+    std::cout << "Output: output_img.jpg " << (written.failed == 0 ? "written." : "could not be written.") << std::endl;
+
     displayImg(parFilteredImg, imgWidth, imgHeight);
     return 0;
 }
@@ -261,7 +513,17 @@ void initializeDevice(){
 }
 
 /**
- * Parallelly filter an image.
+ * Run initializeDevice() on a background thread. The device globals may be
+ * used once the returned future is ready.
+ * */
+
+std::shared_future<void> startDevice(){
+    return std::async(std::launch::async, initializeDevice).share();
+}
+
+/**
+ * Parallelly filter an image with the precision policy selected for the
+ * device, or else its selected backend.
  */
 
 void parFilter(unsigned int imgWidth,
@@ -274,6 +536,45 @@ void parFilter(unsigned int imgWidth,
                float *lpMask,
                float *hpMask,
                unsigned char *outputImg){
+    if(filterPrecision){
+        parFilterPrecision(*filterPrecision, imgWidth, imgHeight, lpMaskSize, hpMaskSize,
+                           inputRchannel, inputGchannel, inputBchannel, lpMask, hpMask, outputImg);
+        return;
+    }
+    parFilterWith(filterBackend, EDGES_ZERO, imgWidth, imgHeight, lpMaskSize, hpMaskSize,
+                  inputRchannel, inputGchannel, inputBchannel, lpMask, hpMask, outputImg);
+}
+
+/**
+ * Check if the device can read images.
+ * */
+
+bool imageBackendSupported(){
+    return device.getInfo<CL_DEVICE_IMAGE_SUPPORT>() == CL_TRUE;
+}
+
+/**
+ * Parallelly filter an image with the given backend.
+ *
+ * The buffer backend caches blocks in local memory (filterImageWithCache).
+ * The image backend reads gray and low-pass as CL_R / CL_UNORM_INT8 images
+ * through a sampler; with cl_khr_image2d_from_buffer and a suitably aligned
+ * width, the images are views of the gray and low-pass buffers, otherwise
+ * the buffers are copied into images.
+ */
+
+void parFilterWith(FilterBackend backend,
+                   FilterEdges edges,
+                   unsigned int imgWidth,
+                   unsigned int imgHeight,
+                   unsigned int lpMaskSize,
+                   unsigned int hpMaskSize,
+                   unsigned char *inputRchannel,
+                   unsigned char *inputGchannel,
+                   unsigned char *inputBchannel,
+                   float *lpMask,
+                   float *hpMask,
+                   unsigned char *outputImg){
     
     /**
      * Create buffers and allocate memory on the device.
@@ -298,169 +599,1074 @@ void parFilter(unsigned int imgWidth,
     grayKernel.setArg(2, inputBchannelBuf);
     grayKernel.setArg(3, grayOutputBuf);
 
+    cl::CommandQueue queue(context, device);
+
+    if(backend == BACKEND_BUFFER){
+
+        /**
+         * Initialize low-pass filter kernel.
+         * */
+        cl::Kernel lpKernel(program, "filterImageWithCache");
+        lpKernel.setArg(0, sizeof(unsigned int), &lpMaskSize);
+        lpKernel.setArg(1, grayOutputBuf);
+        lpKernel.setArg(2, lpMaskBuf);
+        lpKernel.setArg(3, lpOutputBuf);
+
+        /**
+         * Initialize high-pass filter kernel.
+         * */
+
+        cl::Kernel hpKernel(program, "filterImageWithCache");
+        hpKernel.setArg(0, sizeof(unsigned int), &hpMaskSize);
+        hpKernel.setArg(1, lpOutputBuf);
+        hpKernel.setArg(2, hpMaskBuf);
+        hpKernel.setArg(3, hpOutputBuf);
+
+        /**
+         * Execute kernel functions and collect the final result.
+         * */
+
+        queue.enqueueNDRangeKernel(grayKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight));
+        queue.enqueueNDRangeKernel(lpKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight), cl::NDRange(16, 16));
+        queue.enqueueNDRangeKernel(hpKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight), cl::NDRange(16, 16));
+        queue.enqueueReadBuffer(hpOutputBuf, CL_TRUE, 0, imgWidth * imgHeight * sizeof(unsigned char), outputImg);
+        return;
+    }
+
     /**
-     * Initialize low-pass filter kernel.
+     * Create the gray and low-pass images, as views of their buffers when
+     * the device can do so without padding the rows.
      * */
-    cl::Kernel lpKernel(program, "filterImageWithCache");
-    lpKernel.setArg(0, sizeof(unsigned int), &lpMaskSize);
-    lpKernel.setArg(1, grayOutputBuf);
-    lpKernel.setArg(2, lpMaskBuf);
-    lpKernel.setArg(3, lpOutputBuf);
+
+    cl::ImageFormat format(CL_R, CL_UNORM_INT8);
+    cl_uint pitchAlignment = device.getInfo<CL_DEVICE_IMAGE_PITCH_ALIGNMENT>();
+    bool fromBuffer = device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_image2d_from_buffer") != std::string::npos
+                   && (pitchAlignment == 0 || imgWidth % pitchAlignment == 0);
+
+    cl::Image2D grayImage, lpImage;
+    if(fromBuffer){
+        grayImage = cl::Image2D(context, format, grayOutputBuf, imgWidth, imgHeight, imgWidth * sizeof(unsigned char));
+        lpImage = cl::Image2D(context, format, lpOutputBuf, imgWidth, imgHeight, imgWidth * sizeof(unsigned char));
+    } else {
+        grayImage = cl::Image2D(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS, format, imgWidth, imgHeight);
+        lpImage = cl::Image2D(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS, format, imgWidth, imgHeight);
+    }
+
+    /**
+     * Zero-border addressing returns 0 outside the image, clamp-to-edge
+     * repeats the edge pixels.
+     * */
+
+    cl::Sampler sampler(context, CL_FALSE, edges == EDGES_CLAMP ? CL_ADDRESS_CLAMP_TO_EDGE : CL_ADDRESS_CLAMP, CL_FILTER_NEAREST);
+    cl_uint edgeMode = edges;
 
     /**
-     * Initialize high-pass filter kernel.
+     * Initialize the low-pass and high-pass filter kernels.
      * */
 
-    cl::Kernel hpKernel(program, "filterImageWithCache");
+    cl::Kernel lpKernel(program, "filterImage2D");
+    lpKernel.setArg(0, sizeof(unsigned int), &lpMaskSize);
+    lpKernel.setArg(1, sizeof(cl_uint), &edgeMode);
+    lpKernel.setArg(2, grayImage);
+    lpKernel.setArg(3, sampler);
+    lpKernel.setArg(4, lpMaskBuf);
+    lpKernel.setArg(5, lpOutputBuf);
+
+    cl::Kernel hpKernel(program, "filterImage2D");
     hpKernel.setArg(0, sizeof(unsigned int), &hpMaskSize);
-    hpKernel.setArg(1, lpOutputBuf);
-    hpKernel.setArg(2, hpMaskBuf);
-    hpKernel.setArg(3, hpOutputBuf);
+    hpKernel.setArg(1, sizeof(cl_uint), &edgeMode);
+    hpKernel.setArg(2, lpImage);
+    hpKernel.setArg(3, sampler);
+    hpKernel.setArg(4, hpMaskBuf);
+    hpKernel.setArg(5, hpOutputBuf);
 
     /**
      * Execute kernel functions and collect the final result.
      * */
 
-    cl::CommandQueue queue(context, device);
+    cl::array<cl::size_type, 3> origin = {0, 0, 0};
+    cl::array<cl::size_type, 3> region = {imgWidth, imgHeight, 1};
+
     queue.enqueueNDRangeKernel(grayKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight));
-    queue.enqueueNDRangeKernel(lpKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight), cl::NDRange(16, 16));
-    queue.enqueueNDRangeKernel(hpKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight), cl::NDRange(16, 16));
+    if(!fromBuffer){
+        queue.enqueueCopyBufferToImage(grayOutputBuf, grayImage, 0, origin, region);
+    }
+    queue.enqueueNDRangeKernel(lpKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight));
+    if(!fromBuffer){
+        queue.enqueueCopyBufferToImage(lpOutputBuf, lpImage, 0, origin, region);
+    }
+    queue.enqueueNDRangeKernel(hpKernel, cl::NullRange, cl::NDRange(imgWidth, imgHeight));
     queue.enqueueReadBuffer(hpOutputBuf, CL_TRUE, 0, imgWidth * imgHeight * sizeof(unsigned char), outputImg);
 }
 
-// =================================================================
-// ---------------------- Secondary Functions ----------------------
-// =================================================================
+/**
+ * Pick the faster backend on this device: each supported backend filters
+ * the image once to warm up and then three times, and the one with the
+ * lowest best time wins.
+ */
+
+FilterBackend selectBackend(unsigned int imgWidth,
+                            unsigned int imgHeight,
+                            unsigned int lpMaskSize,
+                            unsigned int hpMaskSize,
+                            unsigned char *inputRchannel,
+                            unsigned char *inputGchannel,
+                            unsigned char *inputBchannel,
+                            float *lpMask,
+                            float *hpMask){
+    if(!imageBackendSupported()){
+        std::cout << "Backend: buffer (no image support)" << std::endl;
+        return BACKEND_BUFFER;
+    }
+    if(imgWidth % 16 != 0 || imgHeight % 16 != 0){
+        // filterImageWithCache runs on whole 16x16 work-groups
+        std::cout << "Backend: image (size not a multiple of 16)" << std::endl;
+        return BACKEND_IMAGE;
+    }
+
+    const char *names[2] = {"buffer", "image"};
+    double best[2];
+    std::vector<unsigned char> outputImg(imgWidth * imgHeight);
+
+    for(int backend = BACKEND_BUFFER; backend <= BACKEND_IMAGE; backend++){
+        best[backend] = 1e30;
+        for(int run = 0; run < 4; run++){
+            auto start = std::chrono::steady_clock::now();
+            parFilterWith((FilterBackend) backend, EDGES_ZERO, imgWidth, imgHeight, lpMaskSize, hpMaskSize,
+                          inputRchannel, inputGchannel, inputBchannel, lpMask, hpMask, outputImg.data());
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if(run > 0 && ms < best[backend]){
+                best[backend] = ms;
+            }
+        }
+    }
+
+    FilterBackend chosen = best[BACKEND_IMAGE] < best[BACKEND_BUFFER] ? BACKEND_IMAGE : BACKEND_BUFFER;
+    std::cout << "Backend: " << names[chosen] << " (buffer " << best[BACKEND_BUFFER]
+              << " ms, image " << best[BACKEND_IMAGE] << " ms)" << std::endl;
+    return chosen;
+}
+
+/**
+ * Check if the device has cl_khr_fp16.
+ * */
+
+bool halfSupported(){
+    return device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp16") != std::string::npos;
+}
+
+/**
+ * Storage, arithmetic and width of the kernels of a stage precision.
+ * */
+
+struct StageFormat {
+    const char *storage;            // OpenCL C type of the stage output
+    const char *compute;            // OpenCL C type of the arithmetic
+    unsigned int vec;               // pixels per work-item: 16 bytes of storage
+};
+
+StageFormat stageFormat(StagePrecision precision){
+    switch(precision){
+        case PRECISION_UCHAR4:  return {"uchar", "float", 4};
+        case PRECISION_UCHAR16: return {"uchar", "float", 16};
+        case PRECISION_HALF:    return {"half", "half", 8};
+        case PRECISION_HALF_STORAGE: return {"half", "float", 8};
+        default:                return {"float", "float", 4};
+    }
+}
+
+size_t storageSize(StagePrecision precision){
+    std::string storage = stageFormat(precision).storage;
+    return storage == "uchar" ? 1 : (storage == "half" ? 2 : 4);
+}
 
 /**
- * Sequentially convert an RGB image to grayscale.
+ * Return the program of filter_precision.cl specialised for a stage,
+ * building it on first use.
+ * */
+
+cl::Program &stageProgram(StagePrecision precision, const char *inType, const char *outType){
+    StageFormat format = stageFormat(precision);
+    std::string options = std::string("-D IN_T=") + inType + " -D OUT_T=" + outType + " -D ACC_T=" + format.compute
+                        + " -D VEC=" + std::to_string(format.vec);
+    if(std::string(inType) == "half"){
+        options += " -D IN_HALF";
+    }
+    if(std::string(outType) == "half"){
+        options += " -D OUT_HALF";
+    }
+    if(std::string(format.compute) == "half"){
+        options += " -D USE_HALF";
+    }
+
+    auto cached = precisionPrograms.find(options);
+    if(cached != precisionPrograms.end()){
+        return cached->second;
+    }
+
+    std::ifstream kernel_file("filter_precision.cl");
+    std::string src(std::istreambuf_iterator<char>(kernel_file), (std::istreambuf_iterator<char>()));
+    cl::Program::Sources sources(1, std::make_pair(src.c_str(), src.length() + 1));
+    cl::Program stage(context, sources);
+
+    auto err = stage.build(options.c_str());
+    if(err != CL_BUILD_SUCCESS){
+        std::cerr << "Error!\nBuild Status: " << stage.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device)
+        << "\nBuild Log:\t " << stage.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+        exit(1);
+    }
+    return precisionPrograms[options] = stage;
+}
+
+/**
+ * Parallelly filter an image with the vector kernels of filter_precision.cl:
+ * each stage stores its output as uchar, half or float and processes
+ * several pixels per work-item with vector loads and stores, as set by the
+ * policy. Stages with float arithmetic match seqFilter exactly; half
+ * arithmetic stays within the policy's tolerance.
  */
 
-void seqRgb2Gray(unsigned int imgWidth,
-                 unsigned int imgHeight,
-                 unsigned char *rChannel,
-                 unsigned char *gChannel,
-                 unsigned char *bChannel,
-                 unsigned char *grayImg){
-    
+void parFilterPrecision(const PrecisionPolicy &policy,
+                        unsigned int imgWidth,
+                        unsigned int imgHeight,
+                        unsigned int lpMaskSize,
+                        unsigned int hpMaskSize,
+                        unsigned char *inputRchannel,
+                        unsigned char *inputGchannel,
+                        unsigned char *inputBchannel,
+                        float *lpMask,
+                        float *hpMask,
+                        unsigned char *outputImg){
+    unsigned int imgSize = imgWidth * imgHeight;
+    StageFormat gray = stageFormat(policy.gray), lp = stageFormat(policy.lp), hp = stageFormat(policy.hp);
+
     /**
-     * Declare the current index variable.
-     */
+     * Create buffers and allocate memory on the device; the intermediates
+     * take the storage of their stage.
+     * */
 
-    size_t idx;
+    cl::Buffer inputRchannelBuf(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, imgSize * sizeof(unsigned char), inputRchannel);
+    cl::Buffer inputGchannelBuf(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, imgSize * sizeof(unsigned char), inputGchannel);
+    cl::Buffer inputBchannelBuf(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, imgSize * sizeof(unsigned char), inputBchannel);
+    cl::Buffer grayOutputBuf(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, imgSize * storageSize(policy.gray));
+    cl::Buffer lpMaskBuf(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, lpMaskSize * lpMaskSize * sizeof(float), lpMask);
+    cl::Buffer hpMaskBuf(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, hpMaskSize * hpMaskSize * sizeof(float), hpMask);
+    cl::Buffer lpOutputBuf(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, imgSize * storageSize(policy.lp));
+    cl::Buffer hpOutputBuf(context, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, imgSize * sizeof(unsigned char));
 
     /**
-     * Loop over input image pixels.
-     */
+     * Initialize the grayscale, low-pass and high-pass kernels.
+     * */
 
-    for(int i = 0; i < imgWidth; i++){
-        for(int j = 0; j < imgHeight; j++){
+    cl::Kernel grayKernel(stageProgram(policy.gray, "uchar", gray.storage), "rgb2grayVector");
+    grayKernel.setArg(0, sizeof(unsigned int), &imgSize);
+    grayKernel.setArg(1, inputRchannelBuf);
+    grayKernel.setArg(2, inputGchannelBuf);
+    grayKernel.setArg(3, inputBchannelBuf);
+    grayKernel.setArg(4, grayOutputBuf);
 
-            /**
-             * Compute average pixel.
-             */
+    cl::Kernel lpKernel(stageProgram(policy.lp, gray.storage, lp.storage), "filterVector");
+    lpKernel.setArg(0, sizeof(unsigned int), &lpMaskSize);
+    lpKernel.setArg(1, sizeof(unsigned int), &imgWidth);
+    lpKernel.setArg(2, sizeof(unsigned int), &imgHeight);
+    lpKernel.setArg(3, grayOutputBuf);
+    lpKernel.setArg(4, lpMaskBuf);
+    lpKernel.setArg(5, lpOutputBuf);
 
-            idx = i + j*imgWidth;
-            grayImg[idx] = (rChannel[idx] + gChannel[idx] + bChannel[idx]) / 3;
+    cl::Kernel hpKernel(stageProgram(policy.hp, lp.storage, "uchar"), "filterVector");
+    hpKernel.setArg(0, sizeof(unsigned int), &hpMaskSize);
+    hpKernel.setArg(1, sizeof(unsigned int), &imgWidth);
+    hpKernel.setArg(2, sizeof(unsigned int), &imgHeight);
+    hpKernel.setArg(3, lpOutputBuf);
+    hpKernel.setArg(4, hpMaskBuf);
+    hpKernel.setArg(5, hpOutputBuf);
+
+    /**
+     * Execute kernel functions and collect the final result; each work-item
+     * covers vec pixels of a row.
+     * */
+
+    cl::CommandQueue queue(context, device);
+    queue.enqueueNDRangeKernel(grayKernel, cl::NullRange, cl::NDRange((imgSize + gray.vec - 1) / gray.vec));
+    queue.enqueueNDRangeKernel(lpKernel, cl::NullRange, cl::NDRange((imgWidth + lp.vec - 1) / lp.vec, imgHeight));
+    queue.enqueueNDRangeKernel(hpKernel, cl::NullRange, cl::NDRange((imgWidth + hp.vec - 1) / hp.vec, imgHeight));
+    queue.enqueueReadBuffer(hpOutputBuf, CL_TRUE, 0, imgSize * sizeof(unsigned char), outputImg);
+}
+
+/**
+ * Pick the fastest precision policy within maxDiff of seqFilter: each
+ * policy the device supports filters the image once to warm up and then
+ * three times, and its error against seqOutput is checked against both
+ * maxDiff and the policy's own tolerance. Returns nullptr, i.e. the
+ * scalar kernels, if none qualifies.
+ */
+
+const PrecisionPolicy *selectPrecision(unsigned int imgWidth,
+                                       unsigned int imgHeight,
+                                       unsigned int lpMaskSize,
+                                       unsigned int hpMaskSize,
+                                       unsigned char *inputRchannel,
+                                       unsigned char *inputGchannel,
+                                       unsigned char *inputBchannel,
+                                       float *lpMask,
+                                       float *hpMask,
+                                       unsigned char *seqOutput,
+                                       int maxDiff){
+    size_t imgSize = imgWidth * imgHeight;
+    std::vector<unsigned char> outputImg(imgSize);
+    const PrecisionPolicy *chosen = nullptr;
+    double chosenTime = 1e30;
+
+    std::cout << "Precision policies:" << std::endl;
+    for(const PrecisionPolicy &policy : precisionPolicies){
+        bool half = policy.gray == PRECISION_HALF || policy.lp == PRECISION_HALF || policy.hp == PRECISION_HALF;
+        if(half && !halfSupported()){
+            std::cout << "\t" << policy.name << ": skipped (no cl_khr_fp16)" << std::endl;
+            continue;
+        }
+
+        double best = 1e30;
+        for(int run = 0; run < 4; run++){
+            auto start = std::chrono::steady_clock::now();
+            parFilterPrecision(policy, imgWidth, imgHeight, lpMaskSize, hpMaskSize,
+                               inputRchannel, inputGchannel, inputBchannel, lpMask, hpMask, outputImg.data());
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if(run > 0 && ms < best){
+                best = ms;
+            }
+        }
+
+        CompareOptions tolerance;
+        tolerance.tolerance = policy.maxDiff;
+        tolerance.tileSize = 0;
+        CompareResult check = compareImages(seqOutput, outputImg.data(), imgWidth, imgHeight, tolerance);
+        double mismatch = (double) check.differing / imgSize;
+        bool withinPolicy = check.passed() && mismatch <= policy.maxMismatch;
+
+        std::cout << "\t" << policy.name << ": " << best << " ms, max diff " << check.maxDiff << ", "
+                  << 100 * mismatch << "\% of pixels differ, PSNR " << check.psnr << " dB ("
+                  << (withinPolicy ? "within" : "OUT OF") << " tolerance)" << std::endl;
+
+        if(withinPolicy && check.maxDiff <= maxDiff && best < chosenTime){
+            chosen = &policy;
+            chosenTime = best;
         }
     }
+    return chosen;
 }
 
 /**
- * Sequentially convolve an image with a filter mask.
+ * Parallelly filter a frame of a sequence: the frame is compared with the
+ * previous one on the device, and gray, low-pass and high-pass are rerun
+ * only on the changed tiles grown by the filter halo. The previous frame
+ * and the intermediates stay on the device between calls. Returns the
+ * fraction of the pixels recomputed.
  */
 
-void seqConvolve(unsigned int imgWidth,
-                 unsigned int imgHeight,
-                 unsigned int maskSize,
-                 unsigned char *inputImg,
-                 float *mask,
-                 unsigned char *outputImg){
+double parFilterIncremental(ParIncrementalState &state,
+                            unsigned int imgWidth,
+                            unsigned int imgHeight,
+                            unsigned int lpMaskSize,
+                            unsigned int hpMaskSize,
+                            unsigned char *inputRchannel,
+                            unsigned char *inputGchannel,
+                            unsigned char *inputBchannel,
+                            float *lpMask,
+                            float *hpMask,
+                            unsigned char *outputImg){
+    size_t imgSize = imgWidth * imgHeight * sizeof(unsigned char);
+    unsigned int tilesX = tileCount(imgWidth);
+    unsigned int tilesY = tileCount(imgHeight);
+    unsigned char *channels[3] = {inputRchannel, inputGchannel, inputBchannel};
+
+    if(!state.primed || state.imgWidth != imgWidth || state.imgHeight != imgHeight){
+
+        /**
+         * Allocate the resident buffers; the whole frame is filtered.
+         * */
+
+        state.imgWidth = imgWidth;
+        state.imgHeight = imgHeight;
+        state.queue = cl::CommandQueue(context, device);
+        for(int c = 0; c < 3; c++){
+            state.prev[c] = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY, imgSize);
+            state.input[c] = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY, imgSize);
+        }
+        state.gray = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, imgSize);
+        state.lp = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, imgSize);
+        state.output = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, imgSize);
+        state.lpMask = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, lpMaskSize * lpMaskSize * sizeof(float), lpMask);
+        state.hpMask = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, hpMaskSize * hpMaskSize * sizeof(float), hpMask);
+        state.tileMask = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, tilesX * tilesY);
+        state.dilated = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, tilesX * tilesY);
+        state.tileCount = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(int));
+        state.tileList = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, tilesX * tilesY * sizeof(int));
+        state.hostOutput.resize(imgSize);
+        state.hostTiles.resize(tilesX * tilesY);
+
+        state.primed = false;
+    }
+
     /**
-     * Loop through input image.
+     * Upload the new frame and flag the changed tiles and their halo, or
+     * every tile for the first frame.
      * */
 
-    for(size_t i = 0; i < imgWidth; i++){
-        for(size_t j = 0; j < imgHeight; j++){
-                
-            /**
-             * Check if the mask cannot be applied to the
-             * current image pixel.
-             * */
-            
-            if(i < maskSize/2  
-            || j < maskSize/2
-            || i >= imgWidth - maskSize/2
-            || j >= imgHeight - maskSize/2){
-                outputImg[i + j * imgWidth] = 0;
-                continue;
+    for(int c = 0; c < 3; c++){
+        state.queue.enqueueWriteBuffer(state.input[c], CL_FALSE, 0, imgSize, channels[c]);
+    }
+
+    cl::Kernel diffKernel(program, "diffTiles");
+    diffKernel.setArg(0, sizeof(unsigned int), &imgWidth);
+    diffKernel.setArg(1, sizeof(unsigned int), &imgHeight);
+    for(int c = 0; c < 3; c++){
+        diffKernel.setArg(2 + c, state.prev[c]);
+        diffKernel.setArg(5 + c, state.input[c]);
+    }
+    diffKernel.setArg(8, state.tileMask);
+
+    unsigned int radius = haloTiles(lpMaskSize, hpMaskSize);
+    cl::Kernel dilateKernel(program, "dilateTiles");
+    dilateKernel.setArg(0, sizeof(unsigned int), &radius);
+    dilateKernel.setArg(1, state.tileMask);
+    dilateKernel.setArg(2, state.dilated);
+
+    cl::Kernel listKernel(program, "listTiles");
+    listKernel.setArg(0, state.dilated);
+    listKernel.setArg(1, state.tileCount);
+    listKernel.setArg(2, state.tileList);
+
+    int count = 0;
+    state.queue.enqueueWriteBuffer(state.tileCount, CL_FALSE, 0, sizeof(int), &count);
+    if(state.primed){
+        state.queue.enqueueNDRangeKernel(diffKernel, cl::NullRange, cl::NDRange(tilesX * 16, tilesY * 16), cl::NDRange(16, 16));
+        state.queue.enqueueNDRangeKernel(dilateKernel, cl::NullRange, cl::NDRange(tilesX, tilesY));
+    } else {
+        state.queue.enqueueFillBuffer(state.dilated, (cl_uchar) 1, 0, tilesX * tilesY);
+    }
+    state.queue.enqueueNDRangeKernel(listKernel, cl::NullRange, cl::NDRange(tilesX * tilesY));
+    state.queue.enqueueReadBuffer(state.tileCount, CL_TRUE, 0, sizeof(int), &count);
+
+    if(count > 0){
+
+        /**
+         * Rerun the three stages on the listed tiles, one work-group per tile.
+         * */
+
+        cl::Kernel grayKernel(program, "rgb2grayTiles");
+        grayKernel.setArg(0, sizeof(unsigned int), &imgWidth);
+        grayKernel.setArg(1, sizeof(unsigned int), &imgHeight);
+        grayKernel.setArg(2, sizeof(unsigned int), &tilesX);
+        grayKernel.setArg(3, state.tileList);
+        grayKernel.setArg(4, state.input[0]);
+        grayKernel.setArg(5, state.input[1]);
+        grayKernel.setArg(6, state.input[2]);
+        grayKernel.setArg(7, state.gray);
+
+        cl::Kernel lpKernel(program, "filterTiles");
+        lpKernel.setArg(0, sizeof(unsigned int), &lpMaskSize);
+        lpKernel.setArg(1, sizeof(unsigned int), &imgWidth);
+        lpKernel.setArg(2, sizeof(unsigned int), &imgHeight);
+        lpKernel.setArg(3, sizeof(unsigned int), &tilesX);
+        lpKernel.setArg(4, state.tileList);
+        lpKernel.setArg(5, state.gray);
+        lpKernel.setArg(6, state.lpMask);
+        lpKernel.setArg(7, state.lp);
+
+        cl::Kernel hpKernel(program, "filterTiles");
+        hpKernel.setArg(0, sizeof(unsigned int), &hpMaskSize);
+        hpKernel.setArg(1, sizeof(unsigned int), &imgWidth);
+        hpKernel.setArg(2, sizeof(unsigned int), &imgHeight);
+        hpKernel.setArg(3, sizeof(unsigned int), &tilesX);
+        hpKernel.setArg(4, state.tileList);
+        hpKernel.setArg(5, state.lp);
+        hpKernel.setArg(6, state.hpMask);
+        hpKernel.setArg(7, state.output);
+
+        cl::NDRange tiles(count * 16, 16);
+        state.queue.enqueueNDRangeKernel(grayKernel, cl::NullRange, tiles, cl::NDRange(16, 16));
+        state.queue.enqueueNDRangeKernel(lpKernel, cl::NullRange, tiles, cl::NDRange(16, 16));
+        state.queue.enqueueNDRangeKernel(hpKernel, cl::NullRange, tiles, cl::NDRange(16, 16));
+
+        /**
+         * Read back only the rows spanned by the recomputed tiles.
+         * */
+
+        state.queue.enqueueReadBuffer(state.tileList, CL_TRUE, 0, count * sizeof(int), state.hostTiles.data());
+        unsigned int firstRow = tilesY, lastRow = 0;
+        for(int t = 0; t < count; t++){
+            unsigned int ty = state.hostTiles[t] / tilesX;
+            firstRow = ty < firstRow ? ty : firstRow;
+            lastRow = ty > lastRow ? ty : lastRow;
+        }
+        size_t offset = firstRow * 16 * imgWidth;
+        size_t end = (lastRow + 1) * 16 < imgHeight ? (lastRow + 1) * 16 * imgWidth : imgSize;
+        state.queue.enqueueReadBuffer(state.output, CL_TRUE, offset, end - offset, &state.hostOutput[offset]);
+    }
+
+    for(int c = 0; c < 3; c++){
+        std::swap(state.prev[c], state.input[c]);
+    }
+    state.primed = true;
+    memcpy(outputImg, state.hostOutput.data(), imgSize);
+
+    size_t recomputed = (size_t) count * 16 * 16;
+    return recomputed < imgSize ? (double) recomputed / imgSize : 1.0;
+}
+
+/**
+ * Filter a mostly static sequence incrementally: a small block moves over
+ * the input image, and every frame is filtered by seqFilter, by the
+ * incremental CPU path and by the incremental device path.
+ */
+
+void filterSequence(unsigned int imgWidth,
+                    unsigned int imgHeight,
+                    unsigned int lpMaskSize,
+                    unsigned int hpMaskSize,
+                    unsigned char *inputImg,
+                    float *lpMask,
+                    float *hpMask,
+                    int frames){
+    size_t imgSize = imgWidth * imgHeight;
+    std::vector<unsigned char> frame(inputImg, inputImg + 3 * imgSize);
+    std::vector<unsigned char> seqOut(imgSize), seqIncOut(imgSize), parIncOut(imgSize);
+    unsigned char *r = &frame[0], *g = &frame[imgSize], *b = &frame[2 * imgSize];
+
+    SeqIncrementalState seqState;
+    ParIncrementalState parState;
+    double seqTime = 0, seqIncTime = 0, parIncTime = 0, fraction = 0;
+    bool equal = true;
+    auto elapsed = [](std::chrono::steady_clock::time_point since){
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    };
+
+    for(int f = 0; f < frames; f++){
+
+        /**
+         * Move a 32x32 block by a few pixels.
+         * */
+
+        unsigned int bx = (f * 7) % (imgWidth > 32 ? imgWidth - 32 : 1);
+        unsigned int by = (f * 5) % (imgHeight > 32 ? imgHeight - 32 : 1);
+        for(unsigned int j = by; j < by + 32 && j < imgHeight; j++){
+            for(unsigned int i = bx; i < bx + 32 && i < imgWidth; i++){
+                r[i + j * imgWidth] += 64;
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        seqFilter(imgWidth, imgHeight, lpMaskSize, hpMaskSize, r, g, b, lpMask, hpMask, seqOut.data());
+        seqTime += elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        double seqFraction = seqFilterIncremental(seqState, imgWidth, imgHeight, lpMaskSize, hpMaskSize, r, g, b,
+                                                  lpMask, hpMask, seqIncOut.data());
+        seqIncTime += elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        parFilterIncremental(parState, imgWidth, imgHeight, lpMaskSize, hpMaskSize, r, g, b, lpMask, hpMask, parIncOut.data());
+        parIncTime += elapsed(start);
+
+        if(f > 0){
+            fraction += seqFraction;
+        }
+        equal = equal && seqIncOut == seqOut && parIncOut == seqOut;
+    }
+
+    double scale = 1.0 / frames;
+    std::cout << "Incremental sequence of " << frames << " frames: " << (equal ? "SUCCESS!" : "FAILED!") << std::endl;
+    std::cout << "Mean frame time: \n\tSequential: " << seqTime * scale << " ms;\n\tSequential incremental: "
+              << seqIncTime * scale << " ms;\n\tParallel incremental: " << parIncTime * scale << " ms." << std::endl;
+    if(frames > 1){
+        std::cout << "Pixels recomputed per frame: " << 100 * fraction / (frames - 1) << "\%\n";
+    }
+}
+
+/**
+ * Enqueue the statistics of a device image after waitFor: zero histogram,
+ * count the pixels into it (histogramImage) and derive range from it
+ * (imageRange); done is the event of the last command. histogram and range
+ * are created here and must live until done completes.
+ */
+
+void enqueueImageStats(const cl::CommandQueue &queue,
+                       const cl::Buffer &image,
+                       unsigned int imgSize,
+                       unsigned int clipCount,
+                       cl::Buffer &histogram,
+                       cl::Buffer &range,
+                       const std::vector<cl::Event> *waitFor,
+                       cl::Event *done){
+    histogram = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, STATS_BINS * sizeof(cl_uint));
+    range = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, RANGE_WORDS * sizeof(cl_uint));
+
+    size_t groups = (imgSize + HISTOGRAM_GROUP * HISTOGRAM_PIXELS - 1) / (HISTOGRAM_GROUP * HISTOGRAM_PIXELS);
+    groups = groups < HISTOGRAM_MAX_GROUPS ? groups : HISTOGRAM_MAX_GROUPS;
+    groups = groups > 0 ? groups : 1;
+
+    cl::Kernel histogramKernel(program, "histogramImage");
+    histogramKernel.setArg(0, sizeof(unsigned int), &imgSize);
+    histogramKernel.setArg(1, image);
+    histogramKernel.setArg(2, histogram);
+
+    cl::Kernel rangeKernel(program, "imageRange");
+    rangeKernel.setArg(0, sizeof(unsigned int), &clipCount);
+    rangeKernel.setArg(1, histogram);
+    rangeKernel.setArg(2, range);
+
+    std::vector<cl::Event> zeroed(1), counted(1);
+    queue.enqueueFillBuffer(histogram, (cl_uint) 0, 0, STATS_BINS * sizeof(cl_uint), waitFor, &zeroed[0]);
+    queue.enqueueNDRangeKernel(histogramKernel, cl::NullRange, cl::NDRange(groups * HISTOGRAM_GROUP), cl::NDRange(HISTOGRAM_GROUP),
+                               &zeroed, &counted[0]);
+    queue.enqueueNDRangeKernel(rangeKernel, cl::NullRange, cl::NDRange(1), cl::NullRange, &counted, done);
+}
+
+/**
+ * Parallelly run a filter graph plan on an image. The steps go to an
+ * out-of-order queue when the device has one, each waiting on the events of
+ * the steps the plan lists for it, so independent branches may overlap.
+ * A contrast step finds its range on the device and stretches in place.
+ * A median step runs the selection network over cached tiles up to 7x7,
+ * and the sliding histogram beyond. A morphology step chains its row and
+ * column passes.
+ * For every stage whose index in plan.stages is a key of stats, the
+ * statistics of its output are computed on the device as well; only the
+ * histogram and range are read back. The step then counts as done once its
+ * statistics are, so that its slot is not overwritten before.
+ */
+
+void parRunPlan(const FilterPlan &plan,
+                unsigned int imgWidth,
+                unsigned int imgHeight,
+                unsigned char *inputRchannel,
+                unsigned char *inputGchannel,
+                unsigned char *inputBchannel,
+                unsigned char *outputImg,
+                std::map<int, ImageStats> *stats){
+    size_t imgSize = imgWidth * imgHeight * sizeof(unsigned char);
+    cl::NDRange tiles(tileCount(imgWidth) * 16, tileCount(imgHeight) * 16);
+
+    cl_command_queue_properties properties = device.getInfo<CL_DEVICE_QUEUE_PROPERTIES>() & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+    cl::CommandQueue queue(context, device, properties);
+
+    /**
+     * Create the input buffers and one buffer per slot of the plan.
+     * */
+
+    cl::Buffer inputRchannelBuf(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, imgSize, inputRchannel);
+    cl::Buffer inputGchannelBuf(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, imgSize, inputGchannel);
+    cl::Buffer inputBchannelBuf(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR, imgSize, inputBchannel);
+
+    std::vector<cl::Buffer> slots;
+    for(int i = 0; i < plan.slots; i++){
+        slots.push_back(cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, imgSize));
+    }
+
+    /**
+     * Enqueue the steps in plan order, each after its dependencies.
+     * */
+
+    std::vector<cl::Buffer> masks(plan.steps.size()), scratch(plan.steps.size());
+    std::vector<cl::Buffer> histograms(plan.steps.size()), ranges(plan.steps.size());
+    std::vector<cl::Buffer> statHistograms(plan.steps.size()), statRanges(plan.steps.size());
+    std::vector<std::vector<cl_uint>> hostRanges(plan.steps.size());
+    std::vector<cl::Event> done(plan.steps.size());
+
+    for(size_t t = 0; t < plan.steps.size(); t++){
+        const PlanStep &step = plan.steps[t];
+        const GraphStage &stage = plan.stages[step.stage];
+        cl_uint op = stage.op;
+        cl::Kernel kernel;
+        cl::NDRange global(imgSize), local = cl::NullRange;
+
+        std::vector<cl::Event> waitFor;
+        for(int before : step.after){
+            waitFor.push_back(done[before]);
+        }
+
+        switch(stage.kind){
+            case STAGE_GRAY:
+                kernel = cl::Kernel(program, "rgb2gray");
+                kernel.setArg(0, inputRchannelBuf);
+                kernel.setArg(1, inputGchannelBuf);
+                kernel.setArg(2, inputBchannelBuf);
+                kernel.setArg(3, slots[step.output]);
+                global = cl::NDRange(imgWidth, imgHeight);
+                break;
+            case STAGE_CONVOLVE:
+                masks[t] = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS | CL_MEM_COPY_HOST_PTR,
+                                      stage.mask.size() * sizeof(float), (void*) stage.mask.data());
+                kernel = cl::Kernel(program, "convolveImage");
+                kernel.setArg(0, sizeof(unsigned int), &stage.maskSize);
+                kernel.setArg(1, sizeof(unsigned int), &imgWidth);
+                kernel.setArg(2, sizeof(unsigned int), &imgHeight);
+                kernel.setArg(3, slots[step.inputs[0]]);
+                kernel.setArg(4, masks[t]);
+                kernel.setArg(5, slots[step.output]);
+                global = tiles;
+                local = cl::NDRange(16, 16);
+                break;
+            case STAGE_POINT:
+                kernel = cl::Kernel(program, "pointImage");
+                kernel.setArg(0, sizeof(cl_uint), &op);
+                kernel.setArg(1, sizeof(float), &stage.a);
+                kernel.setArg(2, sizeof(float), &stage.b);
+                kernel.setArg(3, slots[step.inputs[0]]);
+                kernel.setArg(4, slots[step.output]);
+                break;
+            case STAGE_COMBINE:
+                kernel = cl::Kernel(program, "combineImages");
+                kernel.setArg(0, sizeof(cl_uint), &op);
+                kernel.setArg(1, sizeof(float), &stage.a);
+                kernel.setArg(2, sizeof(float), &stage.b);
+                kernel.setArg(3, slots[step.inputs[0]]);
+                kernel.setArg(4, slots[step.inputs[1]]);
+                kernel.setArg(5, slots[step.output]);
+                break;
+            case STAGE_CONTRAST: {
+                cl::Event ranged;
+                enqueueImageStats(queue, slots[step.inputs[0]], imgSize, contrastClipCount(stage.a, imgSize),
+                                  histograms[t], ranges[t], waitFor.empty() ? nullptr : &waitFor, &ranged);
+                waitFor.assign(1, ranged);
+
+                kernel = cl::Kernel(program, "contrastImage");
+                kernel.setArg(0, ranges[t]);
+                kernel.setArg(1, slots[step.inputs[0]]);
+                kernel.setArg(2, slots[step.output]);
+                break;
+            }
+            case STAGE_MEDIAN:
+                kernel = cl::Kernel(program, stage.maskSize <= MEDIAN_DEVICE_NETWORK_SIZE ? "medianImage" : "medianHistogram");
+                kernel.setArg(0, sizeof(unsigned int), &stage.maskSize);
+                kernel.setArg(1, sizeof(unsigned int), &imgWidth);
+                kernel.setArg(2, sizeof(unsigned int), &imgHeight);
+                kernel.setArg(3, slots[step.inputs[0]]);
+                kernel.setArg(4, slots[step.output]);
+                if(stage.maskSize <= MEDIAN_DEVICE_NETWORK_SIZE){
+                    global = tiles;
+                    local = cl::NDRange(16, 16);
+                } else {
+                    global = cl::NDRange((imgWidth + MEDIAN_SEGMENT - 1) / MEDIAN_SEGMENT, imgHeight);
+                }
+                break;
+            case STAGE_MORPH: {
+                /**
+                 * Row pass into a scratch buffer, column pass into the
+                 * output, twice for an opening or closing; the last pass is
+                 * the kernel of the step.
+                 * */
+
+                scratch[t] = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, imgSize);
+                bool dilate = stage.op == MORPH_DILATE || stage.op == MORPH_CLOSE;
+                int passes = stage.op == MORPH_OPEN || stage.op == MORPH_CLOSE ? 4 : 2;
+
+                for(int pass = 0; pass < passes; pass++){
+                    bool columns = pass % 2 == 1;
+                    cl_uint passDilate = dilate != (pass >= 2);
+                    cl_uint size = columns ? stage.maskHeight : stage.maskSize;
+                    cl_uint length = columns ? imgHeight : imgWidth;
+                    cl_uint pixelStep = columns ? imgWidth : 1;
+                    cl_uint lineStep = columns ? 1 : imgWidth;
+
+                    kernel = cl::Kernel(program, "morphLines");
+                    kernel.setArg(0, sizeof(cl_uint), &passDilate);
+                    kernel.setArg(1, sizeof(cl_uint), &size);
+                    kernel.setArg(2, sizeof(cl_uint), &length);
+                    kernel.setArg(3, sizeof(cl_uint), &pixelStep);
+                    kernel.setArg(4, sizeof(cl_uint), &lineStep);
+                    kernel.setArg(5, columns ? scratch[t] : (pass == 0 ? slots[step.inputs[0]] : slots[step.output]));
+                    kernel.setArg(6, columns ? slots[step.output] : scratch[t]);
+                    global = cl::NDRange(columns ? imgWidth : imgHeight, (length + size - 1) / size);
+
+                    if(pass + 1 < passes){
+                        cl::Event passed;
+                        queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, cl::NullRange,
+                                                   waitFor.empty() ? nullptr : &waitFor, &passed);
+                        waitFor.assign(1, passed);
+                    }
+                }
+                break;
+            }
+        }
+
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local, waitFor.empty() ? nullptr : &waitFor, &done[t]);
+
+        /**
+         * Statistics of the output, read back without the image.
+         * */
+
+        if(stats && stats->count(step.stage)){
+            std::vector<cl::Event> produced(1, done[t]);
+            enqueueImageStats(queue, slots[step.output], imgSize, 0, statHistograms[t], statRanges[t], &produced, &done[t]);
+
+            std::vector<cl::Event> counted(1, done[t]);
+            hostRanges[t].resize(RANGE_WORDS);
+            queue.enqueueReadBuffer(statHistograms[t], CL_FALSE, 0, STATS_BINS * sizeof(cl_uint), (*stats)[step.stage].histogram, &counted);
+            queue.enqueueReadBuffer(statRanges[t], CL_FALSE, 0, RANGE_WORDS * sizeof(cl_uint), hostRanges[t].data(), &counted);
+        }
+    }
+
+    /**
+     * Collect the result once the last step, which produces it, is done.
+     * */
+
+    std::vector<cl::Event> last(1, done.back());
+    queue.enqueueReadBuffer(slots[plan.result], CL_TRUE, 0, imgSize, outputImg, &last);
+
+    if(stats){
+        queue.finish();
+        for(size_t t = 0; t < plan.steps.size(); t++){
+            if(!hostRanges[t].empty()){
+                statsFromRange((*stats)[plan.steps[t].stage], hostRanges[t].data());
+            }
+        }
+    }
+}
+
+/**
+ * Run the filter as a graph, which must match seqFilter, and the graph of
+ * filter_graph.cfg, whose CPU and device results must match each other.
+ */
+
+void filterGraphs(unsigned int imgWidth,
+                  unsigned int imgHeight,
+                  unsigned char *inputImg,
+                  unsigned int lpMaskSize,
+                  unsigned int hpMaskSize,
+                  float *lpMask,
+                  float *hpMask,
+                  unsigned char *seqOutput){
+    size_t imgSize = imgWidth * imgHeight;
+    unsigned char *r = &inputImg[0], *g = &inputImg[imgSize], *b = &inputImg[2 * imgSize];
+    std::vector<unsigned char> seqOut(imgSize), parOut(imgSize);
+    const char *names[2] = {"default", "filter_graph.cfg"};
+
+    for(int n = 0; n < 2; n++){
+        FilterGraph graph;
+        FilterPlan plan;
+        std::string error;
+
+        if(n == 0){
+            graph = defaultFilterGraph(lpMaskSize, hpMaskSize, lpMask, hpMask);
+        } else if(!loadFilterGraph(names[n], graph, error)){
+            std::cout << "Filter graph " << names[n] << ": " << error << std::endl;
+            continue;
+        }
+        if(!compileFilterGraph(graph, plan, error)){
+            std::cout << "Filter graph " << names[n] << ": " << error << std::endl;
+            continue;
+        }
+
+        /**
+         * Take the statistics of the gray and high-pass images of the
+         * default graph along.
+         * */
+
+        std::map<int, ImageStats> seqStats, parStats;
+        for(size_t stage = 0; n == 0 && stage < plan.stages.size(); stage++){
+            if(plan.stages[stage].name == "gray" || plan.stages[stage].name == "hp"){
+                seqStats[stage] = parStats[stage] = ImageStats();
             }
-            
+        }
+
+        // Wall time: the device path mostly waits on events
+        auto start = std::chrono::steady_clock::now();
+        seqRunPlan(plan, imgWidth, imgHeight, r, g, b, seqOut.data(), &seqStats);
+        double seqTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        parRunPlan(plan, imgWidth, imgHeight, r, g, b, parOut.data(), &parStats);
+        double parTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        bool equal = seqOut == parOut && (n > 0 || checkEquality(seqOut.data(), seqOutput, imgWidth, imgHeight));
+        for(auto &entry : seqStats){
+            const ImageStats &seq = entry.second, &par = parStats[entry.first];
+            equal = equal && memcmp(seq.histogram, par.histogram, sizeof(seq.histogram)) == 0
+                    && seq.min == par.min && seq.max == par.max && seq.mean == par.mean
+                    && seq.low == par.low && seq.high == par.high;
+        }
+
+        std::cout << "Filter graph " << names[n] << " (" << plan.steps.size() << " stages, " << plan.slots << " buffers): "
+                  << (equal ? "SUCCESS!" : "FAILED!") << "\n\tCPU: " << seqTime << " ms;\n\tDevice: " << parTime << " ms." << std::endl;
+        for(auto &entry : parStats){
+            const ImageStats &stats = entry.second;
+            std::cout << "\t" << plan.stages[entry.first].name << ": min " << (int) stats.min << ", max " << (int) stats.max
+                      << ", mean " << stats.mean << std::endl;
+        }
+    }
+}
+
+/**
+ * Filter many crops through the filter service: each client thread submits
+ * 256x256 crops of the input image at shifting offsets, and the first one
+ * also the whole image, which is split in strips. Every result is checked
+ * against seqFilter.
+ */
+
+void serveThumbnails(unsigned int imgWidth,
+                     unsigned int imgHeight,
+                     unsigned char *inputImg,
+                     unsigned int lpMaskSize,
+                     unsigned int hpMaskSize,
+                     float *lpMask,
+                     float *hpMask,
+                     int clients,
+                     int perClient){
+    size_t imgSize = imgWidth * imgHeight;
+    unsigned int cropWidth = imgWidth < 256 ? imgWidth : 256;
+    unsigned int cropHeight = imgHeight < 256 ? imgHeight : 256;
+    size_t cropSize = cropWidth * cropHeight;
+
+    ServiceOptions options;
+    options.splitRows = 256;
+    FilterService service(context, device, program, lpMaskSize, hpMaskSize, lpMask, hpMask, options);
+
+    std::vector<std::thread> threads;
+    std::vector<int> failures(clients, 0);
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    std::mutex timing;
+
+    for(int c = 0; c < clients; c++){
+        threads.push_back(std::thread([&, c](){
+
             /**
-             * Apply mask based on the neighborhood of pixel inputImg(j,i).
+             * Submit the crops, then wait for all of them.
              * */
-            
-            int outSum = 0;
-            for(size_t k = 0; k < maskSize; k++){
-                for(size_t l = 0; l < maskSize; l++){
-                  size_t colIdx = i - maskSize/2 + k;
-                  size_t rowIdx = j - maskSize/2 + l;
-                  size_t maskIdx = (maskSize-1-k) + (maskSize-1-l)*maskSize;
-                  outSum += inputImg[rowIdx * imgWidth + colIdx] * mask[maskIdx];
+
+            std::vector<std::vector<unsigned char>> crops;
+            std::vector<std::future<std::vector<unsigned char>>> results;
+            for(int i = 0; i < perClient; i++){
+                unsigned int x0 = ((c * perClient + i) * 13) % (imgWidth - cropWidth + 1);
+                unsigned int y0 = ((c * perClient + i) * 7) % (imgHeight - cropHeight + 1);
+                std::vector<unsigned char> crop(3 * cropSize);
+                for(int ch = 0; ch < 3; ch++){
+                    for(unsigned int j = 0; j < cropHeight; j++){
+                        memcpy(&crop[ch * cropSize + j * cropWidth], &inputImg[ch * imgSize + (y0 + j) * imgWidth + x0], cropWidth);
+                    }
                 }
+                results.push_back(service.submit(cropWidth, cropHeight, &crop[0], &crop[cropSize], &crop[2 * cropSize]));
+                crops.push_back(std::move(crop));
+            }
+            if(c == 0){
+                results.push_back(service.submit(imgWidth, imgHeight, &inputImg[0], &inputImg[imgSize], &inputImg[2 * imgSize]));
+                crops.push_back(std::vector<unsigned char>(inputImg, inputImg + 3 * imgSize));
+            }
+
+            std::vector<std::vector<unsigned char>> outputs;
+            for(auto &result : results){
+                outputs.push_back(result.get());
+            }
+            {
+                std::lock_guard<std::mutex> lock(timing);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                elapsed = ms > elapsed ? ms : elapsed;
             }
 
             /**
-             * Update output pixel.
+             * Check every result against seqFilter.
              * */
 
-            if(outSum < 0){
-                outputImg[i + j * imgWidth] = 0;
-            } else if(outSum > 255){
-                outputImg[i + j * imgWidth] = 255;
-            } else{
-                outputImg[i + j * imgWidth] = outSum;
+            for(size_t i = 0; i < crops.size(); i++){
+                unsigned int w = i < (size_t) perClient ? cropWidth : imgWidth;
+                unsigned int h = i < (size_t) perClient ? cropHeight : imgHeight;
+                size_t size = (size_t) w * h;
+                std::vector<unsigned char> expected(size);
+                seqFilter(w, h, lpMaskSize, hpMaskSize, &crops[i][0], &crops[i][size], &crops[i][2 * size], lpMask, hpMask, expected.data());
+                failures[c] += outputs[i] != expected;
             }
-        }
+        }));
     }
+    for(std::thread &thread : threads){
+        thread.join();
+    }
+
+    int failed = 0;
+    for(int f : failures){
+        failed += f;
+    }
+    ServiceStats stats = service.stats();
+    std::cout << "Filter service, " << clients << " clients: " << (failed == 0 ? "SUCCESS!" : "FAILED!") << std::endl;
+    std::cout << "\t" << stats.images << " images in " << elapsed << " ms (" << 1000 * stats.images / elapsed << " images/s);\n\t"
+              << stats.jobs << " images and strips in " << stats.batches << " launches ("
+              << (double) stats.jobs / stats.batches << " per launch)." << std::endl;
 }
 
 /**
- * Sequentially filter an image.
+ * Browse the image as a review tool would: build the pyramid, filter the
+ * first level at most a tile a side as a preview, then every full-resolution
+ * tile, and one of them again from the cache. The preview must match
+ * seqFilter on the level downsampled on the CPU, and the tiles seqOutput.
  */
 
-void seqFilter(unsigned int imgWidth,
-               unsigned int imgHeight,
-               unsigned int lpMaskSize,
-               unsigned int hpMaskSize,
-               unsigned char *inputRchannel,
-               unsigned char *inputGchannel,
-               unsigned char *inputBchannel,
-               float *lpMask,
-               float *hpMask,
-               unsigned char *outputImg){
+void browsePyramid(unsigned int imgWidth,
+                   unsigned int imgHeight,
+                   unsigned char *inputImg,
+                   unsigned int lpMaskSize,
+                   unsigned int hpMaskSize,
+                   float *lpMask,
+                   float *hpMask,
+                   unsigned char *seqOutput){
+    size_t imgSize = imgWidth * imgHeight;
+    auto elapsed = [](std::chrono::steady_clock::time_point since){
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    };
 
-    /**
-     * Convert input image to grayscale.
-     */
+    auto start = std::chrono::steady_clock::now();
+    FilterPyramid pyramid(context, device, program, imgWidth, imgHeight, &inputImg[0], &inputImg[imgSize], &inputImg[2 * imgSize],
+                          lpMaskSize, hpMaskSize, lpMask, hpMask);
+    double buildTime = elapsed(start);
 
-    unsigned char *grayOut = (unsigned char*) malloc(imgWidth * imgHeight * sizeof(unsigned char));
-    seqRgb2Gray(imgWidth, imgHeight, inputRchannel, inputGchannel, inputBchannel, grayOut);
+    unsigned int level = 0;
+    while(level + 1 < pyramid.levels() && (pyramid.width(level) > PYRAMID_TILE_SIZE || pyramid.height(level) > PYRAMID_TILE_SIZE)){
+        level++;
+    }
+    start = std::chrono::steady_clock::now();
+    const std::vector<unsigned char> &preview = pyramid.preview(level);
+    double previewTime = elapsed(start);
+
+    unsigned int width = pyramid.width(level), height = pyramid.height(level);
+    std::vector<unsigned char> downsampled(3 * (size_t) width * height), expected((size_t) width * height);
+    for(int c = 0; c < 3; c++){
+        seqDownsample(imgWidth, imgHeight, level, &inputImg[c * imgSize], &downsampled[c * (size_t) width * height]);
+    }
+    seqFilter(width, height, lpMaskSize, hpMaskSize, &downsampled[0], &downsampled[(size_t) width * height],
+              &downsampled[2 * (size_t) width * height], lpMask, hpMask, expected.data());
+    bool equal = preview == expected;
 
     /**
-     * Apply the low-pass filter.
-     */
+     * Full-resolution tiles, compared row by row with seqOutput.
+     * */
 
-    unsigned char *lpOut = (unsigned char*) malloc(imgWidth * imgHeight * sizeof(unsigned char));
-    seqConvolve(imgWidth, imgHeight, lpMaskSize, grayOut, lpMask, lpOut);
-    
-    /**
-     * Apply the high-pass filter.
-     */
+    start = std::chrono::steady_clock::now();
+    for(unsigned int tileY = 0; tileY < pyramid.tilesY(0); tileY++){
+        for(unsigned int tileX = 0; tileX < pyramid.tilesX(0); tileX++){
+            const std::vector<unsigned char> &tile = pyramid.tile(0, tileX, tileY);
+            unsigned int x0 = tileX * PYRAMID_TILE_SIZE, y0 = tileY * PYRAMID_TILE_SIZE;
+            unsigned int tileWidth = imgWidth - x0 < PYRAMID_TILE_SIZE ? imgWidth - x0 : PYRAMID_TILE_SIZE;
+            for(size_t y = 0; y < tile.size() / tileWidth; y++){
+                equal = equal && memcmp(&tile[y * tileWidth], &seqOutput[x0 + (y0 + y) * imgWidth], tileWidth) == 0;
+            }
+        }
+    }
+    double tileTime = elapsed(start) / (pyramid.tilesX(0) * pyramid.tilesY(0));
+
+    start = std::chrono::steady_clock::now();
+    pyramid.tile(0, 0, 0);
+    double cachedTime = elapsed(start);
 
-    seqConvolve(imgWidth, imgHeight, hpMaskSize, lpOut, hpMask, outputImg);
+    PyramidStats stats = pyramid.stats();
+    std::cout << "Pyramid of " << pyramid.levels() << " levels: " << (equal ? "SUCCESS!" : "FAILED!")
+              << "\n\tBuilt in " << buildTime << " ms;\n\tPreview at level " << level << " (" << width << "x" << height << "): "
+              << previewTime << " ms;\n\tFull-resolution tile: " << tileTime << " ms, " << cachedTime << " ms cached ("
+              << stats.tiles << " tiles filtered, " << stats.cacheHits << " served from the cache)." << std::endl;
 }
 
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
 /**
  * Display unsigned char matrix as an image.
  * */
@@ -468,26 +1674,20 @@ void seqFilter(unsigned int imgWidth,
 void displayImg(unsigned char *img, int imgWidth, int imgHeight){
     
     /**
-     * Create C_IMG object.
+     * Wrap the image in a shared C_IMG object; both are stored row by row.
      * */
     
-    CImg<unsigned char> cimg(imgWidth, imgHeight);
+    const CImg<unsigned char> cimg(img, imgWidth, imgHeight, 1, 1, true);
 
     /**
-     * Transfer image data to C_IMG object.
+     * Display image; headless machines have no display to open.
      * */
 
-    for(int i = 0; i < imgWidth; i++){
-        for(int j = 0; j < imgHeight; j++){
-            cimg(i,j) = img[i + imgWidth*j];
-        }
+    try {
+        cimg.display();
+    } catch(CImgException&){
+        std::cout << "No display available." << std::endl;
     }
-
-    /**
-     * Display image.
-     * */
-
-    cimg.display();
 }
 
 /**
@@ -498,10 +1698,7 @@ bool checkEquality(unsigned char* img1,
                 unsigned char* img2, 
                 const int M, 
                 const int N){
-    for(int i = 0; i < M*N; i++){
-        if(img1[i] != img2[i]){
-            return false;
-        }
-    }
-    return true;
+    CompareOptions options;
+    options.tileSize = 0;
+    return compareImages(img1, img2, M, N, options).passed();
 }
@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "image_stats.h"
+
+#define STATS_MIN_PIXELS_PER_THREAD (1 << 16)  // smaller bands are not worth a thread
+#define STATS_LANES 4                           // interleaved sub-histograms per thread
+
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
+/**
+ * Pixels clipped at each end for a clip fraction; computed once on the host
+ * for both the CPU and the device.
+ * */
+
+unsigned int contrastClipCount(float clip, size_t imgSize){
+    return clip > 0 ? (unsigned int)(clip * imgSize) : 0;
+}
+
+/**
+ * Derive min, max, mean and the contrast range from the histogram, as the
+ * imageRange kernel does.
+ * */
+
+void statsFromHistogram(ImageStats &stats, unsigned int clipCount){
+    unsigned int minimum = 255, maximum = 0;
+    uint64_t pixels = 0, sum = 0;
+    for(unsigned int v = 0; v < STATS_BINS; v++){
+        if(stats.histogram[v] > 0){
+            minimum = v < minimum ? v : minimum;
+            maximum = v;
+        }
+        pixels += stats.histogram[v];
+        sum += (uint64_t) stats.histogram[v] * v;
+    }
+
+    unsigned int low = 0, below = 0;
+    while(low < 255 && below + stats.histogram[low] <= clipCount){
+        below += stats.histogram[low++];
+    }
+    unsigned int high = 255, above = 0;
+    while(high > 0 && above + stats.histogram[high] <= clipCount){
+        above += stats.histogram[high--];
+    }
+
+    stats.pixels = pixels;
+    stats.min = pixels > 0 ? minimum : 0;
+    stats.max = maximum;
+    stats.mean = pixels > 0 ? (double) sum / pixels : 0.0;
+    stats.low = low;
+    stats.high = high;
+}
+
+/**
+ * Fill min, max, mean and the contrast range from a range buffer read back
+ * from the device; the histogram must already be filled in.
+ * */
+
+void statsFromRange(ImageStats &stats, const unsigned int *range){
+    uint64_t sum = range[RANGE_SUM_LOW] | (uint64_t) range[RANGE_SUM_HIGH] << 32;
+    stats.pixels = 0;
+    for(unsigned int v = 0; v < STATS_BINS; v++){
+        stats.pixels += stats.histogram[v];
+    }
+    stats.min = stats.pixels > 0 ? range[RANGE_MIN] : 0;
+    stats.max = range[RANGE_MAX];
+    stats.mean = stats.pixels > 0 ? (double) sum / stats.pixels : 0.0;
+    stats.low = range[RANGE_LOW];
+    stats.high = range[RANGE_HIGH];
+}
+
+/**
+ * Count n pixels into histogram, four pixels at a time into four
+ * sub-histograms.
+ * */
+
+static void countPixels(const unsigned char *pixels, size_t n, unsigned int *histogram){
+    unsigned int lanes[STATS_LANES][STATS_BINS];
+    memset(lanes, 0, sizeof(lanes));
+
+    size_t i = 0;
+    for(; i + STATS_LANES <= n; i += STATS_LANES){
+        lanes[0][pixels[i]]++;
+        lanes[1][pixels[i + 1]]++;
+        lanes[2][pixels[i + 2]]++;
+        lanes[3][pixels[i + 3]]++;
+    }
+    for(; i < n; i++){
+        lanes[0][pixels[i]]++;
+    }
+
+    for(unsigned int v = 0; v < STATS_BINS; v++){
+        histogram[v] = lanes[0][v] + lanes[1][v] + lanes[2][v] + lanes[3][v];
+    }
+}
+
+// =================================================================
+// ------------------------- Statistics ----------------------------
+// =================================================================
+
+/**
+ * Statistics of an image: the bands of the image are counted on their own
+ * threads, the first one on this thread, and their histograms summed.
+ * */
+
+void seqImageStats(const unsigned char *inputImg,
+                   size_t imgSize,
+                   unsigned int clipCount,
+                   ImageStats &stats,
+                   unsigned int threads){
+    size_t bands = threads > 0 ? threads : std::thread::hardware_concurrency();
+    size_t worthwhile = imgSize / STATS_MIN_PIXELS_PER_THREAD;
+    bands = bands < worthwhile ? bands : worthwhile;
+    bands = bands > 0 ? bands : 1;
+    size_t bandSize = (imgSize + bands - 1) / bands;
+
+    std::vector<unsigned int> histograms(bands * STATS_BINS);
+    auto count = [&](size_t band){
+        size_t start = band * bandSize;
+        size_t end = start + bandSize < imgSize ? start + bandSize : imgSize;
+        countPixels(&inputImg[start], start < end ? end - start : 0, &histograms[band * STATS_BINS]);
+    };
+
+    std::vector<std::thread> workers;
+    for(size_t band = 1; band < bands; band++){
+        workers.push_back(std::thread(count, band));
+    }
+    count(0);
+    for(std::thread &worker : workers){
+        worker.join();
+    }
+
+    for(unsigned int v = 0; v < STATS_BINS; v++){
+        stats.histogram[v] = 0;
+        for(size_t band = 0; band < bands; band++){
+            stats.histogram[v] += histograms[band * STATS_BINS + v];
+        }
+    }
+    statsFromHistogram(stats, clipCount);
+}
+
+// =================================================================
+// ------------------------ Auto-contrast --------------------------
+// =================================================================
+
+/**
+ * Map [low, high] to [0, 255] through a table, as the contrastImage kernel;
+ * an empty range leaves the image unchanged.
+ * */
+
+void seqContrastStretch(unsigned char low,
+                        unsigned char high,
+                        size_t imgSize,
+                        const unsigned char *inputImg,
+                        unsigned char *outputImg){
+    unsigned char table[STATS_BINS];
+    for(int p = 0; p < STATS_BINS; p++){
+        int value = high <= low ? p : (p - low) * 255 / (high - low);
+        table[p] = value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+    for(size_t i = 0; i < imgSize; i++){
+        outputImg[i] = table[inputImg[i]];
+    }
+}
+
+/**
+ * Stretch the contrast range of an image, clipping the clip fraction of
+ * its pixels at each end.
+ * */
+
+void seqAutoContrast(float clip,
+                     size_t imgSize,
+                     const unsigned char *inputImg,
+                     unsigned char *outputImg){
+    ImageStats stats;
+    seqImageStats(inputImg, imgSize, contrastClipCount(clip, imgSize), stats);
+    seqContrastStretch(stats.low, stats.high, imgSize, inputImg, outputImg);
+}
@@ -0,0 +1,68 @@
+/**
+ * Histogram statistics of gray images, and the auto-contrast stretch they
+ * drive.
+ *
+ * The statistics of an image are its 256-bin histogram and what follows
+ * from it: min, max, mean, and the contrast range [low, high] left after
+ * clipping clipCount pixels at each end (min and max for clipCount 0). The
+ * auto-contrast stretch maps low to 0 and high to 255 in integer
+ * arithmetic, so that the CPU and the device agree exactly.
+ *
+ * On the device, each work-group counts its pixels in a local histogram
+ * with local atomics and then adds it to the global one; one work-item
+ * derives the range, which the stretch kernel reads in place. Only the
+ * histogram and the range are read back, never the image. The CPU version
+ * counts bands of the image on several threads, each into interleaved
+ * sub-histograms so that runs of equal pixels do not serialize on one
+ * counter.
+ * */
+
+#ifndef IMAGE_STATS_H
+#define IMAGE_STATS_H
+
+#include <stddef.h>
+
+#define STATS_BINS 256
+
+#define RANGE_MIN 0                     // words of the range buffer of imageRange
+#define RANGE_MAX 1
+#define RANGE_LOW 2
+#define RANGE_HIGH 3
+#define RANGE_SUM_LOW 4                 // sum of the pixels, low and high 32 bits
+#define RANGE_SUM_HIGH 5
+#define RANGE_WORDS 6                   // Values must match image_filtering.cl.
+
+struct ImageStats {
+    unsigned int histogram[STATS_BINS] = {};
+    size_t pixels = 0;
+    unsigned char min = 0, max = 0;
+    double mean = 0.0;
+    unsigned char low = 0, high = 0;    // contrast range after clipping
+};
+
+unsigned int contrastClipCount(float clip, size_t imgSize);         // Pixels clipped at each end for a clip fraction.
+
+void statsFromHistogram(ImageStats &stats,
+                        unsigned int clipCount);                    // Derive the rest of the statistics from the histogram.
+
+void statsFromRange(ImageStats &stats,
+                    const unsigned int *range);                     // Fill the statistics from a range buffer read back.
+
+void seqImageStats(const unsigned char *inputImg,
+                   size_t imgSize,
+                   unsigned int clipCount,
+                   ImageStats &stats,
+                   unsigned int threads = 0);                       // Statistics of an image; 0 threads: one per core.
+
+void seqContrastStretch(unsigned char low,
+                        unsigned char high,
+                        size_t imgSize,
+                        const unsigned char *inputImg,
+                        unsigned char *outputImg);                  // Map [low, high] to [0, 255].
+
+void seqAutoContrast(float clip,
+                     size_t imgSize,
+                     const unsigned char *inputImg,
+                     unsigned char *outputImg);                     // Statistics, then stretch.
+
+#endif
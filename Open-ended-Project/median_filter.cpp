@@ -0,0 +1,264 @@
+#include <stdint.h>
+#include <string.h>
+#include "median_filter.h"
+#include "scratch_arena.h"
+
+// -DMEDIAN_NO_SIMD keeps one pixel at a time on every machine
+#ifndef MEDIAN_NO_SIMD
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define MEDIAN_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MEDIAN_NEON 1
+#endif
+#endif
+
+#define MEDIAN_BINS 256
+#define MEDIAN_COARSE_BINS 16                   // coarse bins of 16 fine bins each
+
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
+#if defined(MEDIAN_SSE2)
+typedef __m128i Pixels;                         // 16 pixels
+#define MEDIAN_LANES 16
+static inline Pixels loadPixels(const unsigned char *p){ return _mm_loadu_si128((const __m128i*) p); }
+static inline void storePixels(unsigned char *p, Pixels v){ _mm_storeu_si128((__m128i*) p, v); }
+static inline Pixels minOf(Pixels a, Pixels b){ return _mm_min_epu8(a, b); }
+static inline Pixels maxOf(Pixels a, Pixels b){ return _mm_max_epu8(a, b); }
+#elif defined(MEDIAN_NEON)
+typedef uint8x16_t Pixels;
+#define MEDIAN_LANES 16
+static inline Pixels loadPixels(const unsigned char *p){ return vld1q_u8(p); }
+static inline void storePixels(unsigned char *p, Pixels v){ vst1q_u8(p, v); }
+static inline Pixels minOf(Pixels a, Pixels b){ return vminq_u8(a, b); }
+static inline Pixels maxOf(Pixels a, Pixels b){ return vmaxq_u8(a, b); }
+#endif
+
+static inline unsigned char minOf(unsigned char a, unsigned char b){ return a < b ? a : b; }
+static inline unsigned char maxOf(unsigned char a, unsigned char b){ return a > b ? a : b; }
+
+/**
+ * Median of the N = 2k + 1 values of v by forgetful selection: the min and
+ * the max of k + 2 values cannot be the median of all N, so both are
+ * dropped and the next value joins the k left, until three values remain.
+ * Only min and max, so T may be a vector of pixels; v is overwritten.
+ * */
+
+template <int N, typename T>
+static inline T selectMedian(T *v){
+    int lo = 0, hi = N / 2 + 1;
+
+    for(int next = hi + 1; next < N; next++){
+        for(int i = lo + 1; i <= hi; i++){      // min to v[lo]
+            T a = v[lo], b = v[i];
+            v[lo] = minOf(a, b);
+            v[i] = maxOf(a, b);
+        }
+        for(int i = lo + 1; i < hi; i++){       // max to v[hi]
+            T a = v[i], b = v[hi];
+            v[i] = minOf(a, b);
+            v[hi] = maxOf(a, b);
+        }
+        lo++;
+        v[hi] = v[next];
+    }
+
+    T a = v[lo], b = v[lo + 1], c = v[lo + 2];
+    return maxOf(minOf(a, b), minOf(maxOf(a, b), c));
+}
+
+/**
+ * Zero the pixels where a window of the given radius does not fit; false if
+ * it fits nowhere.
+ * */
+
+static bool zeroBorder(unsigned int imgWidth,
+                       unsigned int imgHeight,
+                       unsigned int radius,
+                       unsigned char *outputImg){
+    if(imgWidth < 2 * radius + 1 || imgHeight < 2 * radius + 1){
+        memset(outputImg, 0, (size_t) imgWidth * imgHeight);
+        return false;
+    }
+    memset(outputImg, 0, (size_t) radius * imgWidth);
+    memset(&outputImg[(size_t) (imgHeight - radius) * imgWidth], 0, (size_t) radius * imgWidth);
+    for(unsigned int y = radius; y < imgHeight - radius; y++){
+        memset(&outputImg[(size_t) y * imgWidth], 0, radius);
+        memset(&outputImg[(size_t) y * imgWidth + imgWidth - radius], 0, radius);
+    }
+    return true;
+}
+
+/**
+ * Median network over the rows of the image, MEDIAN_LANES windows at a time
+ * and then one at a time up to the right border.
+ * */
+
+template <int SIZE>
+static void medianRows(unsigned int imgWidth,
+                       unsigned int imgHeight,
+                       const unsigned char *inputImg,
+                       unsigned char *outputImg){
+    const unsigned int radius = SIZE / 2;
+
+    for(unsigned int y = radius; y + radius < imgHeight; y++){
+        const unsigned char *top = &inputImg[(size_t) (y - radius) * imgWidth];
+        unsigned char *row = &outputImg[(size_t) y * imgWidth];
+        unsigned int x = radius;
+
+#ifdef MEDIAN_LANES
+        for(; x + radius + MEDIAN_LANES <= imgWidth; x += MEDIAN_LANES){
+            Pixels window[SIZE * SIZE];
+            for(int l = 0; l < SIZE; l++){
+                for(int k = 0; k < SIZE; k++){
+                    window[k + l * SIZE] = loadPixels(&top[x - radius + k + (size_t) l * imgWidth]);
+                }
+            }
+            storePixels(&row[x], selectMedian<SIZE * SIZE>(window));
+        }
+#endif
+        for(; x + radius < imgWidth; x++){
+            unsigned char window[SIZE * SIZE];
+            for(int l = 0; l < SIZE; l++){
+                for(int k = 0; k < SIZE; k++){
+                    window[k + l * SIZE] = top[x - radius + k + (size_t) l * imgWidth];
+                }
+            }
+            row[x] = selectMedian<SIZE * SIZE>(window);
+        }
+    }
+}
+
+// =================================================================
+// ---------------------------- Median -----------------------------
+// =================================================================
+
+void seqMedianNetwork(unsigned int imgWidth,
+                      unsigned int imgHeight,
+                      unsigned int size,
+                      const unsigned char *inputImg,
+                      unsigned char *outputImg){
+    if(!zeroBorder(imgWidth, imgHeight, size / 2, outputImg)){
+        return;
+    }
+    switch(size){
+        case 3:  medianRows<3>(imgWidth, imgHeight, inputImg, outputImg); break;
+        case 5:  medianRows<5>(imgWidth, imgHeight, inputImg, outputImg); break;
+        case 7:  medianRows<7>(imgWidth, imgHeight, inputImg, outputImg); break;
+        default: seqMedianHistogram(imgWidth, imgHeight, size, inputImg, outputImg); break;
+    }
+}
+
+/**
+ * Histogram median: every column keeps the histogram of its size pixels
+ * around the current row, updated by one pixel in and one out per row. Along
+ * a row, the 16 coarse bins of the window gain the column entering on the
+ * right and lose the one leaving on the left, and locate the coarse bin of
+ * the median. Only the 16 fine bins under it are then brought up to date,
+ * by the columns that moved since they last were, or rebuilt when the whole
+ * window did; so the cost per pixel does not depend on the size.
+ * */
+
+void seqMedianHistogram(unsigned int imgWidth,
+                        unsigned int imgHeight,
+                        unsigned int size,
+                        const unsigned char *inputImg,
+                        unsigned char *outputImg){
+    const unsigned int step = MEDIAN_BINS / MEDIAN_COARSE_BINS;
+    unsigned int radius = size / 2;
+    unsigned int half = size * size / 2;
+    if(!zeroBorder(imgWidth, imgHeight, radius, outputImg)){
+        return;
+    }
+
+    ScratchArena &arena = threadArena();
+    ArenaScope frame(arena);
+    uint16_t *fineColumns = (uint16_t*) arena.allocate((size_t) imgWidth * MEDIAN_BINS * sizeof(uint16_t));
+    uint16_t *coarseColumns = (uint16_t*) arena.allocate((size_t) imgWidth * MEDIAN_COARSE_BINS * sizeof(uint16_t));
+    memset(fineColumns, 0, (size_t) imgWidth * MEDIAN_BINS * sizeof(uint16_t));
+    memset(coarseColumns, 0, (size_t) imgWidth * MEDIAN_COARSE_BINS * sizeof(uint16_t));
+
+    auto count = [&](unsigned int y, int delta){
+        const unsigned char *row = &inputImg[(size_t) y * imgWidth];
+        for(unsigned int x = 0; x < imgWidth; x++){
+            fineColumns[(size_t) x * MEDIAN_BINS + row[x]] += delta;
+            coarseColumns[(size_t) x * MEDIAN_COARSE_BINS + row[x] / step] += delta;
+        }
+    };
+    for(unsigned int y = 0; y + 1 < size; y++){
+        count(y, 1);
+    }
+
+    for(unsigned int y = radius; y + radius < imgHeight; y++){
+        if(y > radius){
+            count(y - radius - 1, -1);
+        }
+        count(y + radius, 1);
+
+        uint16_t coarse[MEDIAN_COARSE_BINS] = {}, fine[MEDIAN_BINS];
+        unsigned int current[MEDIAN_COARSE_BINS];      // window center the fine bins were last brought to
+        for(unsigned int c = 0; c < MEDIAN_COARSE_BINS; c++){
+            current[c] = 0;                             // stale: no window is centered at 0
+            for(unsigned int x = 0; x < size; x++){
+                coarse[c] += coarseColumns[(size_t) x * MEDIAN_COARSE_BINS + c];
+            }
+        }
+
+        unsigned char *row = &outputImg[(size_t) y * imgWidth];
+        for(unsigned int x = radius; x + radius < imgWidth; x++){
+            if(x > radius){
+                const uint16_t *in = &coarseColumns[(size_t) (x + radius) * MEDIAN_COARSE_BINS];
+                const uint16_t *out = &coarseColumns[(size_t) (x - radius - 1) * MEDIAN_COARSE_BINS];
+                for(unsigned int c = 0; c < MEDIAN_COARSE_BINS; c++){
+                    coarse[c] += in[c] - out[c];
+                }
+            }
+
+            unsigned int below = 0, c = 0;
+            while(below + coarse[c] <= half){
+                below += coarse[c++];
+            }
+
+            uint16_t *bins = &fine[c * step];
+            if(current[c] == 0 || x - current[c] >= size){
+                memset(bins, 0, step * sizeof(uint16_t));
+                for(unsigned int column = x - radius; column <= x + radius; column++){
+                    const uint16_t *in = &fineColumns[(size_t) column * MEDIAN_BINS + c * step];
+                    for(unsigned int v = 0; v < step; v++){
+                        bins[v] += in[v];
+                    }
+                }
+            } else {
+                for(unsigned int center = current[c] + 1; center <= x; center++){
+                    const uint16_t *in = &fineColumns[(size_t) (center + radius) * MEDIAN_BINS + c * step];
+                    const uint16_t *out = &fineColumns[(size_t) (center - radius - 1) * MEDIAN_BINS + c * step];
+                    for(unsigned int v = 0; v < step; v++){
+                        bins[v] += in[v] - out[v];
+                    }
+                }
+            }
+            current[c] = x;
+
+            unsigned int v = 0;
+            while(below + bins[v] <= half){
+                below += bins[v++];
+            }
+            row[x] = c * step + v;
+        }
+    }
+}
+
+void seqMedian(unsigned int imgWidth,
+               unsigned int imgHeight,
+               unsigned int size,
+               const unsigned char *inputImg,
+               unsigned char *outputImg){
+    if(size <= MEDIAN_CPU_NETWORK_SIZE){
+        seqMedianNetwork(imgWidth, imgHeight, size, inputImg, outputImg);
+    } else {
+        seqMedianHistogram(imgWidth, imgHeight, size, inputImg, outputImg);
+    }
+}
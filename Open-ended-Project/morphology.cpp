@@ -0,0 +1,193 @@
+#include <string.h>
+#include "morphology.h"
+#include "scratch_arena.h"
+
+// -DMORPHOLOGY_NO_SIMD keeps one pixel at a time on every machine
+#ifndef MORPHOLOGY_NO_SIMD
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define MORPHOLOGY_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MORPHOLOGY_NEON 1
+#endif
+#endif
+
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
+/**
+ * out = min or max of a and b, pixel by pixel; 16 pixels at a time where
+ * SIMD is available.
+ * */
+
+template <bool DILATE>
+static void extremeOf(const unsigned char *a, const unsigned char *b, unsigned char *out, size_t n){
+    size_t i = 0;
+
+#if defined(MORPHOLOGY_SSE2)
+    for(; i + 16 <= n; i += 16){
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+        _mm_storeu_si128((__m128i*) (out + i), DILATE ? _mm_max_epu8(x, y) : _mm_min_epu8(x, y));
+    }
+#elif defined(MORPHOLOGY_NEON)
+    for(; i + 16 <= n; i += 16){
+        uint8x16_t x = vld1q_u8(a + i), y = vld1q_u8(b + i);
+        vst1q_u8(out + i, DILATE ? vmaxq_u8(x, y) : vminq_u8(x, y));
+    }
+#endif
+    for(; i < n; i++){
+        out[i] = DILATE ? (a[i] > b[i] ? a[i] : b[i]) : (a[i] < b[i] ? a[i] : b[i]);
+    }
+}
+
+/**
+ * Length of a line of n pixels padded by radius on both sides and rounded
+ * up to whole blocks of size.
+ * */
+
+static size_t paddedLength(unsigned int n, unsigned int size){
+    size_t padded = n + 2 * (size / 2);
+    return (padded + size - 1) / size * size;
+}
+
+/**
+ * Row pass: forward and backward running extremes per block of each padded
+ * row, then window x is the extreme of backward[x] and forward[x + size - 1].
+ * */
+
+template <bool DILATE>
+static void morphRows(unsigned int imgWidth,
+                      unsigned int imgHeight,
+                      unsigned int size,
+                      const unsigned char *inputImg,
+                      unsigned char *outputImg){
+    const unsigned char neutral = DILATE ? 0 : 255;
+    unsigned int radius = size / 2;
+    size_t length = paddedLength(imgWidth, size);
+
+    ScratchArena &arena = threadArena();
+    ArenaScope frame(arena);
+    unsigned char *padded = (unsigned char*) arena.allocate(length);
+    unsigned char *forward = (unsigned char*) arena.allocate(length);
+    unsigned char *backward = (unsigned char*) arena.allocate(length);
+    memset(padded, neutral, length);
+
+    for(unsigned int y = 0; y < imgHeight; y++){
+        memcpy(&padded[radius], &inputImg[(size_t) y * imgWidth], imgWidth);
+
+        for(size_t start = 0; start < length; start += size){
+            size_t end = start + size - 1;
+            forward[start] = padded[start];
+            for(size_t i = start + 1; i <= end; i++){
+                forward[i] = DILATE ? (forward[i - 1] > padded[i] ? forward[i - 1] : padded[i])
+                                    : (forward[i - 1] < padded[i] ? forward[i - 1] : padded[i]);
+            }
+            backward[end] = padded[end];
+            for(size_t i = end; i-- > start; ){
+                backward[i] = DILATE ? (backward[i + 1] > padded[i] ? backward[i + 1] : padded[i])
+                                     : (backward[i + 1] < padded[i] ? backward[i + 1] : padded[i]);
+            }
+        }
+
+        extremeOf<DILATE>(backward, &forward[size - 1], &outputImg[(size_t) y * imgWidth], imgWidth);
+    }
+}
+
+/**
+ * Column pass: the same on whole padded rows, so that every comparison
+ * covers a row of pixels.
+ * */
+
+template <bool DILATE>
+static void morphColumns(unsigned int imgWidth,
+                         unsigned int imgHeight,
+                         unsigned int size,
+                         const unsigned char *inputImg,
+                         unsigned char *outputImg){
+    unsigned int radius = size / 2;
+    size_t length = paddedLength(imgHeight, size);
+
+    ScratchArena &arena = threadArena();
+    ArenaScope frame(arena);
+    unsigned char *neutralRow = (unsigned char*) arena.allocate(imgWidth);
+    unsigned char *forward = (unsigned char*) arena.allocate(length * imgWidth);
+    unsigned char *backward = (unsigned char*) arena.allocate(length * imgWidth);
+    memset(neutralRow, DILATE ? 0 : 255, imgWidth);
+
+    auto row = [&](size_t i){
+        return i >= radius && i < imgHeight + radius ? &inputImg[(i - radius) * imgWidth] : neutralRow;
+    };
+
+    for(size_t start = 0; start < length; start += size){
+        size_t end = start + size - 1;
+        memcpy(&forward[start * imgWidth], row(start), imgWidth);
+        for(size_t i = start + 1; i <= end; i++){
+            extremeOf<DILATE>(&forward[(i - 1) * imgWidth], row(i), &forward[i * imgWidth], imgWidth);
+        }
+        memcpy(&backward[end * imgWidth], row(end), imgWidth);
+        for(size_t i = end; i-- > start; ){
+            extremeOf<DILATE>(&backward[(i + 1) * imgWidth], row(i), &backward[i * imgWidth], imgWidth);
+        }
+    }
+
+    extremeOf<DILATE>(backward, &forward[(size_t) (size - 1) * imgWidth], outputImg, (size_t) imgWidth * imgHeight);
+}
+
+// =================================================================
+// -------------------------- Morphology ---------------------------
+// =================================================================
+
+void seqMorphRows(bool dilate,
+                  unsigned int imgWidth,
+                  unsigned int imgHeight,
+                  unsigned int size,
+                  const unsigned char *inputImg,
+                  unsigned char *outputImg){
+    if(dilate){
+        morphRows<true>(imgWidth, imgHeight, size, inputImg, outputImg);
+    } else {
+        morphRows<false>(imgWidth, imgHeight, size, inputImg, outputImg);
+    }
+}
+
+void seqMorphColumns(bool dilate,
+                     unsigned int imgWidth,
+                     unsigned int imgHeight,
+                     unsigned int size,
+                     const unsigned char *inputImg,
+                     unsigned char *outputImg){
+    if(dilate){
+        morphColumns<true>(imgWidth, imgHeight, size, inputImg, outputImg);
+    } else {
+        morphColumns<false>(imgWidth, imgHeight, size, inputImg, outputImg);
+    }
+}
+
+/**
+ * Erosion or dilation is a row pass into a scratch image and a column pass
+ * into outputImg; opening and closing chain two of them.
+ * */
+
+void seqMorphology(MorphOp op,
+                   unsigned int imgWidth,
+                   unsigned int imgHeight,
+                   unsigned int elementWidth,
+                   unsigned int elementHeight,
+                   const unsigned char *inputImg,
+                   unsigned char *outputImg){
+    ScratchArena &arena = threadArena();
+    ArenaScope frame(arena);
+    unsigned char *rows = (unsigned char*) arena.allocate((size_t) imgWidth * imgHeight);
+
+    bool dilate = op == MORPH_DILATE || op == MORPH_CLOSE;
+    seqMorphRows(dilate, imgWidth, imgHeight, elementWidth, inputImg, rows);
+    seqMorphColumns(dilate, imgWidth, imgHeight, elementHeight, rows, outputImg);
+
+    if(op == MORPH_OPEN || op == MORPH_CLOSE){
+        seqMorphRows(!dilate, imgWidth, imgHeight, elementWidth, outputImg, rows);
+        seqMorphColumns(!dilate, imgWidth, imgHeight, elementHeight, rows, outputImg);
+    }
+}
@@ -0,0 +1,55 @@
+/**
+ * Grayscale morphology of gray images with rectangular structuring
+ * elements: erosion (min over the element), dilation (max), opening
+ * (erosion then dilation) and closing (dilation then erosion).
+ *
+ * A rectangle is separable, so each operation is a pass along the rows and
+ * one along the columns. Each pass uses the van Herk/Gil-Werman algorithm:
+ * the line is cut in blocks of the element size, a running extreme is taken
+ * forward and backward within each block, and every window, which spans at
+ * most two blocks, is the extreme of one backward and one forward value.
+ * That is three comparisons per pixel whatever the size. The element is
+ * clipped to the image, as if it were padded with 255 for an erosion and 0
+ * for a dilation.
+ *
+ * On the CPU, the column pass compares 16 columns at a time with SSE2 or
+ * NEON, and the row pass takes its final comparison 16 pixels at a time
+ * (build with -DMORPHOLOGY_NO_SIMD for one pixel at a time). On the device,
+ * morphLines runs either pass, one block of one line per work-item.
+ * */
+
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#define MORPH_MAX_SIZE 255              // largest element side
+
+enum MorphOp {
+    MORPH_ERODE,
+    MORPH_DILATE,
+    MORPH_OPEN,                         // erode, then dilate
+    MORPH_CLOSE                         // dilate, then erode
+};
+
+void seqMorphRows(bool dilate,
+                  unsigned int imgWidth,
+                  unsigned int imgHeight,
+                  unsigned int size,
+                  const unsigned char *inputImg,
+                  unsigned char *outputImg);                      // Min or max over size pixels of each row.
+
+void seqMorphColumns(bool dilate,
+                     unsigned int imgWidth,
+                     unsigned int imgHeight,
+                     unsigned int size,
+                     const unsigned char *inputImg,
+                     unsigned char *outputImg);                   // Min or max over size pixels of each column.
+
+void seqMorphology(MorphOp op,
+                   unsigned int imgWidth,
+                   unsigned int imgHeight,
+                   unsigned int elementWidth,
+                   unsigned int elementHeight,
+                   const unsigned char *inputImg,
+                   unsigned char *outputImg);                     // Morphology with an odd rectangle.
+
+#endif
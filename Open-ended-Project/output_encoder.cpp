@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <ctype.h>
+#include "output_encoder.h"
+
+#define cimg_use_jpeg
+#include "CImg.h"
+using namespace cimg_library;
+
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
+/**
+ * Format from the file extension; PGM if unknown.
+ * */
+
+OutputFormat outputFormat(const std::string &path){
+    size_t dot = path.rfind('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if(extension == "png"){
+        return OUTPUT_PNG;
+    } else if(extension == "jpg" || extension == "jpeg"){
+        return OUTPUT_JPEG;
+    } else if(extension == "raw" || extension == "gray"){
+        return OUTPUT_RAW;
+    }
+    return OUTPUT_PGM;
+}
+
+// =================================================================
+// --------------------------- Clients -----------------------------
+// =================================================================
+
+EncoderPool::EncoderPool(unsigned int workers, size_t capacity, int jpegQuality)
+    : capacity(capacity > 0 ? capacity : 1), jpegQuality(jpegQuality){
+    for(unsigned int i = 0; i < (workers > 0 ? workers : 1); i++){
+        this->workers.push_back(std::thread(&EncoderPool::encode, this));
+    }
+}
+
+/**
+ * Encode the queued frames and stop the workers.
+ * */
+
+EncoderPool::~EncoderPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    for(std::thread &worker : workers){
+        worker.join();
+    }
+}
+
+/**
+ * Queue a frame owned by the pool; waits while the queue is full.
+ * */
+
+void EncoderPool::submit(const std::string &path,
+                         unsigned int imgWidth,
+                         unsigned int imgHeight,
+                         std::vector<unsigned char> &&pixels){
+    Frame frame{path, outputFormat(path), imgWidth, imgHeight, std::move(pixels), nullptr};
+    frame.pixels = frame.owned.data();
+    push(std::move(frame));
+}
+
+/**
+ * Queue a borrowed frame, which must stay unchanged until finish() returns;
+ * waits while the queue is full.
+ * */
+
+void EncoderPool::submit(const std::string &path,
+                         unsigned int imgWidth,
+                         unsigned int imgHeight,
+                         const unsigned char *pixels){
+    push(Frame{path, outputFormat(path), imgWidth, imgHeight, std::vector<unsigned char>(), pixels});
+}
+
+void EncoderPool::push(Frame &&frame){
+    std::unique_lock<std::mutex> lock(mutex);
+    dequeued.wait(lock, [this](){ return frames.size() < capacity; });
+    frames.push_back(std::move(frame));
+    lock.unlock();
+    queued.notify_one();
+}
+
+/**
+ * Wait until every queued frame is written.
+ * */
+
+void EncoderPool::finish(){
+    std::unique_lock<std::mutex> lock(mutex);
+    dequeued.wait(lock, [this](){ return frames.empty() && busy == 0; });
+}
+
+EncoderStats EncoderPool::stats(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+// =================================================================
+// ---------------------------- Workers ----------------------------
+// =================================================================
+
+/**
+ * Worker thread: encode frames until the pool stops and the queue is empty.
+ * */
+
+void EncoderPool::encode(){
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(true){
+        queued.wait(lock, [this](){ return stopping || !frames.empty(); });
+        if(frames.empty()){
+            return;
+        }
+        Frame frame = std::move(frames.front());
+        frames.pop_front();
+        busy++;
+        lock.unlock();
+        dequeued.notify_all();
+
+        /**
+         * Wrap the pixels in a shared CImg, which writes them in place.
+         * */
+
+        bool written = true;
+        try {
+            const CImg<unsigned char> image(frame.pixels, frame.imgWidth, frame.imgHeight, 1, 1, true);
+            switch(frame.format){
+                case OUTPUT_PNG:
+                    image.save_png(frame.path.c_str());
+                    break;
+                case OUTPUT_JPEG:
+                    image.save_jpeg(frame.path.c_str(), jpegQuality);
+                    break;
+                case OUTPUT_PGM:
+                    image.save_pnm(frame.path.c_str());
+                    break;
+                case OUTPUT_RAW:
+                    image.save_raw(frame.path.c_str());
+                    break;
+            }
+        } catch(CImgException&){
+            written = false;
+        }
+
+        lock.lock();
+        busy--;
+        counters.encoded += written;
+        counters.failed += !written;
+        dequeued.notify_all();
+    }
+}
@@ -0,0 +1,83 @@
+/**
+ * Background encoding of filtered images.
+ *
+ * Writing an output image is slow next to filtering it. An EncoderPool
+ * takes gray frames over a bounded queue and encodes them on its own
+ * threads, so that the caller goes on filtering the next frame meanwhile.
+ * When the queue is full, submit waits for a free slot: the encoders then
+ * set the pace and the queued frames bound the memory held.
+ *
+ * A frame is wrapped in a shared CImg, without copying it. It is either
+ * moved into the pool, or borrowed: a borrowed frame must stay unchanged
+ * until finish() returns.
+ * */
+
+#ifndef OUTPUT_ENCODER_H
+#define OUTPUT_ENCODER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum OutputFormat {
+    OUTPUT_PNG,
+    OUTPUT_JPEG,
+    OUTPUT_PGM,                         // binary PNM, needs no codec library
+    OUTPUT_RAW                          // pixels only, row by row
+};
+
+OutputFormat outputFormat(const std::string &path);     // Format from the file extension; PGM if unknown.
+
+struct EncoderStats {
+    size_t encoded = 0;                 // frames written
+    size_t failed = 0;                  // frames the encoder rejected
+};
+
+class EncoderPool {
+public:
+    EncoderPool(unsigned int workers = 2, size_t capacity = 4, int jpegQuality = 90);
+    ~EncoderPool();                     // Encode the queued frames and stop.
+    EncoderPool(const EncoderPool&) = delete;
+    EncoderPool &operator=(const EncoderPool&) = delete;
+
+    void submit(const std::string &path,
+                unsigned int imgWidth,
+                unsigned int imgHeight,
+                std::vector<unsigned char> &&pixels);   // Queue a frame owned by the pool.
+
+    void submit(const std::string &path,
+                unsigned int imgWidth,
+                unsigned int imgHeight,
+                const unsigned char *pixels);           // Queue a borrowed frame.
+
+    void finish();                      // Wait until every queued frame is written.
+    EncoderStats stats();
+
+private:
+    struct Frame {
+        std::string path;
+        OutputFormat format;
+        unsigned int imgWidth, imgHeight;
+        std::vector<unsigned char> owned;
+        const unsigned char *pixels;    // owned.data() or the borrowed frame
+    };
+
+    void push(Frame &&frame);
+    void encode();                      // Worker thread.
+
+    size_t capacity;
+    int jpegQuality;
+
+    std::mutex mutex;
+    std::condition_variable queued, dequeued;
+    std::deque<Frame> frames;
+    unsigned int busy = 0;              // frames being encoded
+    EncoderStats counters;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include "scratch_arena.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
+/**
+ * Heap allocation aligned to align bytes, or nullptr.
+ * */
+
+static void *alignedAlloc(size_t size, size_t align){
+#if defined(_WIN32)
+    return _aligned_malloc(size, align);
+#else
+    void *memory = nullptr;
+    return posix_memalign(&memory, align, size) == 0 ? memory : nullptr;
+#endif
+}
+
+static void alignedFree(void *memory){
+#if defined(_WIN32)
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+// =================================================================
+// ---------------------------- Arena ------------------------------
+// =================================================================
+
+ScratchArena::~ScratchArena(){
+    release(0);
+    reserve(0);
+}
+
+/**
+ * Return size bytes aligned to ARENA_ALIGNMENT, from the block if they fit
+ * and from the heap otherwise; throws std::bad_alloc if the heap is out.
+ * */
+
+void *ScratchArena::allocate(size_t size){
+    size_t offset = (used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    if(offset + size <= blockSize){
+        used = offset + size;
+        peakUse = used > peakUse ? used : peakUse;
+        return block + offset;
+    }
+
+    void *memory = alignedAlloc(size > 0 ? size : 1, ARENA_ALIGNMENT);
+    if(memory == nullptr){
+        throw std::bad_alloc();
+    }
+    heapCount++;
+    overflow.push_back({used, memory});
+    used = offset + size;
+    peakUse = used > peakUse ? used : peakUse;
+    return memory;
+}
+
+/**
+ * Free what was allocated after mark. Back at an empty arena, the block is
+ * regrown to the largest use seen, so that the next frame fits in it.
+ * */
+
+void ScratchArena::release(size_t mark){
+    while(!overflow.empty() && overflow.back().offset >= mark){
+        alignedFree(overflow.back().memory);
+        overflow.pop_back();
+    }
+    used = mark < used ? mark : used;
+
+    if(used == 0 && peakUse > blockSize){
+        reserve(peakUse);
+    }
+}
+
+/**
+ * Grow the block to size bytes, rounded up to a huge page from 2 MiB on;
+ * only while nothing is allocated. reserve(0) frees the block.
+ * */
+
+void ScratchArena::reserve(size_t size){
+    if(used != 0 || (size != 0 && size <= blockSize)){
+        return;
+    }
+
+    if(block){
+#if defined(__linux__)
+        if(hugeBlock){
+            munmap(block, blockSize);
+        } else
+#endif
+        alignedFree(block);
+        block = nullptr;
+        blockSize = 0;
+    }
+    if(size == 0){
+        return;
+    }
+
+    size_t align = size >= ARENA_HUGE_PAGE ? ARENA_HUGE_PAGE : ARENA_ALIGNMENT;
+    size = (size + align - 1) & ~(align - 1);
+    hugeBlock = false;
+    heapCount++;
+
+#if defined(__linux__)
+    /**
+     * mmap only aligns to the base page: map a huge page more, and unmap
+     * the slack on both sides of the first huge page boundary.
+     * */
+
+    if(align == ARENA_HUGE_PAGE){
+        size_t mapped = size + ARENA_HUGE_PAGE;
+        void *memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(memory != MAP_FAILED){
+            uintptr_t start = (uintptr_t) memory;
+            uintptr_t aligned = (start + ARENA_HUGE_PAGE - 1) & ~(uintptr_t)(ARENA_HUGE_PAGE - 1);
+            if(aligned > start){
+                munmap(memory, aligned - start);
+            }
+            if(start + mapped > aligned + size){
+                munmap((void*) (aligned + size), start + mapped - (aligned + size));
+            }
+            madvise((void*) aligned, size, MADV_HUGEPAGE);
+            block = (unsigned char*) aligned;
+            blockSize = size;
+            hugeBlock = true;
+            return;
+        }
+    }
+#endif
+
+    block = (unsigned char*) alignedAlloc(size, align);
+    blockSize = block ? size : 0;
+}
+
+/**
+ * The arena of the calling thread.
+ * */
+
+ScratchArena &threadArena(){
+    thread_local ScratchArena arena;
+    return arena;
+}
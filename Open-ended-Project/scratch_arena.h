@@ -0,0 +1,74 @@
+/**
+ * Scratch arena for the intermediates of the CPU filter path.
+ *
+ * Allocations are 64-byte aligned bumps in one block. A frame opens an
+ * ArenaScope and everything allocated inside it is released when the scope
+ * closes. When a frame needs more than the block holds, the rest comes from
+ * the heap, and once the outermost scope closes the block is regrown to the
+ * largest frame seen. From then on frames of that size make no heap calls.
+ * Blocks of 2 MiB and more are huge-page aligned and, on Linux, advised as
+ * huge pages.
+ *
+ * threadArena() returns the arena of the calling thread, so the CPU path
+ * needs no locking.
+ * */
+
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+#define ARENA_ALIGNMENT 64                      // cache line
+#define ARENA_HUGE_PAGE (2 << 20)               // huge page size on x86-64 and arm64
+
+class ScratchArena {
+public:
+    ScratchArena() {}
+    ~ScratchArena();
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena &operator=(const ScratchArena&) = delete;
+
+    void *allocate(size_t size);                // 64-byte aligned, valid until released
+    size_t mark() const { return used; }
+    void release(size_t mark);                  // Free what was allocated after mark.
+    void reserve(size_t size);                  // Grow the block to size while nothing is allocated.
+
+    size_t capacity() const { return blockSize; }
+    size_t peak() const { return peakUse; }     // largest use since creation
+    size_t heapCalls() const { return heapCount; }  // block and overflow allocations so far
+
+private:
+    unsigned char *block = nullptr;
+    size_t blockSize = 0;
+    size_t used = 0;                            // bytes handed out, block and overflow
+    size_t peakUse = 0;
+    size_t heapCount = 0;
+    bool hugeBlock = false;                     // block was mapped rather than allocated
+
+    struct Overflow {
+        size_t offset;                          // value of used when allocated
+        void *memory;
+    };
+    std::vector<Overflow> overflow;             // allocations past the end of the block
+};
+
+/**
+ * Allocations made while a scope is open are released when it closes.
+ * */
+
+class ArenaScope {
+public:
+    explicit ArenaScope(ScratchArena &arena) : arena(arena), start(arena.mark()) {}
+    ~ArenaScope() { arena.release(start); }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope &operator=(const ArenaScope&) = delete;
+
+private:
+    ScratchArena &arena;
+    size_t start;
+};
+
+ScratchArena &threadArena();                    // The arena of the calling thread.
+
+#endif
@@ -0,0 +1,179 @@
+#include "seq_filter.h"
+#include "scratch_arena.h"
+
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
+/**
+ * Sequentially convert an RGB image to grayscale.
+ */
+
+void seqRgb2Gray(unsigned int imgWidth,
+                 unsigned int imgHeight,
+                 unsigned char *rChannel,
+                 unsigned char *gChannel,
+                 unsigned char *bChannel,
+                 unsigned char *grayImg){
+    seqRgb2GrayRegion(imgWidth, imgHeight, 0, 0, imgWidth, imgHeight, rChannel, gChannel, bChannel, grayImg);
+}
+
+/**
+ * Sequentially convert the pixels [x0, x1) x [y0, y1) of an RGB image to
+ * grayscale.
+ */
+
+void seqRgb2GrayRegion(unsigned int imgWidth,
+                       unsigned int imgHeight,
+                       unsigned int x0,
+                       unsigned int y0,
+                       unsigned int x1,
+                       unsigned int y1,
+                       unsigned char *rChannel,
+                       unsigned char *gChannel,
+                       unsigned char *bChannel,
+                       unsigned char *grayImg){
+    
+    /**
+     * Declare the current index variable.
+     */
+
+    size_t idx;
+
+    /**
+     * Loop over the region, row by row.
+     */
+
+    for(size_t j = y0; j < y1 && j < imgHeight; j++){
+        for(size_t i = x0; i < x1 && i < imgWidth; i++){
+
+            /**
+             * Compute average pixel.
+             */
+
+            idx = i + j*imgWidth;
+            grayImg[idx] = (rChannel[idx] + gChannel[idx] + bChannel[idx]) / 3;
+        }
+    }
+}
+
+/**
+ * Sequentially convolve an image with a filter mask.
+ */
+
+void seqConvolve(unsigned int imgWidth,
+                 unsigned int imgHeight,
+                 unsigned int maskSize,
+                 unsigned char *inputImg,
+                 float *mask,
+                 unsigned char *outputImg){
+    seqConvolveRegion(imgWidth, imgHeight, maskSize, 0, 0, imgWidth, imgHeight, inputImg, mask, outputImg);
+}
+
+/**
+ * Sequentially convolve the pixels [x0, x1) x [y0, y1) of an image with a
+ * filter mask.
+ */
+
+void seqConvolveRegion(unsigned int imgWidth,
+                       unsigned int imgHeight,
+                       unsigned int maskSize,
+                       unsigned int x0,
+                       unsigned int y0,
+                       unsigned int x1,
+                       unsigned int y1,
+                       unsigned char *inputImg,
+                       float *mask,
+                       unsigned char *outputImg){
+    /**
+     * Loop through the region of the input image, row by row.
+     * */
+
+    for(size_t j = y0; j < y1 && j < imgHeight; j++){
+        for(size_t i = x0; i < x1 && i < imgWidth; i++){
+                
+            /**
+             * Check if the mask cannot be applied to the
+             * current image pixel.
+             * */
+            
+            if(i < maskSize/2  
+            || j < maskSize/2
+            || i >= imgWidth - maskSize/2
+            || j >= imgHeight - maskSize/2){
+                outputImg[i + j * imgWidth] = 0;
+                continue;
+            }
+            
+            /**
+             * Apply mask based on the neighborhood of pixel inputImg(j,i).
+             * */
+            
+            int outSum = 0;
+            for(size_t k = 0; k < maskSize; k++){
+                for(size_t l = 0; l < maskSize; l++){
+                  size_t colIdx = i - maskSize/2 + k;
+                  size_t rowIdx = j - maskSize/2 + l;
+                  size_t maskIdx = (maskSize-1-k) + (maskSize-1-l)*maskSize;
+                  outSum += inputImg[rowIdx * imgWidth + colIdx] * mask[maskIdx];
+                }
+            }
+
+            /**
+             * Update output pixel.
+             * */
+
+            if(outSum < 0){
+                outputImg[i + j * imgWidth] = 0;
+            } else if(outSum > 255){
+                outputImg[i + j * imgWidth] = 255;
+            } else{
+                outputImg[i + j * imgWidth] = outSum;
+            }
+        }
+    }
+}
+
+/**
+ * Sequentially filter an image.
+ */
+
+void seqFilter(unsigned int imgWidth,
+               unsigned int imgHeight,
+               unsigned int lpMaskSize,
+               unsigned int hpMaskSize,
+               unsigned char *inputRchannel,
+               unsigned char *inputGchannel,
+               unsigned char *inputBchannel,
+               float *lpMask,
+               float *hpMask,
+               unsigned char *outputImg){
+
+    /**
+     * Take the intermediate images from the scratch arena of the thread;
+     * they are released when the frame returns.
+     */
+
+    ScratchArena &arena = threadArena();
+    ArenaScope frame(arena);
+
+    /**
+     * Convert input image to grayscale.
+     */
+
+    unsigned char *grayOut = (unsigned char*) arena.allocate(imgWidth * imgHeight * sizeof(unsigned char));
+    seqRgb2Gray(imgWidth, imgHeight, inputRchannel, inputGchannel, inputBchannel, grayOut);
+
+    /**
+     * Apply the low-pass filter.
+     */
+
+    unsigned char *lpOut = (unsigned char*) arena.allocate(imgWidth * imgHeight * sizeof(unsigned char));
+    seqConvolve(imgWidth, imgHeight, lpMaskSize, grayOut, lpMask, lpOut);
+    
+    /**
+     * Apply the high-pass filter.
+     */
+
+    seqConvolve(imgWidth, imgHeight, hpMaskSize, lpOut, hpMask, outputImg);
+}
@@ -0,0 +1,57 @@
+/**
+ * Sequential reference implementation of the image filter: grayscale
+ * conversion followed by a low-pass and a high-pass convolution. Shared by
+ * the OpenCL host program and the HLS testbench.
+ * */
+
+#ifndef SEQ_FILTER_H
+#define SEQ_FILTER_H
+
+void seqRgb2Gray(unsigned int imgWidth,
+                 unsigned int imgHeight,
+                 unsigned char *rChannel,
+                 unsigned char *gChannel,
+                 unsigned char *bChannel,
+                 unsigned char *grayImg);                          // Sequentially convert an RGB image to grayscale.
+
+void seqRgb2GrayRegion(unsigned int imgWidth,
+                       unsigned int imgHeight,
+                       unsigned int x0,
+                       unsigned int y0,
+                       unsigned int x1,
+                       unsigned int y1,
+                       unsigned char *rChannel,
+                       unsigned char *gChannel,
+                       unsigned char *bChannel,
+                       unsigned char *grayImg);                    // Grayscale of the pixels [x0, x1) x [y0, y1) only.
+
+void seqConvolve(unsigned int imgWidth,                     
+                 unsigned int imgHeight,
+                 unsigned int maskSize,
+                 unsigned char *inputImg,
+                 float *mask,
+                 unsigned char *outputImg);                        // Sequentially convolve an image with a filter.
+
+void seqConvolveRegion(unsigned int imgWidth,
+                       unsigned int imgHeight,
+                       unsigned int maskSize,
+                       unsigned int x0,
+                       unsigned int y0,
+                       unsigned int x1,
+                       unsigned int y1,
+                       unsigned char *inputImg,
+                       float *mask,
+                       unsigned char *outputImg);                  // Convolve the pixels [x0, x1) x [y0, y1) only.
+
+void seqFilter(unsigned int imgWidth,                       
+               unsigned int imgHeight,
+               unsigned int lpMaskSize,
+               unsigned int hpMaskSize,
+               unsigned char *inputRchannel,
+               unsigned char *inputGchannel,
+               unsigned char *inputBchannel,
+               float *lpMask,
+               float *hpMask,
+               unsigned char *outputImg);                           // Sequentially filter an image.
+
+#endif
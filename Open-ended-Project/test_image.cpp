@@ -1,116 +1,188 @@
-#include <stdio.h>
-#include "hls_stream.h"
-#include "ap_axi_sdata.h"
-
-/***************** AXIS with TLAST structure declaration *********************/
-typedef ap_axis<32, 0, 0, 0> AXIS_wLAST;
-
-/***************** Macros *********************/
-#define WIDTH 64
-#define HEIGHT 48
-#define NUM_CHANNELS 3
-
-#define NUMBER_OF_TEST_VECTORS 1  // Number of test vectors (cases)
-
-/***************** Function declaration *********************/
-void imageFiltering(unsigned char inputImg[WIDTH * HEIGHT * NUM_CHANNELS],
-                    float lpMask[5 * 5],
-                    float hpMask[5 * 5],
-                    unsigned char outputImg[WIDTH * HEIGHT]);
-
-/************************** Variable Definitions *****************************/
-unsigned char inputImg[WIDTH * HEIGHT * NUM_CHANNELS];  // Input image
-float lpMask[5 * 5];  // Low-pass mask
-float hpMask[5 * 5];  // High-pass mask
-unsigned char outputImg_expected[WIDTH * HEIGHT];  // Expected output image
-
-/*****************************************************************************
- * Main function    
- *****************************************************************************/
-int main() {
-    int word_cnt;
-    int success;
-    AXIS_wLAST write_input, read_output;
-    hls::stream<AXIS_wLAST> S_AXIS;
-    hls::stream<AXIS_wLAST> M_AXIS;
-
-    /************** Initialize input data and expected output *****************/
-    // Initialize input image
-    for (int i = 0; i < WIDTH * HEIGHT * NUM_CHANNELS; i++) {
-        inputImg[i] = i % 256;  // Arbitrary input data
-    }
-
-    // Initialize low-pass mask
-    for (int i = 0; i < 5 * 5; i++) {
-        lpMask[i] = 0.04f;
-    }
-
-    // Initialize high-pass mask
-    for (int i = 0; i < 5 * 5; i++) {
-        hpMask[i] = -1.0f;
-    }
-    hpMask[12] = 24.0f;
-
-    for (int i = 0; i < WIDTH * HEIGHT; i++) {
-        outputImg_expected[i] = (inputImg[i] + inputImg[i + WIDTH * HEIGHT] + inputImg[i + 2 * WIDTH * HEIGHT]) / 3;
-    }
-
-    /******************** Input to Function : Transmit the Data Stream ***********************/
-
-    printf(" Transmitting Data ...\r\n");
-
-    // Transmit input image
-    for (int i = 0; i < WIDTH * HEIGHT * NUM_CHANNELS; i++) {
-        write_input.data = inputImg[i];
-        write_input.last = 0;
-        if ((i + 1) % 64 == 0) {
-            write_input.last = 1;
-        }
-        S_AXIS.write(write_input);
-    }
-
-    // Transmit low-pass mask
-    for (int i = 0; i < 5 * 5; i++) {
-        write_input.data = *((int*)&lpMask[i]);
-        write_input.last = 0;
-        if (i == 5 * 5 - 1) {
-            write_input.last = 1;
-        }
-        S_AXIS.write(write_input);
-    }
-
-    // Transmit high-pass mask
-    for (int i = 0; i < 5 * 5; i++) {
-        write_input.data = *((int*)&hpMask[i]);
-        write_input.last = 0;
-        if (i == 5 * 5 - 1) {
-            write_input.last = 1;
-        }
-        S_AXIS.write(write_input);
-    }
-
-    /* Transmission Complete */
-
-    /********************* Call the function (invoke the IP) ***************/
-    imageFiltering(inputImg, lpMask, hpMask, outputImg_expected);
-
-    /******************** Output from Function : Receive the Data Stream ***********************/
-
-    printf(" Receiving data ...\r\n");
-
-    // Receive output image
-    for (int i = 0; i < WIDTH * HEIGHT; i++) {
-        read_output = M_AXIS.read();
-        // Compare output with expected output
-        if (read_output.data != outputImg_expected[i]) {
-            printf("Output mismatch at index %d\r\n", i);
-            return 1;  // Test failed
-        }
-    }
-
-    /* Reception Complete */
-
-    printf("Test Success\r\n");
-
-    return 0;
-}
+#include <stdio.h>
+#include "image.h"
+#include "seq_filter.h"
+#include "checksum.h"
+
+// C simulation on a Linux host, with the stand-in HLS headers:
+//   g++ -O2 -Ihls_sim test_image.cpp image.cpp seq_filter.cpp scratch_arena.cpp checksum.c -o test_image
+
+/***************** Macros *********************/
+#define NUMBER_OF_TEST_VECTORS 2  // Number of test vectors (cases)
+
+// A second frame size, run through the template directly
+#define SMALL_WIDTH 32
+#define SMALL_HEIGHT 16
+
+/************************** Variable Definitions *****************************/
+unsigned char inputImg[WIDTH * HEIGHT * NUM_CHANNELS];  // Input image
+float lpMask[5 * 5];  // Low-pass mask
+float hpMask[5 * 5];  // High-pass mask
+unsigned char outputImg[WIDTH * HEIGHT];  // Output image of the kernel
+unsigned char outputImg_expected[WIDTH * HEIGHT];  // Expected output image
+uint32_t inputDigests[(HEIGHT + STRIP_ROWS - 1) / STRIP_ROWS];  // CRC32C of the pixel beats sent, per strip
+
+/*****************************************************************************
+ * Transmit the masks and a planar RGB frame in the order of image.h
+ *****************************************************************************/
+static void transmitMask(hls::stream<AXIS_wLAST> &S_AXIS, float *mask) {
+    AXIS_wLAST write_input;
+    for (int i = 0; i < 5 * 5; i++) {
+        write_input.data = *((int*)&mask[i]);
+        write_input.user = 0;
+        write_input.last = (i == 5 * 5 - 1);
+        S_AXIS.write(write_input);
+    }
+}
+
+static void transmitFrame(hls::stream<AXIS_wLAST> &S_AXIS, int width, int height) {
+    AXIS_wLAST write_input;
+
+    transmitMask(S_AXIS, lpMask);
+    transmitMask(S_AXIS, hpMask);
+
+    uint32_t crc = 0;
+    for (int y = 0; y < height; y++) {
+        for (int c = 0; c < NUM_CHANNELS; c++) {
+            unsigned char *row = &inputImg[c * width * height + y * width];
+            for (int x = 0; x < width; x += PIXELS_PER_BEAT) {
+                write_input.data = row[x] | (row[x + 1] << 8) | (row[x + 2] << 16) | (row[x + 3] << 24);
+                write_input.user = (y == 0 && c == 0 && x == 0);
+                write_input.last = (c == NUM_CHANNELS - 1 && x == width - PIXELS_PER_BEAT);
+                S_AXIS.write(write_input);
+            }
+            crc = checksumCrc32c(crc, row, width);
+        }
+        if ((y + 1) % STRIP_ROWS == 0 || y == height - 1) {
+            inputDigests[y / STRIP_ROWS] = crc;
+            crc = 0;
+        }
+    }
+}
+
+/*****************************************************************************
+ * Receive a frame and check its TUSER / TLAST framing and strip digests
+ *****************************************************************************/
+static int receiveFrame(hls::stream<AXIS_wLAST> &M_AXIS, int width, int height) {
+    int framing_errors = 0;
+    AXIS_wLAST read_output;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x += PIXELS_PER_BEAT) {
+            if (M_AXIS.empty()) {
+                printf("Output stream ended early at (%d, %d)\r\n", x, y);
+                return framing_errors + 1;
+            }
+            read_output = M_AXIS.read();
+            for (int p = 0; p < PIXELS_PER_BEAT; p++) {
+                outputImg[y * width + x + p] = read_output.data.range(8 * p + 7, 8 * p);
+            }
+            if ((int)read_output.user != (y == 0 && x == 0)
+                || (int)read_output.last != (x == width - PIXELS_PER_BEAT)) {
+                framing_errors++;
+            }
+        }
+
+        if ((y + 1) % STRIP_ROWS == 0 || y == height - 1) {
+            int first = y / STRIP_ROWS * STRIP_ROWS;
+            uint32_t digests[2];
+            for (int i = 0; i < 2; i++) {
+                if (M_AXIS.empty()) {
+                    printf("Output stream ended early in the digests of row %d\r\n", y);
+                    return framing_errors + 1;
+                }
+                read_output = M_AXIS.read();
+                digests[i] = (uint32_t)(long long)read_output.data;
+                if ((int)read_output.user != 0 || (int)read_output.last != i) {
+                    framing_errors++;
+                }
+            }
+            if (digests[0] != inputDigests[y / STRIP_ROWS]
+                || digests[1] != checksumCrc32c(0, &outputImg[first * width], (y + 1 - first) * width)) {
+                printf("Digest mismatch in rows %d-%d\r\n", first, y);
+                framing_errors++;
+            }
+        }
+    }
+    if (!M_AXIS.empty()) {
+        printf("Output stream has %d extra beats\r\n", (int)M_AXIS.size());
+        framing_errors++;
+    }
+    return framing_errors;
+}
+
+static int compareFrame(int width, int height) {
+    int mismatches = 0;
+
+    seqFilter(width, height, 5, 5, &inputImg[0], &inputImg[width * height], &inputImg[2 * width * height],
+              lpMask, hpMask, outputImg_expected);
+
+    for (int i = 0; i < width * height; i++) {
+        if (outputImg[i] != outputImg_expected[i]) {
+            if (mismatches < 10) {
+                printf("Output mismatch at (%d, %d): %d, expected %d\r\n",
+                       i % width, i / width, outputImg[i], outputImg_expected[i]);
+            }
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+/*****************************************************************************
+ * Main function
+ *****************************************************************************/
+int main() {
+    int errors = 0;
+    hls::stream<AXIS_wLAST> S_AXIS;
+    hls::stream<AXIS_wLAST> M_AXIS;
+
+    // Initialize low-pass mask
+    for (int i = 0; i < 5 * 5; i++) {
+        lpMask[i] = 0.04f;
+    }
+
+    // Initialize high-pass mask
+    for (int i = 0; i < 5 * 5; i++) {
+        hpMask[i] = -1.0f;
+    }
+    hpMask[12] = 24.0f;
+
+    for (int test_case = 0; test_case < NUMBER_OF_TEST_VECTORS; test_case++) {
+
+        /************** Initialize input data *****************/
+        // Test vector 0 is a ramp, the others pseudo-random
+        unsigned int seed = 12345 + test_case;
+        for (int i = 0; i < WIDTH * HEIGHT * NUM_CHANNELS; i++) {
+            seed = seed * 1103515245 + 12345;
+            inputImg[i] = test_case == 0 ? i % 256 : (seed >> 16) & 0xff;
+        }
+
+        /******************** Top-level function, WIDTH x HEIGHT ***********************/
+        printf(" Transmitting %dx%d frame ...\r\n", WIDTH, HEIGHT);
+        transmitFrame(S_AXIS, WIDTH, HEIGHT);
+        imageFiltering(S_AXIS, M_AXIS);
+        if (!S_AXIS.empty()) {
+            printf("Input stream not fully consumed\r\n");
+            errors++;
+        }
+        printf(" Receiving data ...\r\n");
+        errors += receiveFrame(M_AXIS, WIDTH, HEIGHT);
+        errors += compareFrame(WIDTH, HEIGHT);
+
+        /******************** Template instance, another frame size ***********************/
+        printf(" Transmitting %dx%d frame ...\r\n", SMALL_WIDTH, SMALL_HEIGHT);
+        transmitFrame(S_AXIS, SMALL_WIDTH, SMALL_HEIGHT);
+        imageFilteringStream<SMALL_WIDTH, SMALL_HEIGHT>(S_AXIS, M_AXIS);
+        errors += receiveFrame(M_AXIS, SMALL_WIDTH, SMALL_HEIGHT);
+        errors += compareFrame(SMALL_WIDTH, SMALL_HEIGHT);
+    }
+
+    if (errors != 0) {
+        printf("Test Failed: %d errors\r\n", errors);
+        return 1;
+    }
+
+    printf("Test Success\r\n");
+
+    return 0;
+}
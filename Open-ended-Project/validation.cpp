@@ -0,0 +1,242 @@
+#include <stdint.h>
+#include <thread>
+#include "validation.h"
+
+// -DVALIDATION_NO_SIMD keeps the scalar loop on every machine
+#ifndef VALIDATION_NO_SIMD
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define VALIDATION_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VALIDATION_NEON 1
+#endif
+#endif
+
+struct SpanStats {
+    size_t differing = 0;
+    size_t mismatches = 0;
+    int maxDiff = 0;
+    uint64_t sumSq = 0;
+};
+
+// =================================================================
+// ---------------------- Secondary Functions ----------------------
+// =================================================================
+
+#ifdef VALIDATION_NEON
+static size_t sumLanes(uint8x16_t v){
+    uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(v)));
+    return vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+}
+#endif
+
+/**
+ * Accumulate the differences between n pixels of a and b.
+ * */
+
+static void compareSpan(const unsigned char *a,
+                        const unsigned char *b,
+                        size_t n,
+                        unsigned char tolerance,
+                        SpanStats &stats){
+    size_t i = 0;
+
+#if defined(VALIDATION_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i tol = _mm_set1_epi8((char) tolerance);
+    __m128i maxv = zero;
+
+    while(i + 16 <= n){
+        // The 32-bit sums of squares hold 4096 blocks before they could overflow
+        size_t end = i + 16 * 4096 < n ? i + 16 * 4096 : n;
+        __m128i squares = zero;
+
+        for(; i + 16 <= end; i += 16){
+            __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+            __m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+            __m128i d = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+
+            maxv = _mm_max_epu8(maxv, d);
+            stats.differing += 16 - __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(d, zero)));
+            stats.mismatches += 16 - __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(d, tol), zero)));
+
+            __m128i lo = _mm_unpacklo_epi8(d, zero), hi = _mm_unpackhi_epi8(d, zero);
+            squares = _mm_add_epi32(squares, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        }
+
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i*) lanes, squares);
+        stats.sumSq += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    unsigned char maxLanes[16];
+    _mm_storeu_si128((__m128i*) maxLanes, maxv);
+    for(int lane = 0; lane < 16; lane++){
+        stats.maxDiff = maxLanes[lane] > stats.maxDiff ? maxLanes[lane] : stats.maxDiff;
+    }
+#elif defined(VALIDATION_NEON)
+    const uint8x16_t tol = vdupq_n_u8(tolerance);
+    uint8x16_t maxv = vdupq_n_u8(0);
+
+    while(i + 16 <= n){
+        // The 8-bit counters hold 255 blocks
+        size_t end = i + 16 * 255 < n ? i + 16 * 255 : n;
+        uint8x16_t differ = vdupq_n_u8(0), over = vdupq_n_u8(0);
+        uint32x4_t squares = vdupq_n_u32(0);
+
+        for(; i + 16 <= end; i += 16){
+            uint8x16_t d = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+
+            maxv = vmaxq_u8(maxv, d);
+            differ = vsubq_u8(differ, vtstq_u8(d, d));      // all ones counts as -1
+            over = vsubq_u8(over, vcgtq_u8(d, tol));
+
+            squares = vpadalq_u16(squares, vmull_u8(vget_low_u8(d), vget_low_u8(d)));
+            squares = vpadalq_u16(squares, vmull_u8(vget_high_u8(d), vget_high_u8(d)));
+        }
+
+        stats.differing += sumLanes(differ);
+        stats.mismatches += sumLanes(over);
+        uint64x2_t sumSq = vpaddlq_u32(squares);
+        stats.sumSq += vgetq_lane_u64(sumSq, 0) + vgetq_lane_u64(sumSq, 1);
+    }
+
+    unsigned char maxLanes[16];
+    vst1q_u8(maxLanes, maxv);
+    for(int lane = 0; lane < 16; lane++){
+        stats.maxDiff = maxLanes[lane] > stats.maxDiff ? maxLanes[lane] : stats.maxDiff;
+    }
+#endif
+
+    for(; i < n; i++){
+        int d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        stats.maxDiff = d > stats.maxDiff ? d : stats.maxDiff;
+        stats.differing += d != 0;
+        stats.mismatches += d > tolerance;
+        stats.sumSq += d * d;
+    }
+}
+
+/**
+ * Compare the rows [y0, y1). Rows are compared whole; only a row with
+ * mismatches is walked again to spread them over the heat map tiles.
+ * */
+
+static void compareBand(const unsigned char *reference,
+                        const unsigned char *image,
+                        unsigned int imgWidth,
+                        unsigned int y0,
+                        unsigned int y1,
+                        unsigned char tolerance,
+                        CompareResult &result,
+                        unsigned int tileSize,
+                        SpanStats &stats){
+    for(size_t y = y0; y < y1; y++){
+        const unsigned char *a = &reference[y * imgWidth];
+        const unsigned char *b = &image[y * imgWidth];
+        size_t mismatches = stats.mismatches;
+
+        compareSpan(a, b, imgWidth, tolerance, stats);
+
+        if(tileSize == 0 || stats.mismatches == mismatches){
+            continue;
+        }
+        unsigned int *tiles = &result.heatMap[(y / tileSize) * result.tilesX];
+        for(unsigned int x = 0; x < imgWidth; x++){
+            int d = a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+            tiles[x / tileSize] += d > tolerance;
+        }
+    }
+}
+
+// =================================================================
+// -------------------------- Comparison ---------------------------
+// =================================================================
+
+/**
+ * Compare image with reference. The rows are split in bands of whole tile
+ * rows, one per thread, so that every thread writes its own heat map rows.
+ * */
+
+CompareResult compareImages(const unsigned char *reference,
+                            const unsigned char *image,
+                            unsigned int imgWidth,
+                            unsigned int imgHeight,
+                            const CompareOptions &options){
+    CompareResult result;
+    result.pixels = (size_t) imgWidth * imgHeight;
+
+    unsigned int tileSize = options.tileSize;
+    if(tileSize > 0){
+        result.tilesX = (imgWidth + tileSize - 1) / tileSize;
+        result.tilesY = (imgHeight + tileSize - 1) / tileSize;
+        result.heatMap.assign((size_t) result.tilesX * result.tilesY, 0);
+    }
+    if(result.pixels == 0){
+        return result;
+    }
+
+    unsigned char tolerance = options.tolerance < 0 ? 0 : options.tolerance > 255 ? 255 : options.tolerance;
+
+    /**
+     * Size the bands.
+     * */
+
+    size_t threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+    size_t worthwhile = result.pixels / VALIDATION_MIN_PIXELS_PER_THREAD;
+    unsigned int unit = tileSize > 0 ? tileSize : 1;
+    size_t units = (imgHeight + unit - 1) / unit;
+
+    threads = threads < worthwhile ? threads : worthwhile;
+    threads = threads < units ? threads : units;
+    threads = threads > 0 ? threads : 1;
+    size_t bandRows = (units + threads - 1) / threads * unit;
+
+    /**
+     * Compare the bands, the first one on this thread.
+     * */
+
+    std::vector<SpanStats> bands(threads);
+    auto compare = [&](size_t band){
+        size_t y0 = band * bandRows;
+        size_t y1 = y0 + bandRows < imgHeight ? y0 + bandRows : imgHeight;
+        if(y0 < y1){
+            compareBand(reference, image, imgWidth, y0, y1, tolerance, result, tileSize, bands[band]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(size_t band = 1; band < threads; band++){
+        workers.push_back(std::thread(compare, band));
+    }
+    compare(0);
+    for(std::thread &worker : workers){
+        worker.join();
+    }
+
+    /**
+     * Combine the bands.
+     * */
+
+    uint64_t sumSq = 0;
+    for(const SpanStats &band : bands){
+        result.differing += band.differing;
+        result.mismatches += band.mismatches;
+        result.maxDiff = band.maxDiff > result.maxDiff ? band.maxDiff : result.maxDiff;
+        sumSq += band.sumSq;
+    }
+    result.mse = (double) sumSq / result.pixels;
+    result.psnr = result.mse > 0 ? 10 * log10(255.0 * 255.0 / result.mse) : INFINITY;
+    return result;
+}
+
+const char *compareImpl(){
+#if defined(VALIDATION_SSE2)
+    return "sse2";
+#elif defined(VALIDATION_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,55 @@
+/**
+ * Comparison of a filtered image with a reference image.
+ *
+ * Besides equality, a comparison reports how far the images are apart: the
+ * pixels that differ at all, those that differ by more than a tolerance, the
+ * largest difference, the PSNR and a heat map of the mismatches per tile.
+ * A tolerance lets backends that are not bit-exact, such as fp16, be
+ * validated against seqFilter.
+ *
+ * Rows are compared 16 pixels at a time with SSE2 or NEON (build with
+ * -DVALIDATION_NO_SIMD for the scalar loop), and large images are split in
+ * bands of tile rows over several threads.
+ * */
+
+#ifndef VALIDATION_H
+#define VALIDATION_H
+
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+
+#define VALIDATION_MIN_PIXELS_PER_THREAD (1 << 16)  // smaller bands are not worth a thread
+
+struct CompareOptions {
+    int tolerance = 0;                  // largest difference that is not a mismatch
+    unsigned int tileSize = 16;         // side of the heat map tiles; 0 skips the heat map
+    unsigned int threads = 0;           // 0: one per core
+};
+
+struct CompareResult {
+    size_t pixels = 0;
+    size_t differing = 0;               // pixels that differ at all
+    size_t mismatches = 0;              // pixels that differ by more than the tolerance
+    int maxDiff = 0;                    // largest absolute difference
+    double mse = 0.0;                   // mean squared difference
+    double psnr = INFINITY;             // dB; infinite for equal images
+    unsigned int tilesX = 0, tilesY = 0;
+    std::vector<unsigned int> heatMap;  // mismatches per tile, row by row
+
+    bool passed() const { return mismatches == 0; }
+};
+
+/**
+ * Compare image with reference, both imgWidth x imgHeight gray images.
+ * */
+
+CompareResult compareImages(const unsigned char *reference,
+                            const unsigned char *image,
+                            unsigned int imgWidth,
+                            unsigned int imgHeight,
+                            const CompareOptions &options = CompareOptions());
+
+const char *compareImpl();              // "sse2", "neon" or "scalar"
+
+#endif
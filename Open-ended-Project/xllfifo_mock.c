@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <string.h>
+#include "xllfifo_mock.h"
+
+// =================================================================
+// ------------------------- Word queues ---------------------------
+// =================================================================
+
+static void queueInit(XLlFifo_MockQueue *q, u32 capacity){
+    free(q->words);
+    free(q->lengths);
+    memset(q, 0, sizeof(*q));
+    q->capacity = capacity;
+    q->words = (u32*) malloc((capacity ? capacity : 1) * sizeof(u32));
+    q->lengthCap = 16;
+    q->lengths = (u32*) malloc(q->lengthCap * sizeof(u32));
+}
+
+/**
+ * Grow an unbounded queue (capacity 0 at creation means unbounded).
+ * */
+
+static void queueReserve(XLlFifo_MockQueue *q, u32 words){
+    if(q->count + words > q->capacity){
+        u32 capacity = q->capacity ? q->capacity : 1;
+        while(capacity < q->count + words){
+            capacity *= 2;
+        }
+        u32 *grown = (u32*) malloc(capacity * sizeof(u32));
+        for(u32 i = 0; i < q->count; i++){
+            grown[i] = q->words[(q->head + i) % q->capacity];
+        }
+        free(q->words);
+        q->words = grown;
+        q->capacity = capacity;
+        q->head = 0;
+    }
+}
+
+static void queuePush(XLlFifo_MockQueue *q, u32 word){
+    q->words[(q->head + q->count) % q->capacity] = word;
+    q->count++;
+}
+
+static u32 queuePop(XLlFifo_MockQueue *q){
+    u32 word = q->words[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    return word;
+}
+
+static void queueEndPacket(XLlFifo_MockQueue *q, u32 nwords){
+    if(q->packets == q->lengthCap){
+        u32 *grown = (u32*) malloc(2 * q->lengthCap * sizeof(u32));
+        for(u32 i = 0; i < q->packets; i++){
+            grown[i] = q->lengths[(q->lengthHead + i) % q->lengthCap];
+        }
+        free(q->lengths);
+        q->lengths = grown;
+        q->lengthCap *= 2;
+        q->lengthHead = 0;
+    }
+    q->lengths[(q->lengthHead + q->packets) % q->lengthCap] = nwords;
+    q->packets++;
+}
+
+static u32 queueFrontPacket(const XLlFifo_MockQueue *q){
+    return q->packets ? q->lengths[q->lengthHead] : 0;
+}
+
+static void queuePopPacket(XLlFifo_MockQueue *q){
+    q->lengthHead = (q->lengthHead + 1) % q->lengthCap;
+    q->packets--;
+}
+
+// =================================================================
+// --------------------------- Far side ----------------------------
+// =================================================================
+
+/**
+ * Move data across the stream: committed TX packets to the device (or back
+ * to RX in loopback), and whole device packets into the RX FIFO.
+ * */
+
+static void step(XLlFifo *InstancePtr){
+    u32 scratch[256];
+
+    while(InstancePtr->tx.packets > 0){
+        u32 n = queueFrontPacket(&InstancePtr->tx);
+        u32 *words = n <= 256 ? scratch : (u32*) malloc(n * sizeof(u32));
+        for(u32 i = 0; i < n; i++){
+            words[i] = InstancePtr->tx.words[(InstancePtr->tx.head + i) % InstancePtr->tx.capacity];
+        }
+
+        int accepted;
+        if(InstancePtr->device != NULL){
+            accepted = InstancePtr->device(InstancePtr, words, n, InstancePtr->deviceArg);
+        } else {
+            XLlFifo_MockSend(InstancePtr, words, n);
+            accepted = 1;
+        }
+        if(words != scratch){
+            free(words);
+        }
+        if(!accepted){
+            break;
+        }
+
+        for(u32 i = 0; i < n; i++){
+            queuePop(&InstancePtr->tx);
+        }
+        queuePopPacket(&InstancePtr->tx);
+    }
+
+    while(InstancePtr->pending.packets > 0){
+        u32 n = queueFrontPacket(&InstancePtr->pending);
+        if(InstancePtr->rx.count + n > InstancePtr->rx.capacity){
+            break;
+        }
+        for(u32 i = 0; i < n; i++){
+            queuePush(&InstancePtr->rx, queuePop(&InstancePtr->pending));
+        }
+        queuePopPacket(&InstancePtr->pending);
+        queueEndPacket(&InstancePtr->rx, n);
+    }
+}
+
+void XLlFifo_MockSend(XLlFifo *InstancePtr, const u32 *words, u32 nwords){
+    queueReserve(&InstancePtr->pending, nwords);
+    for(u32 i = 0; i < nwords; i++){
+        queuePush(&InstancePtr->pending, words[i]);
+    }
+    queueEndPacket(&InstancePtr->pending, nwords);
+}
+
+u32 XLlFifo_MockPending(XLlFifo *InstancePtr){
+    return InstancePtr->pending.count;
+}
+
+void XLlFifo_MockAttach(XLlFifo *InstancePtr, u32 txDepth, u32 rxDepth,
+                        XLlFifo_MockDevice device, void *arg){
+    queueInit(&InstancePtr->tx, txDepth);
+    queueInit(&InstancePtr->rx, rxDepth);
+    queueInit(&InstancePtr->pending, 0);
+    InstancePtr->txOpen = 0;
+    InstancePtr->rxLeft = 0;
+    InstancePtr->rxDone = FALSE;
+    InstancePtr->device = device;
+    InstancePtr->deviceArg = arg;
+}
+
+void XLlFifo_MockRelease(XLlFifo *InstancePtr){
+    free(InstancePtr->tx.words);
+    free(InstancePtr->tx.lengths);
+    free(InstancePtr->rx.words);
+    free(InstancePtr->rx.lengths);
+    free(InstancePtr->pending.words);
+    free(InstancePtr->pending.lengths);
+    memset(InstancePtr, 0, sizeof(*InstancePtr));
+}
+
+// =================================================================
+// ------------------------- Driver calls --------------------------
+// =================================================================
+
+XLlFifo_Config *XLlFifo_LookupConfig(u16 DeviceId){
+    static XLlFifo_Config config;
+    config.DeviceId = DeviceId;
+    config.BaseAddress = 0;
+    return &config;
+}
+
+int XLlFifo_CfgInitialize(XLlFifo *InstancePtr, XLlFifo_Config *Config, UINTPTR EffectiveAddress){
+    memset(InstancePtr, 0, sizeof(*InstancePtr));
+    InstancePtr->Config = *Config;
+    InstancePtr->Config.BaseAddress = EffectiveAddress;
+    XLlFifo_MockAttach(InstancePtr, XLLF_MOCK_TX_DEPTH, XLLF_MOCK_RX_DEPTH, NULL, NULL);
+    InstancePtr->IsReady = TRUE;
+    return XST_SUCCESS;
+}
+
+u32 XLlFifo_Status(XLlFifo *InstancePtr){
+    (void)InstancePtr;
+    return 0;
+}
+
+void XLlFifo_IntClear(XLlFifo *InstancePtr, u32 Mask){
+    (void)Mask;
+    InstancePtr->rxDone = FALSE;
+}
+
+u32 XLlFifo_iTxVacancy(XLlFifo *InstancePtr){
+    step(InstancePtr);
+    return InstancePtr->tx.capacity - InstancePtr->tx.count;
+}
+
+void XLlFifo_TxPutWord(XLlFifo *InstancePtr, u32 Word){
+    // Like the hardware, writing to a full FIFO drops the word
+    if(InstancePtr->tx.count < InstancePtr->tx.capacity){
+        queuePush(&InstancePtr->tx, Word);
+        InstancePtr->txOpen++;
+    }
+}
+
+void XLlFifo_iTxSetLen(XLlFifo *InstancePtr, u32 Bytes){
+    u32 nwords = (Bytes + 3) / 4;
+    if(nwords > InstancePtr->txOpen){
+        nwords = InstancePtr->txOpen;
+    }
+    queueEndPacket(&InstancePtr->tx, nwords);
+    InstancePtr->txOpen -= nwords;
+    step(InstancePtr);
+}
+
+int XLlFifo_IsTxDone(XLlFifo *InstancePtr){
+    step(InstancePtr);
+    return InstancePtr->tx.packets == 0;
+}
+
+u32 XLlFifo_iRxOccupancy(XLlFifo *InstancePtr){
+    step(InstancePtr);
+    return InstancePtr->rx.count;
+}
+
+u32 XLlFifo_iRxGetLen(XLlFifo *InstancePtr){
+    step(InstancePtr);
+    if(InstancePtr->rx.packets == 0){
+        return 0;
+    }
+    InstancePtr->rxLeft = queueFrontPacket(&InstancePtr->rx);
+    queuePopPacket(&InstancePtr->rx);
+    return InstancePtr->rxLeft * 4;
+}
+
+u32 XLlFifo_RxGetWord(XLlFifo *InstancePtr){
+    if(InstancePtr->rx.count == 0 || InstancePtr->rxLeft == 0){
+        return 0;
+    }
+    InstancePtr->rxLeft--;
+    if(InstancePtr->rxLeft == 0){
+        InstancePtr->rxDone = TRUE;
+    }
+    return queuePop(&InstancePtr->rx);
+}
+
+int XLlFifo_IsRxDone(XLlFifo *InstancePtr){
+    return InstancePtr->rxDone;
+}
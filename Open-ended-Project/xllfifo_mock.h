@@ -0,0 +1,126 @@
+/**
+ * Host-side mock of the Xilinx AXI4-Stream FIFO driver (xllfifo.h), so that
+ * the transfer protocol can be run and measured on Linux (build with
+ * -DFIFO_MOCK).
+ *
+ * Only the calls used by fifo_transfer.c are provided, with the driver's
+ * semantics: data written with XLlFifo_TxPutWord stays in the TX FIFO until
+ * XLlFifo_iTxSetLen commits it as a packet; the RX FIFO is store-and-forward
+ * and XLlFifo_iRxGetLen must be read before the words of each packet.
+ *
+ * The far side of the stream is a device model attached with
+ * XLlFifo_MockAttach. It is offered each committed TX packet and may refuse
+ * it (back-pressure). Its results go through XLlFifo_MockSend and move into
+ * the RX FIFO as space allows. Without a device the FIFO loops back.
+ * */
+
+#ifndef XLLFIFO_MOCK_H
+#define XLLFIFO_MOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uintptr_t UINTPTR;
+
+#ifndef XST_SUCCESS
+#define XST_SUCCESS 0L
+#define XST_FAILURE 1L
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+// Default FIFO depths, in 32-bit words
+#define XLLF_MOCK_TX_DEPTH 512
+#define XLLF_MOCK_RX_DEPTH 512
+
+typedef struct {
+    u16 DeviceId;
+    UINTPTR BaseAddress;
+} XLlFifo_Config;
+
+// Word ring with a queue of packet lengths
+typedef struct {
+    u32 *words;
+    u32 capacity;
+    u32 head;
+    u32 count;
+    u32 *lengths;           // packet lengths in words
+    u32 lengthCap;
+    u32 lengthHead;
+    u32 packets;
+} XLlFifo_MockQueue;
+
+struct XLlFifo;
+
+/**
+ * Device model: accept one packet from the TX side, or return 0 to stall
+ * (the packet is offered again later).
+ * */
+
+typedef int (*XLlFifo_MockDevice)(struct XLlFifo *InstancePtr, const u32 *words, u32 nwords, void *arg);
+
+typedef struct XLlFifo {
+    u32 IsReady;
+    XLlFifo_Config Config;
+
+    XLlFifo_MockQueue tx;       // committed packets plus the open one
+    u32 txOpen;                 // words written but not committed yet
+    XLlFifo_MockQueue rx;       // the RX FIFO
+    XLlFifo_MockQueue pending;  // device output waiting for RX space
+    u32 rxLeft;                 // words of the current RX packet still to read
+    u32 rxDone;
+
+    XLlFifo_MockDevice device;
+    void *deviceArg;
+} XLlFifo;
+
+XLlFifo_Config *XLlFifo_LookupConfig(u16 DeviceId);
+int XLlFifo_CfgInitialize(XLlFifo *InstancePtr, XLlFifo_Config *Config, UINTPTR EffectiveAddress);
+
+u32 XLlFifo_Status(XLlFifo *InstancePtr);
+void XLlFifo_IntClear(XLlFifo *InstancePtr, u32 Mask);
+
+u32 XLlFifo_iTxVacancy(XLlFifo *InstancePtr);
+void XLlFifo_TxPutWord(XLlFifo *InstancePtr, u32 Word);
+void XLlFifo_iTxSetLen(XLlFifo *InstancePtr, u32 Bytes);
+int XLlFifo_IsTxDone(XLlFifo *InstancePtr);
+
+u32 XLlFifo_iRxOccupancy(XLlFifo *InstancePtr);
+u32 XLlFifo_iRxGetLen(XLlFifo *InstancePtr);
+u32 XLlFifo_RxGetWord(XLlFifo *InstancePtr);
+int XLlFifo_IsRxDone(XLlFifo *InstancePtr);
+
+/**
+ * Mock-only: resize the FIFOs and attach a device model (NULL for loopback).
+ * */
+
+void XLlFifo_MockAttach(XLlFifo *InstancePtr, u32 txDepth, u32 rxDepth,
+                        XLlFifo_MockDevice device, void *arg);
+
+/**
+ * Mock-only: queue one device output packet for the RX FIFO.
+ * */
+
+void XLlFifo_MockSend(XLlFifo *InstancePtr, const u32 *words, u32 nwords);
+
+/**
+ * Mock-only: device output words not yet in the RX FIFO.
+ * */
+
+u32 XLlFifo_MockPending(XLlFifo *InstancePtr);
+
+void XLlFifo_MockRelease(XLlFifo *InstancePtr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif